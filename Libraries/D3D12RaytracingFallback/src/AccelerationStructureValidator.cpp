@@ -30,4 +30,37 @@ namespace FallbackLayer
         }
     }
 
+    static void WriteHistogramJson(
+        const std::vector<UINT> &histogram,
+        std::ostream &stream)
+    {
+        stream << "[";
+        for (size_t i = 0; i < histogram.size(); i++)
+        {
+            stream << (i ? "," : "") << histogram[i];
+        }
+        stream << "]";
+    }
+
+    void WriteQualityReportJson(
+        const AccelerationStructureQualityReport &report,
+        std::ostream &stream)
+    {
+        stream << "{"
+            << "\"NumInternalNodes\":" << report.NumInternalNodes << ","
+            << "\"NumLeaves\":" << report.NumLeaves << ","
+            << "\"NumPrimitiveReferences\":" << report.NumPrimitiveReferences << ","
+            << "\"MaxDepth\":" << report.MaxDepth << ","
+            << "\"AverageLeafDepth\":" << report.AverageLeafDepth << ","
+            << "\"SAHCost\":" << report.SAHCost << ","
+            << "\"EPO\":" << report.EPO << ","
+            << "\"SiblingOverlap\":" << report.SiblingOverlap << ","
+            << "\"EmptySpaceRatio\":" << report.EmptySpaceRatio << ","
+            << "\"LeafDepthHistogram\":";
+        WriteHistogramJson(report.LeafDepthHistogram, stream);
+        stream << ",\"LeafSizeHistogram\":";
+        WriteHistogramJson(report.LeafSizeHistogram, stream);
+        stream << "}";
+    }
+
 }
@@ -93,6 +93,39 @@ namespace FallbackLayer
         }
     };
 
+    // Quality metrics of an acceleration structure that only depend on its output, so that builders can be
+    // compared with each other. Costs and areas are relative to the surface area of the root.
+    struct AccelerationStructureQualityReport
+    {
+        UINT NumInternalNodes;
+        UINT NumLeaves;
+        UINT NumPrimitiveReferences;    // Primitives referenced by leaves, primitives split across leaves count once per leaf
+        UINT MaxDepth;
+        float AverageLeafDepth;
+
+        // SAH cost with the same traversal/intersection costs as the treelet reordering pass
+        float SAHCost;
+
+        // End-point overlap (Aila et al., "On Quality Metrics of Bounding Volume Hierarchies"): the SAH-weighted
+        // area of geometry that lies inside nodes without belonging to them, relative to the area of all geometry.
+        // Leaf AABBs stand in for the geometry of top levels and procedural primitives.
+        float EPO;
+
+        // Sum of the area of the overlap between every pair of siblings
+        float SiblingOverlap;
+
+        // Fraction of the volume of internal nodes that neither child covers, weighted by surface area
+        float EmptySpaceRatio;
+
+        std::vector<UINT> LeafDepthHistogram;  // Number of leaves at each depth, the root is at depth 0
+        std::vector<UINT> LeafSizeHistogram;   // Number of leaves with each primitive count
+    };
+
+    // Writes the report as a single JSON object, for comparing builders or tracking regressions in scripts
+    void WriteQualityReportJson(
+        const AccelerationStructureQualityReport &report,
+        std::ostream &stream);
+
     class IAccelerationStructureValidator
     {
     public:
@@ -109,5 +142,12 @@ namespace FallbackLayer
             UINT numReferenceBoxes,
             const BYTE *pOutputCpuData,
             std::wstring &errorMessage) = 0;
+
+        // Walks the output and reports its quality, returns false if it isn't a valid tree
+        virtual bool AnalyzeOutput(
+            D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE type,
+            const BYTE *pOutputCpuData,
+            AccelerationStructureQualityReport &report,
+            std::wstring &errorMessage) = 0;
     };
 }
@@ -327,6 +327,349 @@ namespace FallbackLayer
         return VerifyBVHOutput(pLeafNodes, pBVHData, errorMessage);
     }
 
+    // Same costs as TreeletReorder.hlsl
+    static const float QualityCostOfRayBoxIntersection = 1.2f;
+    static const float QualityCostOfRayPrimitiveIntersection = 1.0f;
+
+    // A convex polygon, either a triangle or an AABB face, possibly clipped by a box. Clipping by a plane adds
+    // at most one vertex, and polygons are clipped by at most two boxes.
+    struct QualityPolygon
+    {
+        static const UINT MaxVertices = 16;
+        float3 v[MaxVertices];
+        UINT numVertices;
+    };
+
+    static float GetComponent(const float3 &v, UINT axis)
+    {
+        return (&v.x)[axis];
+    }
+
+    static float ComputeSurfaceArea(const AABB &box)
+    {
+        const float3 extent = box.max - box.min;
+        return 2.0f * (extent.x * extent.y + extent.x * extent.z + extent.y * extent.z);
+    }
+
+    static float ComputeVolume(const AABB &box)
+    {
+        const float3 extent = box.max - box.min;
+        return extent.x * extent.y * extent.z;
+    }
+
+    static bool Intersect(const AABB &a, const AABB &b, AABB &intersection)
+    {
+        intersection.min = max(a.min, b.min);
+        intersection.max = min(a.max, b.max);
+        return intersection.min.x <= intersection.max.x &&
+            intersection.min.y <= intersection.max.y &&
+            intersection.min.z <= intersection.max.z;
+    }
+
+    static float ComputePolygonArea(const QualityPolygon &polygon)
+    {
+        float3 sum = { 0.0f, 0.0f, 0.0f };
+        for (UINT i = 2; i < polygon.numVertices; i++)
+        {
+            sum = sum + cross(polygon.v[i - 1] - polygon.v[0], polygon.v[i] - polygon.v[0]);
+        }
+        return 0.5f * sqrtf(dot(sum, sum));
+    }
+
+    // Sutherland-Hodgman against the 6 planes of the box
+    static void ClipPolygon(const QualityPolygon &polygon, const AABB &box, QualityPolygon &clipped)
+    {
+        clipped = polygon;
+        for (UINT plane = 0; plane < 6 && clipped.numVertices; plane++)
+        {
+            const UINT axis = plane / 2;
+            const bool isMaxPlane = plane & 1;
+            const float planeValue = isMaxPlane ? GetComponent(box.max, axis) : GetComponent(box.min, axis);
+
+            QualityPolygon input = clipped;
+            clipped.numVertices = 0;
+            for (UINT i = 0; i < input.numVertices; i++)
+            {
+                const float3 &current = input.v[i];
+                const float3 &next = input.v[(i + 1) % input.numVertices];
+                const float currentDistance = isMaxPlane ? planeValue - GetComponent(current, axis) : GetComponent(current, axis) - planeValue;
+                const float nextDistance = isMaxPlane ? planeValue - GetComponent(next, axis) : GetComponent(next, axis) - planeValue;
+
+                if (currentDistance >= 0.0f)
+                {
+                    clipped.v[clipped.numVertices++] = current;
+                }
+                if ((currentDistance >= 0.0f) != (nextDistance >= 0.0f))
+                {
+                    const float t = currentDistance / (currentDistance - nextDistance);
+                    clipped.v[clipped.numVertices++] = current + (next - current) * t;
+                }
+            }
+        }
+    }
+
+    static void AddBoxFaces(const AABB &box, std::vector<QualityPolygon> &polygons)
+    {
+        for (UINT axis = 0; axis < 3; axis++)
+        {
+            const UINT u = (axis + 1) % 3;
+            const UINT v = (axis + 2) % 3;
+            for (UINT side = 0; side < 2; side++)
+            {
+                QualityPolygon face;
+                face.numVertices = 4;
+                for (UINT corner = 0; corner < 4; corner++)
+                {
+                    float *pVertex = &face.v[corner].x;
+                    pVertex[axis] = side ? box.maxArr[axis] : box.minArr[axis];
+                    pVertex[u] = (corner == 1 || corner == 2) ? box.maxArr[u] : box.minArr[u];
+                    pVertex[v] = (corner >= 2) ? box.maxArr[v] : box.minArr[v];
+                }
+                polygons.push_back(face);
+            }
+        }
+    }
+
+    bool BvhValidator::AnalyzeOutput(
+        D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE type,
+        const BYTE *pOutputCpuData,
+        AccelerationStructureQualityReport &report,
+        std::wstring &errorMessage)
+    {
+        // Nodes are renumbered depth-first so that every subtree is the range [index, subtreeEnd)
+        struct AnalyzedNode
+        {
+            AABB box;
+            bool isLeaf;
+            UINT depth;
+            UINT subtreeEnd;
+            UINT children[2];
+            UINT numPrimitives;
+            UINT firstPolygon;
+            UINT numPolygons;
+        };
+
+        struct StackEntry
+        {
+            UINT outputIndex;
+            UINT parent;
+            UINT childSlot;
+            UINT depth;
+        };
+
+        report = AccelerationStructureQualityReport();
+
+        const BVHOffsets &offsets = *(const BVHOffsets *)pOutputCpuData;
+        const AABBNode *pNodeArray = (const AABBNode *)(pOutputCpuData + offsets.offsetToBoxes);
+        const Primitive *pPrimitiveArray = (const Primitive *)(pOutputCpuData + offsets.offsetToVertices);
+        const UINT numOutputNodes = (offsets.offsetToVertices - offsets.offsetToBoxes) / sizeof(AABBNode);
+        const bool isBottomLevel = type == D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL;
+        const UINT numPrimitives = isBottomLevel ? (offsets.offsetToPrimitiveMetaData - offsets.offsetToVertices) / sizeof(Primitive) : 0;
+        if (numOutputNodes == 0)
+        {
+            errorMessage = L"Acceleration structure has no nodes";
+            return false;
+        }
+
+        std::vector<AnalyzedNode> nodes;
+        std::vector<QualityPolygon> polygons;
+        std::vector<StackEntry> stack;
+        stack.push_back({ 0, UINT_MAX, 0, 0 });
+        while (stack.size())
+        {
+            const StackEntry entry = stack.back();
+            stack.pop_back();
+
+            if (entry.outputIndex >= numOutputNodes)
+            {
+                errorMessage = L"Child node index out of range";
+                return false;
+            }
+            if (nodes.size() == numOutputNodes)
+            {
+                errorMessage = L"Node is referenced more than once";
+                return false;
+            }
+
+            const UINT nodeIndex = (UINT)nodes.size();
+            if (entry.parent != UINT_MAX)
+            {
+                nodes[entry.parent].children[entry.childSlot] = nodeIndex;
+            }
+
+            const AABBNode &outputNode = pNodeArray[entry.outputIndex];
+            AnalyzedNode node = {};
+            DecompressAABB(node.box, outputNode);
+            node.isLeaf = outputNode.leaf;
+            node.depth = entry.depth;
+            node.firstPolygon = (UINT)polygons.size();
+
+            if (node.isLeaf)
+            {
+                node.numPrimitives = outputNode.numTriangles;
+                if (isBottomLevel)
+                {
+                    const UINT firstPrimitive = outputNode.leafNode.firstTriangleId;
+                    if (firstPrimitive + node.numPrimitives > numPrimitives)
+                    {
+                        errorMessage = L"Leaf references primitives out of range";
+                        return false;
+                    }
+
+                    // Only the part of a primitive inside the leaf belongs to it, which matters for spatial splits
+                    for (UINT i = firstPrimitive; i < firstPrimitive + node.numPrimitives; i++)
+                    {
+                        std::vector<QualityPolygon> primitivePolygons;
+                        const Primitive &primitive = pPrimitiveArray[i];
+                        if (primitive.PrimitiveType == TRIANGLE_TYPE)
+                        {
+                            QualityPolygon triangle;
+                            triangle.numVertices = 3;
+                            for (UINT vertex = 0; vertex < 3; vertex++)
+                            {
+                                triangle.v[vertex] = primitive.triangle.v[vertex];
+                            }
+                            primitivePolygons.push_back(triangle);
+                        }
+                        else
+                        {
+                            AddBoxFaces(primitive.aabb, primitivePolygons);
+                        }
+
+                        for (auto &polygon : primitivePolygons)
+                        {
+                            QualityPolygon clipped;
+                            ClipPolygon(polygon, node.box, clipped);
+                            polygons.push_back(clipped);
+                        }
+                    }
+                }
+                else if (node.numPrimitives)
+                {
+                    AddBoxFaces(node.box, polygons);
+                }
+            }
+            else
+            {
+                // Left is pushed last so that it's numbered first
+                stack.push_back({ outputNode.rightNodeIndex, nodeIndex, 1, entry.depth + 1 });
+                stack.push_back({ outputNode.internalNode.leftNodeIndex, nodeIndex, 0, entry.depth + 1 });
+            }
+            node.numPolygons = (UINT)polygons.size() - node.firstPolygon;
+            nodes.push_back(node);
+        }
+
+        for (UINT i = (UINT)nodes.size(); i-- > 0;)
+        {
+            AnalyzedNode &node = nodes[i];
+            node.subtreeEnd = node.isLeaf ? i + 1 : nodes[node.children[1]].subtreeEnd;
+        }
+
+        const float rootArea = ComputeSurfaceArea(nodes[0].box);
+        const float inverseRootArea = rootArea > 0.0f ? 1.0f / rootArea : 0.0f;
+
+        float totalLeafDepth = 0.0f;
+        float weightedEmptySpace = 0.0f;
+        float emptySpaceWeight = 0.0f;
+        for (auto &node : nodes)
+        {
+            const float area = ComputeSurfaceArea(node.box);
+            if (node.isLeaf)
+            {
+                report.NumLeaves++;
+                report.NumPrimitiveReferences += node.numPrimitives;
+                report.SAHCost += QualityCostOfRayPrimitiveIntersection * node.numPrimitives * area * inverseRootArea;
+
+                report.MaxDepth = std::max(report.MaxDepth, node.depth);
+                totalLeafDepth += node.depth;
+                if (report.LeafDepthHistogram.size() <= node.depth)
+                {
+                    report.LeafDepthHistogram.resize(node.depth + 1);
+                }
+                report.LeafDepthHistogram[node.depth]++;
+
+                if (report.LeafSizeHistogram.size() <= node.numPrimitives)
+                {
+                    report.LeafSizeHistogram.resize(node.numPrimitives + 1);
+                }
+                report.LeafSizeHistogram[node.numPrimitives]++;
+                continue;
+            }
+
+            report.NumInternalNodes++;
+            report.SAHCost += QualityCostOfRayBoxIntersection * area * inverseRootArea;
+
+            const AABB &left = nodes[node.children[0]].box;
+            const AABB &right = nodes[node.children[1]].box;
+            AABB overlap;
+            const bool childrenOverlap = Intersect(left, right, overlap);
+            if (childrenOverlap)
+            {
+                report.SiblingOverlap += ComputeSurfaceArea(overlap) * inverseRootArea;
+            }
+
+            // Flat nodes have no volume to be empty
+            const float volume = ComputeVolume(node.box);
+            if (volume > 0.0f)
+            {
+                const float childVolume = ComputeVolume(left) + ComputeVolume(right) - (childrenOverlap ? ComputeVolume(overlap) : 0.0f);
+                weightedEmptySpace += area * std::max(1.0f - childVolume / volume, 0.0f);
+                emptySpaceWeight += area;
+            }
+        }
+        report.AverageLeafDepth = report.NumLeaves ? totalLeafDepth / report.NumLeaves : 0.0f;
+        report.EmptySpaceRatio = emptySpaceWeight > 0.0f ? weightedEmptySpace / emptySpaceWeight : 0.0f;
+
+        // EPO: for every node, find the geometry outside of its subtree that still overlaps it by walking the
+        // tree with the node's box, skipping the node's own subtree
+        float totalGeometryArea = 0.0f;
+        for (auto &polygon : polygons)
+        {
+            totalGeometryArea += ComputePolygonArea(polygon);
+        }
+
+        float weightedOverlap = 0.0f;
+        std::vector<UINT> overlapStack;
+        for (UINT nodeIndex = 1; nodeIndex < (UINT)nodes.size(); nodeIndex++)
+        {
+            const AnalyzedNode &node = nodes[nodeIndex];
+            const float cost = node.isLeaf ? QualityCostOfRayPrimitiveIntersection * node.numPrimitives : QualityCostOfRayBoxIntersection;
+            if (cost == 0.0f)
+                continue;
+
+            float overlappingArea = 0.0f;
+            overlapStack.push_back(0);
+            while (overlapStack.size())
+            {
+                const UINT otherIndex = overlapStack.back();
+                overlapStack.pop_back();
+
+                const AnalyzedNode &other = nodes[otherIndex];
+                AABB overlap;
+                if ((otherIndex >= nodeIndex && otherIndex < node.subtreeEnd) || !Intersect(node.box, other.box, overlap))
+                    continue;
+
+                if (!other.isLeaf)
+                {
+                    overlapStack.push_back(other.children[0]);
+                    overlapStack.push_back(other.children[1]);
+                    continue;
+                }
+
+                for (UINT i = other.firstPolygon; i < other.firstPolygon + other.numPolygons; i++)
+                {
+                    QualityPolygon clipped;
+                    ClipPolygon(polygons[i], node.box, clipped);
+                    overlappingArea += ComputePolygonArea(clipped);
+                }
+            }
+            weightedOverlap += cost * overlappingArea;
+        }
+        report.EPO = totalGeometryArea > 0.0f ? weightedOverlap / totalGeometryArea : 0.0f;
+
+        return true;
+    }
+
     void DecompressAABB(
         AABB& box,
         const AABBNode& packedBox)
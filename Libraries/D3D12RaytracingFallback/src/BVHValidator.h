@@ -26,6 +26,12 @@ namespace FallbackLayer
             const BYTE *pOutputCpuData,
             std::wstring &errorMessage);
 
+        virtual bool AnalyzeOutput(
+            D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE type,
+            const BYTE *pOutputCpuData,
+            AccelerationStructureQualityReport &report,
+            std::wstring &errorMessage);
+
     private:
 
         class LeafNode
@@ -9,9 +9,12 @@
 //
 //*********************************************************
 #include "pch.h"
+#include "CpuBuildTaskPool.h"
 
 namespace FallbackLayer
 {
+    using namespace DirectX;
+
     struct BVH
     {
         std::vector<AABBNode>   m_nodes;
@@ -40,33 +43,6 @@ namespace FallbackLayer
         return v & 0x00ffffff;
     }
 
-    static
-        void ComputeBox(
-            AABB& overallBox,
-            const std::vector<AABB>& boxes,
-            const std::vector<PrimitiveMetaData>& metadata)
-    {
-        if (metadata.empty())
-        {
-            overallBox.max.x = overallBox.min.x = 0;
-            overallBox.max.y = overallBox.min.y = 0;
-            overallBox.max.z = overallBox.min.z = 0;
-            return;
-        }
-
-        overallBox = boxes[metadata[0].PrimitiveIndex];
-
-        const UINT32 numTris = (UINT32)metadata.size();
-        for (UINT32 i = 1; i < numTris; ++i)
-        {
-            const UINT32 triId = metadata[i].PrimitiveIndex;
-            assert(triId < boxes.size());
-            const AABB& newBox = boxes[triId];
-
-            AddExtentToBox(overallBox, newBox);
-        }
-    }
-
     //
     // Convert a 16-bit float to 32-bit.
     //
@@ -117,15 +93,10 @@ namespace FallbackLayer
     }
 
     static
-        UINT32 BuildBVHAddNode(
-            BVH& bvh,
-            const AABB& box,
-            UINT32 maxDimension)
+        void SetNodeBox(
+            AABBNode& node,
+            const AABB& box)
     {
-        UNREFERENCED_PARAMETER(maxDimension);
-        assert(maxDimension < 3);
-        const UINT32 nodeIndex = (UINT32)bvh.m_nodes.size();
-
         float cX = (box.max.x + box.min.x) * 0.5f;
         float cY = (box.max.y + box.min.y) * 0.5f;
         float cZ = (box.max.z + box.min.z) * 0.5f;
@@ -137,88 +108,24 @@ namespace FallbackLayer
         float dY = max(box.max.y - cY, cY - box.min.y);
         float dZ = max(box.max.z - cZ, cZ - box.min.z);
 
-        AABBNode packedBox;
-        packedBox.center[0] = cX;
-        packedBox.center[1] = cY;
-        packedBox.center[2] = cZ;
-        packedBox.halfDim[0] = dX;
-        packedBox.halfDim[1] = dY;
-        packedBox.halfDim[2] = dZ;
-        packedBox.nodeAllBits = 0;
-
-        bvh.m_nodes.push_back(packedBox);
-
-        assert(bvh.m_nodes.size() - 1 == nodeIndex);
-
-        bvh.m_nodes[nodeIndex].internalNode.separatingAxis = 0;
-
-        return nodeIndex;
-    }
-
-    static
-        UINT32 BuildBVHAddLeaf(
-            BVH& bvh,
-            const AABB& box,
-            const std::vector<PrimitiveMetaData>& metadata)
-    {
-        const UINT32 nodeIndex = BuildBVHAddNode(bvh, box, 0);
-
-        bvh.m_nodes[nodeIndex].nodeAllBits = 0;
-        bvh.m_nodes[nodeIndex].leaf = true;
-
-        const UINT32 idIndex = (UINT32)bvh.m_metadata.size();
-
-        std::copy(metadata.begin(), metadata.end(), std::back_inserter(bvh.m_metadata));
-
-        assert(metadata.size() < 128);
-        assert(idIndex < (1 << 24));
-
-        bvh.m_nodes[nodeIndex].leafNode.firstTriangleId = idIndex;
-        bvh.m_nodes[nodeIndex].leafNode.numTriangleIds = (UINT32)metadata.size();
-
-        return nodeIndex;
+        node.center[0] = cX;
+        node.center[1] = cY;
+        node.center[2] = cZ;
+        node.halfDim[0] = dX;
+        node.halfDim[1] = dY;
+        node.halfDim[2] = dZ;
     }
 
-    //
-    // Sort min to max by centroid
-    //
-
     static
-        void SortByCentroid(
-            std::vector<PrimitiveMetaData>& metadata,
-            const std::vector<AABB>& boxes,
-            UINT32 maxDimension)
+        void InitNode(
+            AABBNode& node,
+            const AABB& box)
     {
-        struct TriPosition
-        {
-            float   pos;
-            UINT32  id;
-        };
-
-        std::vector<TriPosition> sortTris(metadata.size());
-
-        for (UINT32 i = 0; i < metadata.size(); ++i)
-        {
-            const UINT32 triId = metadata[i].PrimitiveIndex;
-            const AABB& box = boxes[triId];
-
-            const float boxCenter = (box.maxArr[maxDimension] + box.minArr[maxDimension]) / 2;
-
-            sortTris[i].pos = boxCenter;
-            sortTris[i].id = metadata[i].PrimitiveIndex;
-        }
-
-        // Split the list into left and right sublists
-        std::sort(sortTris.begin(), sortTris.end(), [](auto&& a, auto&& b) -> bool { return a.pos < b.pos; });
-
-        // Update the output
-        for (UINT32 i = 0; i < metadata.size(); ++i)
-        {
-            metadata[i].PrimitiveIndex = sortTris[i].id;
-        }
+        SetNodeBox(node, box);
+        node.nodeAllBits = 0;
+        node.rightNodeIndex = 0;
     }
 
-
     static
         float ComputeBoxSurfaceArea(
             const AABB& box)
@@ -241,436 +148,1953 @@ namespace FallbackLayer
         box.min.x = box.min.y = box.min.z = 10e10f;//FLT_MAX;
     }
 
-    //
-    // A feeble attempt at a SAH builder
-    //
-
     static
-        void SahSplit(
-            std::vector<PrimitiveMetaData>& metadata,
-            UINT32& maxDimension,
-            UINT32& numTrisInLeftNode,
-            const AABB& nodeBox,
-            const std::vector<AABB>& boxes)
+        void AddPointToBox(
+            AABB& box,
+            const XMFLOAT3& point)
     {
-        static const UINT NUM_SAH_BINS = 64;
-
-        struct SahBin
-        {
-            AABB    box;
-            UINT    numTriangles;
-        };
+        box.min.x = std::min(box.min.x, point.x);
+        box.max.x = std::max(box.max.x, point.x);
 
-        // NOTE: use vector if this blows out the stack?
-        SahBin  sahBins[3][NUM_SAH_BINS];
+        box.min.y = std::min(box.min.y, point.y);
+        box.max.y = std::max(box.max.y, point.y);
 
-        // For the score to be meaningful it seems we need to normalize it to something
-        const float normalizeToParent = 1.f / ComputeBoxSurfaceArea(nodeBox);
-
-        const UINT numTris = (UINT)metadata.size();
+        box.min.z = std::min(box.min.z, point.z);
+        box.max.z = std::max(box.max.z, point.z);
+    }
 
-        float bestSah = FLT_MAX;
-        maxDimension = 0;
-        //numTrisInLeftNode = triangleIds.size() / 2;
+    thread_local UINT BuildTaskPool::s_queueIndex = 0;
 
-        // Compute SAH score per axis
-        for (UINT i = 0; i < 3; ++i)
+    //
+    // Binned SAH builder (Wald, "On fast Construction of SAH-based Bounding Volume Hierarchies").
+    //
+    // Primitive references are partitioned in place in one preallocated array and every node goes to a slot
+    // reserved ahead of time: a subtree over N primitives owns 2N - 1 consecutive slots, with the right child
+    // directly after its parent and the left subtree after the right one. Subtrees therefore never need to
+    // synchronize and can be handed to the task pool as soon as their primitive range is known. Large nodes
+    // near the root bin and partition their primitives in parallel as well.
+    //
+    class BinnedSahBuilder
+    {
+    public:
+        BinnedSahBuilder(
+            const std::vector<AABB>& boxes,
+            UINT32 maxTrisInLeaf,
+            BuildTaskPool* pPool) :
+            m_boxes(boxes),
+            m_maxTrisInLeaf(std::max(maxTrisInLeaf, 1u)),
+            m_pPool(pPool)
         {
-            const float extents = nodeBox.maxArr[i] - nodeBox.minArr[i];
-            if (extents == 0)
-                continue;
+        }
 
-            const float rangeMin = nodeBox.minArr[i];
+        //
+        // Builds the nodes over the boxes passed to the constructor and writes metaData into sortedMetaData in
+        // leaf order
+        //
+        template <typename MetaDataType>
+        void Build(
+            std::vector<AABBNode>& nodes,
+            const std::vector<MetaDataType>& metaData,
+            std::vector<MetaDataType>& sortedMetaData)
+        {
+            const UINT32 numPrimitives = (UINT32)metaData.size();
+            assert(numPrimitives < (1 << 24));
 
-            const float inverseExtents = 1.f / extents;
+            m_nodes.resize(std::max(2 * numPrimitives, 2u) - 1);
+            m_nodeUsed.assign(m_nodes.size(), 0);
+            m_references.resize(numPrimitives);
+            m_scratch.resize(numPrimitives);
+            m_centroids.resize(numPrimitives);
 
-            // Init boxes
-            for (UINT j = 0; j < NUM_SAH_BINS; ++j)
+            if (numPrimitives == 0)
             {
-                sahBins[i][j].numTriangles = 0;
-                InitBoxToInverseMax(sahBins[i][j].box);
+                AABB emptyBox = {};
+                InitNode(m_nodes[0], emptyBox);
+                m_nodes[0].leaf = true;
+                nodes = m_nodes;
+                sortedMetaData.clear();
+                return;
             }
 
-            // Place triangles into the buckets
-            for (UINT j = 0; j < metadata.size(); ++j)
+            ParallelFor(m_pPool, numPrimitives, kParallelChunkSize, [this](UINT begin, UINT end)
             {
-                const UINT triId = metadata[j].PrimitiveIndex;
-
-                const AABB& triBox = boxes[triId];
-
-                const float centroid = (triBox.maxArr[i] + triBox.minArr[i]) * 0.5f;
+                for (UINT i = begin; i < end; ++i)
+                {
+                    const AABB& box = m_boxes[i];
+                    m_references[i] = i;
+                    m_centroids[i] = XMFLOAT3(
+                        (box.min.x + box.max.x) * 0.5f,
+                        (box.min.y + box.max.y) * 0.5f,
+                        (box.min.z + box.max.z) * 0.5f);
+                }
+            });
 
-                const UINT binIndex = std::min(NUM_SAH_BINS - 1,
-                    UINT(NUM_SAH_BINS * ((centroid - rangeMin) * inverseExtents)));
+            AABB rootBox, rootCentroidBox;
+            ComputeRangeBounds(0, numPrimitives, rootBox, rootCentroidBox);
 
-                sahBins[i][binIndex].numTriangles++;
-                AddExtentToBox(sahBins[i][binIndex].box, triBox);
+            std::atomic<UINT> pendingTasks(0);
+            BuildSubtree(0, numPrimitives, 0, rootBox, rootCentroidBox, pendingTasks);
+            if (m_pPool)
+            {
+                m_pPool->Wait(pendingTasks);
             }
 
-            // Make sure we caught all of them once
-            UINT testTris = 0;
-            for (UINT j = 0; j < NUM_SAH_BINS; ++j)
+            CompactNodes(nodes);
+
+            sortedMetaData.resize(numPrimitives);
+            ParallelFor(m_pPool, numPrimitives, kParallelChunkSize, [&](UINT begin, UINT end)
             {
-                testTris += sahBins[i][j].numTriangles;
-            }
-            assert(testTris == numTris);
+                for (UINT i = begin; i < end; ++i)
+                {
+                    sortedMetaData[i] = metaData[m_references[i]];
+                }
+            });
+        }
 
-            // Precompute left and right boxes with counts to be able to test plane positionings
+    private:
+        static const UINT NUM_SAH_BINS = 32;
 
-            AABB leftBoxes[NUM_SAH_BINS];
-            AABB rightBoxes[NUM_SAH_BINS];
+        // Subtrees smaller than this are built on the thread that reached them
+        static const UINT kParallelSubtreeThreshold = 4096;
 
-            for (UINT j = 0; j < NUM_SAH_BINS; ++j)
-            {
-                const UINT rightIdx = NUM_SAH_BINS - j - 1;
+        // Nodes with more primitives than this bin and partition them across the pool
+        static const UINT kParallelBinningThreshold = 64 * 1024;
+        static const UINT kParallelChunkSize = 16 * 1024;
+
+        struct SahBin
+        {
+            AABB    box;
+            AABB    centroidBox;
+            UINT    numTriangles;
+        };
 
-                rightBoxes[rightIdx] = sahBins[i][rightIdx].box;
-                leftBoxes[j] = sahBins[i][j].box;
+        struct SahBins
+        {
+            SahBin  bins[3][NUM_SAH_BINS];
 
-                if (j > 0)
+            void Init(UINT numBins)
+            {
+                for (UINT axis = 0; axis < 3; ++axis)
                 {
-                    AddExtentToBox(leftBoxes[j], leftBoxes[j - 1]);
-                    AddExtentToBox(rightBoxes[rightIdx], rightBoxes[rightIdx + 1]);
+                    for (UINT j = 0; j < numBins; ++j)
+                    {
+                        bins[axis][j].numTriangles = 0;
+                        InitBoxToInverseMax(bins[axis][j].box);
+                        InitBoxToInverseMax(bins[axis][j].centroidBox);
+                    }
                 }
             }
 
-            UINT numTrianglesOnLeft = 0;
-            UINT numTrianglesOnRight = numTris;
-
-            // Find the plane with the best score
-            for (UINT j = 0; j < NUM_SAH_BINS - 1; ++j)
+            void Merge(const SahBins& other, UINT numBins)
             {
-                if (!sahBins[i][j].numTriangles)
+                for (UINT axis = 0; axis < 3; ++axis)
                 {
-                    continue;
+                    for (UINT j = 0; j < numBins; ++j)
+                    {
+                        bins[axis][j].numTriangles += other.bins[axis][j].numTriangles;
+                        AddExtentToBox(bins[axis][j].box, other.bins[axis][j].box);
+                        AddExtentToBox(bins[axis][j].centroidBox, other.bins[axis][j].centroidBox);
+                    }
                 }
+            }
+        };
+
+        struct BinMapping
+        {
+            UINT    numBins;
+            float   rangeMin[3];
+            float   scale[3];
 
-                numTrianglesOnLeft += sahBins[i][j].numTriangles;
-                numTrianglesOnRight -= sahBins[i][j].numTriangles;
+            UINT GetBin(const XMFLOAT3& centroid, UINT axis) const
+            {
+                const float position = (axis == 0) ? centroid.x : (axis == 1) ? centroid.y : centroid.z;
+                const int bin = (int)((position - rangeMin[axis]) * scale[axis]);
+                return (UINT)std::min(std::max(bin, 0), (int)numBins - 1);
+            }
+        };
 
-                const float sah = (numTrianglesOnLeft * ComputeBoxSurfaceArea(leftBoxes[j]) +
-                    numTrianglesOnRight * ComputeBoxSurfaceArea(rightBoxes[j + 1])) *
-                    normalizeToParent;
+        void ComputeRangeBounds(
+            UINT32 begin,
+            UINT32 end,
+            AABB& box,
+            AABB& centroidBox)
+        {
+            const UINT32 count = end - begin;
+            const UINT32 chunkSize = (count >= kParallelBinningThreshold) ? kParallelChunkSize : count;
+            const UINT32 numChunks = (count + chunkSize - 1) / chunkSize;
 
-                assert(!_isnan(sah));
+            std::vector<AABB> chunkBoxes(numChunks * 2);
+            ParallelFor(count >= kParallelBinningThreshold ? m_pPool : nullptr, count, chunkSize, [&](UINT chunkBegin, UINT chunkEnd)
+            {
+                AABB& localBox = chunkBoxes[(chunkBegin / chunkSize) * 2 + 0];
+                AABB& localCentroidBox = chunkBoxes[(chunkBegin / chunkSize) * 2 + 1];
+                InitBoxToInverseMax(localBox);
+                InitBoxToInverseMax(localCentroidBox);
 
-                if (sah < bestSah)
+                for (UINT32 i = begin + chunkBegin; i < begin + chunkEnd; ++i)
                 {
-                    bestSah = sah;
-                    maxDimension = i;
-                    numTrisInLeftNode = numTrianglesOnLeft;
+                    const UINT32 primitive = m_references[i];
+                    AddExtentToBox(localBox, m_boxes[primitive]);
+                    AddPointToBox(localCentroidBox, m_centroids[primitive]);
                 }
+            });
+
+            box = chunkBoxes[0];
+            centroidBox = chunkBoxes[1];
+            for (UINT32 i = 1; i < numChunks; ++i)
+            {
+                AddExtentToBox(box, chunkBoxes[i * 2 + 0]);
+                AddExtentToBox(centroidBox, chunkBoxes[i * 2 + 1]);
             }
         }
 
-        //
-        // Split the set to try to get a balanced tree
-        //
-
-        SortByCentroid(metadata, boxes, maxDimension);
-    }
-
-    //
-    // It's a good idea to do a breadth-first build because then nodes from the same level
-    // get adjacent memory locations. It does take a lot of memory though.
-    //
-    // "Uniform BVH"
-    // -- both children are valid for all internal nodes
-    // -- left child's index is +1 of the parent index, right child's index is stored
-    //    in the packed AABB structure.
-    // -- there could be a varaible number of triangles in leaves
-    //
-    static
-        void BuildBVH(
-            BVH& bvh,
-            const std::vector<AABB>& boxes,
-            const std::vector<PrimitiveMetaData>& primitiveMetaData,
-            UINT32 maxTrisInLeaf)
-    {
-        //
-        // These are huge so use pointers
-        //
-        struct StackItem
+        void BinPrimitives(
+            UINT32 begin,
+            UINT32 end,
+            const BinMapping& mapping,
+            SahBins& result)
         {
-            std::vector<PrimitiveMetaData> primitiveMetaData;
-            UINT32              parentIndex;
-            UINT                right : 1;
-            UINT                axis : 2;
-        };
-
-        std::deque<StackItem*>   fifoLefts;
-        std::deque<StackItem*>   fifoRights;
+            auto binRange = [&](UINT32 rangeBegin, UINT32 rangeEnd, SahBins& bins)
+            {
+                for (UINT32 i = rangeBegin; i < rangeEnd; ++i)
+                {
+                    const UINT32 primitive = m_references[i];
+                    const AABB& box = m_boxes[primitive];
+                    const XMFLOAT3& centroid = m_centroids[primitive];
 
-        StackItem* temp = new StackItem;
-        temp->parentIndex = (UINT)-1;
-        temp->primitiveMetaData = primitiveMetaData;
-        temp->right = false;
-        temp->axis = 0;
-        fifoRights.push_back(temp);
+                    for (UINT axis = 0; axis < 3; ++axis)
+                    {
+                        SahBin& bin = bins.bins[axis][mapping.GetBin(centroid, axis)];
+                        bin.numTriangles++;
+                        AddExtentToBox(bin.box, box);
+                        AddPointToBox(bin.centroidBox, centroid);
+                    }
+                }
+            };
 
-        while (!fifoLefts.empty() || !fifoRights.empty())
-        {
-            // Uniform BVH pops the first left node
-            StackItem* item = nullptr;
+            result.Init(mapping.numBins);
 
-            if (!fifoRights.empty())
+            const UINT32 count = end - begin;
+            if (!m_pPool || count < kParallelBinningThreshold)
             {
-                item = fifoRights.back();
-                fifoRights.pop_back();
+                binRange(begin, end, result);
+                return;
             }
 
-            if (!item)
+            const UINT32 numChunks = (count + kParallelChunkSize - 1) / kParallelChunkSize;
+            std::vector<SahBins> chunkBins(numChunks);
+            ParallelFor(m_pPool, count, kParallelChunkSize, [&](UINT chunkBegin, UINT chunkEnd)
             {
-                item = fifoLefts.back();
-                fifoLefts.pop_back();
-            }
-
-            //
-            // Compute overall bounding box
-            //
-            AABB nodeBox;
-            ComputeBox(nodeBox, boxes, item->primitiveMetaData);
+                SahBins& bins = chunkBins[chunkBegin / kParallelChunkSize];
+                bins.Init(mapping.numBins);
+                binRange(begin + chunkBegin, begin + chunkEnd, bins);
+            });
 
-            const UINT32 numTrianglesInNode = (UINT32)item->primitiveMetaData.size();
-            const UINT32 parentIndex = item->parentIndex;
+            for (const SahBins& bins : chunkBins)
+            {
+                result.Merge(bins, mapping.numBins);
+            }
+        }
 
-            UINT32 thisNodeIndex;
+        //
+        // Moves the references whose bin on axis is below splitBin to the front of the range and returns the
+        // index of the first reference of the right side
+        //
+        UINT32 PartitionPrimitives(
+            UINT32 begin,
+            UINT32 end,
+            const BinMapping& mapping,
+            UINT axis,
+            UINT splitBin)
+        {
+            auto goesLeft = [&](UINT32 primitive) -> bool
+            {
+                return mapping.GetBin(m_centroids[primitive], axis) < splitBin;
+            };
 
-            // Leaf or internal node?
-            if (numTrianglesInNode <= maxTrisInLeaf)
+            const UINT32 count = end - begin;
+            if (!m_pPool || count < kParallelBinningThreshold)
             {
-                thisNodeIndex = BuildBVHAddLeaf(bvh, nodeBox, item->primitiveMetaData);
+                return (UINT32)(std::partition(m_references.begin() + begin, m_references.begin() + end, goesLeft) - m_references.begin());
             }
-            else
-            {
-                //
-                // Find separating plane. Use Median for speed.
-                // SAH is better but also more expensive to build.
-                //
 
-                UINT splitDimension;
-                UINT leftChildNumNodes;
+            // Count per chunk, then scatter both sides through the scratch array
+            const UINT32 numChunks = (count + kParallelChunkSize - 1) / kParallelChunkSize;
+            std::vector<UINT32> chunkLeftCounts(numChunks);
+            ParallelFor(m_pPool, count, kParallelChunkSize, [&](UINT chunkBegin, UINT chunkEnd)
+            {
+                UINT32 numLeft = 0;
+                for (UINT32 i = begin + chunkBegin; i < begin + chunkEnd; ++i)
+                {
+                    numLeft += goesLeft(m_references[i]) ? 1 : 0;
+                }
+                chunkLeftCounts[chunkBegin / kParallelChunkSize] = numLeft;
+            });
 
-                SahSplit(item->primitiveMetaData,
-                    splitDimension,
-                    leftChildNumNodes,
-                    nodeBox,
-                    boxes);
+            std::vector<UINT32> chunkLeftOffsets(numChunks);
+            UINT32 totalLeft = 0;
+            for (UINT32 i = 0; i < numChunks; ++i)
+            {
+                chunkLeftOffsets[i] = totalLeft;
+                totalLeft += chunkLeftCounts[i];
+            }
 
-                assert(leftChildNumNodes <= item->primitiveMetaData.size());
+            ParallelFor(m_pPool, count, kParallelChunkSize, [&](UINT chunkBegin, UINT chunkEnd)
+            {
+                const UINT32 chunkIndex = chunkBegin / kParallelChunkSize;
+                UINT32 leftOutput = begin + chunkLeftOffsets[chunkIndex];
+                UINT32 rightOutput = begin + totalLeft + (chunkBegin - chunkLeftOffsets[chunkIndex]);
 
-                // Try to balance by using the median if SAH failed
-                if ((leftChildNumNodes == 0 ||
-                    leftChildNumNodes == item->primitiveMetaData.size()) &&
-                    item->primitiveMetaData.size() > MAX_TRIS_IN_LEAF)
+                for (UINT32 i = begin + chunkBegin; i < begin + chunkEnd; ++i)
                 {
-                    leftChildNumNodes = (UINT)item->primitiveMetaData.size() / 2;
+                    const UINT32 primitive = m_references[i];
+                    if (goesLeft(primitive))
+                    {
+                        m_scratch[leftOutput++] = primitive;
+                    }
+                    else
+                    {
+                        m_scratch[rightOutput++] = primitive;
+                    }
                 }
+            });
 
-                const UINT32 rightChildNumNodes = (UINT32)item->primitiveMetaData.size() - leftChildNumNodes;
+            ParallelFor(m_pPool, count, kParallelChunkSize, [&](UINT chunkBegin, UINT chunkEnd)
+            {
+                std::copy(m_scratch.begin() + begin + chunkBegin, m_scratch.begin() + begin + chunkEnd, m_references.begin() + begin + chunkBegin);
+            });
 
+            return begin + totalLeft;
+        }
 
-                //
-                // "Recurse"
-                //
+        void BuildSubtree(
+            UINT32 begin,
+            UINT32 end,
+            UINT32 nodeIndex,
+            AABB nodeBox,
+            AABB centroidBox,
+            std::atomic<UINT>& pendingTasks)
+        {
+            // Recurse into (or spawn) the smaller child and keep looping on the larger one, which bounds the
+            // recursion depth by log2 of the primitive count
+            for (;;)
+            {
+                const UINT32 numTriangles = end - begin;
 
-                thisNodeIndex = BuildBVHAddNode(bvh, nodeBox, splitDimension);
+                AABBNode& node = m_nodes[nodeIndex];
+                InitNode(node, nodeBox);
+                m_nodeUsed[nodeIndex] = 1;
 
-                StackItem* leftItem = new StackItem;
-                leftItem->parentIndex = thisNodeIndex;
-                leftItem->primitiveMetaData.resize(leftChildNumNodes);
-                leftItem->right = false;
-                leftItem->axis = splitDimension;
-                for (UINT32 i = 0; i < leftChildNumNodes; ++i)
+                if (numTriangles <= m_maxTrisInLeaf)
                 {
-                    leftItem->primitiveMetaData[i] = item->primitiveMetaData[i];
+                    node.leaf = true;
+                    node.leafNode.firstTriangleId = begin;
+                    node.leafNode.numTriangleIds = numTriangles;
+                    node.numTriangles = numTriangles;
+                    return;
                 }
 
-                StackItem* rightItem = new StackItem;
-                rightItem->parentIndex = thisNodeIndex;
-                rightItem->primitiveMetaData.resize(rightChildNumNodes);
-                rightItem->right = true;
-                rightItem->axis = splitDimension;
-                for (UINT32 i = 0; i < rightChildNumNodes; ++i)
+                UINT32 split = begin;
+                AABB leftBox, rightBox, leftCentroidBox, rightCentroidBox;
+                if (!FindSahSplit(begin, end, nodeBox, centroidBox, split, leftBox, rightBox, leftCentroidBox, rightCentroidBox))
                 {
-                    rightItem->primitiveMetaData[i] = item->primitiveMetaData[i + leftChildNumNodes];
+                    // All centroids coincide, so no plane separates them - split the list in half
+                    split = begin + numTriangles / 2;
+                    ComputeRangeBounds(begin, split, leftBox, leftCentroidBox);
+                    ComputeRangeBounds(split, end, rightBox, rightCentroidBox);
                 }
+                assert(split > begin && split < end);
 
-                fifoLefts.push_back(leftItem);
-                fifoRights.push_back(rightItem);
-            }
+                // The right subtree follows its parent, the left subtree follows the right one
+                const UINT32 rightNodeIndex = nodeIndex + 1;
+                const UINT32 leftNodeIndex = nodeIndex + 2 * (end - split);
+                node.internalNode.leftNodeIndex = leftNodeIndex;
+                node.rightNodeIndex = rightNodeIndex;
 
-            // Update child link of the parent
-            if (parentIndex != -1)
-            {
-                if (!item->right)
+                struct Child
+                {
+                    UINT32  begin;
+                    UINT32  end;
+                    UINT32  nodeIndex;
+                    AABB    box;
+                    AABB    centroidBox;
+                };
+                Child left = { begin, split, leftNodeIndex, leftBox, leftCentroidBox };
+                Child right = { split, end, rightNodeIndex, rightBox, rightCentroidBox };
+
+                const bool leftIsSmaller = (split - begin) < (end - split);
+                const Child& smaller = leftIsSmaller ? left : right;
+                const Child& larger = leftIsSmaller ? right : left;
+
+                if (m_pPool && smaller.end - smaller.begin >= kParallelSubtreeThreshold)
                 {
-                    bvh.m_nodes[parentIndex].internalNode.leftNodeIndex = thisNodeIndex;
-                    bvh.m_nodes[parentIndex].rightNodeIndex = parentIndex + 1;
+                    m_pPool->Spawn([this, smaller, &pendingTasks]()
+                    {
+                        BuildSubtree(smaller.begin, smaller.end, smaller.nodeIndex, smaller.box, smaller.centroidBox, pendingTasks);
+                    }, pendingTasks);
+                }
+                else
+                {
+                    BuildSubtree(smaller.begin, smaller.end, smaller.nodeIndex, smaller.box, smaller.centroidBox, pendingTasks);
                 }
-            }
-
-            // Free the item after use
-            delete item;
-        }
-    }
-
-    void BuildUniformBVH(
-        _In_  UINT NumElements,
-        _In_reads_opt_(NumElements)  const D3D12_RAYTRACING_GEOMETRY_DESC *pGeometries,
-        BVH &bvh)
-    {
-        using namespace DirectX;
-        //
-        // Compute number of triangles
-        //
-
-        UINT    totalNumberOfTriangles = 0;
 
-        for (UINT i = 0; i < NumElements; ++i)
-        {
-            auto &geometry = pGeometries[i];
-            if (geometry.Type == D3D12_RAYTRACING_GEOMETRY_TYPE_TRIANGLES)
-            {
-                totalNumberOfTriangles += GetPrimitiveCountFromGeometryDesc(geometry);
-            }
-            else
-            {
-                throw - 1; // Intersection shaders not supported yet
+                begin = larger.begin;
+                end = larger.end;
+                nodeIndex = larger.nodeIndex;
+                nodeBox = larger.box;
+                centroidBox = larger.centroidBox;
             }
-
         }
 
-        //
-        // Create AABBs
-        //
-
-        std::vector<AABB> boxes;
-        boxes.resize(totalNumberOfTriangles);
-
-        std::vector<PrimitiveMetaData> primitiveMetaData;
-        primitiveMetaData.resize(totalNumberOfTriangles);
-
-        std::vector<float>  triangleVertices;
-        triangleVertices.resize(totalNumberOfTriangles * 9);
-
-        UINT triangleIndex = 0;
-        for (UINT i = 0; i < NumElements; ++i)
+        bool FindSahSplit(
+            UINT32 begin,
+            UINT32 end,
+            const AABB& nodeBox,
+            const AABB& centroidBox,
+            UINT32& split,
+            AABB& leftBox,
+            AABB& rightBox,
+            AABB& leftCentroidBox,
+            AABB& rightCentroidBox)
         {
-            auto &geometry = pGeometries[i];
-            if (geometry.Type != D3D12_RAYTRACING_GEOMETRY_TYPE_TRIANGLES)
+            // Small nodes don't need the full bin count, and clearing and sweeping unused bins dominates their cost
+            BinMapping mapping;
+            mapping.numBins = (end - begin < NUM_SAH_BINS) ? std::max(end - begin, 4u) : NUM_SAH_BINS;
+
+            bool anyExtent = false;
+            for (UINT axis = 0; axis < 3; ++axis)
             {
-                throw - 1; // Intersection shaders not supported yet
+                const float extent = centroidBox.maxArr[axis] - centroidBox.minArr[axis];
+                mapping.rangeMin[axis] = centroidBox.minArr[axis];
+                mapping.scale[axis] = (extent > 0) ? (mapping.numBins * (1.f - 1e-6f)) / extent : 0.f;
+                anyExtent = anyExtent || (extent > 0);
             }
 
-            auto &triangles = geometry.Triangles;
-            if (GetPrimitiveCountFromGeometryDesc(geometry) == 0)
-
+            if (!anyExtent)
             {
-                continue;
+                return false;
             }
 
-            // 
-            const UINT64 vertexStrideDwords = triangles.VertexBuffer.StrideInBytes / 4;
-            const UINT numTris = GetPrimitiveCountFromGeometryDesc(geometry);
+            SahBins bins;
+            BinPrimitives(begin, end, mapping, bins);
 
-            float *pVertexData = (float *)geometry.Triangles.VertexBuffer.StartAddress;
-            float *pIndexData = (float *)geometry.Triangles.IndexBuffer;
+            // For the score to be meaningful it seems we need to normalize it to something
+            const float normalizeToParent = 1.f / std::max(ComputeBoxSurfaceArea(nodeBox), FLT_MIN);
 
-            const float* pVertices = (float*)(pVertexData);
-            const UINT16* pIndices = (UINT16*)(pIndexData);
+            float bestSah = FLT_MAX;
+            UINT bestAxis = 0;
+            UINT bestBin = 0;
 
-            for (UINT j = 0; j < numTris; ++j)
+            for (UINT axis = 0; axis < 3; ++axis)
             {
-                const UINT16 i0 = pIndices[j * 3 + 0];
-                const UINT16 i1 = pIndices[j * 3 + 1];
-                const UINT16 i2 = pIndices[j * 3 + 2];
-
-                const float* v0 = &pVertices[i0 * vertexStrideDwords];
-                const float* v1 = &pVertices[i1 * vertexStrideDwords];
-                const float* v2 = &pVertices[i2 * vertexStrideDwords];
+                if (mapping.scale[axis] == 0)
+                    continue;
 
-                float* pTriVerts = &triangleVertices[triangleIndex * 9];
+                const SahBin* axisBins = bins.bins[axis];
 
-                pTriVerts[0] = v0[0];
-                pTriVerts[1] = v0[1];
-                pTriVerts[2] = v0[2];
+                // Sweep from the right to get the area of every right side
+                float rightAreas[NUM_SAH_BINS];
+                AABB rightAccum;
+                InitBoxToInverseMax(rightAccum);
+                for (UINT j = mapping.numBins - 1; j > 0; --j)
+                {
+                    if (axisBins[j].numTriangles)
+                    {
+                        AddExtentToBox(rightAccum, axisBins[j].box);
+                    }
+                    rightAreas[j] = ComputeBoxSurfaceArea(rightAccum);
+                }
 
-                pTriVerts[3] = v1[0];
-                pTriVerts[4] = v1[1];
-                pTriVerts[5] = v1[2];
+                // Then from the left, scoring each plane between bins j - 1 and j
+                AABB leftAccum;
+                InitBoxToInverseMax(leftAccum);
+                UINT numTrianglesOnLeft = 0;
+                for (UINT j = 1; j < mapping.numBins; ++j)
+                {
+                    if (axisBins[j - 1].numTriangles)
+                    {
+                        AddExtentToBox(leftAccum, axisBins[j - 1].box);
+                        numTrianglesOnLeft += axisBins[j - 1].numTriangles;
+                    }
 
-                pTriVerts[6] = v2[0];
-                pTriVerts[7] = v2[1];
-                pTriVerts[8] = v2[2];
+                    const UINT numTrianglesOnRight = (end - begin) - numTrianglesOnLeft;
+                    if (numTrianglesOnLeft == 0 || numTrianglesOnRight == 0)
+                        continue;
 
-                AABB& box = boxes[triangleIndex];
-                for (UINT k = 0; k < 3; ++k)
-                {
-#define AABB_Min_Padding 0.001f
-                    box.minArr[k] = std::min(v2[k], std::min(v0[k], v1[k]));
-                    box.maxArr[k] = std::max(v2[k], std::max(v0[k], v1[k])) + AABB_Min_Padding;
+                    const float sah = (numTrianglesOnLeft * ComputeBoxSurfaceArea(leftAccum) +
+                        numTrianglesOnRight * rightAreas[j]) * normalizeToParent;
 
-                    if (_isnan(box.minArr[k]) ||
-                        _isnan(box.maxArr[k]))
+                    if (sah < bestSah)
                     {
-                        box.minArr[k] = 0;
-                        box.maxArr[k] = 0;
+                        bestSah = sah;
+                        bestAxis = axis;
+                        bestBin = j;
                     }
                 }
+            }
 
-                // Create out internal triangle indices.
-                PrimitiveMetaData metadata;
-                metadata.GeometryContributionToHitGroupIndex = i;
-                metadata.PrimitiveIndex = triangleIndex;
-                metadata.GeometryFlags = geometry.Flags;
-                primitiveMetaData[triangleIndex] = metadata;
-
-                // Next triangle
-                triangleIndex++;
+            if (bestBin == 0)
+            {
+                return false;
             }
-        }
 
-        //
-        // Create a BVH
-        //
+            InitBoxToInverseMax(leftBox);
+            InitBoxToInverseMax(rightBox);
+            InitBoxToInverseMax(leftCentroidBox);
+            InitBoxToInverseMax(rightCentroidBox);
+            for (UINT j = 0; j < mapping.numBins; ++j)
+            {
+                const SahBin& bin = bins.bins[bestAxis][j];
+                if (!bin.numTriangles)
+                    continue;
+
+                AddExtentToBox(j < bestBin ? leftBox : rightBox, bin.box);
+                AddExtentToBox(j < bestBin ? leftCentroidBox : rightCentroidBox, bin.centroidBox);
+            }
 
-        BuildBVH(bvh, boxes, primitiveMetaData, MAX_TRIS_IN_LEAF);
+            split = PartitionPrimitives(begin, end, mapping, bestAxis, bestBin);
+            return true;
+        }
 
         //
-        // Now copy and compress geometry
+        // Removes the slots that were reserved for subtrees whose leaves hold more than one primitive. Slots
+        // are already in depth-first order, so this keeps "right child = parent + 1".
         //
+        void CompactNodes(
+            std::vector<AABBNode>& nodes)
+        {
+            const UINT32 numSlots = (UINT32)m_nodes.size();
 
-        // Copy verts
-        const UINT numTris = triangleIndex;
-        bvh.m_triangles.resize(numTris * 3 * 3);
-        assert(bvh.m_triangles.size() == triangleVertices.size());
-        assert(sizeof(bvh.m_triangles[0]) == sizeof(triangleVertices[0]));
+            std::vector<UINT32> remap(numSlots);
+            UINT32 numNodes = 0;
+            for (UINT32 i = 0; i < numSlots; ++i)
+            {
+                remap[i] = numNodes;
+                numNodes += m_nodeUsed[i];
+            }
 
-        for (UINT i = 0; i < numTris; ++i)
-        {
-            UINT inputIndex = bvh.m_metadata[i].PrimitiveIndex;
-            float *pInputTriangle = &triangleVertices.data()[inputIndex * 9];
-            float* pOutputTriangle = &bvh.m_triangles[i * 9];
+            if (numNodes == numSlots)
+            {
+                nodes.swap(m_nodes);
+                return;
+            }
 
-            // Construct three planes and write to pPlanes
-            XMVECTOR V0 = XMVectorSet(pInputTriangle[0], pInputTriangle[1], pInputTriangle[2], 0.0f);
-            XMVECTOR V1 = XMVectorSet(pInputTriangle[3], pInputTriangle[4], pInputTriangle[5], 0.0f);
-            XMVECTOR V2 = XMVectorSet(pInputTriangle[6], pInputTriangle[7], pInputTriangle[8], 0.0f);
+            nodes.resize(numNodes);
+            for (UINT32 i = 0; i < numSlots; ++i)
+            {
+                if (!m_nodeUsed[i])
+                    continue;
 
-            XMStoreFloat3((XMFLOAT3*)pOutputTriangle + 0, V0);
-            XMStoreFloat3((XMFLOAT3*)pOutputTriangle + 1, V1);
-            XMStoreFloat3((XMFLOAT3*)pOutputTriangle + 2, V2);
+                AABBNode& node = nodes[remap[i]];
+                node = m_nodes[i];
+                if (!node.leaf)
+                {
+                    node.internalNode.leftNodeIndex = remap[node.internalNode.leftNodeIndex];
+                    node.rightNodeIndex = remap[node.rightNodeIndex];
+                }
+            }
         }
-    }
-}
 
-void BuildRaytracingAccelerationStructureOnCpu(
-    _In_  const D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC *pDesc,
-    _Out_ void *pData)
-{
-    FallbackLayer::BVH bvh;
-    FallbackLayer::BuildUniformBVH(pDesc->Inputs.NumDescs, pDesc->Inputs.pGeometryDescs, bvh);
+        const std::vector<AABB>&    m_boxes;
+        const UINT32                m_maxTrisInLeaf;
+        BuildTaskPool*              m_pPool;
+
+        std::vector<AABBNode>       m_nodes;
+        std::vector<BYTE>           m_nodeUsed;
+        std::vector<UINT32>         m_references;
+        std::vector<UINT32>         m_scratch;
+        std::vector<XMFLOAT3>       m_centroids;
+    };
+
+    //
+    // Nodes are laid out depth-first:
+    //
+    // "Uniform BVH"
+    // -- both children are valid for all internal nodes
+    // -- right child's index is +1 of the parent index, left child's index is stored
+    //    in the packed AABB structure. Both are also stored explicitly.
+    // -- there could be a varaible number of triangles in leaves
+    //
+    template <typename MetaDataType>
+    static
+        void BuildBVH(
+            std::vector<AABBNode>& nodes,
+            const std::vector<AABB>& boxes,
+            const std::vector<MetaDataType>& metaData,
+            std::vector<MetaDataType>& sortedMetaData,
+            UINT32 maxTrisInLeaf,
+            BuildTaskPool* pPool)
+    {
+        BinnedSahBuilder builder(boxes, maxTrisInLeaf, pPool);
+        builder.Build(nodes, metaData, sortedMetaData);
+    }
+
+    static const UINT kTriangleChunkSize = 16 * 1024;
+
+    //
+    // Returns the process-wide pool, created by the first build that needs it and reused by every build after
+    // that. Small inputs aren't worth waking threads for.
+    //
+    static
+        BuildTaskPool* GetBuildTaskPool(
+            UINT numTriangles)
+    {
+        static const UINT kMinTrianglesForParallelBuild = 16 * 1024;
+
+        const UINT numThreads = std::thread::hardware_concurrency();
+        if (numThreads <= 1 || numTriangles < kMinTrianglesForParallelBuild)
+        {
+            return nullptr;
+        }
+
+        static BuildTaskPool s_pool(numThreads);
+        return &s_pool;
+    }
+
+    //
+    // Reads the triangles of one geometry desc, with or without an index buffer
+    //
+    class TriangleReader
+    {
+    public:
+        TriangleReader(
+            const D3D12_RAYTRACING_GEOMETRY_TRIANGLES_DESC& triangles) :
+            m_pVertices((const float*)triangles.VertexBuffer.StartAddress),
+            m_pIndices((const void*)triangles.IndexBuffer),
+            m_indexFormat(triangles.IndexFormat),
+            m_vertexStrideDwords(triangles.VertexBuffer.StrideInBytes / 4)
+        {
+        }
+
+        void LoadTriangle(
+            UINT triangleIndex,
+            float* pTriVerts) const
+        {
+            for (UINT v = 0; v < 3; ++v)
+            {
+                const float* pVertex = &m_pVertices[GetIndex(triangleIndex * 3 + v) * m_vertexStrideDwords];
+                pTriVerts[v * 3 + 0] = pVertex[0];
+                pTriVerts[v * 3 + 1] = pVertex[1];
+                pTriVerts[v * 3 + 2] = pVertex[2];
+            }
+        }
+
+    private:
+        UINT GetIndex(
+            UINT index) const
+        {
+            switch (m_indexFormat)
+            {
+            case DXGI_FORMAT_R16_UINT:
+                return ((const UINT16*)m_pIndices)[index];
+            case DXGI_FORMAT_R32_UINT:
+                return ((const UINT32*)m_pIndices)[index];
+            default:
+                return index;
+            }
+        }
+
+        const float*        m_pVertices;
+        const void*         m_pIndices;
+        const DXGI_FORMAT   m_indexFormat;
+        const UINT64        m_vertexStrideDwords;
+    };
+
+    static
+        void ComputeTriangleBox(
+            const float* pTriVerts,
+            AABB& box)
+    {
+        const float* v0 = pTriVerts;
+        const float* v1 = pTriVerts + 3;
+        const float* v2 = pTriVerts + 6;
+        for (UINT k = 0; k < 3; ++k)
+        {
+#define AABB_Min_Padding 0.001f
+            box.minArr[k] = std::min(v2[k], std::min(v0[k], v1[k]));
+            box.maxArr[k] = std::max(v2[k], std::max(v0[k], v1[k])) + AABB_Min_Padding;
+
+            if (_isnan(box.minArr[k]) ||
+                _isnan(box.maxArr[k]))
+            {
+                box.minArr[k] = 0;
+                box.maxArr[k] = 0;
+            }
+        }
+    }
+
+    //
+    // Upper bound on the references SpatialSplitBvhBuilder adds, used to size the output as well
+    //
+    static
+        UINT32 GetMaxSpatialSplitDuplicates(
+            UINT32 numTriangles,
+            float duplicationBudget)
+    {
+        return (UINT32)(numTriangles * std::max(duplicationBudget, 0.f));
+    }
+
+    //
+    // Spatial split BVH builder (Stich et al., "Spatial Splits in Bounding Volume Hierarchies").
+    //
+    // Every node also considers splitting space instead of the primitive list: references straddling the plane
+    // go to both children, each with its box clipped to the part of the triangle on that side. This pays off
+    // on long or diagonal triangles whose boxes overlap a lot of empty space. Spatial splits are only tried
+    // when the best object split leaves the children overlapping, and the number of references they may add
+    // is capped by a budget relative to the triangle count. Leaves may therefore hold copies of the same
+    // primitive, each with its own PrimitiveMetaData entry. Geometry flagged NO_DUPLICATE_ANYHIT_INVOCATION is
+    // never duplicated.
+    //
+    // The builder is serial, so it is meant for geometry that is built once and traced many times.
+    //
+    class SpatialSplitBvhBuilder
+    {
+    public:
+        SpatialSplitBvhBuilder(
+            const std::vector<AABB>& boxes,
+            const std::vector<float>& triangleVertices,
+            UINT32 maxTrisInLeaf,
+            float duplicationBudget) :
+            m_boxes(boxes),
+            m_triangleVertices(triangleVertices),
+            m_maxTrisInLeaf(std::max(maxTrisInLeaf, 1u)),
+            m_remainingDuplicates(GetMaxSpatialSplitDuplicates((UINT32)boxes.size(), duplicationBudget)),
+            m_minOverlapArea(0)
+        {
+        }
+
+        //
+        // Same contract as BinnedSahBuilder::Build, except that sortedMetaData gets one entry per leaf
+        // reference and can be larger than metaData
+        //
+        void Build(
+            std::vector<AABBNode>& nodes,
+            const std::vector<PrimitiveMetaData>& metaData,
+            std::vector<PrimitiveMetaData>& sortedMetaData)
+        {
+            const UINT32 numPrimitives = (UINT32)metaData.size();
+            assert(numPrimitives + m_remainingDuplicates < (1 << 24));
+
+            m_canDuplicate.resize(numPrimitives);
+            for (UINT32 i = 0; i < numPrimitives; ++i)
+            {
+                m_canDuplicate[i] = !(metaData[i].GeometryFlags & D3D12_RAYTRACING_GEOMETRY_FLAG_NO_DUPLICATE_ANYHIT_INVOCATION);
+            }
+
+            m_nodes.clear();
+            m_nodes.reserve(2 * (numPrimitives + m_remainingDuplicates));
+            m_leafReferences.clear();
+            m_leafReferences.reserve(numPrimitives + m_remainingDuplicates);
+
+            if (numPrimitives == 0)
+            {
+                AABB emptyBox = {};
+                nodes.resize(1);
+                InitNode(nodes[0], emptyBox);
+                nodes[0].leaf = true;
+                sortedMetaData.clear();
+                return;
+            }
+
+            BuildTask root;
+            root.references.resize(numPrimitives);
+            InitBoxToInverseMax(root.box);
+            for (UINT32 i = 0; i < numPrimitives; ++i)
+            {
+                root.references[i].box = m_boxes[i];
+                root.references[i].primitive = i;
+                AddExtentToBox(root.box, m_boxes[i]);
+            }
+            root.nodeIndex = AllocateNode();
+
+            // Overlaps smaller than this fraction of the root are not worth duplicating references for
+            m_minOverlapArea = ComputeBoxSurfaceArea(root.box) * kSpatialSplitAlpha;
+
+            std::vector<BuildTask> stack;
+            stack.push_back(std::move(root));
+            while (!stack.empty())
+            {
+                BuildTask task = std::move(stack.back());
+                stack.pop_back();
+
+                BuildTask left, right;
+                if (SplitNode(task, left, right))
+                {
+                    left.nodeIndex = AllocateNode();
+                    right.nodeIndex = AllocateNode();
+
+                    AABBNode& node = m_nodes[task.nodeIndex];
+                    node.internalNode.leftNodeIndex = left.nodeIndex;
+                    node.rightNodeIndex = right.nodeIndex;
+
+                    stack.push_back(std::move(left));
+                    stack.push_back(std::move(right));
+                }
+            }
+
+            ReorderNodes(nodes);
+
+            sortedMetaData.resize(m_leafReferences.size());
+            for (size_t i = 0; i < m_leafReferences.size(); ++i)
+            {
+                sortedMetaData[i] = metaData[m_leafReferences[i]];
+            }
+        }
+
+    private:
+        static const UINT NUM_OBJECT_BINS = 32;
+        static const UINT NUM_SPATIAL_BINS = 32;
+
+        // Stich et al. use 1e-5: low enough to find most useful splits, high enough to skip the spatial
+        // binning on nodes where the object split is already good
+        static constexpr float kSpatialSplitAlpha = 1e-5f;
+
+        struct Reference
+        {
+            AABB    box;
+            UINT32  primitive;
+        };
+
+        struct BuildTask
+        {
+            std::vector<Reference>  references;
+            AABB                    box;
+            UINT32                  nodeIndex;
+        };
+
+        struct ObjectSplit
+        {
+            float   sah;
+            UINT    axis;
+            UINT    bin;            // references binned below this go left
+            AABB    leftBox;
+            AABB    rightBox;
+        };
+
+        struct SpatialSplit
+        {
+            float   sah;
+            UINT    axis;
+            UINT    bin;            // the plane is the lower edge of this bin
+            float   position;
+            UINT32  numLeft;
+            UINT32  numRight;
+        };
+
+        static float GetCentroid(
+            const AABB& box,
+            UINT axis)
+        {
+            return (box.minArr[axis] + box.maxArr[axis]) * 0.5f;
+        }
+
+        static void IntersectBoxes(
+            AABB& box,
+            const AABB& other)
+        {
+            for (UINT axis = 0; axis < 3; ++axis)
+            {
+                box.minArr[axis] = std::max(box.minArr[axis], other.minArr[axis]);
+                box.maxArr[axis] = std::min(box.maxArr[axis], other.maxArr[axis]);
+            }
+        }
+
+        static bool IsBoxEmpty(
+            const AABB& box)
+        {
+            return box.min.x > box.max.x || box.min.y > box.max.y || box.min.z > box.max.z;
+        }
+
+        UINT32 AllocateNode()
+        {
+            m_nodes.emplace_back();
+            return (UINT32)m_nodes.size() - 1;
+        }
+
+        //
+        // Writes the node for task, and returns false if it became a leaf. Otherwise the references are moved
+        // into the two children.
+        //
+        bool SplitNode(
+            BuildTask& task,
+            BuildTask& left,
+            BuildTask& right)
+        {
+            const UINT32 numReferences = (UINT32)task.references.size();
+
+            AABBNode& node = m_nodes[task.nodeIndex];
+            InitNode(node, task.box);
+
+            if (numReferences <= m_maxTrisInLeaf)
+            {
+                node.leaf = true;
+                node.leafNode.firstTriangleId = (UINT32)m_leafReferences.size();
+                node.leafNode.numTriangleIds = numReferences;
+                node.numTriangles = numReferences;
+                for (const Reference& reference : task.references)
+                {
+                    m_leafReferences.push_back(reference.primitive);
+                }
+                return false;
+            }
+
+            ObjectSplit objectSplit;
+            const bool foundObjectSplit = FindObjectSplit(task, objectSplit);
+
+            SpatialSplit spatialSplit;
+            spatialSplit.sah = FLT_MAX;
+            if (m_remainingDuplicates > 0)
+            {
+                AABB overlap = objectSplit.leftBox;
+                IntersectBoxes(overlap, objectSplit.rightBox);
+                if (!foundObjectSplit || (!IsBoxEmpty(overlap) && ComputeBoxSurfaceArea(overlap) > m_minOverlapArea))
+                {
+                    FindSpatialSplit(task, spatialSplit);
+                }
+            }
+
+            bool split = spatialSplit.sah < FLT_MAX && (!foundObjectSplit || spatialSplit.sah < objectSplit.sah) &&
+                PerformSpatialSplit(task, spatialSplit, left, right);
+
+            if (!split && foundObjectSplit)
+            {
+                left = BuildTask();
+                right = BuildTask();
+                PerformObjectSplit(task, objectSplit, left, right);
+                split = true;
+            }
+
+            if (!split)
+            {
+                // All centroids coincide and space can't be split either - split the list in half
+                const UINT32 half = numReferences / 2;
+                left = BuildTask();
+                right = BuildTask();
+                left.references.assign(task.references.begin(), task.references.begin() + half);
+                right.references.assign(task.references.begin() + half, task.references.end());
+                InitBoxToInverseMax(left.box);
+                InitBoxToInverseMax(right.box);
+                for (const Reference& reference : left.references)
+                {
+                    AddExtentToBox(left.box, reference.box);
+                }
+                for (const Reference& reference : right.references)
+                {
+                    AddExtentToBox(right.box, reference.box);
+                }
+            }
+
+            std::vector<Reference>().swap(task.references);
+            assert(!left.references.empty() && !right.references.empty());
+            return true;
+        }
+
+        bool FindObjectSplit(
+            const BuildTask& task,
+            ObjectSplit& split)
+        {
+            const UINT32 numReferences = (UINT32)task.references.size();
+
+            AABB centroidBox;
+            InitBoxToInverseMax(centroidBox);
+            for (const Reference& reference : task.references)
+            {
+                const XMFLOAT3 centroid(GetCentroid(reference.box, 0), GetCentroid(reference.box, 1), GetCentroid(reference.box, 2));
+                AddPointToBox(centroidBox, centroid);
+            }
+
+            const float normalizeToParent = 1.f / std::max(ComputeBoxSurfaceArea(task.box), FLT_MIN);
+
+            split.sah = FLT_MAX;
+            InitBoxToInverseMax(split.leftBox);
+            InitBoxToInverseMax(split.rightBox);
+
+            for (UINT axis = 0; axis < 3; ++axis)
+            {
+                const float extent = centroidBox.maxArr[axis] - centroidBox.minArr[axis];
+                if (!(extent > 0))
+                    continue;
+
+                const float rangeMin = centroidBox.minArr[axis];
+                const float scale = (NUM_OBJECT_BINS * (1.f - 1e-6f)) / extent;
+
+                AABB binBoxes[NUM_OBJECT_BINS];
+                UINT32 binCounts[NUM_OBJECT_BINS] = {};
+                for (UINT j = 0; j < NUM_OBJECT_BINS; ++j)
+                {
+                    InitBoxToInverseMax(binBoxes[j]);
+                }
+
+                for (const Reference& reference : task.references)
+                {
+                    const int bin = (int)((GetCentroid(reference.box, axis) - rangeMin) * scale);
+                    const UINT clampedBin = (UINT)std::min(std::max(bin, 0), (int)NUM_OBJECT_BINS - 1);
+                    binCounts[clampedBin]++;
+                    AddExtentToBox(binBoxes[clampedBin], reference.box);
+                }
+
+                float rightAreas[NUM_OBJECT_BINS];
+                AABB rightBoxes[NUM_OBJECT_BINS];
+                AABB rightAccum;
+                InitBoxToInverseMax(rightAccum);
+                for (UINT j = NUM_OBJECT_BINS - 1; j > 0; --j)
+                {
+                    if (binCounts[j])
+                    {
+                        AddExtentToBox(rightAccum, binBoxes[j]);
+                    }
+                    rightAreas[j] = ComputeBoxSurfaceArea(rightAccum);
+                    rightBoxes[j] = rightAccum;
+                }
+
+                AABB leftAccum;
+                InitBoxToInverseMax(leftAccum);
+                UINT32 numOnLeft = 0;
+                for (UINT j = 1; j < NUM_OBJECT_BINS; ++j)
+                {
+                    if (binCounts[j - 1])
+                    {
+                        AddExtentToBox(leftAccum, binBoxes[j - 1]);
+                        numOnLeft += binCounts[j - 1];
+                    }
+
+                    const UINT32 numOnRight = numReferences - numOnLeft;
+                    if (numOnLeft == 0 || numOnRight == 0)
+                        continue;
+
+                    const float sah = (numOnLeft * ComputeBoxSurfaceArea(leftAccum) + numOnRight * rightAreas[j]) * normalizeToParent;
+                    if (sah < split.sah)
+                    {
+                        split.sah = sah;
+                        split.axis = axis;
+                        split.bin = j;
+                        split.leftBox = leftAccum;
+                        split.rightBox = rightBoxes[j];
+                    }
+                }
+            }
+
+            return split.sah < FLT_MAX;
+        }
+
+        void PerformObjectSplit(
+            BuildTask& task,
+            const ObjectSplit& split,
+            BuildTask& left,
+            BuildTask& right)
+        {
+            // Recompute the bins exactly the way FindObjectSplit did, so rounding can't move a reference across
+            // the plane
+            float rangeMin = FLT_MAX, rangeMax = -FLT_MAX;
+            for (const Reference& reference : task.references)
+            {
+                rangeMin = std::min(rangeMin, GetCentroid(reference.box, split.axis));
+                rangeMax = std::max(rangeMax, GetCentroid(reference.box, split.axis));
+            }
+            const float scale = (NUM_OBJECT_BINS * (1.f - 1e-6f)) / (rangeMax - rangeMin);
+            const int splitBin = (int)split.bin;
+
+            InitBoxToInverseMax(left.box);
+            InitBoxToInverseMax(right.box);
+            for (const Reference& reference : task.references)
+            {
+                const int bin = std::min(std::max((int)((GetCentroid(reference.box, split.axis) - rangeMin) * scale), 0), (int)NUM_OBJECT_BINS - 1);
+                BuildTask& child = (bin < splitBin) ? left : right;
+                child.references.push_back(reference);
+                AddExtentToBox(child.box, reference.box);
+            }
+        }
+
+        //
+        // Clips the part of the triangle inside reference.box against the plane at position on axis, giving the
+        // boxes of both sides. Either box comes back empty when the triangle doesn't reach that side.
+        //
+        void SplitReference(
+            const Reference& reference,
+            UINT axis,
+            float position,
+            Reference& left,
+            Reference& right) const
+        {
+            left.primitive = right.primitive = reference.primitive;
+            InitBoxToInverseMax(left.box);
+            InitBoxToInverseMax(right.box);
+
+            const float* pTriVerts = &m_triangleVertices[reference.primitive * 9];
+            for (UINT i = 0; i < 3; ++i)
+            {
+                const float* v0 = &pTriVerts[i * 3];
+                const float* v1 = &pTriVerts[((i + 1) % 3) * 3];
+                const XMFLOAT3 p0(v0[0], v0[1], v0[2]);
+
+                if (v0[axis] <= position)
+                {
+                    AddPointToBox(left.box, p0);
+                }
+                if (v0[axis] >= position)
+                {
+                    AddPointToBox(right.box, p0);
+                }
+
+                if ((v0[axis] < position && v1[axis] > position) || (v0[axis] > position && v1[axis] < position))
+                {
+                    const float t = (position - v0[axis]) / (v1[axis] - v0[axis]);
+                    float intersection[3];
+                    for (UINT k = 0; k < 3; ++k)
+                    {
+                        intersection[k] = v0[k] + (v1[k] - v0[k]) * t;
+                    }
+                    intersection[axis] = position;
+
+                    const XMFLOAT3 p(intersection[0], intersection[1], intersection[2]);
+                    AddPointToBox(left.box, p);
+                    AddPointToBox(right.box, p);
+                }
+            }
+
+            // Same padding as ComputeTriangleBox, so flat and axis aligned pieces still have volume. The left
+            // piece ends slightly past the plane, which also keeps rays grazing the plane from slipping through.
+            for (UINT k = 0; k < 3; ++k)
+            {
+                left.box.maxArr[k] += AABB_Min_Padding;
+                right.box.maxArr[k] += AABB_Min_Padding;
+            }
+
+            IntersectBoxes(left.box, reference.box);
+            IntersectBoxes(right.box, reference.box);
+        }
+
+        void FindSpatialSplit(
+            const BuildTask& task,
+            SpatialSplit& split)
+        {
+            const UINT32 numReferences = (UINT32)task.references.size();
+            const float normalizeToParent = 1.f / std::max(ComputeBoxSurfaceArea(task.box), FLT_MIN);
+
+            for (UINT axis = 0; axis < 3; ++axis)
+            {
+                const float rangeMin = task.box.minArr[axis];
+                const float extent = task.box.maxArr[axis] - rangeMin;
+                if (!(extent > 0))
+                    continue;
+
+                const float binWidth = extent / NUM_SPATIAL_BINS;
+                const float scale = 1.f / binWidth;
+                auto getBin = [&](float position) -> UINT
+                {
+                    const int bin = (int)((position - rangeMin) * scale);
+                    return (UINT)std::min(std::max(bin, 0), (int)NUM_SPATIAL_BINS - 1);
+                };
+
+                AABB binBoxes[NUM_SPATIAL_BINS];
+                UINT32 entries[NUM_SPATIAL_BINS] = {};
+                UINT32 exits[NUM_SPATIAL_BINS] = {};
+                for (UINT j = 0; j < NUM_SPATIAL_BINS; ++j)
+                {
+                    InitBoxToInverseMax(binBoxes[j]);
+                }
+
+                // Chop every reference into the bins it spans, clipping the triangle at each bin boundary.
+                // References that can't be duplicated stay whole in the bin of their centroid.
+                for (const Reference& reference : task.references)
+                {
+                    if (!m_canDuplicate[reference.primitive])
+                    {
+                        const UINT bin = getBin(GetCentroid(reference.box, axis));
+                        AddExtentToBox(binBoxes[bin], reference.box);
+                        entries[bin]++;
+                        exits[bin]++;
+                        continue;
+                    }
+
+                    const UINT firstBin = getBin(reference.box.minArr[axis]);
+                    const UINT lastBin = std::max(getBin(reference.box.maxArr[axis]), firstBin);
+
+                    Reference remaining = reference;
+                    for (UINT j = firstBin; j < lastBin; ++j)
+                    {
+                        Reference leftPiece, rightPiece;
+                        SplitReference(remaining, axis, rangeMin + binWidth * (j + 1), leftPiece, rightPiece);
+                        if (!IsBoxEmpty(leftPiece.box))
+                        {
+                            AddExtentToBox(binBoxes[j], leftPiece.box);
+                        }
+                        remaining = rightPiece;
+                    }
+                    if (!IsBoxEmpty(remaining.box))
+                    {
+                        AddExtentToBox(binBoxes[lastBin], remaining.box);
+                    }
+
+                    entries[firstBin]++;
+                    exits[lastBin]++;
+                }
+
+                float rightAreas[NUM_SPATIAL_BINS];
+                UINT32 rightCounts[NUM_SPATIAL_BINS];
+                AABB rightAccum;
+                InitBoxToInverseMax(rightAccum);
+                UINT32 numOnRight = 0;
+                for (UINT j = NUM_SPATIAL_BINS - 1; j > 0; --j)
+                {
+                    AddExtentToBox(rightAccum, binBoxes[j]);
+                    numOnRight += exits[j];
+                    rightAreas[j] = ComputeBoxSurfaceArea(rightAccum);
+                    rightCounts[j] = numOnRight;
+                }
+
+                AABB leftAccum;
+                InitBoxToInverseMax(leftAccum);
+                UINT32 numOnLeft = 0;
+                for (UINT j = 1; j < NUM_SPATIAL_BINS; ++j)
+                {
+                    AddExtentToBox(leftAccum, binBoxes[j - 1]);
+                    numOnLeft += entries[j - 1];
+
+                    const UINT32 numOnRightOfPlane = rightCounts[j];
+                    if (numOnLeft == 0 || numOnRightOfPlane == 0)
+                        continue;
+
+                    // Skip planes that would duplicate more references than the budget has left
+                    const UINT32 numDuplicates = numOnLeft + numOnRightOfPlane - numReferences;
+                    if (numDuplicates > m_remainingDuplicates)
+                        continue;
+
+                    const float sah = (numOnLeft * ComputeBoxSurfaceArea(leftAccum) + numOnRightOfPlane * rightAreas[j]) * normalizeToParent;
+                    if (sah < split.sah)
+                    {
+                        split.sah = sah;
+                        split.axis = axis;
+                        split.bin = j;
+                        split.position = rangeMin + binWidth * j;
+                        split.numLeft = numOnLeft;
+                        split.numRight = numOnRightOfPlane;
+                    }
+                }
+            }
+        }
+
+        //
+        // Returns false, leaving the children to be rebuilt by another split, if every reference ended up on one
+        // side
+        //
+        bool PerformSpatialSplit(
+            BuildTask& task,
+            const SpatialSplit& split,
+            BuildTask& left,
+            BuildTask& right)
+        {
+            const UINT axis = split.axis;
+            const float rangeMin = task.box.minArr[axis];
+            const float scale = 1.f / ((task.box.maxArr[axis] - rangeMin) / NUM_SPATIAL_BINS);
+            const UINT splitBin = split.bin;
+
+            left.references.reserve(split.numLeft);
+            right.references.reserve(split.numRight);
+            InitBoxToInverseMax(left.box);
+            InitBoxToInverseMax(right.box);
+
+            auto getBin = [&](float position) -> UINT
+            {
+                const int bin = (int)((position - rangeMin) * scale);
+                return (UINT)std::min(std::max(bin, 0), (int)NUM_SPATIAL_BINS - 1);
+            };
+
+            // Classify with the same bin mapping FindSpatialSplit used so the counts charged to the budget match
+            for (const Reference& reference : task.references)
+            {
+                UINT firstBin, lastBin;
+                if (m_canDuplicate[reference.primitive])
+                {
+                    firstBin = getBin(reference.box.minArr[axis]);
+                    lastBin = std::max(getBin(reference.box.maxArr[axis]), firstBin);
+                }
+                else
+                {
+                    firstBin = lastBin = getBin(GetCentroid(reference.box, axis));
+                }
+
+                if (lastBin < splitBin)
+                {
+                    left.references.push_back(reference);
+                    AddExtentToBox(left.box, reference.box);
+                }
+                else if (firstBin >= splitBin)
+                {
+                    right.references.push_back(reference);
+                    AddExtentToBox(right.box, reference.box);
+                }
+                else
+                {
+                    Reference leftPiece, rightPiece;
+                    SplitReference(reference, axis, split.position, leftPiece, rightPiece);
+
+                    // The clipped triangle can miss one side when only the padding of its box crossed the plane
+                    const bool reachesLeft = !IsBoxEmpty(leftPiece.box);
+                    const bool reachesRight = !IsBoxEmpty(rightPiece.box);
+                    if (reachesLeft && reachesRight)
+                    {
+                        left.references.push_back(leftPiece);
+                        AddExtentToBox(left.box, leftPiece.box);
+                        right.references.push_back(rightPiece);
+                        AddExtentToBox(right.box, rightPiece.box);
+                        m_remainingDuplicates -= (m_remainingDuplicates > 0) ? 1 : 0;
+                    }
+                    else
+                    {
+                        BuildTask& child = reachesRight ? right : left;
+                        child.references.push_back(reference);
+                        AddExtentToBox(child.box, reference.box);
+                    }
+                }
+            }
+
+            return !left.references.empty() && !right.references.empty();
+        }
+
+        //
+        // Writes the nodes depth-first with the right child after its parent and the left subtree after the
+        // right one, the same layout BinnedSahBuilder produces
+        //
+        void ReorderNodes(
+            std::vector<AABBNode>& nodes)
+        {
+            nodes.resize(m_nodes.size());
+
+            std::vector<UINT32> remap(m_nodes.size());
+            std::vector<UINT32> stack;
+            stack.push_back(0);
+            UINT32 numNodes = 0;
+            while (!stack.empty())
+            {
+                const UINT32 nodeIndex = stack.back();
+                stack.pop_back();
+                remap[nodeIndex] = numNodes++;
+
+                const AABBNode& node = m_nodes[nodeIndex];
+                if (!node.leaf)
+                {
+                    stack.push_back(node.internalNode.leftNodeIndex);
+                    stack.push_back(node.rightNodeIndex);
+                }
+            }
+
+            for (UINT32 i = 0; i < (UINT32)m_nodes.size(); ++i)
+            {
+                AABBNode& node = nodes[remap[i]];
+                node = m_nodes[i];
+                if (!node.leaf)
+                {
+                    node.internalNode.leftNodeIndex = remap[node.internalNode.leftNodeIndex];
+                    node.rightNodeIndex = remap[node.rightNodeIndex];
+                }
+            }
+        }
+
+        const std::vector<AABB>&    m_boxes;
+        const std::vector<float>&   m_triangleVertices;
+        const UINT32                m_maxTrisInLeaf;
+        UINT32                      m_remainingDuplicates;
+        float                       m_minOverlapArea;
+
+        std::vector<AABBNode>       m_nodes;
+        std::vector<UINT32>         m_leafReferences;
+        std::vector<BYTE>           m_canDuplicate;
+    };
+
+    //
+    // A spatialSplitBudget above 0 builds with SpatialSplitBvhBuilder, allowing up to that fraction of the
+    // triangle count in extra primitive references
+    //
+    void BuildUniformBVH(
+        _In_  UINT NumElements,
+        _In_reads_opt_(NumElements)  const D3D12_RAYTRACING_GEOMETRY_DESC *pGeometries,
+        float spatialSplitBudget,
+        BVH &bvh)
+    {
+        //
+        // Compute number of triangles
+        //
+
+        UINT    totalNumberOfTriangles = 0;
+        std::vector<UINT> firstTriangleOfGeometry(NumElements);
+
+        for (UINT i = 0; i < NumElements; ++i)
+        {
+            auto &geometry = pGeometries[i];
+            if (geometry.Type == D3D12_RAYTRACING_GEOMETRY_TYPE_TRIANGLES)
+            {
+                firstTriangleOfGeometry[i] = totalNumberOfTriangles;
+                totalNumberOfTriangles += GetPrimitiveCountFromGeometryDesc(geometry);
+            }
+            else
+            {
+                throw - 1; // Intersection shaders not supported yet
+            }
+
+        }
+
+        BuildTaskPool* pPool = GetBuildTaskPool(totalNumberOfTriangles);
+
+        //
+        // Create AABBs
+        //
+
+        std::vector<AABB> boxes;
+        boxes.resize(totalNumberOfTriangles);
+
+        std::vector<PrimitiveMetaData> primitiveMetaData;
+        primitiveMetaData.resize(totalNumberOfTriangles);
+
+        std::vector<float>  triangleVertices;
+        triangleVertices.resize(totalNumberOfTriangles * 9);
+
+        for (UINT i = 0; i < NumElements; ++i)
+        {
+            auto &geometry = pGeometries[i];
+            auto &triangles = geometry.Triangles;
+            const UINT numTris = GetPrimitiveCountFromGeometryDesc(geometry);
+            if (numTris == 0)
+            {
+                continue;
+            }
+
+            const TriangleReader reader(triangles);
+            const UINT firstTriangle = firstTriangleOfGeometry[i];
+            ParallelFor(pPool, numTris, kTriangleChunkSize, [&](UINT begin, UINT end)
+            {
+                for (UINT j = begin; j < end; ++j)
+                {
+                    const UINT triangleIndex = firstTriangle + j;
+
+                    float* pTriVerts = &triangleVertices[triangleIndex * 9];
+                    reader.LoadTriangle(j, pTriVerts);
+                    ComputeTriangleBox(pTriVerts, boxes[triangleIndex]);
+
+                    // Create out internal triangle indices.
+                    PrimitiveMetaData metadata;
+                    metadata.GeometryContributionToHitGroupIndex = i;
+                    metadata.PrimitiveIndex = triangleIndex;
+                    metadata.GeometryFlags = geometry.Flags;
+                    primitiveMetaData[triangleIndex] = metadata;
+                }
+            });
+        }
+
+        //
+        // Create a BVH
+        //
+
+        if (spatialSplitBudget > 0)
+        {
+            SpatialSplitBvhBuilder builder(boxes, triangleVertices, MAX_TRIS_IN_LEAF, spatialSplitBudget);
+            builder.Build(bvh.m_nodes, primitiveMetaData, bvh.m_metadata);
+        }
+        else
+        {
+            BuildBVH(bvh.m_nodes, boxes, primitiveMetaData, bvh.m_metadata, MAX_TRIS_IN_LEAF, pPool);
+        }
+
+        //
+        // Now copy and compress geometry
+        //
+
+        // Copy verts, once per leaf reference since spatial splits can reference a triangle from several leaves
+        const UINT numTris = (UINT)bvh.m_metadata.size();
+        bvh.m_triangles.resize(numTris * 3 * 3);
+        assert(bvh.m_triangles.size() >= triangleVertices.size());
+        assert(sizeof(bvh.m_triangles[0]) == sizeof(triangleVertices[0]));
+
+        ParallelFor(pPool, numTris, kTriangleChunkSize, [&](UINT begin, UINT end)
+        {
+            for (UINT i = begin; i < end; ++i)
+            {
+                UINT inputIndex = bvh.m_metadata[i].PrimitiveIndex;
+                float *pInputTriangle = &triangleVertices.data()[inputIndex * 9];
+                float* pOutputTriangle = &bvh.m_triangles[i * 9];
+
+                // Construct three planes and write to pPlanes
+                XMVECTOR V0 = XMVectorSet(pInputTriangle[0], pInputTriangle[1], pInputTriangle[2], 0.0f);
+                XMVECTOR V1 = XMVectorSet(pInputTriangle[3], pInputTriangle[4], pInputTriangle[5], 0.0f);
+                XMVECTOR V2 = XMVectorSet(pInputTriangle[6], pInputTriangle[7], pInputTriangle[8], 0.0f);
+
+                XMStoreFloat3((XMFLOAT3*)pOutputTriangle + 0, V0);
+                XMStoreFloat3((XMFLOAT3*)pOutputTriangle + 1, V1);
+                XMStoreFloat3((XMFLOAT3*)pOutputTriangle + 2, V2);
+
+                // PrimitiveIndex() is relative to its geometry, same as the GPU builder
+                PrimitiveMetaData &metadata = bvh.m_metadata[i];
+                metadata.PrimitiveIndex = inputIndex - firstTriangleOfGeometry[metadata.GeometryContributionToHitGroupIndex];
+            }
+        });
+    }
+
+    struct TopLevelBVH
+    {
+        std::vector<AABBNode>       m_nodes;
+        std::vector<BVHMetadata>    m_metadata;
+    };
+
+    static
+        void InverseAffineTransform(
+            const float (&transform)[3][4],
+            float (&inverse)[3][4])
+    {
+        const float a = transform[0][0], b = transform[0][1], c = transform[0][2];
+        const float d = transform[1][0], e = transform[1][1], f = transform[1][2];
+        const float g = transform[2][0], h = transform[2][1], i = transform[2][2];
+
+        const float cofactor00 = e * i - f * h;
+        const float cofactor01 = f * g - d * i;
+        const float cofactor02 = d * h - e * g;
+        const float determinant = a * cofactor00 + b * cofactor01 + c * cofactor02;
+        const float rcpDeterminant = (determinant != 0.0f) ? 1.0f / determinant : 0.0f;
+
+        inverse[0][0] = cofactor00 * rcpDeterminant;
+        inverse[0][1] = (c * h - b * i) * rcpDeterminant;
+        inverse[0][2] = (b * f - c * e) * rcpDeterminant;
+        inverse[1][0] = cofactor01 * rcpDeterminant;
+        inverse[1][1] = (a * i - c * g) * rcpDeterminant;
+        inverse[1][2] = (c * d - a * f) * rcpDeterminant;
+        inverse[2][0] = cofactor02 * rcpDeterminant;
+        inverse[2][1] = (b * g - a * h) * rcpDeterminant;
+        inverse[2][2] = (a * e - b * d) * rcpDeterminant;
+
+        for (UINT row = 0; row < 3; ++row)
+        {
+            inverse[row][3] = -(inverse[row][0] * transform[0][3] +
+                inverse[row][1] * transform[1][3] +
+                inverse[row][2] * transform[2][3]);
+        }
+    }
+
+    //
+    // Bounds the transformed box of a node (center/half-extent form)
+    //
+    static
+        void TransformNodeBox(
+            const AABBNode& node,
+            const float (&transform)[3][4],
+            AABB& box)
+    {
+        for (UINT row = 0; row < 3; ++row)
+        {
+            float center = transform[row][3];
+            float halfDim = 0;
+            for (UINT column = 0; column < 3; ++column)
+            {
+                center += transform[row][column] * node.center[column];
+                halfDim += fabsf(transform[row][column]) * node.halfDim[column];
+            }
+            box.minArr[row] = center - halfDim;
+            box.maxArr[row] = center + halfDim;
+        }
+    }
+
+    static
+        void LoadInstance(
+            UINT instanceIndex,
+            D3D12_ELEMENTS_LAYOUT DescsLayout,
+            D3D12_GPU_VIRTUAL_ADDRESS InstanceDescs,
+            BVHMetadata& metadata,
+            AABB& box)
+    {
+        const D3D12_RAYTRACING_FALLBACK_INSTANCE_DESC &instanceDesc = (DescsLayout == D3D12_ELEMENTS_LAYOUT_ARRAY_OF_POINTERS) ?
+            *((const D3D12_RAYTRACING_FALLBACK_INSTANCE_DESC *const *)InstanceDescs)[instanceIndex] :
+            ((const D3D12_RAYTRACING_FALLBACK_INSTANCE_DESC *)InstanceDescs)[instanceIndex];
+
+        const BYTE *pBottomLevel = (const BYTE *)instanceDesc.AccelerationStructure.GpuVA;
+        const BVHOffsets &bottomLevelOffsets = *(const BVHOffsets *)pBottomLevel;
+        const AABBNode &bottomLevelRoot = *(const AABBNode *)(pBottomLevel + bottomLevelOffsets.offsetToBoxes);
+        TransformNodeBox(bottomLevelRoot, instanceDesc.Transform, box);
+
+        metadata.instanceDesc = instanceDesc;
+        InverseAffineTransform(instanceDesc.Transform, metadata.instanceDesc.Transform);
+        memcpy(metadata.ObjectToWorld, instanceDesc.Transform, sizeof(metadata.ObjectToWorld));
+        metadata.InstanceIndex = instanceIndex;
+    }
+
+    //
+    // Instance descs are read from CPU memory, and their AccelerationStructure pointers must be CPU addresses of
+    // bottom levels built by BuildRaytracingAccelerationStructureOnCpu. The output matches the GPU top level
+    // layout: leaves index an array of BVHMetadata whose instance transform holds WorldToObject.
+    //
+    void BuildTopLevelBVH(
+        _In_  UINT NumElements,
+        _In_  D3D12_ELEMENTS_LAYOUT DescsLayout,
+        _In_  D3D12_GPU_VIRTUAL_ADDRESS InstanceDescs,
+        TopLevelBVH &bvh)
+    {
+        std::vector<AABB> boxes(NumElements);
+        std::vector<BVHMetadata> instanceMetaData(NumElements);
+
+        for (UINT i = 0; i < NumElements; ++i)
+        {
+            LoadInstance(i, DescsLayout, InstanceDescs, instanceMetaData[i], boxes[i]);
+        }
+
+        BuildBVH(bvh.m_nodes, boxes, instanceMetaData, bvh.m_metadata, 1, nullptr);
+    }
+
+    //
+    // Refits the boxes of an existing hierarchy bottom-up from new leaf boxes, keeping its topology. The tree is
+    // cut into independent subtrees that are refit in parallel, then the few nodes above them are refit in
+    // reverse breadth-first order.
+    //
+    // Deformation makes the original splits worse over time. With rotate set, every internal node also tries
+    // the four rotations of Kensler, "Tree Rotations for Improving Bounding Volume Hierarchies", swapping one
+    // child with a grandchild under the other child when that shrinks the other child's box. Rotations only
+    // rewrite child indices, so nodes no longer follow "right child = parent + 1" afterwards.
+    //
+    class BvhRefitter
+    {
+    public:
+        BvhRefitter(
+            AABBNode* pNodes,
+            UINT numNodes,
+            bool rotate,
+            BuildTaskPool* pPool) :
+            m_pNodes(pNodes),
+            m_boxes(numNodes),
+            m_rotate(rotate),
+            m_pPool(pPool)
+        {
+        }
+
+        // computeLeafBox(const AABBNode& leaf, AABB& box) bounds the primitives of a leaf
+        template <typename LeafBoxFunc>
+        void Refit(
+            const LeafBoxFunc& computeLeafBox)
+        {
+            const UINT numSubtrees = m_pPool ? m_pPool->GetThreadCount() * 8 : 1;
+
+            std::vector<UINT> topNodes;
+            std::vector<UINT> subtreeRoots;
+            std::deque<UINT> queue(1, 0u);
+            while (!queue.empty())
+            {
+                const UINT nodeIndex = queue.front();
+                queue.pop_front();
+
+                const AABBNode& node = m_pNodes[nodeIndex];
+                if (node.leaf || queue.size() + subtreeRoots.size() + 1 >= numSubtrees)
+                {
+                    subtreeRoots.push_back(nodeIndex);
+                }
+                else
+                {
+                    topNodes.push_back(nodeIndex);
+                    queue.push_back(node.internalNode.leftNodeIndex);
+                    queue.push_back(node.rightNodeIndex);
+                }
+            }
+
+            ParallelFor(m_pPool, (UINT)subtreeRoots.size(), 1, [&](UINT begin, UINT end)
+            {
+                std::vector<UINT> stack;
+                std::vector<UINT> preOrder;
+                for (UINT i = begin; i < end; ++i)
+                {
+                    stack.push_back(subtreeRoots[i]);
+                    preOrder.clear();
+                    while (!stack.empty())
+                    {
+                        const UINT nodeIndex = stack.back();
+                        stack.pop_back();
+                        preOrder.push_back(nodeIndex);
+
+                        const AABBNode& node = m_pNodes[nodeIndex];
+                        if (!node.leaf)
+                        {
+                            stack.push_back(node.internalNode.leftNodeIndex);
+                            stack.push_back(node.rightNodeIndex);
+                        }
+                    }
+
+                    // Every node comes after its descendants in reverse pre-order
+                    for (auto nodeIndex = preOrder.rbegin(); nodeIndex != preOrder.rend(); ++nodeIndex)
+                    {
+                        RefitNode(*nodeIndex, computeLeafBox);
+                    }
+                }
+            });
+
+            for (auto nodeIndex = topNodes.rbegin(); nodeIndex != topNodes.rend(); ++nodeIndex)
+            {
+                RefitNode(*nodeIndex, computeLeafBox);
+            }
+        }
+
+    private:
+        template <typename LeafBoxFunc>
+        void RefitNode(
+            UINT nodeIndex,
+            const LeafBoxFunc& computeLeafBox)
+        {
+            AABBNode& node = m_pNodes[nodeIndex];
+            AABB& box = m_boxes[nodeIndex];
+            if (node.leaf)
+            {
+                if (node.numTriangles)
+                {
+                    computeLeafBox(node, box);
+                }
+                else
+                {
+                    // Only the root of an empty structure, same as the initial build
+                    box = AABB();
+                }
+            }
+            else
+            {
+                if (m_rotate)
+                {
+                    Rotate(node);
+                }
+
+                box = m_boxes[node.internalNode.leftNodeIndex];
+                AddExtentToBox(box, m_boxes[node.rightNodeIndex]);
+            }
+            SetNodeBox(node, box);
+        }
+
+        void Rotate(
+            AABBNode& node)
+        {
+            const UINT children[2] = { node.internalNode.leftNodeIndex, node.rightNodeIndex };
+
+            float bestGain = 0.0f;
+            UINT bestChild = 0;
+            UINT bestGrandchild = 0;
+            AABB bestBox;
+            for (UINT side = 0; side < 2; ++side)
+            {
+                const AABBNode& child = m_pNodes[children[side]];
+                if (child.leaf)
+                    continue;
+
+                const UINT sibling = children[1 - side];
+                const UINT grandchildren[2] = { child.internalNode.leftNodeIndex, child.rightNodeIndex };
+                const float childArea = ComputeBoxSurfaceArea(m_boxes[children[side]]);
+                for (UINT k = 0; k < 2; ++k)
+                {
+                    // The sibling moves under child in place of grandchildren[k]
+                    AABB rotatedBox = m_boxes[sibling];
+                    AddExtentToBox(rotatedBox, m_boxes[grandchildren[1 - k]]);
+
+                    const float gain = childArea - ComputeBoxSurfaceArea(rotatedBox);
+                    if (gain > bestGain)
+                    {
+                        bestGain = gain;
+                        bestChild = children[side];
+                        bestGrandchild = grandchildren[k];
+                        bestBox = rotatedBox;
+                    }
+                }
+            }
+
+            if (bestGain > 0.0f)
+            {
+                const UINT sibling = (bestChild == children[0]) ? children[1] : children[0];
+                AABBNode& child = m_pNodes[bestChild];
+                ReplaceChild(node, sibling, bestGrandchild);
+                ReplaceChild(child, bestGrandchild, sibling);
+                m_boxes[bestChild] = bestBox;
+                SetNodeBox(child, bestBox);
+            }
+        }
+
+        static void ReplaceChild(
+            AABBNode& node,
+            UINT oldChild,
+            UINT newChild)
+        {
+            if (node.internalNode.leftNodeIndex == oldChild)
+            {
+                node.internalNode.leftNodeIndex = newChild;
+            }
+            else
+            {
+                node.rightNodeIndex = newChild;
+            }
+        }
+
+        AABBNode*           m_pNodes;
+        std::vector<AABB>   m_boxes;
+        const bool          m_rotate;
+        BuildTaskPool*      m_pPool;
+    };
+
+    //
+    // Reloads the triangles of every leaf from the geometry descs and refits the bottom level in place. The
+    // geometry descs must describe the same triangles as the original build, only vertex positions may change.
+    //
+    void RefitBottomLevelBVH(
+        _In_  UINT NumElements,
+        _In_reads_opt_(NumElements)  const D3D12_RAYTRACING_GEOMETRY_DESC *pGeometries,
+        bool rotate,
+        BYTE *pData)
+    {
+        const BVHOffsets &offsets = *(const BVHOffsets *)pData;
+        AABBNode *pNodes = (AABBNode *)(pData + offsets.offsetToBoxes);
+        Primitive *pPrimitives = (Primitive *)(pData + offsets.offsetToVertices);
+        const PrimitiveMetaData *pMetaData = (const PrimitiveMetaData *)(pData + offsets.offsetToPrimitiveMetaData);
+        const UINT numNodes = (offsets.offsetToVertices - offsets.offsetToBoxes) / sizeof(AABBNode);
+        const UINT numPrimitives = (offsets.offsetToPrimitiveMetaData - offsets.offsetToVertices) / sizeof(Primitive);
+
+        std::vector<TriangleReader> readers;
+        readers.reserve(NumElements);
+        for (UINT i = 0; i < NumElements; ++i)
+        {
+            readers.emplace_back(pGeometries[i].Triangles);
+        }
+
+        BuildTaskPool* pPool = GetBuildTaskPool(numPrimitives);
+        ParallelFor(pPool, numPrimitives, kTriangleChunkSize, [&](UINT begin, UINT end)
+        {
+            for (UINT i = begin; i < end; ++i)
+            {
+                const PrimitiveMetaData &metadata = pMetaData[i];
+                readers[metadata.GeometryContributionToHitGroupIndex].LoadTriangle(metadata.PrimitiveIndex, (float *)&pPrimitives[i].triangle);
+            }
+        });
+
+        BvhRefitter refitter(pNodes, numNodes, rotate, pPool);
+        refitter.Refit([pPrimitives](const AABBNode &leaf, AABB &box)
+        {
+            InitBoxToInverseMax(box);
+            const UINT firstPrimitive = leaf.leafNode.firstTriangleId;
+            for (UINT i = firstPrimitive; i < firstPrimitive + leaf.numTriangles; ++i)
+            {
+                AABB triangleBox;
+                ComputeTriangleBox((const float *)&pPrimitives[i].triangle, triangleBox);
+                AddExtentToBox(box, triangleBox);
+            }
+        });
+    }
+
+    //
+    // Reloads the instance descs and refits the top level in place. Instance count and order must match the
+    // original build.
+    //
+    void RefitTopLevelBVH(
+        _In_  UINT NumElements,
+        _In_  D3D12_ELEMENTS_LAYOUT DescsLayout,
+        _In_  D3D12_GPU_VIRTUAL_ADDRESS InstanceDescs,
+        bool rotate,
+        BYTE *pData)
+    {
+        const BVHOffsets &offsets = *(const BVHOffsets *)pData;
+        AABBNode *pNodes = (AABBNode *)(pData + offsets.offsetToBoxes);
+        BVHMetadata *pInstances = (BVHMetadata *)(pData + offsets.offsetToVertices);
+        const UINT numNodes = (offsets.offsetToVertices - offsets.offsetToBoxes) / sizeof(AABBNode);
+        assert((offsets.totalSize - offsets.offsetToVertices) / sizeof(BVHMetadata) == NumElements);
+
+        std::vector<AABB> instanceBoxes(NumElements);
+        for (UINT i = 0; i < NumElements; ++i)
+        {
+            LoadInstance(pInstances[i].InstanceIndex, DescsLayout, InstanceDescs, pInstances[i], instanceBoxes[i]);
+        }
+
+        BvhRefitter refitter(pNodes, numNodes, rotate, nullptr);
+        refitter.Refit([&instanceBoxes](const AABBNode &leaf, AABB &box)
+        {
+            InitBoxToInverseMax(box);
+            const UINT firstInstance = leaf.leafNode.firstTriangleId;
+            for (UINT i = firstInstance; i < firstInstance + leaf.numTriangles; ++i)
+            {
+                AddExtentToBox(box, instanceBoxes[i]);
+            }
+        });
+    }
+}
+
+//
+// Bottom level builds that ask for PREFER_FAST_TRACE use spatial splits. Structures that allow updates don't,
+// since a refit regrows every split leaf to the whole triangle and leaves its duplicate references overlapping.
+//
+static
+    float GetSpatialSplitBudget(
+        _In_  const D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS &inputs,
+        _In_opt_ const CpuAccelerationStructureBuildOptions *pOptions)
+{
+    if (inputs.Type != D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL ||
+        !(inputs.Flags & D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_PREFER_FAST_TRACE) ||
+        (inputs.Flags & D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_ALLOW_UPDATE) ||
+        (inputs.Flags & D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_PERFORM_UPDATE))
+    {
+        return 0.0f;
+    }
+
+    return pOptions ? pOptions->SpatialSplitBudget : CPU_DEFAULT_SPATIAL_SPLIT_BUDGET;
+}
+
+static
+    CpuAccelerationStructureBuilderType GetBuilderType(
+        _In_opt_ const CpuAccelerationStructureBuildOptions *pOptions)
+{
+    return pOptions ? pOptions->BuilderType : CPU_ACCELERATION_STRUCTURE_BUILDER_SAH;
+}
+
+void BuildRaytracingAccelerationStructureOnCpu(
+    _In_  const D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC *pDesc,
+    _Out_ void *pData,
+    _In_opt_ const CpuAccelerationStructureBuildOptions *pOptions)
+{
+    const D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS &inputs = pDesc->Inputs;
+    if (inputs.Flags & D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_PERFORM_UPDATE)
+    {
+        BYTE *pSource = (BYTE *)pDesc->SourceAccelerationStructureData;
+        if (pSource && pSource != pData)
+        {
+            memcpy(pData, pSource, ((const BVHOffsets *)pSource)->totalSize);
+        }
+
+        const bool rotate = (inputs.Flags & D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_PREFER_FAST_TRACE) != 0;
+        if (inputs.Type == D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL)
+        {
+            FallbackLayer::RefitTopLevelBVH(inputs.NumDescs, inputs.DescsLayout, inputs.InstanceDescs, rotate, (BYTE *)pData);
+        }
+        else
+        {
+            FallbackLayer::RefitBottomLevelBVH(inputs.NumDescs, inputs.pGeometryDescs, rotate, (BYTE *)pData);
+        }
+        return;
+    }
+
+    const CpuAccelerationStructureBuilderType builderType = GetBuilderType(pOptions);
+    if (builderType != CPU_ACCELERATION_STRUCTURE_BUILDER_SAH)
+    {
+        const UINT numElements = (inputs.Type == D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL) ? inputs.NumDescs : GetTotalPrimitiveCount(inputs);
+        FallbackLayer::BuildTaskPool* pPool = FallbackLayer::GetBuildTaskPool(numElements);
+        FallbackLayer::CpuLBVHBuilder(pPool).BuildRaytracingAccelerationStructure(pDesc, pData, builderType == CPU_ACCELERATION_STRUCTURE_BUILDER_LBVH_64);
+        return;
+    }
+
+    if (pDesc->Inputs.Type == D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL)
+    {
+        FallbackLayer::TopLevelBVH bvh;
+        FallbackLayer::BuildTopLevelBVH(pDesc->Inputs.NumDescs, pDesc->Inputs.DescsLayout, pDesc->Inputs.InstanceDescs, bvh);
+
+        BYTE* outputData = (BYTE*)pData;
+        BVHOffsets offsets;
+        offsets.offsetToBoxes = sizeof(BVHOffsets);
+        const UINT sizeofBoxes = (UINT)(bvh.m_nodes.size() * sizeof(*bvh.m_nodes.data()));
+
+        // Top levels keep the instance metadata where bottom levels keep their vertices
+        offsets.offsetToVertices = offsets.offsetToBoxes + sizeofBoxes;
+        const UINT sizeofMetadata = (UINT)(bvh.m_metadata.size() * sizeof(*bvh.m_metadata.data()));
+        offsets.totalSize = offsets.offsetToVertices + sizeofMetadata;
+        offsets.offsetToPrimitiveMetaData = offsets.totalSize;
+
+        memcpy(outputData, &offsets, sizeof(offsets));
+        memcpy(outputData + offsets.offsetToBoxes, bvh.m_nodes.data(), sizeofBoxes);
+        memcpy(outputData + offsets.offsetToVertices, bvh.m_metadata.data(), sizeofMetadata);
+        return;
+    }
+
+    FallbackLayer::BVH bvh;
+    FallbackLayer::BuildUniformBVH(pDesc->Inputs.NumDescs, pDesc->Inputs.pGeometryDescs, GetSpatialSplitBudget(inputs, pOptions), bvh);
 
     BYTE* outputData = (BYTE*)pData;
     BVHOffsets offsets;
@@ -697,3 +2121,30 @@ void BuildRaytracingAccelerationStructureOnCpu(
     }
     memcpy(outputData + offsets.offsetToPrimitiveMetaData, bvh.m_metadata.data(), sizeofMetadata);
 }
+
+UINT64 GetRaytracingAccelerationStructureSizeOnCpu(
+    _In_  const D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS *pInputs,
+    _In_opt_ const CpuAccelerationStructureBuildOptions *pOptions)
+{
+    if (GetBuilderType(pOptions) != CPU_ACCELERATION_STRUCTURE_BUILDER_SAH)
+    {
+        return FallbackLayer::CpuLBVHBuilder::GetRequiredSize(*pInputs);
+    }
+
+    if (pInputs->Type == D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL)
+    {
+        const UINT64 numInstances = pInputs->NumDescs;
+        const UINT64 numNodes = std::max(2 * numInstances, 2ull) - 1;
+        return sizeof(BVHOffsets) + numNodes * sizeof(AABBNode) + numInstances * sizeof(BVHMetadata);
+    }
+
+    UINT64 numTriangles = 0;
+    for (UINT i = 0; i < pInputs->NumDescs; ++i)
+    {
+        numTriangles += GetPrimitiveCountFromGeometryDesc(pInputs->pGeometryDescs[i]);
+    }
+    numTriangles += FallbackLayer::GetMaxSpatialSplitDuplicates((UINT32)numTriangles, GetSpatialSplitBudget(*pInputs, pOptions));
+
+    const UINT64 numNodes = std::max(2 * numTriangles, 2ull) - 1;
+    return sizeof(BVHOffsets) + numNodes * sizeof(AABBNode) + numTriangles * (sizeof(Primitive) + sizeof(PrimitiveMetaData));
+}
@@ -0,0 +1,210 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace FallbackLayer
+{
+    //
+    // A small work-stealing pool used by the CPU builder. Every thread owns a deque of tasks: it pushes and pops
+    // its own work at the back and steals from the front of other threads' deques when it runs dry. Tasks are
+    // coarse (whole subtrees or large chunks of primitives) so a lock per deque is cheap enough. Idle workers
+    // sleep on a condition variable until a task is queued, so one pool can stay alive between builds.
+    //
+    class BuildTaskPool
+    {
+    public:
+        typedef std::function<void()> Task;
+
+        BuildTaskPool(UINT numThreads) :
+            m_queuedTasks(0),
+            m_shutdown(false)
+        {
+            m_queues.resize(std::max(numThreads, 1u));
+            for (auto& queue : m_queues)
+            {
+                queue.reset(new WorkQueue);
+            }
+
+            // The thread that owns the pool works on queue 0 while it waits
+            for (UINT i = 1; i < (UINT)m_queues.size(); ++i)
+            {
+                m_threads.emplace_back([this, i]() { WorkerMain(i); });
+            }
+        }
+
+        ~BuildTaskPool()
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_wakeLock);
+                m_shutdown = true;
+            }
+            m_wakeCondition.notify_all();
+
+            for (auto& thread : m_threads)
+            {
+                thread.join();
+            }
+        }
+
+        UINT GetThreadCount() const { return (UINT)m_queues.size(); }
+
+        // Queues a task on the calling thread's deque. pendingTasks is incremented now and decremented once the
+        // task has run.
+        void Spawn(Task&& task, std::atomic<UINT>& pendingTasks)
+        {
+            pendingTasks++;
+
+            {
+                WorkQueue& queue = *m_queues[s_queueIndex];
+                std::lock_guard<std::mutex> lock(queue.lock);
+                queue.tasks.emplace_back(std::move(task), &pendingTasks);
+                m_queuedTasks++;
+            }
+
+            // Taking the lock orders this against a sleeper that has just found no queued tasks
+            {
+                std::lock_guard<std::mutex> lock(m_wakeLock);
+            }
+            m_wakeCondition.notify_one();
+        }
+
+        // Runs queued tasks until pendingTasks drops to zero, sleeping while the remaining ones run elsewhere
+        void Wait(std::atomic<UINT>& pendingTasks)
+        {
+            while (pendingTasks.load(std::memory_order_acquire) != 0)
+            {
+                if (!RunOneTask())
+                {
+                    std::unique_lock<std::mutex> lock(m_wakeLock);
+                    m_wakeCondition.wait(lock, [&]()
+                    {
+                        return pendingTasks.load(std::memory_order_acquire) == 0 || m_queuedTasks.load() != 0;
+                    });
+                }
+            }
+        }
+
+    private:
+        struct WorkQueue
+        {
+            std::mutex lock;
+            std::deque<std::pair<Task, std::atomic<UINT>*>> tasks;
+        };
+
+        bool RunOneTask()
+        {
+            const UINT queueCount = (UINT)m_queues.size();
+            std::pair<Task, std::atomic<UINT>*> item;
+            bool found = false;
+
+            for (UINT i = 0; i < queueCount && !found; ++i)
+            {
+                const bool ownQueue = (i == 0);
+                WorkQueue& queue = *m_queues[(s_queueIndex + i) % queueCount];
+
+                std::lock_guard<std::mutex> lock(queue.lock);
+                if (!queue.tasks.empty())
+                {
+                    if (ownQueue)
+                    {
+                        item = std::move(queue.tasks.back());
+                        queue.tasks.pop_back();
+                    }
+                    else
+                    {
+                        item = std::move(queue.tasks.front());
+                        queue.tasks.pop_front();
+                    }
+                    m_queuedTasks--;
+                    found = true;
+                }
+            }
+
+            if (found)
+            {
+                item.first();
+
+                // The last task of a batch wakes whoever is waiting on it
+                if (item.second->fetch_sub(1, std::memory_order_acq_rel) == 1)
+                {
+                    {
+                        std::lock_guard<std::mutex> lock(m_wakeLock);
+                    }
+                    m_wakeCondition.notify_all();
+                }
+            }
+            return found;
+        }
+
+        void WorkerMain(UINT queueIndex)
+        {
+            s_queueIndex = queueIndex;
+            for (;;)
+            {
+                if (RunOneTask())
+                {
+                    continue;
+                }
+
+                std::unique_lock<std::mutex> lock(m_wakeLock);
+                m_wakeCondition.wait(lock, [this]() { return m_shutdown || m_queuedTasks.load() != 0; });
+                if (m_shutdown)
+                {
+                    return;
+                }
+            }
+        }
+
+        std::vector<std::unique_ptr<WorkQueue>> m_queues;
+        std::vector<std::thread> m_threads;
+        std::atomic<UINT> m_queuedTasks;
+
+        std::mutex m_wakeLock;
+        std::condition_variable m_wakeCondition;
+        bool m_shutdown;
+
+        static thread_local UINT s_queueIndex;
+    };
+
+    //
+    // Calls func(begin, end) over [0, count) in chunks of chunkSize, spread over the pool when there is one
+    //
+    template <typename Func>
+    static
+        void ParallelFor(
+            BuildTaskPool* pPool,
+            UINT count,
+            UINT chunkSize,
+            const Func& func)
+    {
+        if (!pPool || count <= chunkSize)
+        {
+            func(0u, count);
+            return;
+        }
+
+        std::atomic<UINT> pendingTasks(0);
+        for (UINT begin = chunkSize; begin < count; begin += chunkSize)
+        {
+            const UINT end = std::min(begin + chunkSize, count);
+            pPool->Spawn([&func, begin, end]() { func(begin, end); }, pendingTasks);
+        }
+
+        func(0u, chunkSize);
+        pPool->Wait(pendingTasks);
+    }
+}
@@ -0,0 +1,1391 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+#include "pch.h"
+#include "CpuBuildTaskPool.h"
+
+namespace FallbackLayer
+{
+    // Same values as RayTracingHelper.hlsli and TreeletReorderBindings.h
+    static const UINT kIsLeafFlag = 0x80000000;
+    static const UINT kIsProceduralGeometryFlag = 0x40000000;
+    static const float kAABBMinPadding = 0.001f;
+    static const UINT kFullTreeletSize = 7;
+    static const UINT kNumInternalTreeletNodes = kFullTreeletSize - 1;
+    static const UINT kNumTreeletSplitPermutations = 1 << kFullTreeletSize;
+    static const UINT kFullPartitionMask = kNumTreeletSplitPermutations - 1;
+    static const float kCostOfRayBoxIntersection = 1.2f;
+    static const float kCostOfRayTriangleIntersection = 1.0f;
+
+    static const UINT kElementChunkSize = 4 * 1024;
+    static const UINT kSortChunkSize = 64 * 1024;
+    static const UINT kRadixBits = 8;
+    static const UINT kRadixSize = 1 << kRadixBits;
+
+    // GPU-side BoundingBox, ie. the center/half extent form stored in AABBNode
+    struct BoundingBox
+    {
+        float center[3];
+        float halfDim[3];
+    };
+
+    static
+        void InitAABB(
+            AABB &aabb)
+    {
+        aabb.min = { FLT_MAX, FLT_MAX, FLT_MAX };
+        aabb.max = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+    }
+
+    static
+        AABB CombineAABB(
+            const AABB &aabb0,
+            const AABB &aabb1)
+    {
+        AABB parentAABB;
+        for (UINT axis = 0; axis < 3; ++axis)
+        {
+            parentAABB.minArr[axis] = std::min(aabb0.minArr[axis], aabb1.minArr[axis]);
+            parentAABB.maxArr[axis] = std::max(aabb0.maxArr[axis], aabb1.maxArr[axis]);
+        }
+        return parentAABB;
+    }
+
+    static
+        float ComputeBoxSurfaceArea(
+            const AABB &aabb)
+    {
+        const float dx = aabb.max.x - aabb.min.x;
+        const float dy = aabb.max.y - aabb.min.y;
+        const float dz = aabb.max.z - aabb.min.z;
+        return 2.0f * (dx * dy + dx * dz + dy * dz);
+    }
+
+    static
+        BoundingBox AABBtoBoundingBox(
+            const AABB &aabb)
+    {
+        BoundingBox box;
+        for (UINT axis = 0; axis < 3; ++axis)
+        {
+            box.center[axis] = (aabb.minArr[axis] + aabb.maxArr[axis]) * 0.5f;
+            box.halfDim[axis] = aabb.maxArr[axis] - box.center[axis];
+        }
+        return box;
+    }
+
+    static
+        AABB BoundingBoxToAABB(
+            const float (&center)[3],
+            const float (&halfDim)[3])
+    {
+        AABB aabb;
+        for (UINT axis = 0; axis < 3; ++axis)
+        {
+            aabb.minArr[axis] = center[axis] - halfDim[axis];
+            aabb.maxArr[axis] = center[axis] + halfDim[axis];
+        }
+        return aabb;
+    }
+
+    // GetBoxDataFromTriangle before the conversion to a BoundingBox
+    static
+        AABB GetTriangleAABB(
+            const Triangle &tri)
+    {
+        AABB aabb;
+        for (UINT axis = 0; axis < 3; ++axis)
+        {
+            const float v0 = (&tri.v0.x)[axis];
+            const float v1 = (&tri.v1.x)[axis];
+            const float v2 = (&tri.v2.x)[axis];
+            aabb.minArr[axis] = std::min(std::min(v0, v1), v2);
+            aabb.maxArr[axis] = std::max(std::max(v0, v1), v2);
+            aabb.minArr[axis] = std::min(aabb.minArr[axis], aabb.maxArr[axis] - kAABBMinPadding);
+        }
+        return aabb;
+    }
+
+    static
+        void WriteNode(
+            AABBNode &node,
+            const BoundingBox &box,
+            UINT flags0,
+            UINT flags1)
+    {
+        memcpy(node.center, box.center, sizeof(node.center));
+        memcpy(node.halfDim, box.halfDim, sizeof(node.halfDim));
+        node.nodeAllBits = flags0;
+        node.rightNodeIndex = flags1;
+    }
+
+    // mul(transform, float4(v, 1)) for every corner of the box
+    static
+        AABB TransformAABB(
+            const AABB &box,
+            const float4 (&transform)[3])
+    {
+        AABB transformedBox;
+        InitAABB(transformedBox);
+        for (UINT corner = 0; corner < 8; ++corner)
+        {
+            const float x = (corner & 4) ? box.max.x : box.min.x;
+            const float y = (corner & 2) ? box.max.y : box.min.y;
+            const float z = (corner & 1) ? box.max.z : box.min.z;
+            for (UINT row = 0; row < 3; ++row)
+            {
+                const float4 &r = transform[row];
+                const float v = r.x * x + r.y * y + r.z * z + r.w;
+                transformedBox.minArr[row] = std::min(transformedBox.minArr[row], v);
+                transformedBox.maxArr[row] = std::max(transformedBox.maxArr[row], v);
+            }
+        }
+        return transformedBox;
+    }
+
+    // InverseAffineTransform of RayTracingHelper.hlsli, with the products by 0 and 1 folded away
+    static
+        void InverseAffineTransform(
+            const float (&t)[3][4],
+            float (&inverse)[3][4])
+    {
+        const float determinant =
+            t[0][0] * t[1][1] * t[2][2] -
+            t[0][0] * t[2][1] * t[1][2] -
+            t[1][0] * t[0][1] * t[2][2] +
+            t[1][0] * t[2][1] * t[0][2] +
+            t[2][0] * t[0][1] * t[1][2] -
+            t[2][0] * t[1][1] * t[0][2];
+        const float invDet = 1.0f / determinant;
+
+        inverse[0][0] = invDet * (t[1][1] * t[2][2] - t[2][1] * t[1][2]);
+        inverse[1][0] = invDet * (t[1][2] * t[2][0] - t[2][2] * t[1][0]);
+        inverse[2][0] = invDet * (t[1][0] * t[2][1] - t[2][0] * t[1][1]);
+        inverse[0][1] = invDet * (t[2][1] * t[0][2] - t[0][1] * t[2][2]);
+        inverse[1][1] = invDet * (t[2][2] * t[0][0] - t[0][2] * t[2][0]);
+        inverse[2][1] = invDet * (t[2][0] * t[0][1] - t[0][0] * t[2][1]);
+        inverse[0][2] = invDet * (t[0][1] * t[1][2] - t[1][1] * t[0][2]);
+        inverse[1][2] = invDet * (t[0][2] * t[1][0] - t[1][2] * t[0][0]);
+        inverse[2][2] = invDet * (t[0][0] * t[1][1] - t[1][0] * t[0][1]);
+        inverse[0][3] = invDet * (t[0][1] * (t[2][2] * t[1][3] - t[1][2] * t[2][3]) + t[1][1] * (t[0][2] * t[2][3] - t[2][2] * t[0][3]) + t[2][1] * (t[1][2] * t[0][3] - t[0][2] * t[1][3]));
+        inverse[1][3] = invDet * (t[0][2] * (t[2][0] * t[1][3] - t[1][0] * t[2][3]) + t[1][2] * (t[0][0] * t[2][3] - t[2][0] * t[0][3]) + t[2][2] * (t[1][0] * t[0][3] - t[0][0] * t[1][3]));
+        inverse[2][3] = invDet * (t[0][3] * (t[2][0] * t[1][1] - t[1][0] * t[2][1]) + t[1][3] * (t[0][0] * t[2][1] - t[2][0] * t[0][1]) + t[2][3] * (t[1][0] * t[0][1] - t[0][0] * t[1][1]));
+    }
+
+    static
+        float3 TransformVertex(
+            const float3 &v,
+            const float (&transform)[3][4])
+    {
+        float result[3];
+        for (UINT row = 0; row < 3; ++row)
+        {
+            result[row] = transform[row][0] * v.x + transform[row][1] * v.y + transform[row][2] * v.z + transform[row][3];
+        }
+        return float3{ result[0], result[1], result[2] };
+    }
+
+    static
+        UINT GetIndexBufferIndex(
+            const D3D12_RAYTRACING_GEOMETRY_TRIANGLES_DESC &triangles,
+            UINT index)
+    {
+        switch (triangles.IndexFormat)
+        {
+        case DXGI_FORMAT_R16_UINT:
+            return ((const UINT16 *)triangles.IndexBuffer)[index];
+        case DXGI_FORMAT_R32_UINT:
+            return ((const UINT32 *)triangles.IndexBuffer)[index];
+        default:
+            return index;
+        }
+    }
+
+    void CpuLBVHBuilder::LoadPrimitives(
+        _In_  const D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS &inputs,
+        UINT numElements,
+        _Out_writes_(numElements) Primitive *pPrimitives,
+        _Out_writes_(numElements) PrimitiveMetaData *pMetaData)
+    {
+        UINT numPrimitivesLoaded = 0;
+        for (UINT elementIndex = 0; elementIndex < inputs.NumDescs; elementIndex++)
+        {
+            const D3D12_RAYTRACING_GEOMETRY_DESC &geometryDesc = GetGeometryDesc(inputs, elementIndex);
+            const UINT numPrimitivesInGeometry = GetPrimitiveCountFromGeometryDesc(geometryDesc);
+            assert(numPrimitivesLoaded + numPrimitivesInGeometry <= numElements);
+
+            Primitive *pGeometryPrimitives = pPrimitives + numPrimitivesLoaded;
+            PrimitiveMetaData *pGeometryMetaData = pMetaData + numPrimitivesLoaded;
+            ParallelFor(m_pPool, numPrimitivesInGeometry, kElementChunkSize, [&](UINT begin, UINT end)
+            {
+                for (UINT localIndex = begin; localIndex < end; ++localIndex)
+                {
+                    // NullPrimitive() zeroes the data a procedural primitive doesn't use
+                    Primitive &primitive = pGeometryPrimitives[localIndex];
+                    memset(&primitive, 0, sizeof(primitive));
+
+                    if (geometryDesc.Type == D3D12_RAYTRACING_GEOMETRY_TYPE_TRIANGLES)
+                    {
+                        const D3D12_RAYTRACING_GEOMETRY_TRIANGLES_DESC &triangles = geometryDesc.Triangles;
+                        primitive.PrimitiveType = TRIANGLE_TYPE;
+                        for (UINT v = 0; v < 3; ++v)
+                        {
+                            const UINT vertexIndex = GetIndexBufferIndex(triangles, localIndex * 3 + v);
+                            const BYTE *pVertex = (const BYTE *)triangles.VertexBuffer.StartAddress + vertexIndex * triangles.VertexBuffer.StrideInBytes;
+                            float3 &vertex = primitive.triangle.v[v];
+                            memcpy(&vertex, pVertex, sizeof(vertex));
+                            if (triangles.Transform3x4)
+                            {
+                                vertex = TransformVertex(vertex, *(const float (*)[3][4])triangles.Transform3x4);
+                            }
+                        }
+                    }
+                    else
+                    {
+                        const D3D12_RAYTRACING_GEOMETRY_AABBS_DESC &aabbs = geometryDesc.AABBs;
+                        primitive.PrimitiveType = PROCEDURAL_PRIMITIVE_TYPE;
+                        memcpy(&primitive.aabb, (const BYTE *)aabbs.AABBs.StartAddress + localIndex * aabbs.AABBs.StrideInBytes, sizeof(primitive.aabb));
+                    }
+
+                    PrimitiveMetaData &metaData = pGeometryMetaData[localIndex];
+                    metaData.GeometryContributionToHitGroupIndex = elementIndex;
+                    metaData.PrimitiveIndex = localIndex;
+                    metaData.GeometryFlags = geometryDesc.Flags;
+                }
+            });
+            numPrimitivesLoaded += numPrimitivesInGeometry;
+        }
+    }
+
+    void CpuLBVHBuilder::LoadInstances(
+        D3D12_GPU_VIRTUAL_ADDRESS instanceDescs,
+        D3D12_ELEMENTS_LAYOUT instanceDescsLayout,
+        UINT numElements,
+        _Out_writes_(numElements) AABBNode *pNodes,
+        _Out_writes_(numElements) BVHMetadata *pMetaData)
+    {
+        ParallelFor(m_pPool, numElements, kElementChunkSize, [&](UINT begin, UINT end)
+        {
+            for (UINT instanceIndex = begin; instanceIndex < end; ++instanceIndex)
+            {
+                const D3D12_RAYTRACING_FALLBACK_INSTANCE_DESC &instanceDesc = (instanceDescsLayout == D3D12_ELEMENTS_LAYOUT_ARRAY_OF_POINTERS) ?
+                    *((const D3D12_RAYTRACING_FALLBACK_INSTANCE_DESC *const *)instanceDescs)[instanceIndex] :
+                    ((const D3D12_RAYTRACING_FALLBACK_INSTANCE_DESC *)instanceDescs)[instanceIndex];
+
+                const BYTE *pBottomLevel = (const BYTE *)instanceDesc.AccelerationStructure.GpuVA;
+                const AABBNode &bottomLevelRoot = *(const AABBNode *)(pBottomLevel + SizeOfBVHOffsets);
+
+                BVHMetadata &metaData = pMetaData[instanceIndex];
+                metaData.instanceDesc = instanceDesc;
+                InverseAffineTransform(instanceDesc.Transform, metaData.instanceDesc.Transform);
+                memcpy(metaData.ObjectToWorld, instanceDesc.Transform, sizeof(metaData.ObjectToWorld));
+                metaData.InstanceIndex = instanceIndex;
+
+                const AABB box = BoundingBoxToAABB(bottomLevelRoot.center, bottomLevelRoot.halfDim);
+                const UINT leafFlag = kIsLeafFlag | instanceIndex;
+                WriteNode(pNodes[instanceIndex], AABBtoBoundingBox(TransformAABB(box, metaData.ObjectToWorld)), leafFlag, leafFlag);
+            }
+        });
+    }
+
+    static
+        AABB GetElementAABB(
+            SceneType sceneType,
+            const void *pElements,
+            UINT elementIndex)
+    {
+        if (sceneType == SceneType::BottomLevelBVHs)
+        {
+            const AABBNode &node = ((const AABBNode *)pElements)[elementIndex];
+            return BoundingBoxToAABB(node.center, node.halfDim);
+        }
+
+        const Primitive &primitive = ((const Primitive *)pElements)[elementIndex];
+        if (primitive.PrimitiveType == TRIANGLE_TYPE)
+        {
+            AABB aabb;
+            InitAABB(aabb);
+            for (UINT v = 0; v < 3; ++v)
+            {
+                const float *pVertex = &primitive.triangle.v[v].x;
+                for (UINT axis = 0; axis < 3; ++axis)
+                {
+                    aabb.minArr[axis] = std::min(aabb.minArr[axis], pVertex[axis]);
+                    aabb.maxArr[axis] = std::max(aabb.maxArr[axis], pVertex[axis]);
+                }
+            }
+            return aabb;
+        }
+        return primitive.aabb;
+    }
+
+    void CpuLBVHBuilder::CalculateSceneAABB(
+        SceneType sceneType,
+        _In_ const void *pElements,
+        UINT numElements,
+        _Out_ AABB &sceneAABB)
+    {
+        const UINT numChunks = (numElements + kElementChunkSize - 1) / kElementChunkSize;
+        std::vector<AABB> chunkAABBs(numChunks);
+        ParallelFor(m_pPool, numChunks, 1, [&](UINT beginChunk, UINT endChunk)
+        {
+            for (UINT chunk = beginChunk; chunk < endChunk; ++chunk)
+            {
+                AABB &chunkAABB = chunkAABBs[chunk];
+                InitAABB(chunkAABB);
+
+                const UINT end = std::min((chunk + 1) * kElementChunkSize, numElements);
+                for (UINT i = chunk * kElementChunkSize; i < end; ++i)
+                {
+                    chunkAABB = CombineAABB(chunkAABB, GetElementAABB(sceneType, pElements, i));
+                }
+            }
+        });
+
+        InitAABB(sceneAABB);
+        for (const AABB &chunkAABB : chunkAABBs)
+        {
+            sceneAABB = CombineAABB(sceneAABB, chunkAABB);
+        }
+    }
+
+    static
+        float3 GetCentroid(
+            SceneType sceneType,
+            const void *pElements,
+            UINT elementIndex)
+    {
+        if (sceneType == SceneType::BottomLevelBVHs)
+        {
+            const AABBNode &node = ((const AABBNode *)pElements)[elementIndex];
+            return float3{ node.center[0], node.center[1], node.center[2] };
+        }
+
+        const Primitive &primitive = ((const Primitive *)pElements)[elementIndex];
+        float centroid[3];
+        for (UINT axis = 0; axis < 3; ++axis)
+        {
+            if (primitive.PrimitiveType == TRIANGLE_TYPE)
+            {
+                const Triangle &tri = primitive.triangle;
+                centroid[axis] = ((&tri.v0.x)[axis] + (&tri.v1.x)[axis] + (&tri.v2.x)[axis]) / 3.0f;
+            }
+            else
+            {
+                centroid[axis] = (primitive.aabb.minArr[axis] + primitive.aabb.maxArr[axis]) / 2.0f;
+            }
+        }
+        return float3{ centroid[0], centroid[1], centroid[2] };
+    }
+
+    // Moves bit i of the low 10 or 21 bits to bit 3 * i
+    static UINT SpreadBits(UINT v)
+    {
+        v &= 0x3ff;
+        v = (v | (v << 16)) & 0x030000ff;
+        v = (v | (v << 8)) & 0x0300f00f;
+        v = (v | (v << 4)) & 0x030c30c3;
+        v = (v | (v << 2)) & 0x09249249;
+        return v;
+    }
+
+    static UINT64 SpreadBits(UINT64 v)
+    {
+        v &= 0x1fffff;
+        v = (v | (v << 32)) & 0x001f00000000ffffull;
+        v = (v | (v << 16)) & 0x001f0000ff0000ffull;
+        v = (v | (v << 8)) & 0x100f00f00f00f00full;
+        v = (v | (v << 4)) & 0x10c30c30c30c30c3ull;
+        v = (v | (v << 2)) & 0x1249249249249249ull;
+        return v;
+    }
+
+    template <typename MortonCodeType>
+    struct MortonCodeTraits;
+
+    template <>
+    struct MortonCodeTraits<UINT>
+    {
+        static const UINT NumBitsPerAxis = 10;
+
+        static UINT CountLeadingZeroes(UINT v)
+        {
+            unsigned long index;
+            return _BitScanReverse(&index, v) ? 31 - index : 32;
+        }
+
+        // The GPU adds 31 rather than 32 when two codes match, which the CPU copies to stay bit exact
+        static const int DuplicateCodePrefix = 31;
+    };
+
+    template <>
+    struct MortonCodeTraits<UINT64>
+    {
+        static const UINT NumBitsPerAxis = 21;
+
+        static UINT CountLeadingZeroes(UINT64 v)
+        {
+            unsigned long index;
+            return _BitScanReverse64(&index, v) ? 63 - index : 64;
+        }
+
+        static const int DuplicateCodePrefix = 64;
+    };
+
+    // CalculateMortonCodes.hlsli without SCALED_MORTON_CODES. Axes are interleaved in y, x, z order.
+    template <typename MortonCodeType>
+    static
+        void CalculateMortonCodes(
+            BuildTaskPool *pPool,
+            SceneType sceneType,
+            const void *pElements,
+            UINT numElements,
+            const AABB &sceneAABB,
+            UINT *pIndices,
+            MortonCodeType *pMortonCodes)
+    {
+        const float epsilon = 0.00001f;
+        const float maxCoord = (float)(1u << MortonCodeTraits<MortonCodeType>::NumBitsPerAxis);
+
+        float sceneDimension[3];
+        for (UINT axis = 0; axis < 3; ++axis)
+        {
+            sceneDimension[axis] = fmaxf(sceneAABB.maxArr[axis] - sceneAABB.minArr[axis], epsilon);
+        }
+
+        ParallelFor(pPool, numElements, kElementChunkSize, [&](UINT begin, UINT end)
+        {
+            for (UINT elementIndex = begin; elementIndex < end; ++elementIndex)
+            {
+                const float3 centroid = GetCentroid(sceneType, pElements, elementIndex);
+                MortonCodeType coords[3];
+                for (UINT axis = 0; axis < 3; ++axis)
+                {
+                    const float unitCoord = ((&centroid.x)[axis] - sceneAABB.minArr[axis]) / sceneDimension[axis];
+                    const float adjustedCoord = fminf(fmaxf(unitCoord * maxCoord, 0.0f), maxCoord - 1);
+                    coords[axis] = (MortonCodeType)(UINT)adjustedCoord;
+                }
+
+                pMortonCodes[elementIndex] = SpreadBits(coords[1]) | (SpreadBits(coords[0]) << 1) | (SpreadBits(coords[2]) << 2);
+                pIndices[elementIndex] = elementIndex;
+            }
+        });
+    }
+
+    void CpuLBVHBuilder::CalculateMortonCodes(
+        SceneType sceneType,
+        _In_ const void *pElements,
+        UINT numElements,
+        const AABB &sceneAABB,
+        _Out_writes_(numElements) UINT *pIndices,
+        _Out_writes_(numElements) UINT *pMortonCodes)
+    {
+        FallbackLayer::CalculateMortonCodes(m_pPool, sceneType, pElements, numElements, sceneAABB, pIndices, pMortonCodes);
+    }
+
+    void CpuLBVHBuilder::CalculateMortonCodes(
+        SceneType sceneType,
+        _In_ const void *pElements,
+        UINT numElements,
+        const AABB &sceneAABB,
+        _Out_writes_(numElements) UINT *pIndices,
+        _Out_writes_(numElements) UINT64 *pMortonCodes)
+    {
+        FallbackLayer::CalculateMortonCodes(m_pPool, sceneType, pElements, numElements, sceneAABB, pIndices, pMortonCodes);
+    }
+
+    //
+    // One stable counting sort pass of an LSD radix sort, keyed on the 8-bit digit of pDigits at shift. Every
+    // chunk counts its digits in parallel, then scatters in parallel from its own offsets, which keeps elements
+    // with equal digits in chunk order. Returns false without writing anything when all elements share a
+    // digit, since the pass wouldn't move anything.
+    //
+    template <typename MortonCodeType, typename DigitType>
+    static
+        bool SortByDigit(
+            BuildTaskPool *pPool,
+            UINT numElements,
+            const DigitType *pDigits,
+            UINT shift,
+            const MortonCodeType *pInputCodes,
+            const UINT *pInputIndices,
+            MortonCodeType *pOutputCodes,
+            UINT *pOutputIndices)
+    {
+        const UINT numChunks = (numElements + kSortChunkSize - 1) / kSortChunkSize;
+        std::vector<UINT> offsets(numChunks * kRadixSize);
+        ParallelFor(pPool, numChunks, 1, [&](UINT beginChunk, UINT endChunk)
+        {
+            for (UINT chunk = beginChunk; chunk < endChunk; ++chunk)
+            {
+                UINT *pHistogram = &offsets[chunk * kRadixSize];
+                const UINT end = std::min((chunk + 1) * kSortChunkSize, numElements);
+                for (UINT i = chunk * kSortChunkSize; i < end; ++i)
+                {
+                    pHistogram[(pDigits[i] >> shift) & (kRadixSize - 1)]++;
+                }
+            }
+        });
+
+        UINT offset = 0;
+        for (UINT digit = 0; digit < kRadixSize; ++digit)
+        {
+            const UINT digitStart = offset;
+            for (UINT chunk = 0; chunk < numChunks; ++chunk)
+            {
+                const UINT count = offsets[chunk * kRadixSize + digit];
+                offsets[chunk * kRadixSize + digit] = offset;
+                offset += count;
+            }
+
+            if (offset - digitStart == numElements)
+            {
+                return false;
+            }
+        }
+
+        ParallelFor(pPool, numChunks, 1, [&](UINT beginChunk, UINT endChunk)
+        {
+            for (UINT chunk = beginChunk; chunk < endChunk; ++chunk)
+            {
+                UINT *pOffsets = &offsets[chunk * kRadixSize];
+                const UINT end = std::min((chunk + 1) * kSortChunkSize, numElements);
+                for (UINT i = chunk * kSortChunkSize; i < end; ++i)
+                {
+                    const UINT destination = pOffsets[(pDigits[i] >> shift) & (kRadixSize - 1)]++;
+                    pOutputCodes[destination] = pInputCodes[i];
+                    pOutputIndices[destination] = pInputIndices[i];
+                }
+            }
+        });
+        return true;
+    }
+
+    //
+    // LSD radix sort of (code, index) pairs. Indices straight out of CalculateMortonCodes are already ascending,
+    // so sorting on the code alone keeps ties in index order. Otherwise the index digits are sorted first.
+    //
+    template <typename MortonCodeType>
+    static
+        void RadixSort(
+            BuildTaskPool *pPool,
+            MortonCodeType *pMortonCodes,
+            UINT *pIndices,
+            UINT numElements)
+    {
+        std::vector<MortonCodeType> scratchCodes(numElements);
+        std::vector<UINT> scratchIndices(numElements);
+
+        MortonCodeType *pCodes[2] = { pMortonCodes, scratchCodes.data() };
+        UINT *pIndexBuffers[2] = { pIndices, scratchIndices.data() };
+        UINT input = 0;
+
+        const bool indicesAscending = std::is_sorted(pIndices, pIndices + numElements);
+        if (!indicesAscending)
+        {
+            for (UINT shift = 0; shift < sizeof(UINT) * 8; shift += kRadixBits)
+            {
+                if (SortByDigit(pPool, numElements, pIndexBuffers[input], shift, pCodes[input], pIndexBuffers[input], pCodes[1 - input], pIndexBuffers[1 - input]))
+                {
+                    input = 1 - input;
+                }
+            }
+        }
+
+        for (UINT shift = 0; shift < sizeof(MortonCodeType) * 8; shift += kRadixBits)
+        {
+            if (SortByDigit(pPool, numElements, pCodes[input], shift, pCodes[input], pIndexBuffers[input], pCodes[1 - input], pIndexBuffers[1 - input]))
+            {
+                input = 1 - input;
+            }
+        }
+
+        if (input != 0)
+        {
+            memcpy(pMortonCodes, pCodes[input], numElements * sizeof(MortonCodeType));
+            memcpy(pIndices, pIndexBuffers[input], numElements * sizeof(UINT));
+        }
+    }
+
+    void CpuLBVHBuilder::Sort(
+        _Inout_updates_(numElements) UINT *pMortonCodes,
+        _Inout_updates_(numElements) UINT *pIndices,
+        UINT numElements)
+    {
+        RadixSort(m_pPool, pMortonCodes, pIndices, numElements);
+    }
+
+    void CpuLBVHBuilder::Sort(
+        _Inout_updates_(numElements) UINT64 *pMortonCodes,
+        _Inout_updates_(numElements) UINT *pIndices,
+        UINT numElements)
+    {
+        RadixSort(m_pPool, pMortonCodes, pIndices, numElements);
+    }
+
+    void CpuLBVHBuilder::Rearrange(
+        SceneType sceneType,
+        UINT numElements,
+        _In_ const void *pInputElements,
+        _In_ const void *pInputMetaData,
+        _In_reads_(numElements) const UINT *pIndices,
+        _Out_ void *pOutputElements,
+        _Out_ void *pOutputMetaData,
+        _Out_writes_opt_(numElements) UINT *pOutputSortCache)
+    {
+        const bool isTopLevel = sceneType == SceneType::BottomLevelBVHs;
+        const UINT elementSize = isTopLevel ? sizeof(AABBNode) : sizeof(Primitive);
+        const UINT metaDataSize = isTopLevel ? sizeof(BVHMetadata) : sizeof(PrimitiveMetaData);
+
+        ParallelFor(m_pPool, numElements, kElementChunkSize, [&](UINT begin, UINT end)
+        {
+            for (UINT dstIndex = begin; dstIndex < end; ++dstIndex)
+            {
+                const UINT srcIndex = pIndices[dstIndex];
+                memcpy((BYTE *)pOutputElements + dstIndex * elementSize, (const BYTE *)pInputElements + srcIndex * elementSize, elementSize);
+                memcpy((BYTE *)pOutputMetaData + dstIndex * metaDataSize, (const BYTE *)pInputMetaData + srcIndex * metaDataSize, metaDataSize);
+                if (pOutputSortCache)
+                {
+                    pOutputSortCache[srcIndex] = dstIndex;
+                }
+            }
+        });
+    }
+
+    //
+    // BuildBVHSplits.hlsli: Karras, "Maximizing Parallelism in the Construction of BVHs, Octrees, and k-d Trees".
+    // Every internal node finds its own key range and split, so nodes are emitted independently.
+    //
+    template <typename MortonCodeType>
+    class KarrasHierarchyBuilder
+    {
+    public:
+        KarrasHierarchyBuilder(
+            const MortonCodeType *pMortonCodes,
+            UINT numElements) :
+            m_pMortonCodes(pMortonCodes),
+            m_numElements(numElements)
+        {
+        }
+
+        void GenerateHierarchy(
+            UINT idx,
+            HierarchyNode *pHierarchy) const
+        {
+            UINT first, last;
+            DetermineRange(idx, first, last);
+            const UINT split = FindSplit(first, last);
+
+            const UINT leafNodeOffset = m_numElements - 1;
+            const UINT childAIndex = (split == first) ? leafNodeOffset + split : split;
+            const UINT childBIndex = (split + 1 == last) ? leafNodeOffset + split + 1 : split + 1;
+
+            pHierarchy[idx].LeftChildIndex = childAIndex;
+            pHierarchy[idx].RightChildIndex = childBIndex;
+            WriteChild(pHierarchy[childAIndex], idx);
+            WriteChild(pHierarchy[childBIndex], idx);
+        }
+
+    private:
+        static void WriteChild(HierarchyNode &child, UINT parentIndex)
+        {
+            child.ParentIndex = parentIndex;
+            child.bCollapseChildren = 0;
+        }
+
+        // Indices are signed so that stepping off either end of the range reads as "no common prefix"
+        int GetLongestCommonPrefix(INT64 indexA, INT64 indexB) const
+        {
+            if (indexA < 0 || indexB < 0 || indexA >= m_numElements || indexB >= m_numElements)
+            {
+                return -1;
+            }
+
+            const MortonCodeType mortonCodeA = m_pMortonCodes[indexA];
+            const MortonCodeType mortonCodeB = m_pMortonCodes[indexB];
+            if (mortonCodeA != mortonCodeB)
+            {
+                return MortonCodeTraits<MortonCodeType>::CountLeadingZeroes(mortonCodeA ^ mortonCodeB);
+            }
+            return MortonCodeTraits<UINT>::CountLeadingZeroes((UINT)indexA ^ (UINT)indexB) + MortonCodeTraits<MortonCodeType>::DuplicateCodePrefix;
+        }
+
+        void DetermineRange(UINT idx, UINT &first, UINT &last) const
+        {
+            const int d = std::min(std::max(GetLongestCommonPrefix(idx, (INT64)idx + 1) - GetLongestCommonPrefix(idx, (INT64)idx - 1), -1), 1);
+            const int minPrefix = GetLongestCommonPrefix(idx, (INT64)idx - d);
+
+            INT64 maxLength = 2;
+            while (GetLongestCommonPrefix(idx, idx + maxLength * d) > minPrefix)
+            {
+                maxLength *= 4;
+            }
+
+            INT64 length = 0;
+            for (INT64 t = maxLength / 2; t > 0; t /= 2)
+            {
+                if (GetLongestCommonPrefix(idx, idx + (length + t) * d) > minPrefix)
+                {
+                    length = length + t;
+                }
+            }
+
+            const INT64 j = idx + length * d;
+            first = (UINT)std::min((INT64)idx, j);
+            last = (UINT)std::max((INT64)idx, j);
+        }
+
+        UINT FindSplit(UINT first, UINT last) const
+        {
+            const int commonPrefix = GetLongestCommonPrefix(first, last);
+            UINT split = first;
+            UINT step = last - first;
+
+            do
+            {
+                step = (step + 1) >> 1;
+                const UINT newSplit = split + step;
+
+                if (newSplit < last)
+                {
+                    const int splitPrefix = GetLongestCommonPrefix(first, newSplit);
+                    if (splitPrefix > commonPrefix)
+                        split = newSplit;
+                }
+            } while (step > 1);
+
+            return split;
+        }
+
+        const MortonCodeType *m_pMortonCodes;
+        const UINT m_numElements;
+    };
+
+    template <typename MortonCodeType>
+    static
+        void ConstructHierarchy(
+            BuildTaskPool *pPool,
+            const MortonCodeType *pSortedMortonCodes,
+            UINT numElements,
+            HierarchyNode *pHierarchy)
+    {
+        if (numElements < 2)
+        {
+            return;
+        }
+
+        const KarrasHierarchyBuilder<MortonCodeType> builder(pSortedMortonCodes, numElements);
+        ParallelFor(pPool, GetNumInternalNodes(numElements), kElementChunkSize, [&](UINT begin, UINT end)
+        {
+            for (UINT idx = begin; idx < end; ++idx)
+            {
+                builder.GenerateHierarchy(idx, pHierarchy);
+            }
+        });
+    }
+
+    void CpuLBVHBuilder::ConstructHierarchy(
+        _In_reads_(numElements) const UINT *pSortedMortonCodes,
+        UINT numElements,
+        _Out_writes_(2 * numElements - 1) HierarchyNode *pHierarchy)
+    {
+        FallbackLayer::ConstructHierarchy(m_pPool, pSortedMortonCodes, numElements, pHierarchy);
+    }
+
+    void CpuLBVHBuilder::ConstructHierarchy(
+        _In_reads_(numElements) const UINT64 *pSortedMortonCodes,
+        UINT numElements,
+        _Out_writes_(2 * numElements - 1) HierarchyNode *pHierarchy)
+    {
+        FallbackLayer::ConstructHierarchy(m_pPool, pSortedMortonCodes, numElements, pHierarchy);
+    }
+
+    //
+    // TreeletReorder.hlsl for a single treelet root: Karras and Aila, "Fast Parallel Construction of
+    // High-Quality Bounding Volume Hierarchies". The 7 leaves under the root are rearranged into the topology
+    // with the lowest SAH cost, found by dynamic programming over every subset of the leaves.
+    //
+    class TreeletOptimizer
+    {
+    public:
+        TreeletOptimizer(
+            UINT numElements,
+            HierarchyNode *pHierarchy,
+            AABB *pAABBs) :
+            m_numInternalNodes(GetNumInternalNodes(numElements)),
+            m_pHierarchy(pHierarchy),
+            m_pAABBs(pAABBs)
+        {
+        }
+
+        void Optimize(UINT nodeIndex)
+        {
+            FormTreelet(nodeIndex);
+            FindOptimalPartitions(nodeIndex);
+            ReformTree();
+        }
+
+    private:
+        bool IsLeafIndex(UINT nodeIndex) const
+        {
+            return nodeIndex >= m_numInternalNodes;
+        }
+
+        // Keeps opening the treelet leaf with the largest surface area until there are kFullTreeletSize leaves
+        void FormTreelet(UINT nodeIndex)
+        {
+            m_internalNodes[0] = nodeIndex;
+            m_treeletToReorder[0] = m_pHierarchy[nodeIndex].LeftChildIndex;
+            m_treeletToReorder[1] = m_pHierarchy[nodeIndex].RightChildIndex;
+
+            for (UINT treeletSize = 2; treeletSize < kFullTreeletSize; treeletSize++)
+            {
+                float largestSurfaceArea = 0.0f;
+                UINT indexOfNodeIndexToTraverse = kFullTreeletSize;
+                for (UINT i = 0; i < treeletSize; i++)
+                {
+                    const UINT treeletNodeIndex = m_treeletToReorder[i];
+                    if (IsLeafIndex(treeletNodeIndex))
+                    {
+                        continue;
+                    }
+
+                    // The GPU falls back to node 0 when no candidate has any surface area, the CPU opens the first
+                    // candidate instead so the treelet stays inside the subtree
+                    const float surfaceArea = ComputeBoxSurfaceArea(m_pAABBs[treeletNodeIndex]);
+                    if (surfaceArea > largestSurfaceArea || indexOfNodeIndexToTraverse == kFullTreeletSize)
+                    {
+                        if (surfaceArea > largestSurfaceArea)
+                        {
+                            largestSurfaceArea = surfaceArea;
+                        }
+                        indexOfNodeIndexToTraverse = i;
+                    }
+                }
+                assert(indexOfNodeIndexToTraverse < kFullTreeletSize);
+
+                // Replace the original node with its left child and add the right child to the end
+                const UINT nodeIndexToTraverse = m_treeletToReorder[indexOfNodeIndexToTraverse];
+                const HierarchyNode &nodeToTraverse = m_pHierarchy[nodeIndexToTraverse];
+                m_internalNodes[treeletSize - 1] = nodeIndexToTraverse;
+                m_treeletToReorder[indexOfNodeIndexToTraverse] = nodeToTraverse.LeftChildIndex;
+                m_treeletToReorder[treeletSize] = nodeToTraverse.RightChildIndex;
+            }
+        }
+
+        void FindOptimalPartitions(UINT nodeIndex)
+        {
+            // Surface area of every subset of the leaves, the bitmask of the subset being the index
+            for (UINT treeletBitmask = 1; treeletBitmask < kNumTreeletSplitPermutations; treeletBitmask++)
+            {
+                AABB aabb;
+                InitAABB(aabb);
+                for (UINT i = 0; i < kFullTreeletSize; i++)
+                {
+                    if ((1 << i) & treeletBitmask)
+                    {
+                        aabb = CombineAABB(aabb, m_pAABBs[m_treeletToReorder[i]]);
+                    }
+                }
+                m_optimalCost[treeletBitmask] = ComputeBoxSurfaceArea(aabb);
+            }
+
+            const float rootAABBSurfaceArea = ComputeBoxSurfaceArea(m_pAABBs[nodeIndex]);
+            for (UINT i = 0; i < kFullTreeletSize; i++)
+            {
+                m_optimalCost[1 << i] = kCostOfRayBoxIntersection * ComputeBoxSurfaceArea(m_pAABBs[m_treeletToReorder[i]]) / rootAABBSurfaceArea;
+            }
+
+            // Cheapest split of every subset, from subsets of 2 leaves up to the whole treelet
+            for (UINT subsetSize = 2; subsetSize <= kFullTreeletSize; subsetSize++)
+            {
+                for (UINT treeletBitmask = 1; treeletBitmask < kNumTreeletSplitPermutations; treeletBitmask++)
+                {
+                    if (CountBits(treeletBitmask) != subsetSize)
+                    {
+                        continue;
+                    }
+
+                    // Costs are NaN when the whole treelet has no surface area. The GPU then keeps the empty partition,
+                    // the CPU the first one it tries so the treelet can still be rebuilt.
+                    const UINT delta = (treeletBitmask - 1) & treeletBitmask;
+                    UINT partitionBitmask = (0 - delta) & treeletBitmask;
+
+                    float lowestCost = FLT_MAX;
+                    UINT bestPartition = partitionBitmask;
+                    do
+                    {
+                        const float cost = m_optimalCost[partitionBitmask] + m_optimalCost[treeletBitmask ^ partitionBitmask];
+                        if (cost < lowestCost)
+                        {
+                            lowestCost = cost;
+                            bestPartition = partitionBitmask;
+                        }
+                        partitionBitmask = (partitionBitmask - delta) & treeletBitmask;
+                    } while (partitionBitmask != 0);
+
+                    const float costAsLeafNode = kCostOfRayTriangleIntersection * m_optimalCost[treeletBitmask] * subsetSize;
+                    const float costAsInternalNode = kCostOfRayBoxIntersection * m_optimalCost[treeletBitmask] + lowestCost;
+                    m_optimalCost[treeletBitmask] = std::min(costAsInternalNode, costAsLeafNode);
+                    m_optimalPartition[treeletBitmask] = bestPartition;
+                    if (costAsLeafNode < costAsInternalNode)
+                    {
+                        // The unused bit flags that the subset is cheaper flattened into a leaf
+                        m_optimalPartition[treeletBitmask] |= 1 << kFullTreeletSize;
+                    }
+                }
+            }
+        }
+
+        void ReformTree()
+        {
+            struct PartitionEntry
+            {
+                UINT Mask;
+                UINT NodeIndex;
+            };
+            UINT nodesAllocated = 1;
+            UINT partitionStackSize = 1;
+            PartitionEntry partitionStack[kFullTreeletSize];
+            partitionStack[0].Mask = kFullPartitionMask;
+            partitionStack[0].NodeIndex = m_internalNodes[0];
+
+            while (partitionStackSize > 0)
+            {
+                const PartitionEntry partition = partitionStack[--partitionStackSize];
+
+                PartitionEntry leftEntry;
+                leftEntry.Mask = m_optimalPartition[partition.Mask];
+                const bool bCollapseChildren = (leftEntry.Mask & (1 << kFullTreeletSize)) != 0;
+                leftEntry.Mask &= kFullPartitionMask;
+                if (CountBits(leftEntry.Mask) > 1)
+                {
+                    leftEntry.NodeIndex = m_internalNodes[nodesAllocated++];
+                    partitionStack[partitionStackSize++] = leftEntry;
+                }
+                else
+                {
+                    leftEntry.NodeIndex = m_treeletToReorder[FirstBitLow(leftEntry.Mask)];
+                }
+
+                PartitionEntry rightEntry;
+                rightEntry.Mask = partition.Mask ^ leftEntry.Mask;
+                if (CountBits(rightEntry.Mask) > 1)
+                {
+                    rightEntry.NodeIndex = m_internalNodes[nodesAllocated++];
+                    partitionStack[partitionStackSize++] = rightEntry;
+                }
+                else
+                {
+                    rightEntry.NodeIndex = m_treeletToReorder[FirstBitLow(rightEntry.Mask)];
+                }
+
+                m_pHierarchy[partition.NodeIndex].LeftChildIndex = leftEntry.NodeIndex;
+                m_pHierarchy[partition.NodeIndex].RightChildIndex = rightEntry.NodeIndex;
+                m_pHierarchy[leftEntry.NodeIndex].ParentIndex = partition.NodeIndex;
+                m_pHierarchy[leftEntry.NodeIndex].bCollapseChildren = bCollapseChildren;
+                m_pHierarchy[rightEntry.NodeIndex].ParentIndex = partition.NodeIndex;
+                m_pHierarchy[rightEntry.NodeIndex].bCollapseChildren = bCollapseChildren;
+            }
+
+            // Internal nodes were handed out top-down, so going backwards refits them bottom-up
+            for (int j = kNumInternalTreeletNodes - 1; j >= 0; j--)
+            {
+                const HierarchyNode &internalNode = m_pHierarchy[m_internalNodes[j]];
+                m_pAABBs[m_internalNodes[j]] = CombineAABB(m_pAABBs[internalNode.LeftChildIndex], m_pAABBs[internalNode.RightChildIndex]);
+            }
+        }
+
+        static UINT CountBits(UINT v)
+        {
+            UINT count = 0;
+            for (; v; v &= v - 1)
+            {
+                count++;
+            }
+            return count;
+        }
+
+        static UINT FirstBitLow(UINT v)
+        {
+            unsigned long index;
+            _BitScanForward(&index, v);
+            return index;
+        }
+
+        const UINT m_numInternalNodes;
+        HierarchyNode *m_pHierarchy;
+        AABB *m_pAABBs;
+
+        UINT m_treeletToReorder[kFullTreeletSize];
+        UINT m_internalNodes[kNumInternalTreeletNodes];
+        float m_optimalCost[kNumTreeletSplitPermutations];
+        UINT m_optimalPartition[kNumTreeletSplitPermutations];
+    };
+
+    //
+    // FindTreelets.hlsl and TreeletReorder.hlsl. Each pass walks up from the leaves, counting leaves with
+    // atomic counters, until it reaches a subtree with at least minTrianglesPerTreelet leaves. Those are then
+    // optimized in parallel, and each keeps climbing to optimize its ancestors once their other child is done.
+    //
+    void CpuLBVHBuilder::Optimize(
+        UINT numElements,
+        _Inout_updates_(2 * numElements - 1) HierarchyNode *pHierarchy,
+        _Out_writes_(2 * numElements - 1) AABB *pAABBs,
+        _In_reads_(numElements) const Primitive *pPrimitives,
+        D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAGS buildFlags)
+    {
+        if (numElements == 0) return;
+
+        UINT numOptimizationPasses;
+        if (buildFlags & D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_PREFER_FAST_BUILD)
+        {
+            numOptimizationPasses = 0;
+        }
+        else if (buildFlags & D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_PREFER_FAST_TRACE)
+        {
+            numOptimizationPasses = 3;
+        }
+        else
+        {
+            numOptimizationPasses = 1;
+        }
+
+        const UINT numInternalNodes = GetNumInternalNodes(numElements);
+        std::vector<std::atomic<UINT>> numTriangles(numInternalNodes);
+        std::vector<UINT> baseTreelets(numElements / kFullTreeletSize + 1);
+
+        UINT minTrianglesPerTreelet = kFullTreeletSize;
+        for (UINT i = 0; i < numOptimizationPasses; i++)
+        {
+            if (minTrianglesPerTreelet > numElements)
+            {
+                break;
+            }
+
+            for (std::atomic<UINT> &count : numTriangles)
+            {
+                count.store(0, std::memory_order_relaxed);
+            }
+            std::atomic<UINT> numBaseTreelets(0);
+
+            ParallelFor(m_pPool, numElements, kElementChunkSize, [&](UINT begin, UINT end)
+            {
+                for (UINT leafIndex = begin; leafIndex < end; ++leafIndex)
+                {
+                    UINT nodeIndex = numInternalNodes + leafIndex;
+                    UINT nodeNumTriangles = 1;
+                    bool isLeaf = true;
+                    while (true)
+                    {
+                        if (isLeaf)
+                        {
+                            // Triangles go through the BoundingBox form like the GPU does, which can round the box
+                            const Primitive &primitive = pPrimitives[leafIndex];
+                            if (primitive.PrimitiveType == TRIANGLE_TYPE)
+                            {
+                                const BoundingBox box = AABBtoBoundingBox(GetTriangleAABB(primitive.triangle));
+                                pAABBs[nodeIndex] = BoundingBoxToAABB(box.center, box.halfDim);
+                            }
+                            else
+                            {
+                                pAABBs[nodeIndex] = primitive.aabb;
+                            }
+                        }
+                        else
+                        {
+                            const HierarchyNode &node = pHierarchy[nodeIndex];
+                            pAABBs[nodeIndex] = CombineAABB(pAABBs[node.LeftChildIndex], pAABBs[node.RightChildIndex]);
+                        }
+
+                        if (nodeNumTriangles >= minTrianglesPerTreelet)
+                        {
+                            baseTreelets[numBaseTreelets++] = nodeIndex;
+                            break;
+                        }
+
+                        // Leave the parent to whichever child finishes last
+                        const UINT parentNodeIndex = pHierarchy[nodeIndex].ParentIndex;
+                        const UINT numTrianglesFromOtherNode = numTriangles[parentNodeIndex].fetch_add(nodeNumTriangles);
+                        if (numTrianglesFromOtherNode == 0)
+                        {
+                            break;
+                        }
+
+                        nodeIndex = parentNodeIndex;
+                        nodeNumTriangles += numTrianglesFromOtherNode;
+                        isLeaf = false;
+                    }
+                }
+            });
+
+            ParallelFor(m_pPool, numBaseTreelets, 1, [&](UINT begin, UINT end)
+            {
+                TreeletOptimizer optimizer(numElements, pHierarchy, pAABBs);
+                for (UINT treelet = begin; treelet < end; ++treelet)
+                {
+                    UINT nodeIndex = baseTreelets[treelet];
+                    while (true)
+                    {
+                        optimizer.Optimize(nodeIndex);
+                        if (nodeIndex == 0)
+                        {
+                            break;
+                        }
+
+                        const UINT parentNodeIndex = pHierarchy[nodeIndex].ParentIndex;
+                        const UINT ourNumTriangles = numTriangles[nodeIndex].load();
+                        const UINT numTrianglesFromOtherNode = numTriangles[parentNodeIndex].fetch_add(ourNumTriangles);
+                        if (numTrianglesFromOtherNode == 0)
+                        {
+                            break;
+                        }
+
+                        const HierarchyNode &parent = pHierarchy[parentNodeIndex];
+                        pAABBs[parentNodeIndex] = CombineAABB(pAABBs[parent.LeftChildIndex], pAABBs[parent.RightChildIndex]);
+                        nodeIndex = parentNodeIndex;
+                    }
+                }
+            });
+
+            minTrianglesPerTreelet *= 2;
+        }
+    }
+
+    //
+    // ComputeAABBs.hlsli. Every leaf walks up the hierarchy, and the child that finishes last computes the box
+    // of its parent. Children are ordered so the one with fewer leaves comes first.
+    //
+    void CpuLBVHBuilder::ConstructAABB(
+        SceneType sceneType,
+        UINT numElements,
+        _In_reads_(2 * numElements - 1) const HierarchyNode *pHierarchy,
+        _Inout_ BYTE *pOutputBVH,
+        _Out_writes_opt_(2 * numElements - 1) UINT *pAABBParents)
+    {
+        const bool isTopLevel = sceneType == SceneType::BottomLevelBVHs;
+        BVHOffsets &offsets = *(BVHOffsets *)pOutputBVH;
+        AABBNode *pNodes = (AABBNode *)(pOutputBVH + SizeOfBVHOffsets);
+        offsets.offsetToBoxes = SizeOfBVHOffsets;
+
+        if (numElements == 0)
+        {
+            // Empty structures still get a root that no ray can hit
+            memset(pNodes, 0, sizeof(AABBNode));
+            offsets.offsetToVertices = offsets.offsetToBoxes + sizeof(AABBNode);
+            offsets.offsetToPrimitiveMetaData = offsets.offsetToVertices;
+            offsets.totalSize = offsets.offsetToVertices;
+            return;
+        }
+
+        if (isTopLevel)
+        {
+            // Top levels keep the instance metadata where bottom levels keep their primitives
+            offsets.offsetToVertices = GetOffsetToLeafNodeAABBs(numElements) + GetOffsetFromLeafNodesToBottomLevelMetadata(numElements);
+            offsets.totalSize = offsets.offsetToVertices + numElements * SizeOfBVHMetadata;
+            offsets.offsetToPrimitiveMetaData = offsets.totalSize;
+        }
+        else
+        {
+            offsets.offsetToVertices = GetOffsetToPrimitives(numElements);
+            offsets.offsetToPrimitiveMetaData = offsets.offsetToVertices + GetOffsetFromPrimitivesToPrimitiveMetaData(numElements);
+            offsets.totalSize = offsets.offsetToPrimitiveMetaData + numElements * SizeOfPrimitiveMetaData;
+        }
+
+        const Primitive *pPrimitives = (const Primitive *)(pOutputBVH + offsets.offsetToVertices);
+        const BVHMetadata *pInstances = (const BVHMetadata *)(pOutputBVH + offsets.offsetToVertices);
+        auto computeLeafBox = [&](UINT leafIndex, UINT &flags0) -> BoundingBox
+        {
+            flags0 = leafIndex | kIsLeafFlag;
+            if (isTopLevel)
+            {
+                const BVHMetadata &metadata = pInstances[leafIndex];
+                const AABBNode &bottomLevelRoot = *(const AABBNode *)(metadata.instanceDesc.AccelerationStructure.GpuVA + SizeOfBVHOffsets);
+                return AABBtoBoundingBox(TransformAABB(BoundingBoxToAABB(bottomLevelRoot.center, bottomLevelRoot.halfDim), metadata.ObjectToWorld));
+            }
+
+            const Primitive &primitive = pPrimitives[leafIndex];
+            if (primitive.PrimitiveType == TRIANGLE_TYPE)
+            {
+                return AABBtoBoundingBox(GetTriangleAABB(primitive.triangle));
+            }
+            flags0 |= kIsProceduralGeometryFlag;
+            return AABBtoBoundingBox(primitive.aabb);
+        };
+
+        const UINT numInternalNodes = GetNumInternalNodes(numElements);
+        std::vector<std::atomic<UINT>> childNodesProcessed(numInternalNodes);
+
+        ParallelFor(m_pPool, numElements, kElementChunkSize, [&](UINT begin, UINT end)
+        {
+            for (UINT leafIndex = begin; leafIndex < end; ++leafIndex)
+            {
+                UINT nodeIndex = numInternalNodes + leafIndex;
+                UINT numTriangles = 1;
+                bool swapChildIndices = false;
+                while (true)
+                {
+                    if (nodeIndex >= numInternalNodes)
+                    {
+                        UINT flags0;
+                        const BoundingBox box = computeLeafBox(nodeIndex - numInternalNodes, flags0);
+                        WriteNode(pNodes[nodeIndex], box, flags0, 1);
+                    }
+                    else
+                    {
+                        UINT leftNodeIndex = pHierarchy[nodeIndex].LeftChildIndex;
+                        UINT rightNodeIndex = pHierarchy[nodeIndex].RightChildIndex;
+                        if (swapChildIndices)
+                        {
+                            std::swap(leftNodeIndex, rightNodeIndex);
+                        }
+
+                        const AABBNode &leftNode = pNodes[leftNodeIndex];
+                        const AABBNode &rightNode = pNodes[rightNodeIndex];
+                        const AABB aabb = CombineAABB(
+                            BoundingBoxToAABB(leftNode.center, leftNode.halfDim),
+                            BoundingBoxToAABB(rightNode.center, rightNode.halfDim));
+                        WriteNode(pNodes[nodeIndex], AABBtoBoundingBox(aabb), leftNodeIndex & 0x00ffffff, rightNodeIndex);
+                    }
+
+                    if (nodeIndex == 0)
+                    {
+                        break;
+                    }
+
+                    const UINT parentNodeIndex = pHierarchy[nodeIndex].ParentIndex;
+                    const UINT trianglesFromOtherChild = childNodesProcessed[parentNodeIndex].fetch_add(numTriangles);
+                    if (trianglesFromOtherChild == 0)
+                    {
+                        break;
+                    }
+
+                    // Prioritize having the smaller nodes on the left. Unlike the GPU, equal counts never swap,
+                    // whichever child finished last.
+                    const bool isLeft = pHierarchy[parentNodeIndex].LeftChildIndex == nodeIndex;
+                    const UINT leftTriangles = isLeft ? numTriangles : trianglesFromOtherChild;
+                    const UINT rightTriangles = isLeft ? trianglesFromOtherChild : numTriangles;
+                    swapChildIndices = leftTriangles > rightTriangles;
+                    nodeIndex = parentNodeIndex;
+                    numTriangles += trianglesFromOtherChild;
+
+                    if (pAABBParents)
+                    {
+                        pAABBParents[pHierarchy[nodeIndex].LeftChildIndex] = nodeIndex;
+                        pAABBParents[pHierarchy[nodeIndex].RightChildIndex] = nodeIndex;
+                    }
+                }
+            }
+        });
+    }
+
+    UINT64 CpuLBVHBuilder::GetRequiredSize(
+        _In_  const D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS &inputs)
+    {
+        const bool isTopLevel = inputs.Type == D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL;
+        const UINT64 numElements = isTopLevel ? inputs.NumDescs : GetTotalPrimitiveCount(inputs);
+        const UINT64 numNodes = std::max(2 * numElements, 2ull) - 1;
+        const UINT64 sizePerElement = isTopLevel ? SizeOfBVHMetadata : SizeOfPrimitive + SizeOfPrimitiveMetaData;
+
+        UINT64 size = SizeOfBVHOffsets + numNodes * SizeOfAABBNode + numElements * sizePerElement;
+        if (inputs.Flags & D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_ALLOW_UPDATE)
+        {
+            // Sort cache and AABB parents
+            size += numElements * SizeOfUINT32 + numNodes * SizeOfUINT32;
+        }
+        return size;
+    }
+
+    void CpuLBVHBuilder::BuildRaytracingAccelerationStructure(
+        _In_  const D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC *pDesc,
+        _Out_ void *pData,
+        bool use64BitMortonCodes)
+    {
+        const D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS &inputs = pDesc->Inputs;
+        const bool isTopLevel = inputs.Type == D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL;
+        const SceneType sceneType = isTopLevel ? SceneType::BottomLevelBVHs : SceneType::Triangles;
+        const UINT numElements = isTopLevel ? inputs.NumDescs : GetTotalPrimitiveCount(inputs);
+        BYTE *pOutputBVH = (BYTE *)pData;
+
+        if (numElements == 0)
+        {
+            ConstructAABB(sceneType, 0, nullptr, pOutputBVH, nullptr);
+            return;
+        }
+
+        // Same partitions as the GPU scratch buffer: elements, metadata, indices, Morton codes and hierarchy
+        const UINT elementSize = isTopLevel ? sizeof(AABBNode) : sizeof(Primitive);
+        const UINT metaDataSize = isTopLevel ? sizeof(BVHMetadata) : sizeof(PrimitiveMetaData);
+        std::vector<BYTE> scratchElements(numElements * elementSize);
+        std::vector<BYTE> scratchMetaData(numElements * metaDataSize);
+        std::vector<UINT> indices(numElements);
+        std::vector<UINT> mortonCodes;
+        std::vector<UINT64> mortonCodes64;
+
+        if (isTopLevel)
+        {
+            LoadInstances(inputs.InstanceDescs, inputs.DescsLayout, numElements, (AABBNode *)scratchElements.data(), (BVHMetadata *)scratchMetaData.data());
+        }
+        else
+        {
+            LoadPrimitives(inputs, numElements, (Primitive *)scratchElements.data(), (PrimitiveMetaData *)scratchMetaData.data());
+        }
+
+        AABB sceneAABB;
+        CalculateSceneAABB(sceneType, scratchElements.data(), numElements, sceneAABB);
+
+        if (use64BitMortonCodes)
+        {
+            mortonCodes64.resize(numElements);
+            CalculateMortonCodes(sceneType, scratchElements.data(), numElements, sceneAABB, indices.data(), mortonCodes64.data());
+            Sort(mortonCodes64.data(), indices.data(), numElements);
+        }
+        else
+        {
+            mortonCodes.resize(numElements);
+            CalculateMortonCodes(sceneType, scratchElements.data(), numElements, sceneAABB, indices.data(), mortonCodes.data());
+            Sort(mortonCodes.data(), indices.data(), numElements);
+        }
+
+        const UINT offsetToElements = isTopLevel ? GetOffsetToLeafNodeAABBs(numElements) : GetOffsetToPrimitives(numElements);
+        BYTE *pOutputElements = pOutputBVH + offsetToElements;
+        BYTE *pOutputMetaData = pOutputElements + numElements * elementSize;
+
+        UINT *pSortCache = nullptr;
+        UINT *pAABBParents = nullptr;
+        if (inputs.Flags & D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_ALLOW_UPDATE)
+        {
+            pSortCache = (UINT *)(pOutputMetaData + numElements * metaDataSize);
+            pAABBParents = pSortCache + numElements;
+        }
+
+        Rearrange(sceneType, numElements, scratchElements.data(), scratchMetaData.data(), indices.data(), pOutputElements, pOutputMetaData, pSortCache);
+
+        std::vector<HierarchyNode> hierarchy(numElements + GetNumInternalNodes(numElements));
+        if (use64BitMortonCodes)
+        {
+            ConstructHierarchy(mortonCodes64.data(), numElements, hierarchy.data());
+        }
+        else
+        {
+            ConstructHierarchy(mortonCodes.data(), numElements, hierarchy.data());
+        }
+
+#if ENABLE_TREELET_REORDERING
+        if (!isTopLevel)
+        {
+            std::vector<AABB> aabbs(hierarchy.size());
+            Optimize(numElements, hierarchy.data(), aabbs.data(), (const Primitive *)pOutputElements, inputs.Flags);
+        }
+#endif
+
+        ConstructAABB(sceneType, numElements, hierarchy.data(), pOutputBVH, pAABBParents);
+    }
+}
@@ -0,0 +1,139 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+#pragma once
+namespace FallbackLayer
+{
+    class BuildTaskPool;
+
+    //
+    // CPU twin of the GpuBvh2Builder passes: load, scene AABB, Morton codes, sort, rearrange, Karras hierarchy,
+    // treelet reordering and AABB construction. Every pass reads and writes the same structs and buffer layouts
+    // as its GPU counterpart, so the output of any pass can be compared against the GPU one, and a full build
+    // writes the same acceleration structure layout, including the sort cache and AABB parents of ALLOW_UPDATE.
+    //
+    // Where the GPU result depends on thread timing the CPU picks one order: sort ties are ordered by index,
+    // ConstructAABB keeps the child order when both children hold the same number of leaves, and treelets are
+    // reordered bottom-up after both of their children. Morton codes match the GPU ones up to the rounding of
+    // its division, and instance transforms are inverted with a true division instead of rcp. Treelets without
+    // any surface area, which the GPU reorders out of bounds, are rebuilt from their first candidates instead.
+    //
+    // Inputs are read from CPU addresses stored in the GPU VA fields, like BuildRaytracingAccelerationStructureOnCpu.
+    //
+    class CpuLBVHBuilder
+    {
+    public:
+        // Passes are spread over pPool when there is one and run on the calling thread otherwise
+        CpuLBVHBuilder(BuildTaskPool *pPool = nullptr) : m_pPool(pPool) {}
+
+        // 64-bit Morton codes use 21 bits per axis, which the GPU builder doesn't support
+        void BuildRaytracingAccelerationStructure(
+            _In_  const D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC *pDesc,
+            _Out_ void *pData,
+            bool use64BitMortonCodes = false);
+
+        static UINT64 GetRequiredSize(
+            _In_  const D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS &inputs);
+
+        // LoadPrimitivesPass
+        void LoadPrimitives(
+            _In_  const D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS &inputs,
+            UINT numElements,
+            _Out_writes_(numElements) Primitive *pPrimitives,
+            _Out_writes_(numElements) PrimitiveMetaData *pMetaData);
+
+        // LoadInstancesPass
+        void LoadInstances(
+            D3D12_GPU_VIRTUAL_ADDRESS instanceDescs,
+            D3D12_ELEMENTS_LAYOUT instanceDescsLayout,
+            UINT numElements,
+            _Out_writes_(numElements) AABBNode *pNodes,
+            _Out_writes_(numElements) BVHMetadata *pMetaData);
+
+        // SceneAABBCalculator. pElements holds a Primitive per element for triangles and an AABBNode per element
+        // for bottom level BVHs.
+        void CalculateSceneAABB(
+            SceneType sceneType,
+            _In_ const void *pElements,
+            UINT numElements,
+            _Out_ AABB &sceneAABB);
+
+        // MortonCodesCalculator, which also resets pIndices to 0, 1, 2...
+        void CalculateMortonCodes(
+            SceneType sceneType,
+            _In_ const void *pElements,
+            UINT numElements,
+            const AABB &sceneAABB,
+            _Out_writes_(numElements) UINT *pIndices,
+            _Out_writes_(numElements) UINT *pMortonCodes);
+
+        void CalculateMortonCodes(
+            SceneType sceneType,
+            _In_ const void *pElements,
+            UINT numElements,
+            const AABB &sceneAABB,
+            _Out_writes_(numElements) UINT *pIndices,
+            _Out_writes_(numElements) UINT64 *pMortonCodes);
+
+        // BitonicSort: sorts the codes ascending, breaking ties by index, and moves the indices along
+        void Sort(
+            _Inout_updates_(numElements) UINT *pMortonCodes,
+            _Inout_updates_(numElements) UINT *pIndices,
+            UINT numElements);
+
+        void Sort(
+            _Inout_updates_(numElements) UINT64 *pMortonCodes,
+            _Inout_updates_(numElements) UINT *pIndices,
+            UINT numElements);
+
+        // RearrangeElementsPass. Elements and metadata are Primitive/PrimitiveMetaData for triangles and
+        // AABBNode/BVHMetadata for bottom level BVHs. pOutputSortCache is optional.
+        void Rearrange(
+            SceneType sceneType,
+            UINT numElements,
+            _In_ const void *pInputElements,
+            _In_ const void *pInputMetaData,
+            _In_reads_(numElements) const UINT *pIndices,
+            _Out_ void *pOutputElements,
+            _Out_ void *pOutputMetaData,
+            _Out_writes_opt_(numElements) UINT *pOutputSortCache);
+
+        // ConstructHierarchyPass. The ParentIndex of the root is left untouched.
+        void ConstructHierarchy(
+            _In_reads_(numElements) const UINT *pSortedMortonCodes,
+            UINT numElements,
+            _Out_writes_(2 * numElements - 1) HierarchyNode *pHierarchy);
+
+        void ConstructHierarchy(
+            _In_reads_(numElements) const UINT64 *pSortedMortonCodes,
+            UINT numElements,
+            _Out_writes_(2 * numElements - 1) HierarchyNode *pHierarchy);
+
+        // TreeletReorder. pAABBs is scratch space for one AABB per node.
+        void Optimize(
+            UINT numElements,
+            _Inout_updates_(2 * numElements - 1) HierarchyNode *pHierarchy,
+            _Out_writes_(2 * numElements - 1) AABB *pAABBs,
+            _In_reads_(numElements) const Primitive *pPrimitives,
+            D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAGS buildFlags);
+
+        // ConstructAABBPass for a full build: writes the header and every node of pOutputBVH, which must already
+        // hold the rearranged elements. pAABBParents is optional and filled in like PREPARE_UPDATE does.
+        void ConstructAABB(
+            SceneType sceneType,
+            UINT numElements,
+            _In_reads_(2 * numElements - 1) const HierarchyNode *pHierarchy,
+            _Inout_ BYTE *pOutputBVH,
+            _Out_writes_opt_(2 * numElements - 1) UINT *pAABBParents);
+
+    private:
+        BuildTaskPool *m_pPool;
+    };
+}
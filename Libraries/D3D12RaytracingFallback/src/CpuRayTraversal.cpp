@@ -0,0 +1,1138 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+#include "pch.h"
+
+namespace FallbackLayer
+{
+    using namespace DirectX;
+
+    // Matches RayTracingHelper.hlsli
+    static const UINT IsProceduralGeometryFlag = 0x40000000;
+
+    static const UINT HIT_KIND_TRIANGLE_FRONT_FACE = 0xFE;
+    static const UINT HIT_KIND_TRIANGLE_BACK_FACE = 0xFF;
+
+    struct TraceContext
+    {
+        UINT                        rayFlags;
+        UINT                        instanceInclusionMask;
+        const CpuAnyHitFunction*    pAnyHit;
+        CpuTraversalStats*          pStats;
+    };
+
+    struct InstanceState
+    {
+        UINT    index;
+        UINT    id;
+        UINT    contributionToHitGroupIndex;
+        UINT    flags;
+    };
+
+    struct BottomLevelView
+    {
+        BottomLevelView(const void* pAccelerationStructure)
+        {
+            const BYTE* pData = (const BYTE*)pAccelerationStructure;
+            const BVHOffsets& offsets = *(const BVHOffsets*)pData;
+            pNodes = (const AABBNode*)(pData + offsets.offsetToBoxes);
+            pPrimitives = (const Primitive*)(pData + offsets.offsetToVertices);
+            pMetaData = (const PrimitiveMetaData*)(pData + offsets.offsetToPrimitiveMetaData);
+        }
+
+        const AABBNode*             pNodes;
+        const Primitive*            pPrimitives;
+        const PrimitiveMetaData*    pMetaData;
+    };
+
+    struct TopLevelView
+    {
+        TopLevelView(const void* pAccelerationStructure)
+        {
+            const BYTE* pData = (const BYTE*)pAccelerationStructure;
+            const BVHOffsets& offsets = *(const BVHOffsets*)pData;
+            pNodes = (const AABBNode*)(pData + offsets.offsetToBoxes);
+
+            // Top levels store the offset to their instance metadata where bottom levels store the offset to vertices
+            pInstances = (const BVHMetadata*)(pData + offsets.offsetToVertices);
+        }
+
+        const AABBNode*     pNodes;
+        const BVHMetadata*  pInstances;
+    };
+
+    //
+    // Small stack that only touches the heap for unusually deep trees
+    //
+    class TraversalStack
+    {
+    public:
+        TraversalStack() : m_size(0) {}
+
+        void Push(UINT nodeIndex)
+        {
+            if (m_size < kInlineSize)
+            {
+                m_inline[m_size] = nodeIndex;
+            }
+            else
+            {
+                m_overflow.push_back(nodeIndex);
+            }
+            m_size++;
+        }
+
+        UINT Pop()
+        {
+            m_size--;
+            if (m_size < kInlineSize)
+            {
+                return m_inline[m_size];
+            }
+
+            const UINT nodeIndex = m_overflow.back();
+            m_overflow.pop_back();
+            return nodeIndex;
+        }
+
+        bool Empty() const { return m_size == 0; }
+
+    private:
+        static const UINT kInlineSize = 2 * TRAVERSAL_MAX_STACK_DEPTH;
+
+        UINT                m_inline[kInlineSize];
+        std::vector<UINT>   m_overflow;
+        UINT                m_size;
+    };
+
+    //
+    // Ray values precomputed once per BVH level, mirroring RayData in the traversal shader
+    //
+    struct RayState
+    {
+        XMVECTOR    inverseDirection;
+        XMVECTOR    originTimesInverseDirection;
+        XMVECTOR    absInverseDirection;
+        XMFLOAT3    origin;
+        XMFLOAT3    direction;
+        XMFLOAT3    shear;
+        int         swizzle[3];
+        float       tMin;
+    };
+
+    static
+        void InitRayState(
+            RayState& ray,
+            const float origin[3],
+            const float direction[3],
+            float tMin)
+    {
+        ray.origin = XMFLOAT3(origin[0], origin[1], origin[2]);
+        ray.direction = XMFLOAT3(direction[0], direction[1], direction[2]);
+        ray.tMin = tMin;
+
+        // Nudge zero components so the slab test never computes 0 * inf
+        float boxDirection[3];
+        for (UINT axis = 0; axis < 3; ++axis)
+        {
+            const float minMagnitude = 1e-20f;
+            boxDirection[axis] = (fabsf(direction[axis]) < minMagnitude) ?
+                (std::signbit(direction[axis]) ? -minMagnitude : minMagnitude) : direction[axis];
+        }
+
+        ray.inverseDirection = XMVectorReciprocal(XMVectorSet(boxDirection[0], boxDirection[1], boxDirection[2], 1.0f));
+        ray.originTimesInverseDirection = XMVectorMultiply(XMLoadFloat3(&ray.origin), ray.inverseDirection);
+        ray.absInverseDirection = XMVectorAbs(ray.inverseDirection);
+
+        // Watertight intersection setup: z is the dominant axis of the direction
+        const float absX = fabsf(direction[0]), absY = fabsf(direction[1]), absZ = fabsf(direction[2]);
+        const int zIndex = (absX > absY && absX > absZ) ? 0 : (absY > absZ) ? 1 : 2;
+        ray.swizzle[0] = (zIndex + 1) % 3;
+        ray.swizzle[1] = (zIndex + 2) % 3;
+        ray.swizzle[2] = zIndex;
+        if (direction[zIndex] < 0.0f)
+        {
+            std::swap(ray.swizzle[0], ray.swizzle[1]);
+        }
+
+        ray.shear = XMFLOAT3(
+            direction[ray.swizzle[0]] / direction[zIndex],
+            direction[ray.swizzle[1]] / direction[zIndex],
+            1.0f / direction[zIndex]);
+    }
+
+    static
+        void TransformRay(
+            const float (&transform)[3][4],
+            const XMFLOAT3& origin,
+            const XMFLOAT3& direction,
+            float transformedOrigin[3],
+            float transformedDirection[3])
+    {
+        for (UINT row = 0; row < 3; ++row)
+        {
+            transformedOrigin[row] = transform[row][0] * origin.x + transform[row][1] * origin.y + transform[row][2] * origin.z + transform[row][3];
+            transformedDirection[row] = transform[row][0] * direction.x + transform[row][1] * direction.y + transform[row][2] * direction.z;
+        }
+    }
+
+    //
+    // Ray/AABB intersection, separating axes theorem
+    //
+    static
+        bool RayBoxTest(
+            const RayState& ray,
+            const AABBNode& node,
+            float closestT,
+            float& resultT)
+    {
+        const XMVECTOR center = XMLoadFloat3((const XMFLOAT3*)node.center);
+        const XMVECTOR halfDim = XMLoadFloat3((const XMFLOAT3*)node.halfDim);
+
+        const XMVECTOR relativeMiddle = XMVectorSubtract(XMVectorMultiply(center, ray.inverseDirection), ray.originTimesInverseDirection);
+        const XMVECTOR extent = XMVectorMultiply(halfDim, ray.absInverseDirection);
+
+        XMFLOAT3 minL, maxL;
+        XMStoreFloat3(&minL, XMVectorSubtract(relativeMiddle, extent));
+        XMStoreFloat3(&maxL, XMVectorAdd(relativeMiddle, extent));
+
+        const float minT = std::max(std::max(minL.x, minL.y), minL.z);
+        const float maxT = std::min(std::min(maxL.x, maxL.y), maxL.z);
+
+        resultT = std::max(minT, 0.0f);
+        return resultT < std::min(maxT, closestT);
+    }
+
+    // Using Woop/Benthin/Wald 2013: "Watertight Ray/Triangle Intersection", same as the traversal shader
+    static
+        bool RayTriangleIntersect(
+            const RayState& ray,
+            UINT rayFlags,
+            UINT instanceFlags,
+            const Triangle& triangle,
+            float& hitT,
+            float bary[2],
+            bool& frontFace)
+    {
+        const bool useCulling = !(instanceFlags & D3D12_RAYTRACING_INSTANCE_FLAG_TRIANGLE_CULL_DISABLE);
+        const bool flipFaces = (instanceFlags & D3D12_RAYTRACING_INSTANCE_FLAG_TRIANGLE_FRONT_COUNTERCLOCKWISE) != 0;
+        const UINT backFaceCullingFlag = flipFaces ? D3D12_RAY_FLAG_CULL_FRONT_FACING_TRIANGLES : D3D12_RAY_FLAG_CULL_BACK_FACING_TRIANGLES;
+        const UINT frontFaceCullingFlag = flipFaces ? D3D12_RAY_FLAG_CULL_BACK_FACING_TRIANGLES : D3D12_RAY_FLAG_CULL_FRONT_FACING_TRIANGLES;
+        const bool useBackfaceCulling = useCulling && (rayFlags & backFaceCullingFlag);
+        const bool useFrontfaceCulling = useCulling && (rayFlags & frontFaceCullingFlag);
+
+        const float* pOrigin = &ray.origin.x;
+        const float* pV0 = &triangle.v0.x;
+        const float* pV1 = &triangle.v1.x;
+        const float* pV2 = &triangle.v2.x;
+
+        float A[3], B[3], C[3];
+        for (UINT i = 0; i < 3; ++i)
+        {
+            const int axis = ray.swizzle[i];
+            A[i] = pV0[axis] - pOrigin[axis];
+            B[i] = pV1[axis] - pOrigin[axis];
+            C[i] = pV2[axis] - pOrigin[axis];
+        }
+
+        A[0] -= ray.shear.x * A[2];
+        A[1] -= ray.shear.y * A[2];
+        B[0] -= ray.shear.x * B[2];
+        B[1] -= ray.shear.y * B[2];
+        C[0] -= ray.shear.x * C[2];
+        C[1] -= ray.shear.y * C[2];
+
+        const float U = C[0] * B[1] - C[1] * B[0];
+        const float V = A[0] * C[1] - A[1] * C[0];
+        const float W = B[0] * A[1] - B[1] * A[0];
+
+        if (useFrontfaceCulling)
+        {
+            if (U > 0.0f || V > 0.0f || W > 0.0f) return false;
+        }
+        else if (useBackfaceCulling)
+        {
+            if (U < 0.0f || V < 0.0f || W < 0.0f) return false;
+        }
+        else
+        {
+            if ((U < 0.0f || V < 0.0f || W < 0.0f) &&
+                (U > 0.0f || V > 0.0f || W > 0.0f)) return false;
+        }
+
+        const float det = U + V + W;
+        if (det == 0.0f) return false;
+
+        const float T = U * ray.shear.z * A[2] + V * ray.shear.z * B[2] + W * ray.shear.z * C[2];
+
+        if (useFrontfaceCulling)
+        {
+            if (T > 0.0f || T < hitT * det) return false;
+        }
+        else if (useBackfaceCulling)
+        {
+            if (T < 0.0f || T > hitT * det) return false;
+        }
+        else
+        {
+            float signCorrectedT = fabsf(T);
+            if ((T > 0.0f) != (det > 0.0f))
+            {
+                signCorrectedT = -signCorrectedT;
+            }
+
+            if (signCorrectedT < 0.0f || signCorrectedT > hitT * fabsf(det)) return false;
+        }
+
+        const float rcpDet = 1.0f / det;
+        bary[0] = V * rcpDet;
+        bary[1] = W * rcpDet;
+        hitT = T * rcpDet;
+        frontFace = (det > 0.0f) != flipFaces;
+        return true;
+    }
+
+    static
+        bool IsOpaque(
+            bool geomOpaque,
+            UINT instanceFlags,
+            UINT rayFlags)
+    {
+        bool opaque = geomOpaque;
+
+        if (instanceFlags & D3D12_RAYTRACING_INSTANCE_FLAG_FORCE_OPAQUE)
+            opaque = true;
+        else if (instanceFlags & D3D12_RAYTRACING_INSTANCE_FLAG_FORCE_NON_OPAQUE)
+            opaque = false;
+
+        if (rayFlags & D3D12_RAY_FLAG_FORCE_OPAQUE)
+            opaque = true;
+        else if (rayFlags & D3D12_RAY_FLAG_FORCE_NON_OPAQUE)
+            opaque = false;
+
+        return opaque;
+    }
+
+    //
+    // Tests one primitive of a leaf and commits the hit if it's closer. Returns true if the search for this ray
+    // should end.
+    //
+    static
+        bool IntersectPrimitive(
+            const TraceContext& context,
+            UINT rayIndex,
+            const RayState& ray,
+            const InstanceState& instance,
+            const Primitive& primitive,
+            const PrimitiveMetaData& metadata,
+            CpuRayHit& hit)
+    {
+        if (primitive.PrimitiveType != TRIANGLE_TYPE)
+        {
+            return false;
+        }
+
+        if (context.pStats)
+        {
+            context.pStats->PrimitivesTested++;
+        }
+
+        const bool geomOpaque = (metadata.GeometryFlags & D3D12_RAYTRACING_GEOMETRY_FLAG_OPAQUE) != 0;
+        const bool opaque = IsOpaque(geomOpaque, instance.flags, context.rayFlags);
+        if ((opaque && (context.rayFlags & D3D12_RAY_FLAG_CULL_OPAQUE)) ||
+            (!opaque && (context.rayFlags & D3D12_RAY_FLAG_CULL_NON_OPAQUE)))
+        {
+            return false;
+        }
+
+        CpuRayHit candidate;
+        candidate.T = hit.T;
+        bool frontFace;
+        if (!RayTriangleIntersect(ray, context.rayFlags, instance.flags, primitive.triangle, candidate.T, candidate.Barycentrics, frontFace) ||
+            !(candidate.T > ray.tMin))
+        {
+            return false;
+        }
+
+        candidate.HitKind = frontFace ? HIT_KIND_TRIANGLE_FRONT_FACE : HIT_KIND_TRIANGLE_BACK_FACE;
+        candidate.PrimitiveIndex = metadata.PrimitiveIndex;
+        candidate.GeometryContributionToHitGroupIndex = metadata.GeometryContributionToHitGroupIndex;
+        candidate.InstanceIndex = instance.index;
+        candidate.InstanceID = instance.id;
+        candidate.InstanceContributionToHitGroupIndex = instance.contributionToHitGroupIndex;
+
+        CpuAnyHitResult result = CpuAnyHitAccept;
+        if (!opaque && context.pAnyHit)
+        {
+            result = (*context.pAnyHit)(rayIndex, candidate);
+        }
+
+        if (result == CpuAnyHitIgnore)
+        {
+            return false;
+        }
+
+        hit = candidate;
+        return result == CpuAnyHitAcceptAndEndSearch || (context.rayFlags & D3D12_RAY_FLAG_ACCEPT_FIRST_HIT_AND_END_SEARCH);
+    }
+
+    static
+        InstanceState GetInstanceState(
+            const BVHMetadata& instance)
+    {
+        InstanceState state;
+        state.index = instance.InstanceIndex;
+        state.id = instance.instanceDesc.InstanceID;
+        state.contributionToHitGroupIndex = instance.instanceDesc.InstanceContributionToHitGroupIndex;
+        state.flags = instance.instanceDesc.Flags;
+        return state;
+    }
+
+    static
+        bool IsLeafEmptyOrProcedural(
+            const AABBNode& node)
+    {
+        return node.numTriangles == 0 || (node.nodeAllBits & IsProceduralGeometryFlag);
+    }
+
+    static
+        void CountNodeBytes(
+            const TraceContext& context,
+            UINT64 numBytes)
+    {
+        if (context.pStats)
+        {
+            context.pStats->NodeBytesRead += numBytes;
+        }
+    }
+
+    //
+    // Single ray traversal
+    //
+
+    static
+        bool TraverseBottomLevel(
+            const TraceContext& context,
+            UINT rayIndex,
+            const BottomLevelView& bvh,
+            const RayState& ray,
+            const InstanceState& instance,
+            CpuRayHit& hit)
+    {
+        float rootT;
+        CountNodeBytes(context, sizeof(AABBNode));
+        if (!RayBoxTest(ray, bvh.pNodes[0], hit.T, rootT))
+        {
+            return false;
+        }
+
+        TraversalStack stack;
+        stack.Push(0);
+        while (!stack.Empty())
+        {
+            const AABBNode& node = bvh.pNodes[stack.Pop()];
+            if (context.pStats)
+            {
+                context.pStats->NodesVisited++;
+            }
+
+            if (node.leaf)
+            {
+                if (IsLeafEmptyOrProcedural(node))
+                    continue;
+
+                const UINT firstPrimitive = node.leafNode.firstTriangleId;
+                for (UINT i = firstPrimitive; i < firstPrimitive + node.numTriangles; ++i)
+                {
+                    if (IntersectPrimitive(context, rayIndex, ray, instance, bvh.pPrimitives[i], bvh.pMetaData[i], hit))
+                    {
+                        return true;
+                    }
+                }
+                continue;
+            }
+
+            const UINT leftNodeIndex = node.internalNode.leftNodeIndex;
+            const UINT rightNodeIndex = node.rightNodeIndex;
+            float leftT, rightT;
+            CountNodeBytes(context, 2 * sizeof(AABBNode));
+            const bool leftTest = RayBoxTest(ray, bvh.pNodes[leftNodeIndex], hit.T, leftT);
+            const bool rightTest = RayBoxTest(ray, bvh.pNodes[rightNodeIndex], hit.T, rightT);
+
+            // Push the far child first so the near one is visited next
+            if (leftTest && rightTest)
+            {
+                const bool leftIsNear = leftT < rightT;
+                stack.Push(leftIsNear ? rightNodeIndex : leftNodeIndex);
+                stack.Push(leftIsNear ? leftNodeIndex : rightNodeIndex);
+            }
+            else if (leftTest)
+            {
+                stack.Push(leftNodeIndex);
+            }
+            else if (rightTest)
+            {
+                stack.Push(rightNodeIndex);
+            }
+        }
+        return false;
+    }
+
+    //
+    // Traces the bottom levels of a range of instances, returns true if the search for this ray should end
+    //
+    static
+        bool TraverseInstances(
+            const TraceContext& context,
+            UINT rayIndex,
+            const TopLevelView& bvh,
+            UINT firstInstance,
+            UINT numInstances,
+            const RayState& ray,
+            CpuRayHit& hit)
+    {
+        for (UINT i = firstInstance; i < firstInstance + numInstances; ++i)
+        {
+            const BVHMetadata& instance = bvh.pInstances[i];
+            if (!(instance.instanceDesc.InstanceMask & context.instanceInclusionMask))
+                continue;
+
+            float objectOrigin[3], objectDirection[3];
+            TransformRay(instance.instanceDesc.Transform, ray.origin, ray.direction, objectOrigin, objectDirection);
+
+            RayState objectRay;
+            InitRayState(objectRay, objectOrigin, objectDirection, ray.tMin);
+
+            const BottomLevelView bottomLevel((const void*)instance.instanceDesc.AccelerationStructure.GpuVA);
+            if (TraverseBottomLevel(context, rayIndex, bottomLevel, objectRay, GetInstanceState(instance), hit))
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    static
+        void TraverseTopLevel(
+            const TraceContext& context,
+            UINT rayIndex,
+            const TopLevelView& bvh,
+            const RayState& ray,
+            CpuRayHit& hit)
+    {
+        float rootT;
+        CountNodeBytes(context, sizeof(AABBNode));
+        if (!RayBoxTest(ray, bvh.pNodes[0], hit.T, rootT))
+        {
+            return;
+        }
+
+        TraversalStack stack;
+        stack.Push(0);
+        while (!stack.Empty())
+        {
+            const AABBNode& node = bvh.pNodes[stack.Pop()];
+            if (context.pStats)
+            {
+                context.pStats->NodesVisited++;
+            }
+
+            if (node.leaf)
+            {
+                if (node.numTriangles == 0)
+                    continue;
+
+                if (TraverseInstances(context, rayIndex, bvh, node.leafNode.firstTriangleId, node.numTriangles, ray, hit))
+                {
+                    return;
+                }
+                continue;
+            }
+
+            const UINT leftNodeIndex = node.internalNode.leftNodeIndex;
+            const UINT rightNodeIndex = node.rightNodeIndex;
+            float leftT, rightT;
+            CountNodeBytes(context, 2 * sizeof(AABBNode));
+            const bool leftTest = RayBoxTest(ray, bvh.pNodes[leftNodeIndex], hit.T, leftT);
+            const bool rightTest = RayBoxTest(ray, bvh.pNodes[rightNodeIndex], hit.T, rightT);
+
+            if (leftTest && rightTest)
+            {
+                const bool leftIsNear = leftT < rightT;
+                stack.Push(leftIsNear ? rightNodeIndex : leftNodeIndex);
+                stack.Push(leftIsNear ? leftNodeIndex : rightNodeIndex);
+            }
+            else if (leftTest)
+            {
+                stack.Push(leftNodeIndex);
+            }
+            else if (rightTest)
+            {
+                stack.Push(rightNodeIndex);
+            }
+        }
+    }
+
+    //
+    // Packet traversal. Every box is tested against all the rays of the packet at once, one ray per SIMD lane,
+    // and a node is visited while any active ray hits it. Triangles are tested per ray with the same watertight
+    // test as single rays, so both paths return identical hits.
+    //
+
+    struct RayPacket
+    {
+        RayState    rays[CPU_RAY_PACKET_SIZE];
+
+        // Transposed from rays[], lane i belongs to ray i
+        XMVECTOR    inverseDirection[3];
+        XMVECTOR    originTimesInverseDirection[3];
+        XMVECTOR    absInverseDirection[3];
+
+        // Sum of the directions, used to pick which child to visit first
+        XMFLOAT3    direction;
+        UINT        numRays;
+    };
+
+    static
+        void InitRayPacketLanes(
+            RayPacket& packet)
+    {
+        XMMATRIX inverseDirection, originTimesInverseDirection, absInverseDirection;
+        for (UINT lane = 0; lane < CPU_RAY_PACKET_SIZE; ++lane)
+        {
+            // Unused lanes repeat the first ray, they are never active
+            const RayState& ray = packet.rays[lane < packet.numRays ? lane : 0];
+            inverseDirection.r[lane] = ray.inverseDirection;
+            originTimesInverseDirection.r[lane] = ray.originTimesInverseDirection;
+            absInverseDirection.r[lane] = ray.absInverseDirection;
+        }
+
+        inverseDirection = XMMatrixTranspose(inverseDirection);
+        originTimesInverseDirection = XMMatrixTranspose(originTimesInverseDirection);
+        absInverseDirection = XMMatrixTranspose(absInverseDirection);
+
+        for (UINT axis = 0; axis < 3; ++axis)
+        {
+            packet.inverseDirection[axis] = inverseDirection.r[axis];
+            packet.originTimesInverseDirection[axis] = originTimesInverseDirection.r[axis];
+            packet.absInverseDirection[axis] = absInverseDirection.r[axis];
+        }
+
+        packet.direction = XMFLOAT3(0, 0, 0);
+        for (UINT lane = 0; lane < packet.numRays; ++lane)
+        {
+            packet.direction.x += packet.rays[lane].direction.x;
+            packet.direction.y += packet.rays[lane].direction.y;
+            packet.direction.z += packet.rays[lane].direction.z;
+        }
+    }
+
+    static
+        XMVECTOR LoadClosestT(
+            const CpuRayHit* pHits,
+            UINT numRays)
+    {
+        float closestT[CPU_RAY_PACKET_SIZE] = {};
+        for (UINT lane = 0; lane < numRays; ++lane)
+        {
+            closestT[lane] = pHits[lane].T;
+        }
+        return XMVectorSet(closestT[0], closestT[1], closestT[2], closestT[3]);
+    }
+
+    static
+        bool AnyLane(
+            FXMVECTOR mask)
+    {
+        return XMVector4NotEqualInt(mask, XMVectorZero());
+    }
+
+    static
+        UINT CountLanes(
+            FXMVECTOR mask)
+    {
+        UINT lanes[CPU_RAY_PACKET_SIZE];
+        XMStoreInt4((uint32_t*)lanes, mask);
+        return (lanes[0] ? 1 : 0) + (lanes[1] ? 1 : 0) + (lanes[2] ? 1 : 0) + (lanes[3] ? 1 : 0);
+    }
+
+    // Returns the mask of the lanes whose ray hits the box
+    static
+        XMVECTOR RayPacketBoxTest(
+            const RayPacket& packet,
+            const AABBNode& node,
+            FXMVECTOR closestT)
+    {
+        XMVECTOR minT = XMVectorZero();
+        XMVECTOR maxT = closestT;
+        for (UINT axis = 0; axis < 3; ++axis)
+        {
+            const XMVECTOR relativeMiddle = XMVectorSubtract(
+                XMVectorMultiply(XMVectorReplicate(node.center[axis]), packet.inverseDirection[axis]),
+                packet.originTimesInverseDirection[axis]);
+            const XMVECTOR extent = XMVectorMultiply(XMVectorReplicate(node.halfDim[axis]), packet.absInverseDirection[axis]);
+
+            minT = XMVectorMax(minT, XMVectorSubtract(relativeMiddle, extent));
+            maxT = XMVectorMin(maxT, XMVectorAdd(relativeMiddle, extent));
+        }
+        return XMVectorLess(minT, maxT);
+    }
+
+    static
+        void PushChildrenNearFirst(
+            TraversalStack& stack,
+            const AABBNode* pNodes,
+            const AABBNode& node,
+            const XMFLOAT3& direction)
+    {
+        const UINT leftNodeIndex = node.internalNode.leftNodeIndex;
+        const UINT rightNodeIndex = node.rightNodeIndex;
+        const AABBNode& left = pNodes[leftNodeIndex];
+        const AABBNode& right = pNodes[rightNodeIndex];
+
+        const float leftAlongDirection =
+            (left.center[0] - right.center[0]) * direction.x +
+            (left.center[1] - right.center[1]) * direction.y +
+            (left.center[2] - right.center[2]) * direction.z;
+
+        const bool leftIsNear = leftAlongDirection < 0.0f;
+        stack.Push(leftIsNear ? rightNodeIndex : leftNodeIndex);
+        stack.Push(leftIsNear ? leftNodeIndex : rightNodeIndex);
+    }
+
+    //
+    // activeMask holds the lanes still searching, lanes whose search ends are cleared from it
+    //
+    static
+        void TraverseBottomLevel(
+            const TraceContext& context,
+            UINT firstRayIndex,
+            const BottomLevelView& bvh,
+            const RayPacket& packet,
+            const InstanceState& instance,
+            XMVECTOR& activeMask,
+            CpuRayHit* pHits)
+    {
+        TraversalStack stack;
+        stack.Push(0);
+        while (!stack.Empty())
+        {
+            const AABBNode& node = bvh.pNodes[stack.Pop()];
+            CountNodeBytes(context, sizeof(AABBNode));
+            const XMVECTOR hitMask = XMVectorAndInt(RayPacketBoxTest(packet, node, LoadClosestT(pHits, packet.numRays)), activeMask);
+            if (!AnyLane(hitMask))
+                continue;
+
+            if (context.pStats)
+            {
+                context.pStats->NodesVisited += CountLanes(hitMask);
+            }
+
+            if (!node.leaf)
+            {
+                PushChildrenNearFirst(stack, bvh.pNodes, node, packet.direction);
+                continue;
+            }
+
+            if (IsLeafEmptyOrProcedural(node))
+                continue;
+
+            UINT lanes[CPU_RAY_PACKET_SIZE];
+            XMStoreInt4((uint32_t*)lanes, hitMask);
+
+            UINT endedLanes[CPU_RAY_PACKET_SIZE] = {};
+            const UINT firstPrimitive = node.leafNode.firstTriangleId;
+            for (UINT lane = 0; lane < packet.numRays; ++lane)
+            {
+                if (!lanes[lane])
+                    continue;
+
+                for (UINT i = firstPrimitive; i < firstPrimitive + node.numTriangles; ++i)
+                {
+                    if (IntersectPrimitive(context, firstRayIndex + lane, packet.rays[lane], instance, bvh.pPrimitives[i], bvh.pMetaData[i], pHits[lane]))
+                    {
+                        endedLanes[lane] = 0xffffffff;
+                        break;
+                    }
+                }
+            }
+
+            activeMask = XMVectorAndCInt(activeMask, XMLoadInt4((const uint32_t*)endedLanes));
+            if (!AnyLane(activeMask))
+                return;
+        }
+    }
+
+    static
+        void TraverseTopLevel(
+            const TraceContext& context,
+            UINT firstRayIndex,
+            const TopLevelView& bvh,
+            const RayPacket& packet,
+            XMVECTOR& activeMask,
+            CpuRayHit* pHits)
+    {
+        TraversalStack stack;
+        stack.Push(0);
+        while (!stack.Empty())
+        {
+            const AABBNode& node = bvh.pNodes[stack.Pop()];
+            CountNodeBytes(context, sizeof(AABBNode));
+            const XMVECTOR hitMask = XMVectorAndInt(RayPacketBoxTest(packet, node, LoadClosestT(pHits, packet.numRays)), activeMask);
+            if (!AnyLane(hitMask))
+                continue;
+
+            if (context.pStats)
+            {
+                context.pStats->NodesVisited += CountLanes(hitMask);
+            }
+
+            if (!node.leaf)
+            {
+                PushChildrenNearFirst(stack, bvh.pNodes, node, packet.direction);
+                continue;
+            }
+
+            const UINT firstInstance = node.leafNode.firstTriangleId;
+            for (UINT i = firstInstance; i < firstInstance + node.numTriangles; ++i)
+            {
+                const BVHMetadata& instance = bvh.pInstances[i];
+                if (!(instance.instanceDesc.InstanceMask & context.instanceInclusionMask))
+                    continue;
+
+                // The whole packet moves to object space together, only lanes that hit the instance box traverse it
+                RayPacket objectPacket;
+                objectPacket.numRays = packet.numRays;
+                for (UINT lane = 0; lane < packet.numRays; ++lane)
+                {
+                    const RayState& ray = packet.rays[lane];
+                    float objectOrigin[3], objectDirection[3];
+                    TransformRay(instance.instanceDesc.Transform, ray.origin, ray.direction, objectOrigin, objectDirection);
+                    InitRayState(objectPacket.rays[lane], objectOrigin, objectDirection, ray.tMin);
+                }
+                InitRayPacketLanes(objectPacket);
+
+                XMVECTOR instanceMask = XMVectorAndInt(hitMask, activeMask);
+                const XMVECTOR searchingMask = instanceMask;
+                const BottomLevelView bottomLevel((const void*)instance.instanceDesc.AccelerationStructure.GpuVA);
+                TraverseBottomLevel(context, firstRayIndex, bottomLevel, objectPacket, GetInstanceState(instance), instanceMask, pHits);
+
+                // Drop the lanes whose search ended inside this instance
+                activeMask = XMVectorAndCInt(activeMask, XMVectorAndCInt(searchingMask, instanceMask));
+                if (!AnyLane(activeMask))
+                    return;
+            }
+        }
+    }
+
+    static
+        void InitHit(
+            const CpuRayDesc& ray,
+            CpuRayHit& hit)
+    {
+        hit.T = ray.TMax;
+        hit.Barycentrics[0] = hit.Barycentrics[1] = 0.0f;
+        hit.HitKind = 0;
+        hit.PrimitiveIndex = CPU_RAY_NO_HIT;
+        hit.GeometryContributionToHitGroupIndex = CPU_RAY_NO_HIT;
+        hit.InstanceIndex = CPU_RAY_NO_HIT;
+        hit.InstanceID = CPU_RAY_NO_HIT;
+        hit.InstanceContributionToHitGroupIndex = CPU_RAY_NO_HIT;
+    }
+
+    static
+        TraceContext GetTraceContext(
+            const CpuTraceRaysDesc& desc)
+    {
+        TraceContext context;
+        context.rayFlags = desc.RayFlags;
+        context.instanceInclusionMask = desc.InstanceInclusionMask;
+        context.pAnyHit = desc.pAnyHit;
+        context.pStats = desc.pStats;
+        return context;
+    }
+
+    // Bottom levels traced directly behave like a single instance with an identity transform and no flags
+    static
+        InstanceState GetDefaultInstanceState()
+    {
+        InstanceState state = {};
+        return state;
+    }
+
+    //
+    // Wide BVH traversal. One ray at a time, testing the children of a node four at a time with SIMD.
+    //
+
+    //
+    // Returns a bit per child whose box the ray enters before closestT, along with its entry distance
+    //
+    template <UINT Width>
+    static
+        UINT IntersectWideNode(
+            const RayState& ray,
+            const CpuWideBVHNode<Width>& node,
+            float closestT,
+            float (&childT)[Width])
+    {
+        XMFLOAT3 inverseDirection, originTimesInverseDirection;
+        XMStoreFloat3(&inverseDirection, ray.inverseDirection);
+        XMStoreFloat3(&originTimesInverseDirection, ray.originTimesInverseDirection);
+        const float* pInverseDirection = &inverseDirection.x;
+        const float* pOriginTimesInverseDirection = &originTimesInverseDirection.x;
+
+        UINT hitMask = 0;
+        for (UINT group = 0; group < Width; group += 4)
+        {
+            XMVECTOR tNear = XMVectorZero();
+            XMVECTOR tFar = XMVectorReplicate(closestT);
+            for (UINT axis = 0; axis < 3; ++axis)
+            {
+                const BYTE* pLower = &node.lower[axis][group];
+                const BYTE* pUpper = &node.upper[axis][group];
+                const XMVECTOR lower = XMVectorSet(pLower[0], pLower[1], pLower[2], pLower[3]);
+                const XMVECTOR upper = XMVectorSet(pUpper[0], pUpper[1], pUpper[2], pUpper[3]);
+
+                // Same dequantization as the collapse: origin + q * step
+                const XMVECTOR origin = XMVectorReplicate(node.origin[axis]);
+                const XMVECTOR step = XMVectorReplicate(ldexpf(1.0f, node.exponent[axis]));
+                const XMVECTOR boxMin = XMVectorAdd(XMVectorMultiply(lower, step), origin);
+                const XMVECTOR boxMax = XMVectorAdd(XMVectorMultiply(upper, step), origin);
+
+                const XMVECTOR inverse = XMVectorReplicate(pInverseDirection[axis]);
+                const XMVECTOR originTimesInverse = XMVectorReplicate(pOriginTimesInverseDirection[axis]);
+                const XMVECTOR t0 = XMVectorSubtract(XMVectorMultiply(boxMin, inverse), originTimesInverse);
+                const XMVECTOR t1 = XMVectorSubtract(XMVectorMultiply(boxMax, inverse), originTimesInverse);
+
+                tNear = XMVectorMax(tNear, XMVectorMin(t0, t1));
+                tFar = XMVectorMin(tFar, XMVectorMax(t0, t1));
+            }
+
+            UINT lanes[4];
+            XMStoreInt4((uint32_t*)lanes, XMVectorLess(tNear, tFar));
+            XMStoreFloat4((XMFLOAT4*)&childT[group], tNear);
+            for (UINT lane = 0; lane < 4; ++lane)
+            {
+                hitMask |= (lanes[lane] ? 1u : 0u) << (group + lane);
+            }
+        }
+        return hitMask;
+    }
+
+    //
+    // intersectLeaf(firstPrimitive, numPrimitives) returns true if the search for this ray should end
+    //
+    template <UINT Width, typename LeafFunction>
+    static
+        bool TraverseWideBVH(
+            const TraceContext& context,
+            const CpuWideBVH<Width>& bvh,
+            const RayState& ray,
+            const CpuRayHit& hit,
+            const LeafFunction& intersectLeaf)
+    {
+        const CpuWideBVHNode<Width>* pNodes = bvh.GetNodes();
+
+        TraversalStack stack;
+        stack.Push(0);
+        while (!stack.Empty())
+        {
+            const UINT child = stack.Pop();
+            if (child & CPU_WIDE_BVH_LEAF_FLAG)
+            {
+                if (intersectLeaf(child & 0x00ffffff, ((child >> 24) & 0x7f) + 1))
+                {
+                    return true;
+                }
+                continue;
+            }
+
+            const CpuWideBVHNode<Width>& node = pNodes[child];
+            if (context.pStats)
+            {
+                context.pStats->NodesVisited++;
+            }
+            CountNodeBytes(context, sizeof(node));
+
+            float childT[Width];
+            UINT hitMask = IntersectWideNode(ray, node, hit.T, childT);
+
+            // Sort the children that were hit by distance and push the far ones first
+            UINT order[Width];
+            UINT numHits = 0;
+            for (; hitMask; hitMask &= hitMask - 1)
+            {
+                UINT i = 0;
+                while (!(hitMask & (1u << i)))
+                {
+                    i++;
+                }
+
+                if (node.children[i] == CPU_WIDE_BVH_EMPTY_CHILD)
+                    continue;
+
+                UINT position = numHits++;
+                while (position > 0 && childT[order[position - 1]] > childT[i])
+                {
+                    order[position] = order[position - 1];
+                    position--;
+                }
+                order[position] = i;
+            }
+
+            while (numHits > 0)
+            {
+                stack.Push(node.children[order[--numHits]]);
+            }
+        }
+        return false;
+    }
+
+    template <UINT Width>
+    static
+        void TraverseWideBVH(
+            const TraceContext& context,
+            UINT rayIndex,
+            const CpuWideBVH<Width>& bvh,
+            const RayState& ray,
+            CpuRayHit& hit)
+    {
+        if (bvh.GetType() == D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL)
+        {
+            const TopLevelView topLevel(bvh.GetAccelerationStructure());
+            TraverseWideBVH(context, bvh, ray, hit, [&](UINT firstInstance, UINT numInstances)
+            {
+                return TraverseInstances(context, rayIndex, topLevel, firstInstance, numInstances, ray, hit);
+            });
+        }
+        else
+        {
+            const BottomLevelView bottomLevel(bvh.GetAccelerationStructure());
+            const InstanceState instance = GetDefaultInstanceState();
+            TraverseWideBVH(context, bvh, ray, hit, [&](UINT firstPrimitive, UINT numPrimitives)
+            {
+                for (UINT i = firstPrimitive; i < firstPrimitive + numPrimitives; ++i)
+                {
+                    if (IntersectPrimitive(context, rayIndex, ray, instance, bottomLevel.pPrimitives[i], bottomLevel.pMetaData[i], hit))
+                    {
+                        return true;
+                    }
+                }
+                return false;
+            });
+        }
+    }
+
+    void TraceRayOnCpu(
+        _In_  const CpuTraceRaysDesc &desc,
+        _In_  const CpuRayDesc &ray,
+        _Out_ CpuRayHit &hit)
+    {
+        InitHit(ray, hit);
+
+        RayState rayState;
+        InitRayState(rayState, ray.Origin, ray.Direction, ray.TMin);
+
+        const TraceContext context = GetTraceContext(desc);
+        if (desc.Type == D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL)
+        {
+            TraverseTopLevel(context, 0, TopLevelView(desc.pAccelerationStructure), rayState, hit);
+        }
+        else
+        {
+            TraverseBottomLevel(context, 0, BottomLevelView(desc.pAccelerationStructure), rayState, GetDefaultInstanceState(), hit);
+        }
+    }
+
+    void TraceRayPacketOnCpu(
+        _In_  const CpuTraceRaysDesc &desc,
+        _In_reads_(numRays) const CpuRayDesc *pRays,
+        UINT numRays,
+        _Out_writes_(numRays) CpuRayHit *pHits,
+        UINT firstRayIndex)
+    {
+        assert(numRays <= CPU_RAY_PACKET_SIZE);
+        if (numRays == 0)
+        {
+            return;
+        }
+
+        RayPacket packet;
+        packet.numRays = numRays;
+        UINT lanes[CPU_RAY_PACKET_SIZE] = {};
+        for (UINT lane = 0; lane < numRays; ++lane)
+        {
+            InitHit(pRays[lane], pHits[lane]);
+            InitRayState(packet.rays[lane], pRays[lane].Origin, pRays[lane].Direction, pRays[lane].TMin);
+            lanes[lane] = 0xffffffff;
+        }
+        InitRayPacketLanes(packet);
+
+        XMVECTOR activeMask = XMLoadInt4((const uint32_t*)lanes);
+        const TraceContext context = GetTraceContext(desc);
+        if (desc.Type == D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL)
+        {
+            TraverseTopLevel(context, firstRayIndex, TopLevelView(desc.pAccelerationStructure), packet, activeMask, pHits);
+        }
+        else
+        {
+            TraverseBottomLevel(context, firstRayIndex, BottomLevelView(desc.pAccelerationStructure), packet, GetDefaultInstanceState(), activeMask, pHits);
+        }
+    }
+
+    void TraceRaysOnCpu(
+        _In_  const CpuTraceRaysDesc &desc,
+        _In_reads_(numRays) const CpuRayDesc *pRays,
+        UINT numRays,
+        _Out_writes_(numRays) CpuRayHit *pHits)
+    {
+        for (UINT firstRay = 0; firstRay < numRays; firstRay += CPU_RAY_PACKET_SIZE)
+        {
+            const UINT packetSize = std::min(numRays - firstRay, CPU_RAY_PACKET_SIZE);
+            TraceRayPacketOnCpu(desc, pRays + firstRay, packetSize, pHits + firstRay, firstRay);
+        }
+    }
+
+    template <UINT Width>
+    void TraceRayOnCpu(
+        _In_  const CpuTraceRaysDesc &desc,
+        _In_  const CpuWideBVH<Width> &bvh,
+        _In_  const CpuRayDesc &ray,
+        _Out_ CpuRayHit &hit)
+    {
+        TraceRaysOnCpu(desc, bvh, &ray, 1, &hit);
+    }
+
+    template <UINT Width>
+    void TraceRaysOnCpu(
+        _In_  const CpuTraceRaysDesc &desc,
+        _In_  const CpuWideBVH<Width> &bvh,
+        _In_reads_(numRays) const CpuRayDesc *pRays,
+        UINT numRays,
+        _Out_writes_(numRays) CpuRayHit *pHits)
+    {
+        assert(desc.pAccelerationStructure == bvh.GetAccelerationStructure() && desc.Type == bvh.GetType());
+
+        const TraceContext context = GetTraceContext(desc);
+        for (UINT i = 0; i < numRays; ++i)
+        {
+            InitHit(pRays[i], pHits[i]);
+
+            RayState rayState;
+            InitRayState(rayState, pRays[i].Origin, pRays[i].Direction, pRays[i].TMin);
+            TraverseWideBVH(context, i, bvh, rayState, pHits[i]);
+        }
+    }
+
+    template void TraceRayOnCpu(const CpuTraceRaysDesc &, const CpuBVH4 &, const CpuRayDesc &, CpuRayHit &);
+    template void TraceRayOnCpu(const CpuTraceRaysDesc &, const CpuBVH8 &, const CpuRayDesc &, CpuRayHit &);
+    template void TraceRaysOnCpu(const CpuTraceRaysDesc &, const CpuBVH4 &, const CpuRayDesc *, UINT, CpuRayHit *);
+    template void TraceRaysOnCpu(const CpuTraceRaysDesc &, const CpuBVH8 &, const CpuRayDesc *, UINT, CpuRayHit *);
+}
@@ -0,0 +1,107 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+#pragma once
+namespace FallbackLayer
+{
+    //
+    // CPU traversal of acceleration structures produced by BuildRaytracingAccelerationStructureOnCpu, following
+    // the same rules as the traversal shader: watertight triangle tests, ray and instance flags, instance masks
+    // and the BVHMetadata instance transforms of top levels. Procedural primitives are skipped.
+    //
+
+    struct CpuRayDesc
+    {
+        float   Origin[3];
+        float   TMin;
+        float   Direction[3];
+        float   TMax;
+    };
+
+    static const UINT CPU_RAY_NO_HIT = 0xffffffff;
+
+    struct CpuRayHit
+    {
+        float   T;
+        float   Barycentrics[2];
+        UINT    HitKind;
+        UINT    PrimitiveIndex;     // CPU_RAY_NO_HIT if the ray didn't hit anything
+        UINT    GeometryContributionToHitGroupIndex;
+        UINT    InstanceIndex;
+        UINT    InstanceID;
+        UINT    InstanceContributionToHitGroupIndex;
+    };
+
+    enum CpuAnyHitResult
+    {
+        CpuAnyHitIgnore,
+        CpuAnyHitAccept,
+        CpuAnyHitAcceptAndEndSearch,
+    };
+
+    // Called for candidate hits on non-opaque geometry, rayIndex is the index of the ray in the traced batch
+    typedef std::function<CpuAnyHitResult(UINT rayIndex, const CpuRayHit &candidate)> CpuAnyHitFunction;
+
+    // Traversal work, accumulated over every ray traced with the desc. Useful to compare builds of the same scene.
+    struct CpuTraversalStats
+    {
+        UINT64  NodesVisited;       // nodes whose box was entered, counted once per ray
+        UINT64  PrimitivesTested;   // ray-primitive intersection tests
+        UINT64  NodeBytesRead;      // node data loaded, shared by the rays of a packet
+    };
+
+    struct CpuTraceRaysDesc
+    {
+        const void *pAccelerationStructure;
+        D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE Type;
+        UINT RayFlags;                      // D3D12_RAY_FLAGS, use D3D12_RAY_FLAG_ACCEPT_FIRST_HIT_AND_END_SEARCH for any hit queries
+        UINT InstanceInclusionMask;
+        const CpuAnyHitFunction *pAnyHit;   // optional
+        CpuTraversalStats *pStats;          // optional, not synchronized so use one per thread
+    };
+
+    void TraceRayOnCpu(
+        _In_  const CpuTraceRaysDesc &desc,
+        _In_  const CpuRayDesc &ray,
+        _Out_ CpuRayHit &hit);
+
+    // Traces up to CPU_RAY_PACKET_SIZE rays together, testing every box against the whole packet with SIMD
+    static const UINT CPU_RAY_PACKET_SIZE = 4;
+    void TraceRayPacketOnCpu(
+        _In_  const CpuTraceRaysDesc &desc,
+        _In_reads_(numRays) const CpuRayDesc *pRays,
+        UINT numRays,
+        _Out_writes_(numRays) CpuRayHit *pHits,
+        UINT firstRayIndex = 0);
+
+    // Traces any number of rays in packets. Coherent rays (e.g. neighboring pixels) should be adjacent.
+    void TraceRaysOnCpu(
+        _In_  const CpuTraceRaysDesc &desc,
+        _In_reads_(numRays) const CpuRayDesc *pRays,
+        UINT numRays,
+        _Out_writes_(numRays) CpuRayHit *pHits);
+
+    // Same as above with a wide BVH collapsed from desc.pAccelerationStructure. For top levels only the top
+    // level is wide, instances still trace their binary bottom levels. Rays are traced one at a time.
+    template <UINT Width>
+    void TraceRayOnCpu(
+        _In_  const CpuTraceRaysDesc &desc,
+        _In_  const CpuWideBVH<Width> &bvh,
+        _In_  const CpuRayDesc &ray,
+        _Out_ CpuRayHit &hit);
+
+    template <UINT Width>
+    void TraceRaysOnCpu(
+        _In_  const CpuTraceRaysDesc &desc,
+        _In_  const CpuWideBVH<Width> &bvh,
+        _In_reads_(numRays) const CpuRayDesc *pRays,
+        UINT numRays,
+        _Out_writes_(numRays) CpuRayHit *pHits);
+}
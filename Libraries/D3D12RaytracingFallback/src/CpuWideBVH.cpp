@@ -0,0 +1,308 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+#include "pch.h"
+
+namespace FallbackLayer
+{
+    //
+    // Collapses a binary tree into a Width-wide one top-down. Every wide node starts from the two children of
+    // a binary node and keeps opening the child with the largest surface area until it has Width children,
+    // which is the greedy strategy of Wald et al., "Getting Rid of Packets". Subtrees small enough to become a
+    // leaf are never opened. The binary tree is only read, so any valid topology works, including trees whose
+    // indices were shuffled by refit rotations.
+    //
+    template <UINT Width>
+    class WideBVHCollapser
+    {
+    public:
+        WideBVHCollapser(
+            const AABBNode* pNodes,
+            UINT numNodes,
+            UINT maxLeafSize) :
+            m_pNodes(pNodes),
+            m_maxLeafSize(std::min(std::max(maxLeafSize, 1u), CPU_WIDE_BVH_MAX_LEAF_SIZE))
+        {
+            m_subtrees.resize(numNodes);
+        }
+
+        void Collapse(
+            std::vector<CpuWideBVHNode<Width>>& nodes)
+        {
+            ComputeSubtrees();
+
+            nodes.clear();
+            nodes.emplace_back();
+
+            if (IsLeafCandidate(0))
+            {
+                UINT root = 0;
+                WriteNode(&root, 1, nodes[0]);
+                return;
+            }
+
+            std::vector<std::pair<UINT, UINT>> stack;
+            stack.emplace_back(0, 0);
+            while (!stack.empty())
+            {
+                const UINT binaryNode = stack.back().first;
+                const UINT wideNode = stack.back().second;
+                stack.pop_back();
+
+                UINT children[Width];
+                const UINT numChildren = OpenChildren(binaryNode, children);
+                WriteNode(children, numChildren, nodes[wideNode]);
+
+                for (UINT i = 0; i < numChildren; ++i)
+                {
+                    if (IsLeafCandidate(children[i]))
+                        continue;
+
+                    const UINT childNode = (UINT)nodes.size();
+                    nodes[wideNode].children[i] = childNode;
+                    nodes.emplace_back();
+                    stack.emplace_back(children[i], childNode);
+                }
+            }
+        }
+
+    private:
+        struct Subtree
+        {
+            float   boxMin[3];
+            float   boxMax[3];
+            UINT    firstPrimitive;
+            UINT    endPrimitive;
+            UINT    numPrimitives;
+        };
+
+        //
+        // Bottom-up pass computing the box and primitive range of every subtree
+        //
+        void ComputeSubtrees()
+        {
+            std::vector<std::pair<UINT, bool>> stack;
+            stack.emplace_back(0, false);
+            while (!stack.empty())
+            {
+                const UINT nodeIndex = stack.back().first;
+                const bool childrenDone = stack.back().second;
+                stack.pop_back();
+
+                const AABBNode& node = m_pNodes[nodeIndex];
+                Subtree& subtree = m_subtrees[nodeIndex];
+                if (node.leaf)
+                {
+                    for (UINT axis = 0; axis < 3; ++axis)
+                    {
+                        subtree.boxMin[axis] = node.center[axis] - node.halfDim[axis];
+                        subtree.boxMax[axis] = node.center[axis] + node.halfDim[axis];
+                    }
+                    subtree.firstPrimitive = node.leafNode.firstTriangleId;
+                    subtree.numPrimitives = node.numTriangles;
+                    subtree.endPrimitive = subtree.firstPrimitive + subtree.numPrimitives;
+                    continue;
+                }
+
+                const UINT left = node.internalNode.leftNodeIndex;
+                const UINT right = node.rightNodeIndex;
+                if (!childrenDone)
+                {
+                    stack.emplace_back(nodeIndex, true);
+                    stack.emplace_back(left, false);
+                    stack.emplace_back(right, false);
+                    continue;
+                }
+
+                const Subtree& leftSubtree = m_subtrees[left];
+                const Subtree& rightSubtree = m_subtrees[right];
+                for (UINT axis = 0; axis < 3; ++axis)
+                {
+                    subtree.boxMin[axis] = std::min(leftSubtree.boxMin[axis], rightSubtree.boxMin[axis]);
+                    subtree.boxMax[axis] = std::max(leftSubtree.boxMax[axis], rightSubtree.boxMax[axis]);
+                }
+                subtree.firstPrimitive = std::min(leftSubtree.firstPrimitive, rightSubtree.firstPrimitive);
+                subtree.endPrimitive = std::max(leftSubtree.endPrimitive, rightSubtree.endPrimitive);
+                subtree.numPrimitives = leftSubtree.numPrimitives + rightSubtree.numPrimitives;
+            }
+        }
+
+        // Leaves index a range of primitives, so a subtree can only become one if its primitives are consecutive
+        bool IsLeafCandidate(
+            UINT nodeIndex) const
+        {
+            const Subtree& subtree = m_subtrees[nodeIndex];
+            if (m_pNodes[nodeIndex].leaf)
+            {
+                assert(subtree.numPrimitives <= CPU_WIDE_BVH_MAX_LEAF_SIZE);
+                return true;
+            }
+            return subtree.numPrimitives <= m_maxLeafSize && subtree.endPrimitive - subtree.firstPrimitive == subtree.numPrimitives;
+        }
+
+        float GetSurfaceArea(
+            UINT nodeIndex) const
+        {
+            const Subtree& subtree = m_subtrees[nodeIndex];
+            const float dx = subtree.boxMax[0] - subtree.boxMin[0];
+            const float dy = subtree.boxMax[1] - subtree.boxMin[1];
+            const float dz = subtree.boxMax[2] - subtree.boxMin[2];
+            return dx * dy + dx * dz + dy * dz;
+        }
+
+        UINT OpenChildren(
+            UINT nodeIndex,
+            UINT (&children)[Width]) const
+        {
+            const AABBNode& node = m_pNodes[nodeIndex];
+            children[0] = node.internalNode.leftNodeIndex;
+            children[1] = node.rightNodeIndex;
+            UINT numChildren = 2;
+
+            while (numChildren < Width)
+            {
+                UINT largest = Width;
+                float largestArea = -1.0f;
+                for (UINT i = 0; i < numChildren; ++i)
+                {
+                    if (IsLeafCandidate(children[i]))
+                        continue;
+
+                    const float area = GetSurfaceArea(children[i]);
+                    if (area > largestArea)
+                    {
+                        largest = i;
+                        largestArea = area;
+                    }
+                }
+
+                if (largest == Width)
+                    break;
+
+                const AABBNode& opened = m_pNodes[children[largest]];
+                children[largest] = opened.internalNode.leftNodeIndex;
+                children[numChildren++] = opened.rightNodeIndex;
+            }
+            return numChildren;
+        }
+
+        //
+        // Quantizes the child boxes and fills in leaf children. Internal children are filled in by the caller.
+        //
+        void WriteNode(
+            const UINT* pChildren,
+            UINT numChildren,
+            CpuWideBVHNode<Width>& node) const
+        {
+            float nodeMin[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+            float nodeMax[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+            for (UINT i = 0; i < numChildren; ++i)
+            {
+                const Subtree& subtree = m_subtrees[pChildren[i]];
+                for (UINT axis = 0; axis < 3; ++axis)
+                {
+                    nodeMin[axis] = std::min(nodeMin[axis], subtree.boxMin[axis]);
+                    nodeMax[axis] = std::max(nodeMax[axis], subtree.boxMax[axis]);
+                }
+            }
+
+            float step[3];
+            for (UINT axis = 0; axis < 3; ++axis)
+            {
+                if (numChildren == 0)
+                {
+                    nodeMin[axis] = nodeMax[axis] = 0.0f;
+                }
+
+                // Smallest power of two step that still spans the node in 255 steps. Power of two steps make
+                // origin + q * step exact up to the final add, so the bounds below are easy to keep conservative.
+                const float extent = nodeMax[axis] - nodeMin[axis];
+                int exponent = -126;
+                if (extent > 0.0f)
+                {
+                    frexpf(extent / 255.0f, &exponent);
+                    exponent = std::max(exponent, -126);
+                }
+                while (exponent < 127 && nodeMin[axis] + 255.0f * ldexpf(1.0f, exponent) < nodeMax[axis])
+                {
+                    exponent++;
+                }
+
+                node.origin[axis] = nodeMin[axis];
+                node.exponent[axis] = (INT8)exponent;
+                step[axis] = ldexpf(1.0f, exponent);
+            }
+
+            for (UINT i = 0; i < Width; ++i)
+            {
+                if (i >= numChildren || m_subtrees[pChildren[i]].numPrimitives == 0)
+                {
+                    node.children[i] = CPU_WIDE_BVH_EMPTY_CHILD;
+                    for (UINT axis = 0; axis < 3; ++axis)
+                    {
+                        node.lower[axis][i] = 0;
+                        node.upper[axis][i] = 0;
+                    }
+                    continue;
+                }
+
+                const Subtree& subtree = m_subtrees[pChildren[i]];
+                for (UINT axis = 0; axis < 3; ++axis)
+                {
+                    const float origin = node.origin[axis];
+                    int lower = (int)floorf((subtree.boxMin[axis] - origin) / step[axis]);
+                    int upper = (int)ceilf((subtree.boxMax[axis] - origin) / step[axis]);
+                    lower = std::min(std::max(lower, 0), 255);
+                    upper = std::min(std::max(upper, 0), 255);
+
+                    // Rounding of the final add can still pull a bound inside the child
+                    while (lower > 0 && origin + lower * step[axis] > subtree.boxMin[axis])
+                    {
+                        lower--;
+                    }
+                    while (upper < 255 && origin + upper * step[axis] < subtree.boxMax[axis])
+                    {
+                        upper++;
+                    }
+
+                    node.lower[axis][i] = (BYTE)lower;
+                    node.upper[axis][i] = (BYTE)upper;
+                }
+
+                node.children[i] = CPU_WIDE_BVH_LEAF_FLAG | ((subtree.numPrimitives - 1) << 24) | subtree.firstPrimitive;
+            }
+        }
+
+        const AABBNode*         m_pNodes;
+        const UINT              m_maxLeafSize;
+        std::vector<Subtree>    m_subtrees;
+    };
+
+    template <UINT Width>
+    CpuWideBVH<Width>::CpuWideBVH(
+        _In_ const void *pAccelerationStructure,
+        D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE type,
+        UINT maxLeafSize) :
+        m_pAccelerationStructure(pAccelerationStructure),
+        m_type(type)
+    {
+        // Both levels start with the nodes and follow them with the vertices or the instance metadata
+        const BYTE *pData = (const BYTE *)pAccelerationStructure;
+        const BVHOffsets &offsets = *(const BVHOffsets *)pData;
+        const AABBNode *pNodes = (const AABBNode *)(pData + offsets.offsetToBoxes);
+        const UINT numNodes = (offsets.offsetToVertices - offsets.offsetToBoxes) / sizeof(AABBNode);
+
+        WideBVHCollapser<Width> collapser(pNodes, numNodes, maxLeafSize);
+        collapser.Collapse(m_nodes);
+    }
+
+    template class CpuWideBVH<4>;
+    template class CpuWideBVH<8>;
+}
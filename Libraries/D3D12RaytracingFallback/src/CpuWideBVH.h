@@ -0,0 +1,71 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+#pragma once
+namespace FallbackLayer
+{
+    //
+    // 4- or 8-wide BVH collapsed from a binary acceleration structure built by
+    // BuildRaytracingAccelerationStructureOnCpu, for CPU traversal. Only the nodes are rebuilt: leaves index
+    // the Primitive/PrimitiveMetaData arrays (or the instance metadata of a top level) of the original
+    // structure, which must stay alive and unmodified while the wide BVH is in use.
+    //
+    // Child boxes are stored SoA and quantized to 8 bits in a grid local to their parent, so a 4-wide node fits
+    // in one cache line and an 8-wide node in two, where the binary tree needs a 32 byte node per child.
+    //
+
+    static const UINT CPU_WIDE_BVH_EMPTY_CHILD = 0xffffffff;
+    static const UINT CPU_WIDE_BVH_LEAF_FLAG = 0x80000000;
+    static const UINT CPU_WIDE_BVH_MAX_LEAF_SIZE = 32;
+
+    template <UINT Width>
+    __declspec(align(64))
+    struct CpuWideBVHNode
+    {
+        float   origin[3];          // Min corner of the quantization grid
+        INT8    exponent[3];        // Grid step per axis is 2^exponent
+
+        // Internal children hold a node index. Leaves hold CPU_WIDE_BVH_LEAF_FLAG, (primitive count - 1) in
+        // bits 24-30 and the first primitive in bits 0-23. Unused slots are CPU_WIDE_BVH_EMPTY_CHILD.
+        UINT    children[Width];
+
+        // Child box on each axis is [origin + lower * step, origin + upper * step]
+        BYTE    lower[3][Width];
+        BYTE    upper[3][Width];
+    };
+
+    template <UINT Width>
+    class CpuWideBVH
+    {
+    public:
+        static_assert(Width == 4 || Width == 8, "Only 4- and 8-wide BVHs are supported");
+
+        // Subtrees over at most maxLeafSize consecutive primitives are merged into a single leaf
+        CpuWideBVH(
+            _In_ const void *pAccelerationStructure,
+            D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE type,
+            UINT maxLeafSize = 4);
+
+        const void *GetAccelerationStructure() const { return m_pAccelerationStructure; }
+        D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE GetType() const { return m_type; }
+
+        // Node 0 is the root
+        const CpuWideBVHNode<Width> *GetNodes() const { return m_nodes.data(); }
+        UINT GetNodeCount() const { return (UINT)m_nodes.size(); }
+
+    private:
+        const void *m_pAccelerationStructure;
+        D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE m_type;
+        std::vector<CpuWideBVHNode<Width>> m_nodes;
+    };
+
+    typedef CpuWideBVH<4> CpuBVH4;
+    typedef CpuWideBVH<8> CpuBVH8;
+}
@@ -775,6 +775,657 @@ namespace FallbackLayerUnitTests
                 testCase);
         }
 
+        // Reports the quality of the CPU builders next to the GPU builder with treelet reordering, so that
+        // regressions in any of them show up in the test log. The CPU LBVH runs the same passes as the GPU.
+        TEST_METHOD(CompareCpuAndGpuBVHBuilderQuality)
+        {
+            const UINT numTriangles = 2000;
+            std::vector<float> vertices;
+            srand(10);
+            for (UINT i = 0; i < numTriangles; i++)
+            {
+                float center[3];
+                for (UINT axis = 0; axis < 3; axis++)
+                {
+                    center[axis] = (rand() / (float)RAND_MAX) * 100.0f - 50.0f;
+                }
+                for (UINT vertex = 0; vertex < 3; vertex++)
+                {
+                    for (UINT axis = 0; axis < 3; axis++)
+                    {
+                        vertices.push_back(center[axis] + (rand() / (float)RAND_MAX) * 2.0f - 1.0f);
+                    }
+                }
+            }
+            CpuGeometryDescriptor geomDesc(vertices.data(), (UINT)vertices.size() / 3);
+
+            ID3D12Device &device = m_d3d12Context.GetDevice();
+            FallbackLayer::GpuBvh2Builder gpuBuilder(&device, m_d3d12Context.GetTotalLaneCount(), 0);
+            InternalFallbackBuilder builderWrapper(&gpuBuilder);
+            std::unique_ptr<BYTE[]> pGpuData;
+            BuildBottomLevelAccelerationStructureAndGetCpuData(
+                builderWrapper,
+                &geomDesc,
+                1,
+                pGpuData,
+                D3D12_ELEMENTS_LAYOUT_ARRAY,
+                D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_PREFER_FAST_TRACE);
+
+            D3D12_RAYTRACING_GEOMETRY_DESC d3d12GeomDesc = GetCpuTriangleGeometryDesc(
+                geomDesc.m_pVertexData, geomDesc.m_numVerticies, D3D12_RAYTRACING_GEOMETRY_FLAG_NONE);
+            D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS inputs = GetBottomLevelInputs(&d3d12GeomDesc, 1);
+            std::unique_ptr<BYTE[]> pCpuData;
+            BuildAccelerationStructureOnCpu(inputs, pCpuData);
+
+            // Same flags as the GPU build so both run the same number of treelet reordering passes
+            inputs.Flags = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_PREFER_FAST_TRACE;
+            CpuAccelerationStructureBuildOptions lbvhOptions = { CPU_DEFAULT_SPATIAL_SPLIT_BUDGET, CPU_ACCELERATION_STRUCTURE_BUILDER_LBVH };
+            std::unique_ptr<BYTE[]> pCpuLBVHData;
+            BuildAccelerationStructureOnCpu(inputs, pCpuLBVHData, &lbvhOptions);
+
+            auto &validator = FallbackLayer::GetAccelerationStructureValidator(gpuBuilder.GetAccelerationStructureType());
+            const BYTE *pOutputs[] = { pCpuData.get(), pGpuData.get(), pCpuLBVHData.get() };
+            const char *builderNames[] = { "CPU", "GPU", "CPU LBVH" };
+            FallbackLayer::AccelerationStructureQualityReport reports[ARRAYSIZE(pOutputs)];
+            for (UINT i = 0; i < ARRAYSIZE(pOutputs); i++)
+            {
+                std::wstring errorMessage;
+                if (!validator.AnalyzeOutput(D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL, pOutputs[i], reports[i], errorMessage))
+                {
+                    Assert::Fail(errorMessage.c_str());
+                }
+                Assert::AreEqual(numTriangles, reports[i].NumLeaves, L"Every triangle should be in its own leaf");
+
+                std::stringstream message;
+                message << builderNames[i] << " BVH quality: ";
+                FallbackLayer::WriteQualityReportJson(reports[i], message);
+                message << "\n";
+                Logger::WriteMessage(message.str().c_str());
+            }
+            Assert::IsTrue(reports[0].SAHCost <= reports[1].SAHCost, L"Binned SAH build should be at least as good as LBVH with treelet reordering");
+
+            // Only the low Morton code bits, which depend on the GPU's float division, may differ
+            Assert::AreEqual(reports[1].SAHCost, reports[2].SAHCost, reports[1].SAHCost * 0.01f, L"CPU LBVH should match the GPU builder");
+        }
+
+        TEST_METHOD(R32IndexBufferBottomLevelCpuBVHBuilder)
+        {
+            CpuGeometryDescriptor testCases[] =
+            {
+                CpuGeometryDescriptor(ReferenceVerticies0, VERTEX_COUNT(ReferenceVerticies0), ReferenceR32Indices0, ARRAYSIZE(ReferenceR32Indices0)),
+                CpuGeometryDescriptor(ReferenceVerticies1, VERTEX_COUNT(ReferenceVerticies1), ReferenceR32Indices1, ARRAYSIZE(ReferenceR32Indices1))
+            };
+
+            for (UINT testIndex = 0; testIndex < ARRAYSIZE(testCases); testIndex++)
+            {
+                TestCpuBvh2Builder(testCases[testIndex]);
+            }
+        }
+
+        TEST_METHOD(UpdateBottomLevelCpuBVHBuilder)
+        {
+            ID3D12Device &device = m_d3d12Context.GetDevice();
+            FallbackLayer::GpuBvh2Builder gpuBuilder(&device, m_d3d12Context.GetTotalLaneCount(), 0);
+            auto &validator = FallbackLayer::GetAccelerationStructureValidator(gpuBuilder.GetAccelerationStructureType());
+
+            const D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAGS updateFlags[] =
+            {
+                D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_PERFORM_UPDATE,
+                D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_PERFORM_UPDATE | D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_PREFER_FAST_TRACE
+            };
+
+            for (UINT testIndex = 0; testIndex < ARRAYSIZE(updateFlags); testIndex++)
+            {
+                std::vector<float> vertices(ReferenceVerticies1, ReferenceVerticies1 + ARRAYSIZE(ReferenceVerticies1));
+                CpuGeometryDescriptor geomDesc(vertices.data(), VERTEX_COUNT(ReferenceVerticies1), ReferenceR32Indices1, ARRAYSIZE(ReferenceR32Indices1));
+
+                D3D12_RAYTRACING_GEOMETRY_DESC d3d12GeomDesc = {};
+                d3d12GeomDesc.Type = D3D12_RAYTRACING_GEOMETRY_TYPE_TRIANGLES;
+                auto &triangleDesc = d3d12GeomDesc.Triangles;
+                triangleDesc.IndexBuffer = (D3D12_GPU_VIRTUAL_ADDRESS)geomDesc.m_pIndexBuffer;
+                triangleDesc.VertexBuffer.StartAddress = (D3D12_GPU_VIRTUAL_ADDRESS)geomDesc.m_pVertexData;
+                triangleDesc.IndexFormat = geomDesc.m_indexBufferFormat;
+                triangleDesc.IndexCount = geomDesc.m_numIndicies;
+                triangleDesc.VertexCount = geomDesc.m_numVerticies;
+                triangleDesc.VertexBuffer.StrideInBytes = sizeof(float) * 3;
+
+                D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS inputs = {};
+                inputs.Type = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL;
+                inputs.DescsLayout = D3D12_ELEMENTS_LAYOUT_ARRAY;
+                inputs.Flags = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_ALLOW_UPDATE;
+                inputs.NumDescs = 1;
+                inputs.pGeometryDescs = &d3d12GeomDesc;
+
+                std::unique_ptr<BYTE[]> pData;
+                BuildAccelerationStructureOnCpu(inputs, pData);
+
+                // Fold the strip of triangles over itself so the original boxes no longer bound anything
+                for (UINT i = 0; i < (UINT)vertices.size(); i += 3)
+                {
+                    const float x = vertices[i];
+                    vertices[i] = 5.0f - x * 0.5f;
+                    vertices[i + 1] += x * x;
+                    vertices[i + 2] *= -2.0f;
+                }
+
+                D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC desc = {};
+                desc.Inputs = inputs;
+                desc.Inputs.Flags |= updateFlags[testIndex];
+                BuildRaytracingAccelerationStructureOnCpu(&desc, pData.get());
+
+                std::wstring errorMessage;
+                if (!validator.VerifyBottomLevelOutput(&geomDesc, 1, pData.get(), errorMessage))
+                {
+                    Assert::Fail(errorMessage.c_str());
+                }
+            }
+        }
+
+        // Unindexed, tightly packed float3 triangles read straight from CPU memory
+        D3D12_RAYTRACING_GEOMETRY_DESC GetCpuTriangleGeometryDesc(
+            const float *pVertices,
+            UINT vertexCount,
+            D3D12_RAYTRACING_GEOMETRY_FLAGS flags = D3D12_RAYTRACING_GEOMETRY_FLAG_OPAQUE)
+        {
+            D3D12_RAYTRACING_GEOMETRY_DESC geomDesc = {};
+            geomDesc.Type = D3D12_RAYTRACING_GEOMETRY_TYPE_TRIANGLES;
+            geomDesc.Flags = flags;
+            geomDesc.Triangles.IndexFormat = DXGI_FORMAT_UNKNOWN;
+            geomDesc.Triangles.VertexFormat = DXGI_FORMAT_R32G32B32_FLOAT;
+            geomDesc.Triangles.VertexCount = vertexCount;
+            geomDesc.Triangles.VertexBuffer.StartAddress = (D3D12_GPU_VIRTUAL_ADDRESS)pVertices;
+            geomDesc.Triangles.VertexBuffer.StrideInBytes = sizeof(float) * 3;
+            return geomDesc;
+        }
+
+        // The inputs point at pGeometryDescs, which must outlive them
+        D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS GetBottomLevelInputs(
+            const D3D12_RAYTRACING_GEOMETRY_DESC *pGeometryDescs,
+            UINT numDescs)
+        {
+            D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS inputs = {};
+            inputs.Type = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL;
+            inputs.DescsLayout = D3D12_ELEMENTS_LAYOUT_ARRAY;
+            inputs.NumDescs = numDescs;
+            inputs.pGeometryDescs = pGeometryDescs;
+            return inputs;
+        }
+
+        // Long diagonal slivers whose boxes overlap a lot of empty space, where spatial splits pay off
+        std::vector<float> GenerateSliverTriangles(UINT numTriangles)
+        {
+            std::vector<float> vertices;
+            for (UINT i = 0; i < numTriangles; i++)
+            {
+                const float x = i * 0.25f;
+                const float z = i * 0.1f;
+                const float triangle[] = { x, 0.0f, z, x + 8.0f, 8.0f, z + 1.0f, x + 0.5f, 0.0f, z };
+                vertices.insert(vertices.end(), triangle, triangle + ARRAYSIZE(triangle));
+            }
+            return vertices;
+        }
+
+        void BuildAccelerationStructureOnCpu(
+            const D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS &inputs,
+            std::unique_ptr<BYTE[]> &outputData,
+            const CpuAccelerationStructureBuildOptions *pOptions = nullptr)
+        {
+            outputData = std::unique_ptr<BYTE[]>(new BYTE[(size_t)GetRaytracingAccelerationStructureSizeOnCpu(&inputs, pOptions)]);
+
+            D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC desc = {};
+            desc.Inputs = inputs;
+            BuildRaytracingAccelerationStructureOnCpu(&desc, outputData.get(), pOptions);
+        }
+
+        // Geometry 0 is ReferenceVerticies0 and opaque, geometry 1 is ReferenceVerticies1 and non-opaque
+        void BuildCpuRayTraversalBottomLevel(std::unique_ptr<BYTE[]> &outputData)
+        {
+            D3D12_RAYTRACING_GEOMETRY_DESC geomDescs[] =
+            {
+                GetCpuTriangleGeometryDesc(ReferenceVerticies0, VERTEX_COUNT(ReferenceVerticies0)),
+                GetCpuTriangleGeometryDesc(ReferenceVerticies1, VERTEX_COUNT(ReferenceVerticies1), D3D12_RAYTRACING_GEOMETRY_FLAG_NONE),
+            };
+            BuildAccelerationStructureOnCpu(GetBottomLevelInputs(geomDescs, ARRAYSIZE(geomDescs)), outputData);
+        }
+
+        FallbackLayer::CpuRayDesc CreateCpuRay(float x, float y, float z, float directionZ)
+        {
+            FallbackLayer::CpuRayDesc ray = { { x, y, z }, 0.0f, { 0.0f, 0.0f, directionZ }, 1000.0f };
+            return ray;
+        }
+
+        // Traces the rays one at a time and as packets, both paths must agree
+        void TraceCpuRays(
+            const FallbackLayer::CpuTraceRaysDesc &traceDesc,
+            const FallbackLayer::CpuRayDesc *pRays,
+            UINT numRays,
+            FallbackLayer::CpuRayHit *pHits)
+        {
+            FallbackLayer::TraceRaysOnCpu(traceDesc, pRays, numRays, pHits);
+            for (UINT i = 0; i < numRays; i++)
+            {
+                FallbackLayer::CpuRayHit hit;
+                FallbackLayer::TraceRayOnCpu(traceDesc, pRays[i], hit);
+                Assert::IsTrue(memcmp(&hit, &pHits[i], sizeof(hit)) == 0, L"Packet traversal doesn't match single ray traversal");
+            }
+        }
+
+        TEST_METHOD(BottomLevelCpuRayTraversal)
+        {
+            std::unique_ptr<BYTE[]> pData;
+            BuildCpuRayTraversalBottomLevel(pData);
+
+            FallbackLayer::CpuTraceRaysDesc traceDesc = {};
+            traceDesc.pAccelerationStructure = pData.get();
+            traceDesc.Type = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL;
+            traceDesc.InstanceInclusionMask = 0xff;
+
+            FallbackLayer::CpuRayDesc rays[] =
+            {
+                CreateCpuRay(0.25f, 0.75f, -1.0f, 1.0f),
+                CreateCpuRay(1.25f, 0.75f, -1.0f, 1.0f),
+                CreateCpuRay(2.25f, 0.75f, -1.0f, 1.0f),
+                CreateCpuRay(0.25f, 0.75f, 1.5f, 1.0f),
+                CreateCpuRay(0.25f, 0.75f, 2.5f, 1.0f),
+                CreateCpuRay(0.25f, 0.75f, 1.5f, -1.0f),
+            };
+            const UINT expectedGeometry[] = { 0, 1, 1, 0, 0, 0 };
+            const UINT expectedPrimitive[] = { 0, 0, 3, 2, FallbackLayer::CPU_RAY_NO_HIT, 1 };
+            const float expectedT[] = { 1.0f, 1.0f, 1.0f, 0.5f, 1000.0f, 0.5f };
+
+            FallbackLayer::CpuRayHit hits[ARRAYSIZE(rays)];
+            TraceCpuRays(traceDesc, rays, ARRAYSIZE(rays), hits);
+            for (UINT i = 0; i < ARRAYSIZE(rays); i++)
+            {
+                Assert::AreEqual(expectedPrimitive[i], hits[i].PrimitiveIndex, L"Ray hit the wrong primitive");
+                Assert::AreEqual(expectedT[i], hits[i].T, 1e-5f, L"Incorrect hit distance");
+                if (expectedPrimitive[i] != FallbackLayer::CPU_RAY_NO_HIT)
+                {
+                    Assert::AreEqual(expectedGeometry[i], hits[i].GeometryContributionToHitGroupIndex, L"Ray hit the wrong geometry");
+                }
+            }
+            Assert::AreNotEqual(hits[3].HitKind, hits[5].HitKind, L"Opposite rays should hit opposite faces");
+
+            // Culling the back faces leaves exactly one of the two opposite rays with a hit
+            traceDesc.RayFlags = D3D12_RAY_FLAG_CULL_BACK_FACING_TRIANGLES;
+            FallbackLayer::CpuRayHit culledHits[ARRAYSIZE(rays)];
+            TraceCpuRays(traceDesc, rays, ARRAYSIZE(rays), culledHits);
+            Assert::IsTrue((culledHits[3].PrimitiveIndex == FallbackLayer::CPU_RAY_NO_HIT) != (culledHits[5].PrimitiveIndex == FallbackLayer::CPU_RAY_NO_HIT));
+        }
+
+        TEST_METHOD(BottomLevelCpuRayTraversalAnyHit)
+        {
+            std::unique_ptr<BYTE[]> pData;
+            BuildCpuRayTraversalBottomLevel(pData);
+
+            UINT anyHitCount = 0;
+            FallbackLayer::CpuAnyHitFunction ignoreHits = [&](UINT, const FallbackLayer::CpuRayHit &)
+            {
+                anyHitCount++;
+                return FallbackLayer::CpuAnyHitIgnore;
+            };
+
+            FallbackLayer::CpuTraceRaysDesc traceDesc = {};
+            traceDesc.pAccelerationStructure = pData.get();
+            traceDesc.Type = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL;
+            traceDesc.InstanceInclusionMask = 0xff;
+            traceDesc.pAnyHit = &ignoreHits;
+
+            // Only the non-opaque geometry calls the any hit function
+            FallbackLayer::CpuRayDesc rays[] =
+            {
+                CreateCpuRay(0.25f, 0.75f, -1.0f, 1.0f),
+                CreateCpuRay(1.25f, 0.75f, -1.0f, 1.0f),
+            };
+            FallbackLayer::CpuRayHit hits[ARRAYSIZE(rays)];
+            TraceCpuRays(traceDesc, rays, ARRAYSIZE(rays), hits);
+            Assert::AreEqual(0u, hits[0].PrimitiveIndex);
+            Assert::AreEqual(FallbackLayer::CPU_RAY_NO_HIT, hits[1].PrimitiveIndex);
+            Assert::IsTrue(anyHitCount > 0);
+
+            // Accept the first hit found, which need not be the closest
+            traceDesc.pAnyHit = nullptr;
+            traceDesc.RayFlags = D3D12_RAY_FLAG_ACCEPT_FIRST_HIT_AND_END_SEARCH;
+            TraceCpuRays(traceDesc, rays, ARRAYSIZE(rays), hits);
+            Assert::AreNotEqual(FallbackLayer::CPU_RAY_NO_HIT, hits[0].PrimitiveIndex);
+            Assert::AreNotEqual(FallbackLayer::CPU_RAY_NO_HIT, hits[1].PrimitiveIndex);
+
+            traceDesc.RayFlags = D3D12_RAY_FLAG_CULL_NON_OPAQUE;
+            TraceCpuRays(traceDesc, rays, ARRAYSIZE(rays), hits);
+            Assert::AreEqual(0u, hits[0].PrimitiveIndex);
+            Assert::AreEqual(FallbackLayer::CPU_RAY_NO_HIT, hits[1].PrimitiveIndex);
+        }
+
+        TEST_METHOD(SpatialSplitBottomLevelCpuRayTraversal)
+        {
+            const UINT numTriangles = 64;
+            std::vector<float> vertices = GenerateSliverTriangles(numTriangles);
+
+            D3D12_RAYTRACING_GEOMETRY_DESC geomDesc = GetCpuTriangleGeometryDesc(vertices.data(), (UINT)vertices.size() / 3);
+            D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS inputs = GetBottomLevelInputs(&geomDesc, 1);
+
+            std::unique_ptr<BYTE[]> pBinnedData;
+            BuildAccelerationStructureOnCpu(inputs, pBinnedData);
+
+            inputs.Flags = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_PREFER_FAST_TRACE;
+            std::unique_ptr<BYTE[]> pSpatialSplitData;
+            BuildAccelerationStructureOnCpu(inputs, pSpatialSplitData);
+
+            const BVHOffsets &offsets = *(const BVHOffsets *)pSpatialSplitData.get();
+            const UINT numReferences = (offsets.offsetToPrimitiveMetaData - offsets.offsetToVertices) / sizeof(Primitive);
+            Assert::IsTrue(numReferences > numTriangles, L"Expected spatial splits to duplicate some triangles");
+            Assert::IsTrue(offsets.totalSize <= GetRaytracingAccelerationStructureSizeOnCpu(&inputs), L"Output is larger than the size reported for it");
+
+            std::vector<FallbackLayer::CpuRayDesc> rays;
+            for (float y = 0.05f; y < 8.0f; y += 0.3f)
+            {
+                for (float x = 0.05f; x < 24.0f; x += 0.3f)
+                {
+                    rays.push_back(CreateCpuRay(x, y, -10.0f, 1.0f));
+                }
+            }
+
+            FallbackLayer::CpuTraceRaysDesc traceDesc = {};
+            traceDesc.Type = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL;
+            traceDesc.InstanceInclusionMask = 0xff;
+
+            FallbackLayer::CpuTraversalStats binnedStats = {};
+            std::vector<FallbackLayer::CpuRayHit> binnedHits(rays.size());
+            traceDesc.pAccelerationStructure = pBinnedData.get();
+            traceDesc.pStats = &binnedStats;
+            FallbackLayer::TraceRaysOnCpu(traceDesc, rays.data(), (UINT)rays.size(), binnedHits.data());
+
+            FallbackLayer::CpuTraversalStats spatialSplitStats = {};
+            std::vector<FallbackLayer::CpuRayHit> spatialSplitHits(rays.size());
+            traceDesc.pAccelerationStructure = pSpatialSplitData.get();
+            traceDesc.pStats = &spatialSplitStats;
+            FallbackLayer::TraceRaysOnCpu(traceDesc, rays.data(), (UINT)rays.size(), spatialSplitHits.data());
+
+            for (UINT i = 0; i < (UINT)rays.size(); i++)
+            {
+                Assert::AreEqual(binnedHits[i].PrimitiveIndex, spatialSplitHits[i].PrimitiveIndex, L"Spatial splits changed the closest hit");
+                Assert::AreEqual(binnedHits[i].T, spatialSplitHits[i].T, L"Spatial splits changed the hit distance");
+            }
+            Assert::IsTrue(spatialSplitStats.PrimitivesTested < binnedStats.PrimitivesTested, L"Spatial splits should reduce the triangle tests");
+        }
+
+        void AnalyzeBottomLevel(const BYTE *pData, FallbackLayer::AccelerationStructureQualityReport &report)
+        {
+            std::wstring errorMessage;
+            auto &validator = FallbackLayer::GetAccelerationStructureValidator(FallbackLayer::BVH2);
+            if (!validator.AnalyzeOutput(D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL, pData, report, errorMessage))
+            {
+                Assert::Fail(errorMessage.c_str());
+            }
+        }
+
+        TEST_METHOD(BottomLevelCpuBVHQualityReport)
+        {
+            // Two unit triangles 5 apart: the root is 6 wide and each child covers 1/6 of it
+            const float separatedTriangles[] =
+            {
+                0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 0.0f, 0.0f, 1.0f, 0.0f,
+                5.0f, 0.0f, 0.0f, 6.0f, 1.0f, 0.0f, 5.0f, 1.0f, 0.0f,
+            };
+
+            D3D12_RAYTRACING_GEOMETRY_DESC geomDesc = GetCpuTriangleGeometryDesc(separatedTriangles, VERTEX_COUNT(separatedTriangles));
+            D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS inputs = GetBottomLevelInputs(&geomDesc, 1);
+
+            std::unique_ptr<BYTE[]> pData;
+            BuildAccelerationStructureOnCpu(inputs, pData);
+
+            FallbackLayer::AccelerationStructureQualityReport report;
+            AnalyzeBottomLevel(pData.get(), report);
+            Assert::AreEqual(1u, report.NumInternalNodes);
+            Assert::AreEqual(2u, report.NumLeaves);
+            Assert::AreEqual(2u, report.NumPrimitiveReferences);
+            Assert::AreEqual(1u, report.MaxDepth);
+            Assert::IsTrue(report.LeafDepthHistogram == std::vector<UINT>({ 0, 2 }), L"Incorrect leaf depth histogram");
+            Assert::IsTrue(report.LeafSizeHistogram == std::vector<UINT>({ 0, 2 }), L"Incorrect leaf size histogram");
+            Assert::AreEqual(1.2f + 2.0f / 6.0f, report.SAHCost, 1e-2f, L"Incorrect SAH cost");
+            Assert::AreEqual(0.0f, report.EPO, L"Separated triangles shouldn't overlap other nodes");
+            Assert::AreEqual(0.0f, report.SiblingOverlap);
+            Assert::AreEqual(4.0f / 6.0f, report.EmptySpaceRatio, 1e-2f, L"Incorrect empty space ratio");
+
+            std::stringstream json;
+            FallbackLayer::WriteQualityReportJson(report, json);
+            Assert::IsTrue(json.str().find("\"LeafDepthHistogram\":[0,2]") != std::string::npos, L"Histogram missing from the JSON report");
+
+            // Spatial splits exist to cut the overlap of long slivers
+            const UINT numTriangles = 64;
+            std::vector<float> vertices = GenerateSliverTriangles(numTriangles);
+            geomDesc = GetCpuTriangleGeometryDesc(vertices.data(), (UINT)vertices.size() / 3);
+
+            FallbackLayer::AccelerationStructureQualityReport binnedReport;
+            BuildAccelerationStructureOnCpu(inputs, pData);
+            AnalyzeBottomLevel(pData.get(), binnedReport);
+
+            FallbackLayer::AccelerationStructureQualityReport spatialSplitReport;
+            inputs.Flags = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_PREFER_FAST_TRACE;
+            BuildAccelerationStructureOnCpu(inputs, pData);
+            AnalyzeBottomLevel(pData.get(), spatialSplitReport);
+
+            Assert::AreEqual(numTriangles, binnedReport.NumPrimitiveReferences);
+            Assert::IsTrue(spatialSplitReport.NumPrimitiveReferences > numTriangles, L"Expected spatial splits to duplicate some triangles");
+            Assert::IsTrue(spatialSplitReport.SAHCost < binnedReport.SAHCost, L"Spatial splits should lower the SAH cost");
+            Assert::IsTrue(spatialSplitReport.EPO < binnedReport.EPO, L"Spatial splits should lower the EPO");
+        }
+
+        TEST_METHOD(LBVHBottomLevelCpuBVHBuilder)
+        {
+            const UINT numTriangles = 2000;
+            std::vector<float> vertices;
+            srand(11);
+            for (UINT i = 0; i < numTriangles * 9; i++)
+            {
+                vertices.push_back((rand() / (float)RAND_MAX) * 20.0f - 10.0f);
+            }
+
+            D3D12_RAYTRACING_GEOMETRY_DESC geomDesc = GetCpuTriangleGeometryDesc(vertices.data(), (UINT)vertices.size() / 3);
+            D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS inputs = GetBottomLevelInputs(&geomDesc, 1);
+
+            std::unique_ptr<BYTE[]> pSahData;
+            BuildAccelerationStructureOnCpu(inputs, pSahData);
+
+            std::vector<FallbackLayer::CpuRayDesc> rays;
+            for (float y = -9.95f; y < 10.0f; y += 0.5f)
+            {
+                for (float x = -9.95f; x < 10.0f; x += 0.5f)
+                {
+                    rays.push_back(CreateCpuRay(x, y, -20.0f, 1.0f));
+                }
+            }
+
+            FallbackLayer::CpuTraceRaysDesc traceDesc = {};
+            traceDesc.Type = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL;
+            traceDesc.InstanceInclusionMask = 0xff;
+            traceDesc.pAccelerationStructure = pSahData.get();
+            std::vector<FallbackLayer::CpuRayHit> expectedHits(rays.size());
+            FallbackLayer::TraceRaysOnCpu(traceDesc, rays.data(), (UINT)rays.size(), expectedHits.data());
+
+            const CpuAccelerationStructureBuilderType builderTypes[] = { CPU_ACCELERATION_STRUCTURE_BUILDER_LBVH, CPU_ACCELERATION_STRUCTURE_BUILDER_LBVH_64 };
+            inputs.Flags = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_PREFER_FAST_TRACE | D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_ALLOW_UPDATE;
+            for (UINT testIndex = 0; testIndex < ARRAYSIZE(builderTypes); testIndex++)
+            {
+                CpuAccelerationStructureBuildOptions options = { CPU_DEFAULT_SPATIAL_SPLIT_BUDGET, builderTypes[testIndex] };
+                std::unique_ptr<BYTE[]> pData;
+                BuildAccelerationStructureOnCpu(inputs, pData, &options);
+
+                FallbackLayer::AccelerationStructureQualityReport report;
+                AnalyzeBottomLevel(pData.get(), report);
+                Assert::AreEqual(numTriangles, report.NumLeaves, L"Every triangle should be in its own leaf");
+
+                // ALLOW_UPDATE appends the sort cache and the AABB parents, like the GPU builder
+                const BVHOffsets &offsets = *(const BVHOffsets *)pData.get();
+                const UINT numNodes = 2 * numTriangles - 1;
+                Assert::AreEqual((UINT64)offsets.totalSize + (numTriangles + numNodes) * sizeof(UINT), GetRaytracingAccelerationStructureSizeOnCpu(&inputs, &options));
+
+                const PrimitiveMetaData *pMetaData = (const PrimitiveMetaData *)(pData.get() + offsets.offsetToPrimitiveMetaData);
+                const UINT *pSortCache = (const UINT *)(pData.get() + offsets.totalSize);
+                const UINT *pAABBParents = pSortCache + numTriangles;
+                for (UINT i = 0; i < numTriangles; i++)
+                {
+                    Assert::AreEqual(i, pMetaData[pSortCache[i]].PrimitiveIndex, L"Sort cache doesn't point at the sorted primitive");
+                }
+
+                const AABBNode *pNodes = (const AABBNode *)(pData.get() + offsets.offsetToBoxes);
+                for (UINT i = 0; i < numTriangles - 1; i++)
+                {
+                    Assert::AreEqual(i, pAABBParents[pNodes[i].internalNode.leftNodeIndex], L"Incorrect AABB parent");
+                    Assert::AreEqual(i, pAABBParents[pNodes[i].rightNodeIndex], L"Incorrect AABB parent");
+                }
+
+                traceDesc.pAccelerationStructure = pData.get();
+                std::vector<FallbackLayer::CpuRayHit> hits(rays.size());
+                FallbackLayer::TraceRaysOnCpu(traceDesc, rays.data(), (UINT)rays.size(), hits.data());
+                for (UINT i = 0; i < (UINT)rays.size(); i++)
+                {
+                    Assert::AreEqual(expectedHits[i].T, hits[i].T, L"LBVH changed the hit distance");
+                }
+            }
+        }
+
+        // Traces the rays with a wide BVH collapsed from the binary one in traceDesc. Rays through an edge shared
+        // by two triangles can report either one, so only the hit distances are compared.
+        template <UINT Width>
+        void TraceWideBVHCpuRays(
+            const FallbackLayer::CpuTraceRaysDesc &traceDesc,
+            const std::vector<FallbackLayer::CpuRayDesc> &rays,
+            const std::vector<FallbackLayer::CpuRayHit> &expectedHits,
+            const FallbackLayer::CpuTraversalStats &binaryStats)
+        {
+            FallbackLayer::CpuWideBVH<Width> bvh(traceDesc.pAccelerationStructure, traceDesc.Type);
+
+            FallbackLayer::CpuTraversalStats wideStats = {};
+            FallbackLayer::CpuTraceRaysDesc wideTraceDesc = traceDesc;
+            wideTraceDesc.pStats = &wideStats;
+            std::vector<FallbackLayer::CpuRayHit> hits(rays.size());
+            FallbackLayer::TraceRaysOnCpu(wideTraceDesc, bvh, rays.data(), (UINT)rays.size(), hits.data());
+
+            for (UINT i = 0; i < (UINT)rays.size(); i++)
+            {
+                Assert::AreEqual(expectedHits[i].PrimitiveIndex == FallbackLayer::CPU_RAY_NO_HIT, hits[i].PrimitiveIndex == FallbackLayer::CPU_RAY_NO_HIT, L"Wide BVH changed whether the ray hits");
+                Assert::AreEqual(expectedHits[i].T, hits[i].T, L"Wide BVH changed the hit distance");
+            }
+            Assert::IsTrue(wideStats.NodesVisited < binaryStats.NodesVisited, L"Wide BVH should visit fewer nodes");
+            Assert::IsTrue(wideStats.NodeBytesRead < binaryStats.NodeBytesRead, L"Wide BVH should read less node data");
+        }
+
+        TEST_METHOD(WideBVHCpuRayTraversal)
+        {
+            // A bumpy 32x32 grid, large enough for several levels of wide nodes
+            const UINT gridSize = 32;
+            std::vector<float> vertices;
+            for (UINT z = 0; z < gridSize; z++)
+            {
+                for (UINT x = 0; x < gridSize; x++)
+                {
+                    const float height = ((x * 7 + z * 13) % 5) * 0.1f;
+                    const float quad[] =
+                    {
+                        (float)x, height, (float)z,
+                        x + 1.0f, height, (float)z,
+                        (float)x, height, z + 1.0f,
+                        x + 1.0f, height, (float)z,
+                        x + 1.0f, height, z + 1.0f,
+                        (float)x, height, z + 1.0f,
+                    };
+                    vertices.insert(vertices.end(), quad, quad + ARRAYSIZE(quad));
+                }
+            }
+
+            D3D12_RAYTRACING_GEOMETRY_DESC geomDesc = GetCpuTriangleGeometryDesc(vertices.data(), (UINT)vertices.size() / 3);
+            D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS inputs = GetBottomLevelInputs(&geomDesc, 1);
+
+            std::unique_ptr<BYTE[]> pData;
+            BuildAccelerationStructureOnCpu(inputs, pData);
+
+            // Slanted rays so that some of them pass between the bumps, plus a few that miss the grid entirely
+            std::vector<FallbackLayer::CpuRayDesc> rays;
+            for (float z = -1.1f; z < gridSize + 1.0f; z += 0.7f)
+            {
+                for (float x = -1.1f; x < gridSize + 1.0f; x += 0.7f)
+                {
+                    FallbackLayer::CpuRayDesc ray = { { x, 5.0f, z }, 0.0f, { 0.3f, -1.0f, 0.2f }, 1000.0f };
+                    rays.push_back(ray);
+                }
+            }
+
+            FallbackLayer::CpuTraceRaysDesc traceDesc = {};
+            traceDesc.pAccelerationStructure = pData.get();
+            traceDesc.Type = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL;
+            traceDesc.InstanceInclusionMask = 0xff;
+
+            FallbackLayer::CpuTraversalStats binaryStats = {};
+            traceDesc.pStats = &binaryStats;
+            std::vector<FallbackLayer::CpuRayHit> binaryHits(rays.size());
+            for (UINT i = 0; i < (UINT)rays.size(); i++)
+            {
+                FallbackLayer::TraceRayOnCpu(traceDesc, rays[i], binaryHits[i]);
+            }
+            traceDesc.pStats = nullptr;
+
+            TraceWideBVHCpuRays<4>(traceDesc, rays, binaryHits, binaryStats);
+            TraceWideBVHCpuRays<8>(traceDesc, rays, binaryHits, binaryStats);
+        }
+
+        TEST_METHOD(TopLevelCpuRayTraversal)
+        {
+            std::unique_ptr<BYTE[]> pBottomLevel;
+            BuildCpuRayTraversalBottomLevel(pBottomLevel);
+
+            const float instanceOffsetsY[] = { 10.0f, -10.0f };
+            D3D12_RAYTRACING_FALLBACK_INSTANCE_DESC instanceDescs[ARRAYSIZE(instanceOffsetsY)] = {};
+            for (UINT i = 0; i < ARRAYSIZE(instanceDescs); i++)
+            {
+                auto &instanceDesc = instanceDescs[i];
+                instanceDesc.Transform[0][0] = instanceDesc.Transform[1][1] = instanceDesc.Transform[2][2] = 1.0f;
+                instanceDesc.Transform[1][3] = instanceOffsetsY[i];
+                instanceDesc.InstanceID = 5 + i;
+                instanceDesc.InstanceMask = 1 << i;
+                instanceDesc.InstanceContributionToHitGroupIndex = 2 * i;
+                instanceDesc.AccelerationStructure.GpuVA = (D3D12_GPU_VIRTUAL_ADDRESS)pBottomLevel.get();
+            }
+
+            D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS inputs = {};
+            inputs.Type = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL;
+            inputs.DescsLayout = D3D12_ELEMENTS_LAYOUT_ARRAY;
+            inputs.NumDescs = ARRAYSIZE(instanceDescs);
+            inputs.InstanceDescs = (D3D12_GPU_VIRTUAL_ADDRESS)instanceDescs;
+
+            std::unique_ptr<BYTE[]> pTopLevel;
+            BuildAccelerationStructureOnCpu(inputs, pTopLevel);
+
+            FallbackLayer::CpuTraceRaysDesc traceDesc = {};
+            traceDesc.pAccelerationStructure = pTopLevel.get();
+            traceDesc.Type = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL;
+            traceDesc.InstanceInclusionMask = 0xff;
+
+            FallbackLayer::CpuRayDesc rays[] =
+            {
+                CreateCpuRay(0.25f, 10.75f, -1.0f, 1.0f),
+                CreateCpuRay(2.25f, -9.25f, -2.0f, 1.0f),
+                CreateCpuRay(0.25f, 0.75f, -1.0f, 1.0f),
+            };
+            FallbackLayer::CpuRayHit hits[ARRAYSIZE(rays)];
+            TraceCpuRays(traceDesc, rays, ARRAYSIZE(rays), hits);
+
+            for (UINT i = 0; i < ARRAYSIZE(instanceDescs); i++)
+            {
+                Assert::AreEqual(i, hits[i].InstanceIndex, L"Ray hit the wrong instance");
+                Assert::AreEqual(5 + i, hits[i].InstanceID);
+                Assert::AreEqual(2 * i, hits[i].InstanceContributionToHitGroupIndex);
+                Assert::AreEqual(1.0f + i, hits[i].T, 1e-5f, L"Incorrect hit distance");
+            }
+            Assert::AreEqual(3u, hits[1].PrimitiveIndex);
+            Assert::AreEqual(FallbackLayer::CPU_RAY_NO_HIT, hits[2].PrimitiveIndex, L"Ray between the instances shouldn't hit");
+
+            traceDesc.InstanceInclusionMask = 0x2;
+            TraceCpuRays(traceDesc, rays, ARRAYSIZE(rays), hits);
+            Assert::AreEqual(FallbackLayer::CPU_RAY_NO_HIT, hits[0].PrimitiveIndex, L"Instance mask wasn't applied");
+            Assert::AreEqual(1u, hits[1].InstanceIndex);
+        }
+
         template <UINT numBottomLevels>
         void SimpleTopLevelGpuBVHBuilder(
             D3D12_ELEMENTS_LAYOUT layoutToTest,
@@ -2826,6 +3477,10 @@ namespace FallbackLayerUnitTests
             m_d3d12Context.ReadbackResource(pOutputAABBBuffer, &calculatedAABB, sizeof(calculatedAABB));
 
             Assert::IsTrue(memcmp(&expectedAABB, &calculatedAABB, sizeof(expectedAABB)) == 0, L"Calculated AAB incorrect");
+
+            AABB cpuAABB;
+            CpuLBVHBuilder().CalculateSceneAABB(sceneType, outputData.data(), numElements, cpuAABB);
+            Assert::IsTrue(memcmp(&calculatedAABB, &cpuAABB, sizeof(cpuAABB)) == 0, L"CPU scene AABB doesn't match the GPU");
         }
 
         bool IsMortonCodeEqual(UINT codeA, UINT codeB)
@@ -2854,7 +3509,7 @@ namespace FallbackLayerUnitTests
             TestCalculatingAndSortingMortonCodes(5000, SceneType::BottomLevelBVHs);
         }
 
-        void TestSortingMortonCodes(UINT numTriangles, std::vector<MortonCodeIndexPair> &expectedMortonCodes, ID3D12Resource *pMortonCodeBuffer, ID3D12Resource *pIndexBuffer)
+        void TestSortingMortonCodes(UINT numTriangles, std::vector<MortonCodeIndexPair> &expectedMortonCodes, std::vector<UINT32> &unsortedMortonCodes, ID3D12Resource *pMortonCodeBuffer, ID3D12Resource *pIndexBuffer)
             // Now try the sorting pass
         {
             CComPtr<ID3D12GraphicsCommandList> pCommandList;
@@ -2885,6 +3540,15 @@ namespace FallbackLayerUnitTests
             {
                 Assert::IsTrue(expectedMortonCodes[i].Index == calculatedIndices[i] && IsMortonCodeEqual(expectedMortonCodes[i].MortonCode, calculatedMortonCodes[i]), L"Sorted morton codes incorrect");
             }
+
+            // Sorting the same codes on the CPU has to give exactly the same order
+            std::vector<UINT32> cpuIndices(numTriangles);
+            for (UINT i = 0; i < numTriangles; i++)
+            {
+                cpuIndices[i] = i;
+            }
+            CpuLBVHBuilder().Sort(unsortedMortonCodes.data(), cpuIndices.data(), numTriangles);
+            Assert::IsTrue(unsortedMortonCodes == calculatedMortonCodes && cpuIndices == calculatedIndices, L"CPU sort doesn't match the GPU");
         }
 
         void TestCalculatingAndSortingMortonCodes(UINT numElements, SceneType sceneType)
@@ -2936,12 +3600,16 @@ namespace FallbackLayerUnitTests
             std::vector<UINT32> calculatedMortonCodes(numElements);
             m_d3d12Context.ReadbackResource(pOutputMortonCodeBuffer, calculatedMortonCodes.data(), (UINT)(calculatedMortonCodes.size() * sizeof(UINT32)));
 
+            std::vector<UINT32> cpuIndices(numElements);
+            std::vector<UINT32> cpuMortonCodes(numElements);
+            CpuLBVHBuilder().CalculateMortonCodes(sceneType, outputData.data(), numElements, sceneAABB, cpuIndices.data(), cpuMortonCodes.data());
             for (UINT i = 0; i < numElements; i++)
             {
                 Assert::IsTrue(IsMortonCodeEqual(expectedMortonCodes[i].MortonCode, calculatedMortonCodes[i]), L"Calculated morton code is incorrect");
+                Assert::IsTrue(i == cpuIndices[i] && IsMortonCodeEqual(calculatedMortonCodes[i], cpuMortonCodes[i]), L"CPU morton code doesn't match the GPU");
             }
 
-            TestSortingMortonCodes(numElements, expectedMortonCodes, pOutputMortonCodeBuffer, pOutputIndexBuffer);
+            TestSortingMortonCodes(numElements, expectedMortonCodes, calculatedMortonCodes, pOutputMortonCodeBuffer, pOutputIndexBuffer);
         }
 
         TEST_METHOD(TreeletReorderingFastTrace)
@@ -3039,7 +3707,18 @@ namespace FallbackLayerUnitTests
             // Not needed but helpful for debugging
             std::vector<AABB> outputAABBs(numNodes);
             m_d3d12Context.ReadbackResource(pAABBBuffer, outputAABBs.data(), (UINT)(outputAABBs.size() * sizeof(*outputAABBs.data())));
+            ValidateHierarchy(outputHierarchy, numLeafNodes);
 
+            // Every triangle has a zero area box, where the CPU deliberately opens a different node than the GPU,
+            // so only the validity of its output is checked
+            std::vector<AABB> cpuAABBs(numNodes);
+            CpuLBVHBuilder().Optimize(numLeafNodes, hierarchy.data(), cpuAABBs.data(), triangleBuffer.data(), flag);
+            ValidateHierarchy(hierarchy, numLeafNodes);
+        }
+
+        void ValidateHierarchy(const std::vector<HierarchyNode> &outputHierarchy, UINT numLeafNodes)
+        {
+            const UINT numInternalNodes = numLeafNodes - 1;
             std::vector<UINT> nodeStack;
             nodeStack.push_back(0);
 
@@ -19,6 +19,46 @@ void OutputDebugLog(ID3D12RaytracingFallbackDevice *pDevice);
 void VisualizeAccelerationStructureLevel(ID3D12RaytracingFallbackDevice *pDevice, UINT level);
 #endif
 
+// Bottom levels read geometry, and top levels read instance descs, from CPU addresses stored in the GPU VA fields.
+// Top level instances must reference bottom levels that were also built on the CPU.
+// PERFORM_UPDATE refits the structure at SourceAccelerationStructureData (or pData when that is 0) into pData,
+// keeping its hierarchy. The inputs must match the original build except for vertex positions and instance
+// descs. Adding PREFER_FAST_TRACE also runs tree rotations during the refit to slow down quality decay.
+// Other bottom level builds with PREFER_FAST_TRACE use spatial splits, which build slower but trace faster on
+// scenes with long or diagonal triangles. Leaves may then reference the same triangle more than once.
+// Builds with ALLOW_UPDATE never use spatial splits: a refit would grow each split reference back to the
+// bounds of its whole triangle, so the duplicates would overlap and trace slower than an unsplit build.
+// The LBVH builders instead run the same passes as the GPU builder, so their output can be compared against it.
+
+enum CpuAccelerationStructureBuilderType
+{
+    // Binned SAH, with spatial splits for PREFER_FAST_TRACE bottom levels without ALLOW_UPDATE
+    CPU_ACCELERATION_STRUCTURE_BUILDER_SAH = 0,
+    // Same Morton codes, hierarchy, treelet reordering and layout as the GPU builder, including the sort cache
+    // and AABB parents of ALLOW_UPDATE. Also supports procedural primitives.
+    CPU_ACCELERATION_STRUCTURE_BUILDER_LBVH,
+    // LBVH with 64-bit Morton codes, which the GPU builder doesn't have
+    CPU_ACCELERATION_STRUCTURE_BUILDER_LBVH_64,
+};
+
+struct CpuAccelerationStructureBuildOptions
+{
+    // Extra primitive references spatial splits may add, as a fraction of the triangle count
+    float SpatialSplitBudget;
+
+    // Updates always refit in place, whichever builder made the structure
+    CpuAccelerationStructureBuilderType BuilderType;
+};
+
+static const float CPU_DEFAULT_SPATIAL_SPLIT_BUDGET = 0.3f;
+
 void BuildRaytracingAccelerationStructureOnCpu(
     _In_  const D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC *pDesc,
-    _Out_ void *pData);
+    _Out_ void *pData,
+    _In_opt_ const CpuAccelerationStructureBuildOptions *pOptions = nullptr);
+
+// Upper bound on the size BuildRaytracingAccelerationStructureOnCpu writes, so no device is needed to size the output.
+// pOptions must match the ones passed to the build.
+UINT64 GetRaytracingAccelerationStructureSizeOnCpu(
+    _In_  const D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS *pInputs,
+    _In_opt_ const CpuAccelerationStructureBuildOptions *pOptions = nullptr);
@@ -25,6 +25,7 @@
 #include <unordered_set>
 #include <map>
 #include <deque>
+#include <functional>
 #include <string>
 #include <strsafe.h>
 #include "d3d12_1.h"
@@ -49,6 +50,8 @@
 
 #include "D3D12RaytracingFallback.h"
 #include "RaytracingCompatibilityDebug.h"
+#include "CpuWideBVH.h"
+#include "CpuRayTraversal.h"
 #include "ComObject.h"
 
 #include "NativeRaytracing.h"
@@ -86,6 +89,7 @@
 #include "GpuBvh2Copy.h"
 #include "TreeletReorder.h"
 #include "GpuBvh2Builder.h"
+#include "CpuLBVHBuilder.h"
 
 // Dispatchers
 #include "UberShaderBindings.h"
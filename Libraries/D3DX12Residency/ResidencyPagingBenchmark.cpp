@@ -0,0 +1,157 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+
+// Replays generated traces with d3dx12ResidencySimulator.h and reports how many submissions per second the paging work
+// gets through with each policy, for 1K to 64K tracked objects. The simulator runs the same steps as
+// ProcessPagingWork against a fake device, so this measures the library's own bookkeeping and no GPU is needed.
+// Usage: ResidencyPagingBenchmark [submissions] [objects per submission] [budget percent]
+
+#ifdef _WIN32
+#include <windows.h>
+#include <d3d12.h>
+#include <dxgi1_4.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+
+#include "d3dx12ResidencySimulator.h"
+
+using namespace D3DX12Residency;
+
+namespace
+{
+    typedef std::chrono::high_resolution_clock Clock;
+
+    // Four submissions per 60 Hz frame
+    const UINT64 cTicksPerSecond = 1000000;
+    const UINT64 cTicksPerSubmission = cTicksPerSecond / 240;
+
+    // Objects of 64 KB to 4 MB. The ones that fit in the budget start out resident. Every submission uses objects picked
+    // at random, so a budget below 100% keeps the paging work evicting and making objects resident again.
+    void GenerateTrace(UINT32 NumObjects, UINT32 NumSubmissions, UINT32 ObjectsPerSubmission, UINT32 BudgetPercent,
+        Simulation::Trace& ReplayTrace, Simulation::Trace& SetupTrace)
+    {
+        std::mt19937 Random(NumObjects);
+
+        ReplayTrace = Simulation::Trace();
+        ReplayTrace.TicksPerSecond = cTicksPerSecond;
+
+        UINT64 TotalSize = 0;
+        for (UINT32 i = 0; i < NumObjects; i++)
+        {
+            Simulation::TraceObject Object = { (1 + Random() % 64) * 64 * 1024, ManagedObject::DefaultEvictionPriority, false };
+            ReplayTrace.Objects.push_back(Object);
+            TotalSize += Object.Size;
+        }
+
+        const UINT64 Budget = TotalSize / 100 * BudgetPercent;
+        UINT64 ResidentSize = 0;
+        for (UINT32 i = 0; i < NumObjects; i++)
+        {
+            Simulation::TraceObject& Object = ReplayTrace.Objects[i];
+            Object.StartResident = ResidentSize + Object.Size <= Budget;
+            ResidentSize += Object.StartResident ? Object.Size : 0;
+
+            Simulation::TraceEvent Event = {};
+            Event.Type = Simulation::TraceEvent::TYPE::BEGIN_TRACKING;
+            Event.ObjectIndex = i;
+            ReplayTrace.Events.push_back(Event);
+        }
+
+        // Only tracks the objects, so that their setup can be taken out of the time
+        SetupTrace = ReplayTrace;
+
+        for (UINT32 i = 0; i < NumSubmissions; i++)
+        {
+            Simulation::TraceEvent Event = {};
+            Event.Type = Simulation::TraceEvent::TYPE::EXECUTE;
+            Event.TimeStamp = (i + 1) * cTicksPerSubmission;
+            Event.Budget = Budget;
+            Event.ObjectIndices.resize(ObjectsPerSubmission);
+            for (UINT32& ObjectIndex : Event.ObjectIndices)
+            {
+                ObjectIndex = Random() % NumObjects;
+            }
+            ReplayTrace.Events.push_back(std::move(Event));
+        }
+    }
+
+    // The fastest of several runs
+    double TimeSimulation(const Simulation::Trace& ReplayTrace, EVICTION_POLICY Policy, Simulation::SimulationResults& Results)
+    {
+        Simulation::SimulationDesc Desc;
+        double Fastest = 0.0;
+        for (UINT32 Run = 0; Run < 3; Run++)
+        {
+            Clock::time_point Start = Clock::now();
+            Simulation::Simulate(ReplayTrace, Desc, Policy, Results);
+            const double Seconds = std::chrono::duration<double>(Clock::now() - Start).count();
+            Fastest = (Run == 0) ? Seconds : std::min(Fastest, Seconds);
+        }
+        return Fastest;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const UINT32 NumSubmissions = (argc > 1) ? UINT32(strtoul(argv[1], nullptr, 10)) : 4000;
+    const UINT32 ObjectsPerSubmission = (argc > 2) ? UINT32(strtoul(argv[2], nullptr, 10)) : 256;
+    const UINT32 BudgetPercent = (argc > 3) ? UINT32(strtoul(argv[3], nullptr, 10)) : 75;
+    if (NumSubmissions == 0 || ObjectsPerSubmission == 0 || BudgetPercent == 0 || BudgetPercent > 100)
+    {
+        fprintf(stderr, "Usage: %s [submissions] [objects per submission] [budget percent, 1 to 100]\n", argv[0]);
+        return 1;
+    }
+
+    const UINT32 ObjectCounts[] = { 1024, 4096, 16384, 65536 };
+    const EVICTION_POLICY Policies[] =
+    {
+        EVICTION_POLICY::LRU,
+        EVICTION_POLICY::SIZE_WEIGHTED_LRU,
+        EVICTION_POLICY::TWO_QUEUE,
+        EVICTION_POLICY::PRIORITY
+    };
+
+    printf("%u submissions of %u objects, budget %u%% of all objects\n", NumSubmissions, ObjectsPerSubmission, BudgetPercent);
+    printf("Submissions per second:\n");
+    printf("%-8s", "Objects");
+    for (EVICTION_POLICY Policy : Policies)
+    {
+        printf(" %18s", Simulation::GetPolicyName(Policy));
+    }
+    printf(" %14s\n", "Objects paged");
+
+    for (UINT32 NumObjects : ObjectCounts)
+    {
+        Simulation::Trace ReplayTrace, SetupTrace;
+        GenerateTrace(NumObjects, NumSubmissions, ObjectsPerSubmission, BudgetPercent, ReplayTrace, SetupTrace);
+
+        printf("%-8u", NumObjects);
+        UINT64 NumObjectsPaged = 0;
+        for (EVICTION_POLICY Policy : Policies)
+        {
+            Simulation::SimulationResults Results;
+            const double SetupSeconds = TimeSimulation(SetupTrace, Policy, Results);
+            const double Seconds = TimeSimulation(ReplayTrace, Policy, Results);
+            NumObjectsPaged += Results.NumObjectsMadeResident + Results.NumObjectsEvicted;
+
+            printf(" %18.0f", NumSubmissions / std::max(Seconds - SetupSeconds, 1e-9));
+        }
+        // Averaged over the policies, per submission
+        printf(" %14.1f\n", double(NumObjectsPaged) / (NumSubmissions * (sizeof(Policies) / sizeof(Policies[0]))));
+    }
+
+    return 0;
+}
@@ -0,0 +1,241 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+
+// Records residency sets on several threads at once and reports the cost of Open, Insert and Close.
+// Every thread inserts objects from the same pool so that the sets share objects, the way command lists recorded in
+// parallel share heaps. Residency sets don't touch the device, so no GPU is needed.
+// Usage: ResidencySetBenchmark [threads] [objects per set] [sets per thread]
+
+#include <windows.h>
+#include <d3d12.h>
+#include <dxgi1_4.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "d3dx12Residency.h"
+
+using namespace D3DX12Residency;
+
+namespace
+{
+    typedef std::chrono::high_resolution_clock Clock;
+
+    struct ThreadResults
+    {
+        double OpenSeconds = 0.0;
+        double InsertSeconds = 0.0;
+        double DuplicateInsertSeconds = 0.0;
+        double CloseSeconds = 0.0;
+        UINT64 NumInserted = 0;
+        UINT64 NumDuplicatesRejected = 0;
+        UINT64 NumOpenFailures = 0;
+    };
+
+    inline double Seconds(Clock::time_point Start, Clock::time_point End)
+    {
+        return std::chrono::duration<double>(End - Start).count();
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const UINT32 NumThreads = (argc > 1) ? UINT32(strtoul(argv[1], nullptr, 10)) : 16;
+    const UINT32 ObjectsPerSet = (argc > 2) ? UINT32(strtoul(argv[2], nullptr, 10)) : 2048;
+    const UINT32 SetsPerThread = (argc > 3) ? UINT32(strtoul(argv[3], nullptr, 10)) : 1000;
+    if (NumThreads == 0 || ObjectsPerSet == 0)
+    {
+        fprintf(stderr, "Usage: %s [threads] [objects per set] [sets per thread]\n", argv[0]);
+        return 1;
+    }
+
+    ResidencyManager Manager;
+
+    // Twice as many objects as one set uses, so each pair of threads overlaps on about half of their objects
+    std::vector<ManagedObject> Objects(ObjectsPerSet * 2);
+
+    std::vector<ThreadResults> Results(NumThreads);
+    std::atomic<UINT32> NumReady(0);
+    std::vector<std::thread> Threads;
+
+    for (UINT32 t = 0; t < NumThreads; t++)
+    {
+        Threads.emplace_back([&, t]()
+        {
+            ThreadResults& Result = Results[t];
+            ResidencySet* pSet = Manager.CreateResidencySet();
+
+            // Start every thread at the same time so that the sets contend
+            NumReady++;
+            while (NumReady < NumThreads)
+            {
+                std::this_thread::yield();
+            }
+
+            for (UINT32 i = 0; i < SetsPerThread; i++)
+            {
+                const UINT32 First = (t * 7919 + i * 104729) % UINT32(Objects.size());
+
+                Clock::time_point Start = Clock::now();
+                if (FAILED(pSet->Open()))
+                {
+                    Result.NumOpenFailures++;
+                    continue;
+                }
+                Clock::time_point Opened = Clock::now();
+
+                for (UINT32 j = 0; j < ObjectsPerSet; j++)
+                {
+                    Result.NumInserted += pSet->Insert(&Objects[(First + j) % Objects.size()]) ? 1 : 0;
+                }
+                Clock::time_point Inserted = Clock::now();
+
+                // Binding the same heap again is the common case while recording
+                for (UINT32 j = 0; j < ObjectsPerSet; j++)
+                {
+                    Result.NumDuplicatesRejected += pSet->Insert(&Objects[(First + j) % Objects.size()]) ? 0 : 1;
+                }
+                Clock::time_point Duplicated = Clock::now();
+
+                pSet->Close();
+                Clock::time_point Closed = Clock::now();
+
+                Result.OpenSeconds += Seconds(Start, Opened);
+                Result.InsertSeconds += Seconds(Opened, Inserted);
+                Result.DuplicateInsertSeconds += Seconds(Inserted, Duplicated);
+                Result.CloseSeconds += Seconds(Duplicated, Closed);
+            }
+
+            Manager.DestroyResidencySet(pSet);
+        });
+    }
+
+    for (std::thread& Thread : Threads)
+    {
+        Thread.join();
+    }
+
+    ThreadResults Total;
+    for (const ThreadResults& Result : Results)
+    {
+        Total.OpenSeconds = std::max(Total.OpenSeconds, Result.OpenSeconds);
+        Total.InsertSeconds = std::max(Total.InsertSeconds, Result.InsertSeconds);
+        Total.DuplicateInsertSeconds = std::max(Total.DuplicateInsertSeconds, Result.DuplicateInsertSeconds);
+        Total.CloseSeconds = std::max(Total.CloseSeconds, Result.CloseSeconds);
+        Total.NumInserted += Result.NumInserted;
+        Total.NumDuplicatesRejected += Result.NumDuplicatesRejected;
+        Total.NumOpenFailures += Result.NumOpenFailures;
+    }
+
+    // Every set has been closed, so no object may still be marked as used by a command list
+    UINT64 NumObjectsStillUsed = 0;
+    for (const ManagedObject& Object : Objects)
+    {
+        NumObjectsStillUsed += Object.IsUsedOnAnyCommandList() ? 1 : 0;
+    }
+
+    // The slowest thread's time, per operation of one thread
+    const double NumSets = double(SetsPerThread);
+    const double NumInserts = NumSets * ObjectsPerSet;
+    printf("%u threads, %u objects per set, %u sets per thread\n", NumThreads, ObjectsPerSet, SetsPerThread);
+    printf("%-18s %10.1f ns\n", "Open", Total.OpenSeconds * 1e9 / NumSets);
+    printf("%-18s %10.1f ns\n", "Insert", Total.InsertSeconds * 1e9 / NumInserts);
+    printf("%-18s %10.1f ns\n", "Insert duplicate", Total.DuplicateInsertSeconds * 1e9 / NumInserts);
+    printf("%-18s %10.1f ns\n", "Close", Total.CloseSeconds * 1e9 / NumSets);
+    printf("%-18s %10.1f M/s\n", "Inserts, all", double(Total.NumInserted) / std::max(Total.InsertSeconds, 1e-9) * 1e-6);
+
+    const UINT64 ExpectedInserts = UINT64(NumThreads) * SetsPerThread * ObjectsPerSet;
+    const bool Valid = Total.NumOpenFailures == 0 &&
+                       Total.NumInserted == ExpectedInserts &&
+                       Total.NumDuplicatesRejected == ExpectedInserts &&
+                       NumObjectsStillUsed == 0;
+    if (Valid == false)
+    {
+        fprintf(stderr, "FAILED: %llu open failures, %llu of %llu inserted, %llu of %llu duplicates rejected, %llu objects still in use\n",
+            (unsigned long long)Total.NumOpenFailures,
+            (unsigned long long)Total.NumInserted, (unsigned long long)ExpectedInserts,
+            (unsigned long long)Total.NumDuplicatesRejected, (unsigned long long)ExpectedInserts,
+            (unsigned long long)NumObjectsStillUsed);
+        return 1;
+    }
+
+    // Every command list index is free again. Open many more sets than fit in the first 64 bits of each object, twice,
+    // and check that each round finds every object in every set.
+    const UINT32 NumConcurrentSets = std::max(NumThreads, 1000u);
+    const UINT32 NumSharedObjects = std::min(ObjectsPerSet, 64u);
+    std::vector<ResidencySet*> Sets(NumConcurrentSets);
+    for (ResidencySet*& pSet : Sets)
+    {
+        pSet = Manager.CreateResidencySet();
+    }
+    for (UINT32 Round = 0; Round < 2; Round++)
+    {
+        UINT32 NumOpened = 0;
+        UINT64 NumSharedInserted = 0;
+        for (ResidencySet* pSet : Sets)
+        {
+            if (SUCCEEDED(pSet->Open()))
+            {
+                NumOpened++;
+                for (UINT32 j = 0; j < NumSharedObjects; j++)
+                {
+                    NumSharedInserted += pSet->Insert(&Objects[j]) ? 1 : 0;
+                }
+            }
+        }
+        for (ResidencySet* pSet : Sets)
+        {
+            pSet->Close();
+        }
+
+        NumObjectsStillUsed = 0;
+        for (const ManagedObject& Object : Objects)
+        {
+            NumObjectsStillUsed += Object.IsUsedOnAnyCommandList() ? 1 : 0;
+        }
+
+        if (NumOpened != NumConcurrentSets ||
+            NumSharedInserted != UINT64(NumConcurrentSets) * NumSharedObjects ||
+            NumObjectsStillUsed != 0)
+        {
+            fprintf(stderr, "FAILED: %u of %u sets opened at once, %llu of %llu inserted, %llu objects still in use\n",
+                NumOpened, NumConcurrentSets,
+                (unsigned long long)NumSharedInserted, (unsigned long long)(UINT64(NumConcurrentSets) * NumSharedObjects),
+                (unsigned long long)NumObjectsStillUsed);
+            return 1;
+        }
+    }
+    for (ResidencySet* pSet : Sets)
+    {
+        Manager.DestroyResidencySet(pSet);
+    }
+
+    // The second round reused the first round's indices, so the objects only have the mask blocks for that many sets
+    const UINT32 LastWord = (NumConcurrentSets - 1) / 64;
+    const UINT32 ExpectedBlocks = (LastWord == 0) ? 0 : (LastWord - 1) / ManagedObject::CommandListMaskBlock::NumWords + 1;
+    UINT32 NumBlocks = 0;
+    for (const ManagedObject::CommandListMaskBlock* pBlock = Objects[0].pMoreCommandListsUsedOn; pBlock; pBlock = pBlock->pNext)
+    {
+        NumBlocks++;
+    }
+    if (NumBlocks != ExpectedBlocks)
+    {
+        fprintf(stderr, "FAILED: %u mask blocks for %u sets, expected %u\n", NumBlocks, NumConcurrentSets, ExpectedBlocks);
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,86 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+
+// Replays a trace recorded with ResidencyManager::RecordTrace with every eviction policy and prints how much each one paged.
+// Usage: ResidencySimulator <trace> [budget in MB] [sync points in flight]
+
+#ifdef _WIN32
+#include <windows.h>
+#include <d3d12.h>
+#include <dxgi1_4.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "d3dx12ResidencySimulator.h"
+
+using namespace D3DX12Residency;
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "Usage: %s <trace> [budget in MB] [sync points in flight]\n", argv[0]);
+        return 1;
+    }
+
+    FILE* pFile = fopen(argv[1], "r");
+    if (pFile == nullptr)
+    {
+        fprintf(stderr, "Can't open %s\n", argv[1]);
+        return 1;
+    }
+
+    Simulation::Trace Trace;
+    const bool Loaded = Trace.Load(pFile);
+    fclose(pFile);
+    if (Loaded == false)
+    {
+        fprintf(stderr, "%s is not a valid residency trace\n", argv[1]);
+        return 1;
+    }
+
+    Simulation::SimulationDesc Desc;
+    if (argc > 2)
+    {
+        Desc.Budget = UINT64(strtoull(argv[2], nullptr, 10)) * 1024 * 1024;
+    }
+    if (argc > 3)
+    {
+        Desc.NumSyncPointsInFlight = UINT32(strtoul(argv[3], nullptr, 10));
+    }
+
+    const EVICTION_POLICY Policies[] =
+    {
+        EVICTION_POLICY::LRU,
+        EVICTION_POLICY::SIZE_WEIGHTED_LRU,
+        EVICTION_POLICY::TWO_QUEUE,
+        EVICTION_POLICY::PRIORITY
+    };
+
+    printf("%-18s %12s %12s %8s %12s %10s %14s\n", "Policy", "MB resident", "MB evicted", "Stalls", "Over budget", "Peak MB", "Objects paged");
+    for (EVICTION_POLICY Policy : Policies)
+    {
+        Simulation::SimulationResults Results;
+        Simulation::Simulate(Trace, Desc, Policy, Results);
+
+        printf("%-18s %12.1f %12.1f %8llu %12llu %10.1f %14llu\n",
+            Simulation::GetPolicyName(Policy),
+            Results.BytesMadeResident / (1024.0 * 1024.0),
+            Results.BytesEvicted / (1024.0 * 1024.0),
+            (unsigned long long)Results.NumStallSyncPoints,
+            (unsigned long long)Results.NumOverBudgetExecutions,
+            Results.PeakUsage / (1024.0 * 1024.0),
+            (unsigned long long)(Results.NumObjectsMadeResident + Results.NumObjectsEvicted));
+    }
+
+    return 0;
+}
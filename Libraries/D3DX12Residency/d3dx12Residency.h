@@ -10,6 +10,9 @@
 //*********************************************************
 
 #pragma once
+#include <stdio.h>
+#include <algorithm>
+
 namespace D3DX12Residency
 {
 #if 0
@@ -26,14 +29,18 @@ namespace D3DX12Residency
 // Note: This library automatically runs in a single-threaded mode if ID3D12Device3 is supported.
 #define RESIDENCY_SINGLE_THREADED 0
 
+// Only compile ManagedObject and the eviction policies, which need neither Windows nor D3D12.
+// d3dx12ResidencySimulator.h uses this to replay traces on other platforms.
+#ifndef RESIDENCY_POLICY_ONLY
+#define RESIDENCY_POLICY_ONLY 0
+#endif
+
 #define RESIDENCY_MIN(x,y) ((x) < (y) ? (x) : (y))
 #define RESIDENCY_MAX(x,y) ((x) > (y) ? (x) : (y))
 
-    // This size can be tuned to your app in order to save space
-#define MAX_NUM_CONCURRENT_CMD_LISTS 32
-
     namespace Internal
     {
+#if !RESIDENCY_POLICY_ONLY
         class CriticalSection
         {
             friend class ScopedLock;
@@ -82,25 +89,156 @@ namespace D3DX12Residency
         class SyncManager
         {
         public:
-            SyncManager()
+            SyncManager() : FreeListHead(MakeHead(0, sUnsetValue)), NumCommandLists(0)
             {
-                for (UINT32 i = 0; i < ARRAYSIZE(AvailableCommandLists); i++)
+                for (UINT32 i = 0; i < sNumBlocks; i++)
                 {
-                    AvailableCommandLists[i] = false;
+                    pNextFreeCommandList[i] = nullptr;
                 }
             }
 
-            Internal::CriticalSection MaskCriticalSection;
+            ~SyncManager()
+            {
+                for (UINT32 i = 0; i < sNumBlocks; i++)
+                {
+                    delete[](pNextFreeCommandList[i]);
+                }
+            }
+
+            // Returns a free command list index, or a new one if every index is in use. Returns sUnsetValue if the
+            // memory for a new index can't be allocated.
+            UINT32 ReserveCommandList()
+            {
+                LONG64 Head = FreeListHead;
+                while (true)
+                {
+                    const UINT32 Index = GetIndex(Head);
+                    if (Index == sUnsetValue)
+                    {
+                        return AddCommandList();
+                    }
+
+                    // If another thread changes the list in the meantime its tag changes and this fails
+                    const LONG64 PreviousHead = InterlockedCompareExchange64(&FreeListHead, MakeHead(Head, *GetNextFreeCommandList(Index)), Head);
+                    if (PreviousHead == Head)
+                    {
+                        return Index;
+                    }
+                    Head = PreviousHead;
+                }
+            }
+
+            void ReturnCommandList(UINT32 Index)
+            {
+                volatile UINT32* pNext = GetNextFreeCommandList(Index);
+
+                LONG64 Head = FreeListHead;
+                while (true)
+                {
+                    *pNext = GetIndex(Head);
+
+                    const LONG64 PreviousHead = InterlockedCompareExchange64(&FreeListHead, MakeHead(Head, Index), Head);
+                    if (PreviousHead == Head)
+                    {
+                        return;
+                    }
+                    Head = PreviousHead;
+                }
+            }
 
             static const UINT32 sUnsetValue = UINT32(-1);
-            // Represents which command lists are currently open for recording
-            bool AvailableCommandLists[MAX_NUM_CONCURRENT_CMD_LISTS];
+
+        private:
+            // Indices are only added when every existing one is in use, so there are never more than the most sets
+            // that were open at once. Their free list links live in blocks which double in size, starting at 64, and
+            // are allocated the first time one of their indices is used.
+            static const UINT32 sFirstBlockSize = 64;
+            static const UINT32 sNumBlocks = 26;
+
+            UINT32 AddCommandList()
+            {
+                const UINT32 Index = UINT32(InterlockedIncrement(&NumCommandLists) - 1);
+
+                UINT32 Block, Offset;
+                FindBlock(Index, Block, Offset);
+                if (Block >= sNumBlocks)
+                {
+                    return sUnsetValue;
+                }
+
+                if (pNextFreeCommandList[Block] == nullptr)
+                {
+                    // Several threads can get their first index from the same block, only one of them installs it
+                    volatile UINT32* pNewBlock = new UINT32[sFirstBlockSize << Block];
+                    if (pNewBlock == nullptr)
+                    {
+                        return sUnsetValue;
+                    }
+                    if (InterlockedCompareExchangePointer((PVOID volatile*)&pNextFreeCommandList[Block], (PVOID)pNewBlock, nullptr) != nullptr)
+                    {
+                        delete[](pNewBlock);
+                    }
+                }
+                return Index;
+            }
+
+            inline volatile UINT32* GetNextFreeCommandList(UINT32 Index)
+            {
+                UINT32 Block, Offset;
+                FindBlock(Index, Block, Offset);
+                return &pNextFreeCommandList[Block][Offset];
+            }
+
+            static inline void FindBlock(UINT32 Index, UINT32& Block, UINT32& Offset)
+            {
+                Block = 0;
+                Offset = Index;
+                while (Block < sNumBlocks && Offset >= (sFirstBlockSize << Block))
+                {
+                    Offset -= sFirstBlockSize << Block;
+                    Block++;
+                }
+            }
+
+            // The head of the free list packs the first free index in the low 32 bits and a tag which changes on every
+            // update in the high 32 bits, so that a stale head can't be swapped back in (ABA).
+            static inline UINT32 GetIndex(LONG64 Head)
+            {
+                return UINT32(UINT64(Head) & 0xFFFFFFFF);
+            }
+
+            static inline LONG64 MakeHead(LONG64 PreviousHead, UINT32 Index)
+            {
+                return LONG64((((UINT64(PreviousHead) >> 32) + 1) << 32) | Index);
+            }
+
+            // Lock-free stack of the command list indices that aren't used by an open residency set
+            volatile LONG64 FreeListHead;
+            volatile UINT32* volatile pNextFreeCommandList[sNumBlocks];
+            volatile LONG NumCommandLists;
         };
+#endif
 
         //Forward Declaration
         class ResidencyManagerInternal;
     }
 
+    // How the residency manager picks the objects to evict when it has to trim to get back under budget.
+    // Objects which haven't been used within the eviction grace period are trimmed the same way by every policy.
+    enum class EVICTION_POLICY
+    {
+        // Evict the least recently used objects first
+        LRU,
+        // Evict the objects with the largest size * age first, so that fewer objects are paged to free the same space
+        SIZE_WEIGHTED_LRU,
+        // 2Q: objects start out on probation and are protected once a second execution uses them, or when they are made
+        // resident again after being evicted. Objects on probation are evicted first, which stops objects that are only
+        // used once from pushing out the working set.
+        TWO_QUEUE,
+        // Evict the objects with the lowest EvictionPriority first, and the least recently used first within a priority
+        PRIORITY
+    };
+
     // Used to track meta data for each object the app potentially wants
     // to make resident or evict.
     class ManagedObject
@@ -112,14 +250,32 @@ namespace D3DX12Residency
             EVICTED
         };
 
+        // Same value as D3D12_RESIDENCY_PRIORITY_NORMAL
+        static const UINT32 DefaultEvictionPriority = 0x78000000;
+
         ManagedObject() :
             pUnderlying(nullptr),
             Size(0),
             ResidencyStatus(RESIDENCY_STATUS::RESIDENT),
             LastGPUSyncPoint(0),
-            LastUsedTimestamp(0)
+            LastUsedTimestamp(0),
+            EvictionPriority(DefaultEvictionPriority),
+            NumExecutionsReferenced(0),
+            IsProtected(false),
+            CommandListsUsedOn(0),
+            pMoreCommandListsUsedOn(nullptr)
+        {
+        }
+
+        ~ManagedObject()
         {
-            memset(CommandListsUsedOn, 0, sizeof(CommandListsUsedOn));
+            CommandListMaskBlock* pBlock = pMoreCommandListsUsedOn;
+            while (pBlock)
+            {
+                CommandListMaskBlock* pNext = pBlock->pNext;
+                delete(pBlock);
+                pBlock = pNext;
+            }
         }
 
         void Initialize(ID3D12Pageable* pUnderlyingIn, UINT64 ObjectSize, UINT64 InitialGPUSyncPoint = 0)
@@ -132,6 +288,20 @@ namespace D3DX12Residency
 
         inline bool IsInitialized() { return pUnderlying != nullptr; }
 
+        // Whether an open residency set contains this object
+        bool IsUsedOnAnyCommandList() const
+        {
+            bool Used = CommandListsUsedOn != 0;
+            for (const CommandListMaskBlock* pBlock = pMoreCommandListsUsedOn; pBlock; pBlock = pBlock->pNext)
+            {
+                for (UINT32 i = 0; i < CommandListMaskBlock::NumWords; i++)
+                {
+                    Used |= pBlock->Words[i] != 0;
+                }
+            }
+            return Used;
+        }
+
         // Wether the object is resident or not
         RESIDENCY_STATUS ResidencyStatus;
 
@@ -143,13 +313,47 @@ namespace D3DX12Residency
         UINT64 LastGPUSyncPoint;
         UINT64 LastUsedTimestamp;
 
-        // This is used to track which open command lists this resource is currently used on.
-        bool CommandListsUsedOn[MAX_NUM_CONCURRENT_CMD_LISTS];
+        // Only used by EVICTION_POLICY::PRIORITY, on the same scale as D3D12_RESIDENCY_PRIORITY.
+        // Objects with a lower priority are evicted first.
+        UINT32 EvictionPriority;
+
+        // The number of executions that used this object and whether it is on the protected list, see EVICTION_POLICY::TWO_QUEUE
+        UINT32 NumExecutionsReferenced;
+        bool IsProtected;
+
+        // The bits for command list indices past the first 64, 256 per block. A residency set adds the blocks it
+        // needs the first time it uses the object, and they are kept until the object is destroyed.
+        struct CommandListMaskBlock
+        {
+            static const UINT32 NumWords = 4;
+
+            CommandListMaskBlock() : pNext(nullptr)
+            {
+                for (UINT32 i = 0; i < NumWords; i++)
+                {
+                    Words[i] = 0;
+                }
+            }
+
+            volatile LONG64 Words[NumWords];
+            CommandListMaskBlock* volatile pNext;
+        };
+
+        // This is used to track which open command lists this resource is currently used on, one bit per command list.
+        // Residency sets for different command lists can be recorded on different threads so bits are set atomically.
+        volatile LONG64 CommandListsUsedOn;
+        CommandListMaskBlock* volatile pMoreCommandListsUsedOn;
 
         // Linked list entry
         LIST_ENTRY ListEntry;
+
+    private:
+        // The mask blocks are owned by the object
+        ManagedObject(const ManagedObject&) = delete;
+        ManagedObject& operator=(const ManagedObject&) = delete;
     };
 
+#if !RESIDENCY_POLICY_ONLY
     // This represents a set of objects which are referenced by a command list i.e. every time a resource
     // is bound for rendering, clearing, copy etc. the set must be updated to ensure the it is resident 
     // for execution.
@@ -183,10 +387,18 @@ namespace D3DX12Residency
             RESIDENCY_CHECK(IsOpen);
             RESIDENCY_CHECK(CommandListIndex != InvalidIndex);
 
-            // If we haven't seen this object on this command list mark it
-            if (pObject->CommandListsUsedOn[CommandListIndex] == false)
+            volatile LONG64* pUsedOn = GetCommandListsUsedOn(pObject);
+            if (pUsedOn == nullptr)
+            {
+                OutOfMemory = true;
+                return false;
+            }
+            const LONG64 Mask = LONG64(1ull << (CommandListIndex % 64));
+
+            // If we haven't seen this object on this command list mark it. Only this set changes its own bit,
+            // so the atomic is skipped for objects that have already been inserted.
+            if ((*pUsedOn & Mask) == 0 && (InterlockedOr64(pUsedOn, Mask) & Mask) == 0)
             {
-                pObject->CommandListsUsedOn[CommandListIndex] = true;
                 if (ppSet == nullptr || CurrentSetSize >= MaxResidencySetSize)
                 {
                     Realloc();
@@ -209,8 +421,6 @@ namespace D3DX12Residency
 
         HRESULT Open()
         {
-            Internal::ScopedLock Lock(&pSyncManager->MaskCriticalSection);
-
             // It's invalid to open a set that is already open
             if (IsOpen)
             {
@@ -219,22 +429,10 @@ namespace D3DX12Residency
 
             RESIDENCY_CHECK(CommandListIndex == InvalidIndex);
 
-            bool CommandlistAvailable = false;
-            // Find the first available command list by bitscanning
-            for (UINT32 i = 0; i < ARRAYSIZE(pSyncManager->AvailableCommandLists); i++)
-            {
-                if (pSyncManager->AvailableCommandLists[i] == false)
-                {
-                    CommandListIndex = i;
-                    pSyncManager->AvailableCommandLists[i] = true;
-                    CommandlistAvailable = true;
-                    break;
-                }
-            }
-
-            if (CommandlistAvailable == false)
+            CommandListIndex = pSyncManager->ReserveCommandList();
+            if (CommandListIndex == Internal::SyncManager::sUnsetValue)
             {
-                // There are too many open residency sets, consider using less or increasing the value of MAX_NUM_CONCURRENT_CMD_LISTS
+                // Out of memory for a new command list index
                 RESIDENCY_CHECK(false);
                 return E_OUTOFMEMORY;
             }
@@ -274,14 +472,52 @@ namespace D3DX12Residency
 
         inline void Remove(ManagedObject* pObject)
         {
-            pObject->CommandListsUsedOn[CommandListIndex] = false;
+            InterlockedAnd64(GetCommandListsUsedOn(pObject), ~LONG64(1ull << (CommandListIndex % 64)));
         }
 
-        inline void ReturnCommandListReservation()
+        // Returns the word of the object's mask that holds this set's bit. Returns nullptr if a mask block can't be allocated.
+        inline volatile LONG64* GetCommandListsUsedOn(ManagedObject* pObject)
+        {
+            return (CommandListIndex < 64) ? &pObject->CommandListsUsedOn : GetMoreCommandListsUsedOn(pObject);
+        }
+
+        // Adds mask blocks to the object if this set's index is past them
+        volatile LONG64* GetMoreCommandListsUsedOn(ManagedObject* pObject)
         {
-            Internal::ScopedLock Lock(&pSyncManager->MaskCriticalSection);
+            const UINT32 Word = CommandListIndex / 64;
+            UINT32 Block = (Word - 1) / ManagedObject::CommandListMaskBlock::NumWords;
+            ManagedObject::CommandListMaskBlock* volatile* ppBlock = &pObject->pMoreCommandListsUsedOn;
+            while (true)
+            {
+                ManagedObject::CommandListMaskBlock* pBlock = *ppBlock;
+                if (pBlock == nullptr)
+                {
+                    // Sets on other threads can add the same block, only one of them is kept
+                    pBlock = new ManagedObject::CommandListMaskBlock();
+                    if (pBlock == nullptr)
+                    {
+                        return nullptr;
+                    }
+                    PVOID pPrevious = InterlockedCompareExchangePointer((PVOID volatile*)ppBlock, pBlock, nullptr);
+                    if (pPrevious != nullptr)
+                    {
+                        delete(pBlock);
+                        pBlock = (ManagedObject::CommandListMaskBlock*)pPrevious;
+                    }
+                }
+
+                if (Block == 0)
+                {
+                    return &pBlock->Words[(Word - 1) % ManagedObject::CommandListMaskBlock::NumWords];
+                }
+                Block--;
+                ppBlock = &pBlock->pNext;
+            }
+        }
 
-            pSyncManager->AvailableCommandLists[CommandListIndex] = false;
+        inline void ReturnCommandListReservation()
+        {
+            pSyncManager->ReturnCommandList(CommandListIndex);
 
             CommandListIndex = ResidencySet::InvalidIndex;
 
@@ -328,6 +564,7 @@ namespace D3DX12Residency
 
         Internal::SyncManager* pSyncManager;
     };
+#endif
 
     namespace Internal
     {
@@ -380,6 +617,7 @@ namespace D3DX12Residency
             return pEntry->Flink == pEntry;
         }
 
+#if !RESIDENCY_POLICY_ONLY
         struct Fence
         {
             Fence(UINT64 StartingValue) : pFence(nullptr), FenceValue(StartingValue)
@@ -495,23 +733,82 @@ namespace D3DX12Residency
             // NumQueueSyncPoints QueueSyncPoints will be placed below here
             QueueSyncPoint pQueueSyncPoints[1];
         };
+#endif
+
+        // Generate a result between the minimum period and the maximum period based on the current
+        // local memory pressure. I.e. when memory pressure is low, objects will persist longer before
+        // being evicted.
+        inline UINT64 GetEvictionGracePeriod(UINT64 CurrentUsage, UINT64 Budget, double TrimPercentageMemoryUsageThreshold, UINT64 MinPeriod, UINT64 MaxPeriod)
+        {
+            // 1 == full pressure, 0 == no pressure
+            double Pressure = (double(CurrentUsage) / double(Budget));
+            Pressure = RESIDENCY_MIN(Pressure, 1.0);
+
+            if (Pressure > TrimPercentageMemoryUsageThreshold)
+            {
+                // Normalize the pressure for the range 0 to cTrimPercentageMemoryUsageThreshold
+                Pressure = (Pressure - TrimPercentageMemoryUsageThreshold) / (1.0 - TrimPercentageMemoryUsageThreshold);
+
+                // Linearly interpolate between the min period and the max period based on the pressure
+                return UINT64((MaxPeriod - MinPeriod) * (1.0 - Pressure)) + MinPeriod;
+            }
+            else
+            {
+                // Essentially don't trim at all
+                return UINT64(-1);
+            }
+        }
+
+        // Only grows, so that submissions stop allocating once the app reaches its steady state. The contents aren't kept.
+        template<typename T>
+        inline void GrowScratchSpace(T*& pScratch, UINT32& ScratchSize, UINT32 RequiredSize)
+        {
+            if (RequiredSize > ScratchSize)
+            {
+                ScratchSize = RESIDENCY_MAX(RequiredSize, ScratchSize + (ScratchSize / 2));
+
+                delete[](pScratch);
+                pScratch = new T[ScratchSize];
+            }
+        }
 
         // A Least Recently Used Cache. Tracks all of the objects requested by the app so that objects
-        // that aren't used freqently can get evicted to help the app stay under buget.
+        // that aren't used freqently can get evicted to help the app stay under buget. The EVICTION_POLICY
+        // decides which of the objects that are no longer in use on the GPU get evicted first.
         class LRUCache
         {
         public:
             LRUCache() :
+                Policy(EVICTION_POLICY::LRU),
                 NumResidentObjects(0),
                 NumEvictedObjects(0),
-                ResidentSize(0)
+                ResidentSize(0),
+                ProtectedSize(0),
+                pRankedCandidates(nullptr),
+                RankedCandidatesSize(0)
             {
                 Internal::InitializeListHead(&ResidentObjectListHead);
+                Internal::InitializeListHead(&ProtectedObjectListHead);
                 Internal::InitializeListHead(&EvictedObjectListHead);
             };
 
+            ~LRUCache()
+            {
+                delete[](pRankedCandidates);
+            }
+
+            // The policy can only be changed while no objects are being tracked
+            void SetPolicy(EVICTION_POLICY PolicyIn)
+            {
+                RESIDENCY_CHECK(NumResidentObjects == 0 && NumEvictedObjects == 0);
+                Policy = PolicyIn;
+            }
+
             void Insert(ManagedObject* pObject)
             {
+                pObject->NumExecutionsReferenced = 0;
+                pObject->IsProtected = false;
+
                 if (pObject->ResidencyStatus == ManagedObject::RESIDENCY_STATUS::RESIDENT)
                 {
                     Internal::InsertHeadList(&ResidentObjectListHead, &pObject->ListEntry);
@@ -532,6 +829,10 @@ namespace D3DX12Residency
                 {
                     NumResidentObjects--;
                     ResidentSize -= pObject->Size;
+                    if (pObject->IsProtected)
+                    {
+                        ProtectedSize -= pObject->Size;
+                    }
                 }
                 else
                 {
@@ -541,13 +842,20 @@ namespace D3DX12Residency
 
             // When an object is used by the GPU we move it to the end of the list.
             // This way things closer to the head of the list are the objects which
-            // are stale and better candidates for eviction
+            // are stale and better candidates for eviction.
+            // This must be called once per execution that uses the object.
             void ObjectReferenced(ManagedObject* pObject)
             {
                 RESIDENCY_CHECK(pObject->ResidencyStatus == ManagedObject::RESIDENCY_STATUS::RESIDENT);
 
+                pObject->NumExecutionsReferenced++;
+                if (Policy == EVICTION_POLICY::TWO_QUEUE && pObject->NumExecutionsReferenced > 1)
+                {
+                    Protect(pObject);
+                }
+
                 Internal::RemoveEntryList(&pObject->ListEntry);
-                Internal::InsertTailList(&ResidentObjectListHead, &pObject->ListEntry);
+                Internal::InsertTailList(GetResidentList(pObject), &pObject->ListEntry);
             }
 
             void MakeResident(ManagedObject* pObject)
@@ -556,17 +864,29 @@ namespace D3DX12Residency
 
                 pObject->ResidencyStatus = ManagedObject::RESIDENCY_STATUS::RESIDENT;
                 Internal::RemoveEntryList(&pObject->ListEntry);
-                Internal::InsertTailList(&ResidentObjectListHead, &pObject->ListEntry);
 
                 NumEvictedObjects--;
                 NumResidentObjects++;
                 ResidentSize += pObject->Size;
+
+                // Being used again after it was evicted means the object is part of the working set
+                if (Policy == EVICTION_POLICY::TWO_QUEUE && pObject->NumExecutionsReferenced > 0)
+                {
+                    Protect(pObject);
+                }
+                Internal::InsertTailList(GetResidentList(pObject), &pObject->ListEntry);
             }
 
             void Evict(ManagedObject* pObject)
             {
                 RESIDENCY_CHECK(pObject->ResidencyStatus == ManagedObject::RESIDENCY_STATUS::RESIDENT);
 
+                if (pObject->IsProtected)
+                {
+                    pObject->IsProtected = false;
+                    ProtectedSize -= pObject->Size;
+                }
+
                 pObject->ResidencyStatus = ManagedObject::RESIDENCY_STATUS::EVICTED;
                 Internal::RemoveEntryList(&pObject->ListEntry);
                 Internal::InsertTailList(&EvictedObjectListHead, &pObject->ListEntry);
@@ -576,72 +896,213 @@ namespace D3DX12Residency
                 NumEvictedObjects++;
             }
 
-            // Evict all of the resident objects used in sync points up to the specficied one (inclusive)
+            // Evict resident objects used in sync points up to the specficied one (inclusive) until the usage is under budget
             void TrimToSyncPointInclusive(INT64 CurrentUsage, INT64 CurrentBudget, ID3D12Pageable** EvictionList, UINT32& NumObjectsToEvict, UINT64 SyncPoint)
             {
                 NumObjectsToEvict = 0;
 
-                LIST_ENTRY* pResourceEntry = ResidentObjectListHead.Flink;
-                while (pResourceEntry != &ResidentObjectListHead)
+                if (Policy == EVICTION_POLICY::SIZE_WEIGHTED_LRU || Policy == EVICTION_POLICY::PRIORITY)
                 {
-                    ManagedObject* pObject = CONTAINING_RECORD(pResourceEntry, ManagedObject, ListEntry);
+                    TrimRankedToSyncPointInclusive(CurrentUsage, CurrentBudget, EvictionList, NumObjectsToEvict, SyncPoint);
+                    return;
+                }
 
-                    if (pObject->LastGPUSyncPoint > SyncPoint || CurrentUsage < CurrentBudget)
+                while (CurrentUsage >= CurrentBudget)
+                {
+                    ManagedObject* pObject = FindEvictionCandidate(SyncPoint);
+                    if (pObject == nullptr)
                     {
                         break;
                     }
 
-                    RESIDENCY_CHECK(pObject->ResidencyStatus == ManagedObject::RESIDENCY_STATUS::RESIDENT);
-
                     EvictionList[NumObjectsToEvict++] = pObject->pUnderlying;
                     Evict(pObject);
 
                     CurrentUsage -= pObject->Size;
+                }
+            }
 
-                    pResourceEntry = ResidentObjectListHead.Flink;
+            // Trim all objects which are older than the specified time and were last used before FirstUncompletedSyncPoint
+            void TrimAgedAllocations(UINT64 FirstUncompletedSyncPoint, ID3D12Pageable** EvictionList, UINT32& NumObjectsToEvict, UINT64 CurrentTimeStamp, UINT64 MinDelta)
+            {
+                TrimAgedAllocations(&ResidentObjectListHead, FirstUncompletedSyncPoint, EvictionList, NumObjectsToEvict, CurrentTimeStamp, MinDelta);
+                TrimAgedAllocations(&ProtectedObjectListHead, FirstUncompletedSyncPoint, EvictionList, NumObjectsToEvict, CurrentTimeStamp, MinDelta);
+            }
+
+            // Whether any resident object was last used before the specified sync point, i.e. whether waiting for
+            // the GPU could let us trim anything
+            bool HasObjectsUsedBefore(UINT64 SyncPoint)
+            {
+                ManagedObject* pOldest = GetListHead(&ResidentObjectListHead);
+                ManagedObject* pOldestProtected = GetListHead(&ProtectedObjectListHead);
+
+                return (pOldest && pOldest->LastGPUSyncPoint < SyncPoint) ||
+                       (pOldestProtected && pOldestProtected->LastGPUSyncPoint < SyncPoint);
+            }
+
+            EVICTION_POLICY Policy;
+
+            // Both resident lists are in the order the objects were last used. With EVICTION_POLICY::TWO_QUEUE the objects
+            // on probation are in ResidentObjectListHead, every other policy only uses ResidentObjectListHead.
+            LIST_ENTRY ResidentObjectListHead;
+            LIST_ENTRY ProtectedObjectListHead;
+            LIST_ENTRY EvictedObjectListHead;
+
+            UINT32 NumResidentObjects;
+            UINT32 NumEvictedObjects;
+
+            UINT64 ResidentSize;
+            UINT64 ProtectedSize;
+
+        private:
+            // With EVICTION_POLICY::TWO_QUEUE, objects on probation are evicted first until they make up less than this
+            // fraction of the resident size
+            static constexpr double cMinProbationFraction = 0.25;
+
+            struct EvictionCandidate
+            {
+                double Score;
+                // Position in the resident list, so that ties go to the least recently used object
+                UINT32 Order;
+                ManagedObject* pObject;
+
+                // The heap keeps the candidate to evict first on top
+                static bool EvictsLater(const EvictionCandidate& a, const EvictionCandidate& b)
+                {
+                    return (a.Score != b.Score) ? a.Score < b.Score : a.Order > b.Order;
                 }
+            };
+
+            // Only grows, the contents aren't kept between trims
+            EvictionCandidate* pRankedCandidates;
+            UINT32 RankedCandidatesSize;
+
+            inline LIST_ENTRY* GetResidentList(ManagedObject* pObject)
+            {
+                return pObject->IsProtected ? &ProtectedObjectListHead : &ResidentObjectListHead;
+            }
+
+            inline ManagedObject* GetListHead(LIST_ENTRY* pListHead)
+            {
+                if (IsListEmpty(pListHead))
+                {
+                    return nullptr;
+                }
+                return CONTAINING_RECORD(pListHead->Flink, ManagedObject, ListEntry);
             }
 
-            // Trim all objects which are older than the specified time
-            void TrimAgedAllocations(DeviceWideSyncPoint* MaxSyncPoint, ID3D12Pageable** EvictionList, UINT32& NumObjectsToEvict, UINT64 CurrentTimeStamp, UINT64 MinDelta)
+            inline void Protect(ManagedObject* pObject)
             {
+                if (pObject->IsProtected == false)
+                {
+                    pObject->IsProtected = true;
+                    ProtectedSize += pObject->Size;
+                }
+            }
+
+            // Returns the next object to evict out of the ones used in sync points up to SyncPoint (inclusive). The policies
+            // which rank every candidate go through TrimRankedToSyncPointInclusive instead.
+            ManagedObject* FindEvictionCandidate(UINT64 SyncPoint)
+            {
+                if (Policy == EVICTION_POLICY::TWO_QUEUE)
+                {
+                    ManagedObject* pProbation = GetListHead(&ResidentObjectListHead);
+                    ManagedObject* pProtected = GetListHead(&ProtectedObjectListHead);
+
+                    if (pProbation && pProbation->LastGPUSyncPoint > SyncPoint)
+                    {
+                        pProbation = nullptr;
+                    }
+                    if (pProtected && pProtected->LastGPUSyncPoint > SyncPoint)
+                    {
+                        pProtected = nullptr;
+                    }
+
+                    // Only take from the protected list once probation has shrunk to its share of the resident objects
+                    if (pProbation && (pProtected == nullptr || double(ResidentSize - ProtectedSize) > double(ResidentSize) * cMinProbationFraction))
+                    {
+                        return pProbation;
+                    }
+                    return pProtected ? pProtected : pProbation;
+                }
+
+                ManagedObject* pOldest = GetListHead(&ResidentObjectListHead);
+                return (pOldest && pOldest->LastGPUSyncPoint <= SyncPoint) ? pOldest : nullptr;
+            }
+
+            // For EVICTION_POLICY::SIZE_WEIGHTED_LRU and EVICTION_POLICY::PRIORITY. The scores don't change during a trim, so
+            // every object that is no longer in use is scored once and put in a heap, and the best one is popped per eviction.
+            void TrimRankedToSyncPointInclusive(INT64 CurrentUsage, INT64 CurrentBudget, ID3D12Pageable** EvictionList, UINT32& NumObjectsToEvict, UINT64 SyncPoint)
+            {
+                if (CurrentUsage < CurrentBudget)
+                {
+                    return;
+                }
+
+                if (NumResidentObjects > RankedCandidatesSize)
+                {
+                    RankedCandidatesSize = RESIDENCY_MAX(NumResidentObjects, RankedCandidatesSize + (RankedCandidatesSize / 2));
+
+                    delete[](pRankedCandidates);
+                    pRankedCandidates = new EvictionCandidate[RankedCandidatesSize];
+                }
+
+                UINT32 NumCandidates = 0;
                 LIST_ENTRY* pResourceEntry = ResidentObjectListHead.Flink;
                 while (pResourceEntry != &ResidentObjectListHead)
                 {
                     ManagedObject* pObject = CONTAINING_RECORD(pResourceEntry, ManagedObject, ListEntry);
-
-                    if ((MaxSyncPoint && pObject->LastGPUSyncPoint >= MaxSyncPoint->GenerationID) || // Only trim allocations done on the GPU
-                        CurrentTimeStamp - pObject->LastUsedTimestamp <= MinDelta) // Don't evict things which have been used recently
+                    if (pObject->LastGPUSyncPoint > SyncPoint)
                     {
                         break;
                     }
 
-                    RESIDENCY_CHECK(pObject->ResidencyStatus == ManagedObject::RESIDENCY_STATUS::RESIDENT);
+                    EvictionCandidate& Candidate = pRankedCandidates[NumCandidates];
+                    Candidate.Score = (Policy == EVICTION_POLICY::PRIORITY) ?
+                        -double(pObject->EvictionPriority) :
+                        double(pObject->Size) * double(SyncPoint - pObject->LastGPUSyncPoint + 1);
+                    Candidate.Order = NumCandidates++;
+                    Candidate.pObject = pObject;
+
+                    pResourceEntry = pResourceEntry->Flink;
+                }
+
+                std::make_heap(pRankedCandidates, pRankedCandidates + NumCandidates, EvictionCandidate::EvictsLater);
+                while (CurrentUsage >= CurrentBudget && NumCandidates > 0)
+                {
+                    std::pop_heap(pRankedCandidates, pRankedCandidates + NumCandidates, EvictionCandidate::EvictsLater);
+                    ManagedObject* pObject = pRankedCandidates[--NumCandidates].pObject;
+
                     EvictionList[NumObjectsToEvict++] = pObject->pUnderlying;
                     Evict(pObject);
 
-                    pResourceEntry = ResidentObjectListHead.Flink;
+                    CurrentUsage -= pObject->Size;
                 }
             }
 
-            ManagedObject* GetResidentListHead()
+            void TrimAgedAllocations(LIST_ENTRY* pListHead, UINT64 FirstUncompletedSyncPoint, ID3D12Pageable** EvictionList, UINT32& NumObjectsToEvict, UINT64 CurrentTimeStamp, UINT64 MinDelta)
             {
-                if (IsListEmpty(&ResidentObjectListHead))
+                LIST_ENTRY* pResourceEntry = pListHead->Flink;
+                while (pResourceEntry != pListHead)
                 {
-                    return nullptr;
-                }
-                return CONTAINING_RECORD(ResidentObjectListHead.Flink, ManagedObject, ListEntry);
-            }
+                    ManagedObject* pObject = CONTAINING_RECORD(pResourceEntry, ManagedObject, ListEntry);
 
-            LIST_ENTRY ResidentObjectListHead;
-            LIST_ENTRY EvictedObjectListHead;
+                    if (pObject->LastGPUSyncPoint >= FirstUncompletedSyncPoint || // Only trim allocations done on the GPU
+                        CurrentTimeStamp - pObject->LastUsedTimestamp <= MinDelta) // Don't evict things which have been used recently
+                    {
+                        break;
+                    }
 
-            UINT32 NumResidentObjects;
-            UINT32 NumEvictedObjects;
+                    RESIDENCY_CHECK(pObject->ResidencyStatus == ManagedObject::RESIDENCY_STATUS::RESIDENT);
+                    EvictionList[NumObjectsToEvict++] = pObject->pUnderlying;
+                    Evict(pObject);
 
-            UINT64 ResidentSize;
+                    pResourceEntry = pListHead->Flink;
+                }
+            }
         };
 
+#if !RESIDENCY_POLICY_ONLY
         class ResidencyManagerInternal
         {
         public:
@@ -670,6 +1131,12 @@ namespace D3DX12Residency
                 AsyncWorkQueue(nullptr),
                 MaxSoftwareQueueLatency(6),
                 AsyncWorkQueueSize(7),
+                pMakeResidentScratch(nullptr),
+                MakeResidentScratchSize(0),
+                pEvictionScratch(nullptr),
+                EvictionScratchSize(0),
+                TicksPerSecond(0),
+                pTraceFile(nullptr),
                 pSyncManager(pSyncManagerIn)
             {
                 Internal::InitializeListHead(&QueueFencesListHead);
@@ -681,11 +1148,12 @@ namespace D3DX12Residency
             };
 
             // NOTE: DeviceNodeIndex is an index not a mask. The majority of D3D12 uses bit masks to identify a GPU node whereas DXGI uses 0 based indices.
-            HRESULT Initialize(ID3D12Device* ParentDevice, UINT DeviceNodeIndex, IDXGIAdapter* ParentAdapter, UINT32 MaxLatency)
+            HRESULT Initialize(ID3D12Device* ParentDevice, UINT DeviceNodeIndex, IDXGIAdapter* ParentAdapter, UINT32 MaxLatency, EVICTION_POLICY EvictionPolicy)
             {
                 Device = ParentDevice;
                 NodeIndex = DeviceNodeIndex;
                 MaxSoftwareQueueLatency = MaxLatency;
+                LRU.SetPolicy(EvictionPolicy);
 
                 // Try to query for the device interface with a queued MakeResident API.
                 if (FAILED(Device->QueryInterface(&Device3)))
@@ -713,6 +1181,7 @@ namespace D3DX12Residency
 
                 LARGE_INTEGER Frequency;
                 QueryPerformanceFrequency(&Frequency);
+                TicksPerSecond = Frequency.QuadPart;
 
                 // Calculate how many QPC ticks are equivalent to the given time in seconds
                 MinEvictionGracePeriodTicks = UINT64(Frequency.QuadPart * cMinEvictionGracePeriod);
@@ -830,6 +1299,14 @@ namespace D3DX12Residency
 
                 delete [] AsyncWorkQueue;
 
+                delete[](pMakeResidentScratch);
+                pMakeResidentScratch = nullptr;
+                MakeResidentScratchSize = 0;
+
+                delete[](pEvictionScratch);
+                pEvictionScratch = nullptr;
+                EvictionScratchSize = 0;
+
                 if (Device3)
                 {
                     Device3->Release();
@@ -853,26 +1330,91 @@ namespace D3DX12Residency
 
             void BeginTrackingObject(ManagedObject* pObject)
             {
-                Internal::ScopedLock Lock(&Mutex);
+                // TraceMutex is held across the update so that the object is either in the snapshot written by RecordTrace
+                // or recorded here, never both. The file is only written once Mutex is released.
+                Internal::ScopedLock TraceLock(&TraceMutex);
 
                 if (pObject)
                 {
-                    RESIDENCY_CHECK(pObject->pUnderlying != nullptr);
-                    if (cStartEvicted)
+                    bool Resident;
                     {
-                        pObject->ResidencyStatus = ManagedObject::RESIDENCY_STATUS::EVICTED;
-                        RESIDENCY_CHECK_RESULT(Device->Evict(1, &pObject->pUnderlying));
-                    }
+                        Internal::ScopedLock Lock(&Mutex);
 
-                    LRU.Insert(pObject);
+                        RESIDENCY_CHECK(pObject->pUnderlying != nullptr);
+                        if (cStartEvicted)
+                        {
+                            pObject->ResidencyStatus = ManagedObject::RESIDENCY_STATUS::EVICTED;
+                            RESIDENCY_CHECK_RESULT(Device->Evict(1, &pObject->pUnderlying));
+                        }
+
+                        LRU.Insert(pObject);
+                        Resident = pObject->ResidencyStatus == ManagedObject::RESIDENCY_STATUS::RESIDENT;
+                    }
+                    RecordObject(pObject, Resident);
                 }
             }
 
             void EndTrackingObject(ManagedObject* pObject)
             {
-                Internal::ScopedLock Lock(&Mutex);
+                Internal::ScopedLock TraceLock(&TraceMutex);
+
+                {
+                    Internal::ScopedLock Lock(&Mutex);
+                    LRU.Remove(pObject);
+                }
+
+                if (pTraceFile)
+                {
+                    fprintf(pTraceFile, "d %llx\n", (unsigned long long)(SIZE_T)pObject);
+                }
+            }
+
+            // Write every object that is tracked and every execution to pFile, in the format read by
+            // Simulation::Trace::Load in d3dx12ResidencySimulator.h. Pass nullptr to stop recording.
+            void RecordTrace(FILE* pFile)
+            {
+                Internal::ScopedLock TraceLock(&TraceMutex);
 
-                LRU.Remove(pObject);
+                pTraceFile = pFile;
+                if (pTraceFile == nullptr)
+                {
+                    return;
+                }
+
+                // Copy the list of tracked objects so that the paging work isn't held up while it is written. Nothing can
+                // stop being tracked until TraceMutex is released.
+                struct TracedObject
+                {
+                    ManagedObject* pObject;
+                    bool Resident;
+                };
+                TracedObject* pObjects = nullptr;
+                UINT32 NumObjects = 0;
+                {
+                    Internal::ScopedLock Lock(&Mutex);
+
+                    pObjects = new TracedObject[LRU.NumResidentObjects + LRU.NumEvictedObjects];
+
+                    LIST_ENTRY* ListHeads[] = { &LRU.ResidentObjectListHead, &LRU.ProtectedObjectListHead, &LRU.EvictedObjectListHead };
+                    for (UINT32 i = 0; i < ARRAYSIZE(ListHeads); i++)
+                    {
+                        for (LIST_ENTRY* pEntry = ListHeads[i]->Flink; pEntry != ListHeads[i]; pEntry = pEntry->Flink)
+                        {
+                            ManagedObject* pObject = CONTAINING_RECORD(pEntry, ManagedObject, ListEntry);
+                            pObjects[NumObjects].pObject = pObject;
+                            pObjects[NumObjects].Resident = pObject->ResidencyStatus == ManagedObject::RESIDENCY_STATUS::RESIDENT;
+                            NumObjects++;
+                        }
+                    }
+                }
+
+                fprintf(pTraceFile, "f %llu\n", (unsigned long long)TicksPerSecond);
+                for (UINT32 i = 0; i < NumObjects; i++)
+                {
+                    RecordObject(pObjects[i].pObject, pObjects[i].Resident);
+                }
+
+                delete[](pObjects);
             }
 
             // One residency set per command-list
@@ -1094,6 +1636,19 @@ namespace D3DX12Residency
                 UINT64 FenceValueToSignal;
             };
 
+            // Use a union so that we only need 1 allocation
+            union ResidentScratchSpace
+            {
+                ManagedObject* pManagedObject;
+                ID3D12Pageable* pUnderlying;
+            };
+
+            // Scratch space for ProcessPagingWork, which never runs on more than one thread at a time
+            ResidentScratchSpace* pMakeResidentScratch;
+            UINT32 MakeResidentScratchSize;
+            ID3D12Pageable** pEvictionScratch;
+            UINT32 EvictionScratchSize;
+
             SIZE_T AsyncWorkQueueSize;
             AsyncWorkload* AsyncWorkQueue;
 
@@ -1147,13 +1702,6 @@ namespace D3DX12Residency
             {
                 Internal::DeviceWideSyncPoint* FirstUncompletedSyncPoint = DequeueCompletedSyncPoints();
 
-                // Use a union so that we only need 1 allocation
-                union ResidentScratchSpace
-                {
-                    ManagedObject* pManagedObject;
-                    ID3D12Pageable* pUnderlying;
-                };
-
                 ResidentScratchSpace* pMakeResidentList = nullptr;
                 UINT32 NumObjectsToMakeResident = 0;
 
@@ -1166,25 +1714,46 @@ namespace D3DX12Residency
                 LARGE_INTEGER CurrentTime;
                 QueryPerformanceCounter(&CurrentTime);
 
+                // Only the paging work changes the residency of objects that are already tracked, so the objects which
+                // need to be made resident can be gathered before taking the lock
+                GrowScratchSpace(pMakeResidentScratch, MakeResidentScratchSize, UINT32(pWork->pMasterSet->CurrentSetSize));
+                pMakeResidentList = pMakeResidentScratch;
+
+                for (INT32 i = 0; i < pWork->pMasterSet->CurrentSetSize; i++)
+                {
+                    ManagedObject* pObject = pWork->pMasterSet->ppSet[i];
+                    // If it's evicted we need to make it resident again
+                    if (pObject->ResidencyStatus == ManagedObject::RESIDENCY_STATUS::EVICTED)
+                    {
+                        pMakeResidentList[NumObjectsToMakeResident++].pManagedObject = pObject;
+                        SizeToMakeResident += pObject->Size;
+                    }
+                }
+
+                DXGI_QUERY_VIDEO_MEMORY_INFO LocalMemory;
+                ZeroMemory(&LocalMemory, sizeof(LocalMemory));
+                GetCurrentBudget(&LocalMemory, DXGI_MEMORY_SEGMENT_GROUP_LOCAL);
+
+                // The set belongs to this work, so it is written to the trace before taking the lock
+                RecordExecution(pWork, CurrentTime.QuadPart, LocalMemory.Budget);
+
                 {
                     // A lock must be taken here as the state of the objects will be altered
                     Internal::ScopedLock Lock(&Mutex);
 
-                    pMakeResidentList = new ResidentScratchSpace[pWork->pMasterSet->CurrentSetSize];
-                    pEvictionList = new ID3D12Pageable*[LRU.NumResidentObjects];
+                    // At most every resident object can be evicted at once
+                    GrowScratchSpace(pEvictionScratch, EvictionScratchSize, LRU.NumResidentObjects + NumObjectsToMakeResident);
+                    pEvictionList = pEvictionScratch;
 
-                    // Mark the objects used by this command list to be made resident
-                    for (INT32 i = 0; i < pWork->pMasterSet->CurrentSetSize; i++)
+                    for (UINT32 i = 0; i < NumObjectsToMakeResident; i++)
                     {
-                        ManagedObject*& pObject = pWork->pMasterSet->ppSet[i];
-                        // If it's evicted we need to make it resident again
-                        if (pObject->ResidencyStatus == ManagedObject::RESIDENCY_STATUS::EVICTED)
-                        {
-                            pMakeResidentList[NumObjectsToMakeResident++].pManagedObject = pObject;
-                            LRU.MakeResident(pObject);
+                        LRU.MakeResident(pMakeResidentList[i].pManagedObject);
+                    }
 
-                            SizeToMakeResident += pObject->Size;
-                        }
+                    // Mark the objects used by this command list as used on this sync point
+                    for (INT32 i = 0; i < pWork->pMasterSet->CurrentSetSize; i++)
+                    {
+                        ManagedObject* pObject = pWork->pMasterSet->ppSet[i];
 
                         // Update the last sync point that this was used on
                         pObject->LastGPUSyncPoint = pWork->SyncPointGeneration;
@@ -1193,12 +1762,9 @@ namespace D3DX12Residency
                         LRU.ObjectReferenced(pObject);
                     }
 
-                    DXGI_QUERY_VIDEO_MEMORY_INFO LocalMemory;
-                    ZeroMemory(&LocalMemory, sizeof(LocalMemory));
-                    GetCurrentBudget(&LocalMemory, DXGI_MEMORY_SEGMENT_GROUP_LOCAL);
-
                     UINT64 EvictionGracePeriod = GetCurrentEvictionGracePeriod(&LocalMemory);
-                    LRU.TrimAgedAllocations(FirstUncompletedSyncPoint, pEvictionList, NumObjectsToEvict, CurrentTime.QuadPart, EvictionGracePeriod);
+                    LRU.TrimAgedAllocations(FirstUncompletedSyncPoint ? FirstUncompletedSyncPoint->GenerationID : UINT64(-1),
+                                            pEvictionList, NumObjectsToEvict, CurrentTime.QuadPart, EvictionGracePeriod);
 
                     if (NumObjectsToEvict)
                     {
@@ -1274,14 +1840,11 @@ namespace D3DX12Residency
 
                             if (FAILED(hr) || ObjectsMadeResident != NumObjectsToMakeResident)
                             {
-                                ManagedObject* pResidentHead = LRU.GetResidentListHead();
-
                                 // Get the next sync point to wait for
                                 FirstUncompletedSyncPoint = DequeueCompletedSyncPoints();
 
                                 // If there is nothing to trim OR the only objects 'Resident' are the ones about to be used by this execute.
-                                if (pResidentHead == nullptr ||
-                                    pResidentHead->LastGPUSyncPoint >= pWork->SyncPointGeneration ||
+                                if (LRU.HasObjectsUsedBefore(pWork->SyncPointGeneration) == false ||
                                     FirstUncompletedSyncPoint == nullptr)
                                 {
                                     // Make resident the rest of the objects as there is nothing left to trim
@@ -1340,9 +1903,6 @@ namespace D3DX12Residency
                             }
                         }
                     }
-
-                    delete[](pMakeResidentList);
-                    delete[](pEvictionList);
                 }
 
                 if (!Device3)
@@ -1492,28 +2052,36 @@ namespace D3DX12Residency
                 }
             }
 
-            // Generate a result between the minimum period and the maximum period based on the current
-            // local memory pressure. I.e. when memory pressure is low, objects will persist longer before
-            // being evicted.
             UINT64 GetCurrentEvictionGracePeriod(DXGI_QUERY_VIDEO_MEMORY_INFO* LocalMemoryState)
             {
-                // 1 == full pressure, 0 == no pressure
-                double Pressure = (double(LocalMemoryState->CurrentUsage) / double(LocalMemoryState->Budget));
-                Pressure = RESIDENCY_MIN(Pressure, 1.0);
+                return GetEvictionGracePeriod(LocalMemoryState->CurrentUsage, LocalMemoryState->Budget, cTrimPercentageMemoryUsageThreshold,
+                                              MinEvictionGracePeriodTicks, MaxEvictionGracePeriodTicks);
+            }
 
-                if (Pressure > cTrimPercentageMemoryUsageThreshold)
+            // Objects are identified by the address of their ManagedObject in traces. TraceMutex must be held.
+            void RecordObject(ManagedObject* pObject, bool Resident)
+            {
+                if (pTraceFile)
                 {
-                    // Normalize the pressure for the range 0 to cTrimPercentageMemoryUsageThreshold
-                    Pressure = (Pressure - cTrimPercentageMemoryUsageThreshold) / (1.0 - cTrimPercentageMemoryUsageThreshold);
+                    fprintf(pTraceFile, "o %llx %llu %u %d\n", (unsigned long long)(SIZE_T)pObject, (unsigned long long)pObject->Size,
+                            pObject->EvictionPriority, Resident ? 1 : 0);
+                }
+            }
 
-                    // Linearly interpolate between the min period and the max period based on the pressure
-                    return UINT64((MaxEvictionGracePeriodTicks - MinEvictionGracePeriodTicks) * (1.0 - Pressure)) + MinEvictionGracePeriodTicks;
+            void RecordExecution(AsyncWorkload* pWork, UINT64 TimeStamp, UINT64 Budget)
+            {
+                Internal::ScopedLock TraceLock(&TraceMutex);
+                if (pTraceFile == nullptr)
+                {
+                    return;
                 }
-                else
+
+                fprintf(pTraceFile, "e %llu %llu %d", (unsigned long long)TimeStamp, (unsigned long long)Budget, pWork->pMasterSet->CurrentSetSize);
+                for (INT32 i = 0; i < pWork->pMasterSet->CurrentSetSize; i++)
                 {
-                    // Essentially don't trim at all
-                    return MAXUINT64;
+                    fprintf(pTraceFile, " %llx", (unsigned long long)(SIZE_T)pWork->pMasterSet->ppSet[i]);
                 }
+                fprintf(pTraceFile, "\n");
             }
 
             LIST_ENTRY QueueFencesListHead;
@@ -1540,6 +2108,9 @@ namespace D3DX12Residency
 
             Internal::CriticalSection ExecutionCS;
 
+            // Guards pTraceFile and the writes to it. When both are needed it is taken before Mutex.
+            Internal::CriticalSection TraceMutex;
+
             const bool cStartEvicted;
 
             const float cMinEvictionGracePeriod;
@@ -1553,10 +2124,15 @@ namespace D3DX12Residency
             UINT32 MaxSoftwareQueueLatency;
             LUID ResidencyManagerUniqueID;
 
+            UINT64 TicksPerSecond;
+            FILE* pTraceFile;
+
             SyncManager* pSyncManager;
         };
+#endif
     }
 
+#if !RESIDENCY_POLICY_ONLY
     class ResidencyManager
     {
     public:
@@ -1566,9 +2142,10 @@ namespace D3DX12Residency
         }
 
         // NOTE: DeviceNodeIndex is an index not a mask. The majority of D3D12 uses bit masks to identify a GPU node whereas DXGI uses 0 based indices.
-        FORCEINLINE HRESULT Initialize(ID3D12Device* ParentDevice, UINT DeviceNodeIndex, IDXGIAdapter* ParentAdapter, UINT32 MaxLatency)
+        FORCEINLINE HRESULT Initialize(ID3D12Device* ParentDevice, UINT DeviceNodeIndex, IDXGIAdapter* ParentAdapter, UINT32 MaxLatency,
+                                       EVICTION_POLICY EvictionPolicy = EVICTION_POLICY::LRU)
         {
-            return Manager.Initialize(ParentDevice, DeviceNodeIndex, ParentAdapter, MaxLatency);
+            return Manager.Initialize(ParentDevice, DeviceNodeIndex, ParentAdapter, MaxLatency, EvictionPolicy);
         }
 
         FORCEINLINE void Destroy()
@@ -1591,6 +2168,13 @@ namespace D3DX12Residency
             return Manager.GetCurrentGPUSyncPoint(Queue, pCurrentGPUSyncPoint);
         }
 
+        // Records the objects and executions seen by the manager to pFile so they can be replayed with d3dx12ResidencySimulator.h.
+        // The file must stay open until RecordTrace(nullptr) is called.
+        FORCEINLINE void RecordTrace(FILE* pFile)
+        {
+            Manager.RecordTrace(pFile);
+        }
+
         // One residency set per command-list
         FORCEINLINE HRESULT ExecuteCommandLists(ID3D12CommandQueue* Queue, ID3D12CommandList** CommandLists, ResidencySet** ResidencySets, UINT32 Count)
         {
@@ -1617,4 +2201,5 @@ namespace D3DX12Residency
         Internal::ResidencyManagerInternal Manager;
         Internal::SyncManager SyncManager;
     };
+#endif
 };
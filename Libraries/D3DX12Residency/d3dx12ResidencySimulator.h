@@ -0,0 +1,403 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+
+// Replays traces recorded with ResidencyManager::RecordTrace against a fake device and budget, so that the
+// eviction policies can be compared without a GPU. On Windows include this after d3dx12Residency.h's usual
+// dependencies; anywhere else it only needs the C++ standard library.
+
+#pragma once
+#ifndef _WIN32
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+typedef int32_t INT32;
+typedef uint32_t UINT32;
+typedef int64_t INT64;
+typedef int64_t LONG64;
+typedef uint64_t UINT64;
+typedef size_t SIZE_T;
+
+struct LIST_ENTRY
+{
+    LIST_ENTRY* Flink;
+    LIST_ENTRY* Blink;
+};
+
+#define CONTAINING_RECORD(address, type, field) ((type*)((char*)(address) - offsetof(type, field)))
+
+// Never dereferenced by the policies
+struct ID3D12Pageable;
+
+#define RESIDENCY_POLICY_ONLY 1
+#endif
+
+#include "d3dx12Residency.h"
+
+#include <unordered_map>
+#include <vector>
+
+namespace D3DX12Residency
+{
+    namespace Simulation
+    {
+        struct TraceObject
+        {
+            UINT64 Size;
+            UINT32 EvictionPriority;
+            bool StartResident;
+        };
+
+        struct TraceEvent
+        {
+            enum class TYPE
+            {
+                BEGIN_TRACKING,
+                END_TRACKING,
+                EXECUTE
+            };
+
+            TYPE Type;
+
+            // BEGIN_TRACKING and END_TRACKING
+            UINT32 ObjectIndex;
+
+            // EXECUTE: the QPC time stamp and local memory budget when the paging work ran, and the objects used
+            UINT64 TimeStamp;
+            UINT64 Budget;
+            std::vector<UINT32> ObjectIndices;
+        };
+
+        struct Trace
+        {
+            Trace() : TicksPerSecond(1) {}
+
+            // Reads a file written by ResidencyManager::RecordTrace. Every BEGIN_TRACKING gets its own object, so
+            // addresses reused by the app after END_TRACKING don't alias.
+            bool Load(FILE* pFile)
+            {
+                std::unordered_map<UINT64, UINT32> TrackedObjects;
+
+                char Type;
+                while (fscanf(pFile, " %c", &Type) == 1)
+                {
+                    unsigned long long ID = 0;
+                    TraceEvent Event = {};
+
+                    switch (Type)
+                    {
+                    case 'f':
+                    {
+                        unsigned long long Frequency;
+                        if (fscanf(pFile, "%llu", &Frequency) != 1 || Frequency == 0)
+                        {
+                            return false;
+                        }
+                        TicksPerSecond = Frequency;
+                        continue;
+                    }
+                    case 'o':
+                    {
+                        unsigned long long Size;
+                        unsigned int Priority;
+                        int Resident;
+                        if (fscanf(pFile, "%llx %llu %u %d", &ID, &Size, &Priority, &Resident) != 4)
+                        {
+                            return false;
+                        }
+
+                        TraceObject Object = { Size, Priority, Resident != 0 };
+                        Event.Type = TraceEvent::TYPE::BEGIN_TRACKING;
+                        Event.ObjectIndex = UINT32(Objects.size());
+                        TrackedObjects[ID] = Event.ObjectIndex;
+                        Objects.push_back(Object);
+                        break;
+                    }
+                    case 'd':
+                    {
+                        if (fscanf(pFile, "%llx", &ID) != 1 || TrackedObjects.count(ID) == 0)
+                        {
+                            return false;
+                        }
+
+                        Event.Type = TraceEvent::TYPE::END_TRACKING;
+                        Event.ObjectIndex = TrackedObjects[ID];
+                        TrackedObjects.erase(ID);
+                        break;
+                    }
+                    case 'e':
+                    {
+                        unsigned long long TimeStamp, Budget;
+                        int Count;
+                        if (fscanf(pFile, "%llu %llu %d", &TimeStamp, &Budget, &Count) != 3 || Count < 0)
+                        {
+                            return false;
+                        }
+
+                        Event.Type = TraceEvent::TYPE::EXECUTE;
+                        Event.TimeStamp = TimeStamp;
+                        Event.Budget = Budget;
+                        Event.ObjectIndices.resize(Count);
+                        for (int i = 0; i < Count; i++)
+                        {
+                            if (fscanf(pFile, "%llx", &ID) != 1 || TrackedObjects.count(ID) == 0)
+                            {
+                                return false;
+                            }
+                            Event.ObjectIndices[i] = TrackedObjects[ID];
+                        }
+                        break;
+                    }
+                    default:
+                        return false;
+                    }
+
+                    Events.push_back(std::move(Event));
+                }
+
+                return true;
+            }
+
+            UINT64 TicksPerSecond;
+            std::vector<TraceObject> Objects;
+            std::vector<TraceEvent> Events;
+        };
+
+        struct SimulationDesc
+        {
+            SimulationDesc() :
+                Budget(0),
+                NumSyncPointsInFlight(2),
+                MinEvictionGracePeriod(1.0f),
+                MaxEvictionGracePeriod(60.0f),
+                TrimPercentageMemoryUsageThreshold(0.7f)
+            {}
+
+            // Replaces the budget recorded with each execution unless it is 0
+            UINT64 Budget;
+
+            // How many executions the fake GPU runs behind the paging work
+            UINT32 NumSyncPointsInFlight;
+
+            // Same as the ResidencyManagerInternal constants
+            float MinEvictionGracePeriod;
+            float MaxEvictionGracePeriod;
+            float TrimPercentageMemoryUsageThreshold;
+        };
+
+        struct SimulationResults
+        {
+            UINT64 BytesMadeResident;
+            UINT64 BytesEvicted;
+            UINT64 NumObjectsMadeResident;
+            UINT64 NumObjectsEvicted;
+
+            // Sync points the paging work had to wait for before it could trim enough to make an execution's objects resident
+            UINT64 NumStallSyncPoints;
+
+            // Executions which went over budget because nothing else could be evicted
+            UINT64 NumOverBudgetExecutions;
+
+            UINT64 PeakUsage;
+        };
+
+        // Stands in for the D3D device and the memory budget. Objects are passed around by their ManagedObject, whose
+        // pUnderlying points back at itself.
+        struct SimulatedDevice
+        {
+            SimulatedDevice(SimulationResults* pResultsIn) : Usage(0), pResults(pResultsIn) {}
+
+            void MakeResident(UINT32 NumObjects, ManagedObject* const* ppObjects)
+            {
+                for (UINT32 i = 0; i < NumObjects; i++)
+                {
+                    Usage += ppObjects[i]->Size;
+                    pResults->BytesMadeResident += ppObjects[i]->Size;
+                }
+                pResults->NumObjectsMadeResident += NumObjects;
+                pResults->PeakUsage = RESIDENCY_MAX(pResults->PeakUsage, Usage);
+            }
+
+            void Evict(UINT32 NumObjects, ID3D12Pageable* const* ppObjects)
+            {
+                for (UINT32 i = 0; i < NumObjects; i++)
+                {
+                    const UINT64 Size = reinterpret_cast<ManagedObject*>(ppObjects[i])->Size;
+                    Usage -= Size;
+                    pResults->BytesEvicted += Size;
+                }
+                pResults->NumObjectsEvicted += NumObjects;
+            }
+
+            UINT64 Usage;
+            SimulationResults* pResults;
+        };
+
+        // Replays ReplayTrace with the same steps as ResidencyManagerInternal::ProcessPagingWork. Every execution is its own
+        // sync point, and waiting for a sync point completes it on the fake GPU.
+        inline void Simulate(const Trace& ReplayTrace, const SimulationDesc& Desc, EVICTION_POLICY Policy, SimulationResults& Results)
+        {
+            Results = SimulationResults();
+            SimulatedDevice Device(&Results);
+
+            const UINT64 MinEvictionGracePeriodTicks = UINT64(ReplayTrace.TicksPerSecond * Desc.MinEvictionGracePeriod);
+            const UINT64 MaxEvictionGracePeriodTicks = UINT64(ReplayTrace.TicksPerSecond * Desc.MaxEvictionGracePeriod);
+
+            Internal::LRUCache LRU;
+            LRU.SetPolicy(Policy);
+
+            std::vector<ManagedObject> Objects(ReplayTrace.Objects.size());
+
+            // Sized per execution the same way as ProcessPagingWork's scratch space
+            ManagedObject** pMakeResidentList = nullptr;
+            UINT32 MakeResidentListSize = 0;
+            ID3D12Pageable** pEvictionList = nullptr;
+            UINT32 EvictionListSize = 0;
+            UINT32 NumObjectsToEvict = 0;
+
+            // Executions up to but not including CompletedGeneration are done on the fake GPU
+            UINT64 Generation = 0;
+            UINT64 CompletedGeneration = 0;
+
+            for (const TraceEvent& Event : ReplayTrace.Events)
+            {
+                if (Event.Type != TraceEvent::TYPE::EXECUTE)
+                {
+                    const TraceObject& ObjectDesc = ReplayTrace.Objects[Event.ObjectIndex];
+                    ManagedObject* pObject = &Objects[Event.ObjectIndex];
+
+                    if (Event.Type == TraceEvent::TYPE::BEGIN_TRACKING)
+                    {
+                        pObject->Initialize(reinterpret_cast<ID3D12Pageable*>(pObject), ObjectDesc.Size, Generation);
+                        pObject->EvictionPriority = ObjectDesc.EvictionPriority;
+                        pObject->ResidencyStatus = ObjectDesc.StartResident ? ManagedObject::RESIDENCY_STATUS::RESIDENT : ManagedObject::RESIDENCY_STATUS::EVICTED;
+                        LRU.Insert(pObject);
+
+                        // Creating an object isn't paging, but it does use up the budget
+                        if (ObjectDesc.StartResident)
+                        {
+                            Device.Usage += ObjectDesc.Size;
+                            Results.PeakUsage = RESIDENCY_MAX(Results.PeakUsage, Device.Usage);
+                        }
+                    }
+                    else
+                    {
+                        LRU.Remove(pObject);
+                        if (pObject->ResidencyStatus == ManagedObject::RESIDENCY_STATUS::RESIDENT)
+                        {
+                            Device.Usage -= pObject->Size;
+                        }
+                    }
+                    continue;
+                }
+
+                const UINT64 Budget = Desc.Budget ? Desc.Budget : Event.Budget;
+
+                if (Generation > Desc.NumSyncPointsInFlight)
+                {
+                    CompletedGeneration = RESIDENCY_MAX(CompletedGeneration, Generation - Desc.NumSyncPointsInFlight);
+                }
+                const UINT64 FirstUncompletedSyncPoint = (CompletedGeneration < Generation) ? CompletedGeneration : UINT64(-1);
+
+                // Mark the objects used by this execution to be made resident
+                Internal::GrowScratchSpace(pMakeResidentList, MakeResidentListSize, UINT32(Event.ObjectIndices.size()));
+                UINT32 NumObjectsToMakeResident = 0;
+                UINT64 SizeToMakeResident = 0;
+                for (UINT32 ObjectIndex : Event.ObjectIndices)
+                {
+                    ManagedObject* pObject = &Objects[ObjectIndex];
+
+                    // The master set only holds each object once
+                    if (pObject->NumExecutionsReferenced > 0 && pObject->LastGPUSyncPoint == Generation)
+                    {
+                        continue;
+                    }
+
+                    if (pObject->ResidencyStatus == ManagedObject::RESIDENCY_STATUS::EVICTED)
+                    {
+                        pMakeResidentList[NumObjectsToMakeResident++] = pObject;
+                        LRU.MakeResident(pObject);
+
+                        SizeToMakeResident += pObject->Size;
+                    }
+
+                    pObject->LastGPUSyncPoint = Generation;
+                    pObject->LastUsedTimestamp = Event.TimeStamp;
+                    LRU.ObjectReferenced(pObject);
+                }
+
+                const UINT64 EvictionGracePeriod = Internal::GetEvictionGracePeriod(Device.Usage, Budget, Desc.TrimPercentageMemoryUsageThreshold,
+                                                                                    MinEvictionGracePeriodTicks, MaxEvictionGracePeriodTicks);
+                // At most every resident object can be evicted at once
+                Internal::GrowScratchSpace(pEvictionList, EvictionListSize, LRU.NumResidentObjects);
+
+                NumObjectsToEvict = 0;
+                LRU.TrimAgedAllocations(FirstUncompletedSyncPoint, pEvictionList, NumObjectsToEvict, Event.TimeStamp, EvictionGracePeriod);
+                Device.Evict(NumObjectsToEvict, pEvictionList);
+
+                UINT32 MakeResidentIndex = 0;
+                while (MakeResidentIndex < NumObjectsToMakeResident)
+                {
+                    // Make resident as many objects as fit in the budget
+                    const INT64 AvailableSpace = INT64(Budget) - INT64(Device.Usage);
+                    UINT64 BatchSize = 0;
+                    UINT32 BatchStart = MakeResidentIndex;
+                    while (AvailableSpace > 0 && MakeResidentIndex < NumObjectsToMakeResident &&
+                           BatchSize + pMakeResidentList[MakeResidentIndex]->Size <= UINT64(AvailableSpace))
+                    {
+                        BatchSize += pMakeResidentList[MakeResidentIndex++]->Size;
+                    }
+                    Device.MakeResident(MakeResidentIndex - BatchStart, &pMakeResidentList[BatchStart]);
+                    SizeToMakeResident -= BatchSize;
+
+                    if (MakeResidentIndex == NumObjectsToMakeResident)
+                    {
+                        break;
+                    }
+
+                    // If there is nothing to trim OR the only objects 'Resident' are the ones about to be used by this execute.
+                    if (LRU.HasObjectsUsedBefore(Generation) == false || CompletedGeneration >= Generation)
+                    {
+                        Device.MakeResident(NumObjectsToMakeResident - MakeResidentIndex, &pMakeResidentList[MakeResidentIndex]);
+                        Results.NumOverBudgetExecutions++;
+                        break;
+                    }
+
+                    // Wait until the GPU is done with the oldest sync point, then trim what it used
+                    const UINT64 GenerationToWaitFor = CompletedGeneration;
+                    CompletedGeneration = GenerationToWaitFor + 1;
+                    Results.NumStallSyncPoints++;
+
+                    NumObjectsToEvict = 0;
+                    LRU.TrimToSyncPointInclusive(INT64(Device.Usage + SizeToMakeResident), INT64(Budget), pEvictionList, NumObjectsToEvict, GenerationToWaitFor);
+                    Device.Evict(NumObjectsToEvict, pEvictionList);
+                }
+
+                Generation++;
+            }
+
+            delete[](pMakeResidentList);
+            delete[](pEvictionList);
+        }
+
+        inline const char* GetPolicyName(EVICTION_POLICY Policy)
+        {
+            switch (Policy)
+            {
+            case EVICTION_POLICY::LRU: return "LRU";
+            case EVICTION_POLICY::SIZE_WEIGHTED_LRU: return "SIZE_WEIGHTED_LRU";
+            case EVICTION_POLICY::TWO_QUEUE: return "TWO_QUEUE";
+            case EVICTION_POLICY::PRIORITY: return "PRIORITY";
+            default: return "UNKNOWN";
+            }
+        }
+    }
+}
@@ -61,10 +61,8 @@ BuddyAllocator::BuddyAllocator(kBuddyAllocationStrategy allocationStrategy, D3D1
     , m_maxBlockSize(maxBlockSize)
     , m_minBlockSize(MinBlockSize)
     , m_pBackingHeap(nullptr)
-#if defined(PROFILE) || defined(_DEBUG)
-    , m_SpaceUsed(0)
-    , m_InternalFragmentation(0)
-#endif
+    , m_spaceUsed(0)
+    , m_internalFragmentation(0)
 {
     ASSERT(Math::IsDivisible(maxBlockSize, m_minBlockSize));
     ASSERT(Math::IsPowerOfTwo(maxBlockSize / m_minBlockSize));
@@ -74,6 +72,16 @@ BuddyAllocator::BuddyAllocator(kBuddyAllocationStrategy allocationStrategy, D3D1
     Reset();
 }
 
+void BuddyAllocator::Reset()
+{
+    lock_guard<mutex> LockGuard(m_mutex);
+
+    m_freeBlocks.Reset(m_maxOrder);
+
+    m_spaceUsed = 0;
+    m_internalFragmentation = 0;
+}
+
 void BuddyAllocator::Initialize()
 {
     if (m_allocationStrategy == kBuddyAllocationStrategy::kPlacedResourceStrategy)
@@ -106,65 +114,6 @@ void BuddyAllocator::Destroy()
     }
 }
 
-size_t BuddyAllocator::AllocateBlock(UINT order)
-{
-    size_t offset;
-
-    if (order > m_maxOrder)
-    {
-        throw(std::bad_alloc()); // Can't allocate a block that large  
-    }
-
-    auto it = m_freeBlocks[order].begin();
-
-    if (it == m_freeBlocks[order].end())
-    {
-        // No free nodes in the requested pool.  Try to find a higher-order block and split it.  
-        size_t left = AllocateBlock(order + 1);
-
-        size_t size = OrderToUnitSize(order);
-
-        size_t right = left + size;
-
-        m_freeBlocks[order].insert(right); // Add the right block to the free pool  
-
-        offset = left; // Return the left block  
-    }
-
-    else
-    {
-        offset = *it;
-
-        // Remove the block from the free list  
-        m_freeBlocks[order].erase(it);
-    }
-
-    return offset;
-}
-
-void BuddyAllocator::DeallocateBlock(size_t offset, UINT order)
-{
-    // See if the buddy block is free  
-    size_t size = OrderToUnitSize(order);
-
-    size_t buddy = GetBuddyOffset(offset, size);
-
-    auto it = m_freeBlocks[order].find(buddy);
-
-    if (it != m_freeBlocks[order].end())
-    {
-        // Deallocate merged blocks  
-        DeallocateBlock(min(offset, buddy), order + 1);
-        // Remove the buddy from the free list  
-        m_freeBlocks[order].erase(it);
-    }
-    else
-    {
-        // Add the block to the free list  
-        m_freeBlocks[order].insert(offset); // throw(std::bad_alloc) 
-    }
-}
-
 BuddyBlock* BuddyAllocator::Allocate(uint32_t numElements, uint32_t elementSize, const void* initialData)
 {
     size_t size = numElements * elementSize;
@@ -173,14 +122,17 @@ BuddyBlock* BuddyAllocator::Allocate(uint32_t numElements, uint32_t elementSize,
 
     try
     {
-        size_t offset = AllocateBlock(order);
         uint32_t paddedSize = uint32_t(OrderToUnitSize(order) * m_minBlockSize);
+        size_t offset;
+        {
+            lock_guard<mutex> LockGuard(m_mutex);
+            offset = m_freeBlocks.AllocateBlock(order);
+            m_spaceUsed += paddedSize;
+            m_internalFragmentation += paddedSize - size;
+        }
 
         uint32_t blockOffset = uint32_t(m_baseOffset + (offset * m_minBlockSize));
 
-        INCREASE_BUDDY_COUNTER(m_SpaceUsed, paddedSize);
-        INCREASE_BUDDY_COUNTER(m_InternalFragmentation, (paddedSize - size));
-
         BuddyBlock* pBlock = new BuddyBlock(blockOffset, //offset
             paddedSize, //total size (padded to fit a block)
             numElements * elementSize);
@@ -191,9 +143,7 @@ BuddyBlock* BuddyAllocator::Allocate(uint32_t numElements, uint32_t elementSize,
         }
         else
         {
-            //TODO: To be truely thread-safe this operation should be atomic to guard against
-            //      the case in which blocks from this allocator are used on multiple threads 
-            //      (because it's really only 1 resource underneath)
+            lock_guard<mutex> LockGuard(m_backingResourceMutex);
             pBlock->InitFromResource(&m_BackingResource, numElements, elementSize, initialData);
         }
 
@@ -226,30 +176,43 @@ void BuddyAllocator::DeallocateInternal(BuddyBlock* pBlock)
 
     UINT order = UnitSizeToOrder(size);
 
-    try
     {
-        DeallocateBlock(offset, order); // throw(std::bad_alloc)
-
-        DECREASE_BUDDY_COUNTER(m_SpaceUsed, size);
-        DECREASE_BUDDY_COUNTER(m_InternalFragmentation, (size - pBlock->m_unpaddedSize));
-        
-        if (m_allocationStrategy == kBuddyAllocationStrategy::kPlacedResourceStrategy)
-        {
-            // Release the resource
-            pBlock->Destroy();
-        }
-        delete(pBlock);
+        lock_guard<mutex> LockGuard(m_mutex);
+        m_freeBlocks.DeallocateBlock(offset, order);
+        m_spaceUsed -= pBlock->GetSize();
+        m_internalFragmentation -= pBlock->GetSize() - pBlock->m_unpaddedSize;
     }
 
-    catch (std::bad_alloc&)
+    if (m_allocationStrategy == kBuddyAllocationStrategy::kPlacedResourceStrategy)
     {
-        // Deallocate failed trying to add the free block to the pool  
-        // resulting in a leak.  Unfortunately there is not much we can do.  
-        // Fortunately this is expected to be extremely rare as the storage  
-        // needed for each deallocate is very small.  
+        // Release the resource
+        pBlock->Destroy();
     }
+    delete(pBlock);
 };
 
+void BuddyAllocator::GetStats(BuddyAllocatorStats& stats)
+{
+    lock_guard<mutex> LockGuard(m_mutex);
+
+    stats.m_totalSize = m_maxBlockSize;
+    stats.m_usedSize = m_spaceUsed;
+    stats.m_internalFragmentation = m_internalFragmentation;
+    stats.m_freeSize = 0;
+    stats.m_largestFreeBlock = 0;
+    stats.m_numFreeBlocks = 0;
+
+    for (UINT order = 0; order <= m_maxOrder; ++order)
+    {
+        const size_t blockSize = OrderToUnitSize(order) * m_minBlockSize;
+        const size_t numFreeBlocks = m_freeBlocks.GetNumFreeBlocks(order);
+        stats.m_freeSize += numFreeBlocks * blockSize;
+        stats.m_numFreeBlocks += numFreeBlocks;
+        if (numFreeBlocks > 0)
+            stats.m_largestFreeBlock = blockSize;
+    }
+}
+
 /*
 void BuddyAllocator::CleanUpAllocations()
 {
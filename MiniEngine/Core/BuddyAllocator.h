@@ -16,27 +16,22 @@
 // When a block is de-allocated an attempt is made to merge it with it's 
 // neighbour (buddy) if it is contiguous and free.
 // Based on reference implementation by Bill Kristiansen
+//
+// Free blocks are tracked by BuddyBlockAllocator, which keeps one bitmap per order.  It is guarded by a
+// mutex that is never held while creating resources.
 //  
 
 #pragma once
 
 #include "GpuBuffer.h"
+#include "BuddyBlockAllocator.h"
 #include <vector>
 #include <queue>
 #include <mutex>
-#include <set>
 
 // Unfortunately the api restricts the minimum size of a placed buffer resource to 64k
 #define MIN_PLACED_BUFFER_SIZE (64 * 1024)
 
-#if defined(PROFILE) || defined(_DEBUG)
-#define INCREASE_BUDDY_COUNTER(A, B) (A = A + B);
-#define DECREASE_BUDDY_COUNTER(A, B) (A = A - B);
-#else
-#define INCREASE_BUDDY_COUNTER(A, B)
-#define DECREASE_BUDDY_COUNTER(A, B)
-#endif
-
 enum kBuddyAllocationStrategy
 {
     // This strategy uses Placed Resources to sub-allocate a buffer out of an underlying ID3D12Heap.
@@ -75,6 +70,22 @@ struct BuddyBlock
     void Destroy();
 };
 
+struct BuddyAllocatorStats
+{
+    size_t m_totalSize;
+    size_t m_usedSize;              // Including the padding of each block to a power of two
+    size_t m_internalFragmentation; // The padding alone
+    size_t m_freeSize;
+    size_t m_largestFreeBlock;
+    size_t m_numFreeBlocks;
+
+    // How much of the free space can't be allocated in one block, from 0 to 1
+    float GetExternalFragmentation() const
+    {
+        return m_freeSize == 0 ? 0.0f : 1.0f - (float)m_largestFreeBlock / (float)m_freeSize;
+    }
+};
+
 class BuddyAllocator
 {
 public:
@@ -94,18 +105,12 @@ public:
         return block.GetOffset() >= m_baseOffset && block.GetSize() <= m_maxBlockSize;
     }
 
-    inline void Reset()
-    {
-        // Clear the free blocks collection  
-        m_freeBlocks.clear();
-
-        // Initialize the pool with a free inner block of max inner block size  
-        m_freeBlocks.resize(m_maxOrder + 1);
-        m_freeBlocks[m_maxOrder].insert((size_t)0);
-    }
+    void Reset();
 
     void CleanUpAllocations();
 
+    void GetStats(BuddyAllocatorStats& stats);
+
 private:
     ID3D12Heap* m_pBackingHeap;
     ByteAddressBuffer m_BackingResource;
@@ -113,7 +118,10 @@ private:
     const D3D12_HEAP_TYPE m_heapType;
 
     std::queue<BuddyBlock*> m_deferredDeletionQueue;
-    std::vector<std::set<size_t>> m_freeBlocks;
+
+    // Guards the free blocks and statistics
+    std::mutex m_mutex;
+    BuddyBlockAllocator m_freeBlocks;
     UINT m_maxOrder;
     const size_t m_baseOffset;
     const size_t m_maxBlockSize;
@@ -139,11 +147,11 @@ private:
     void DeallocateInternal(BuddyBlock* pBlock);
 
     size_t OrderToUnitSize(UINT order) const { return ((size_t)1) << order; }
-    size_t AllocateBlock(UINT order);
-    void DeallocateBlock(size_t offset, UINT order);
 
-#if defined(PROFILE) || defined(_DEBUG)
-    size_t m_SpaceUsed;
-    size_t m_InternalFragmentation;
-#endif
+    size_t m_spaceUsed;
+    size_t m_internalFragmentation;
+
+    // The backing resource of kManualSubAllocationStrategy has a single state, so blocks are initialized
+    // one at a time
+    std::mutex m_backingResourceMutex;
 };
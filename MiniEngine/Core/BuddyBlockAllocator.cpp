@@ -0,0 +1,152 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+// Developed by Minigraph
+//
+// Author(s):  Jack Elliott
+//
+
+#include "pch.h"
+#include "BuddyBlockAllocator.h"
+#include <new>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// The bits must not all be zero
+static inline uint32_t FindLowestSetBit(uint64_t bits)
+{
+#ifdef _MSC_VER
+    unsigned long bit;
+    _BitScanForward64(&bit, bits);
+    return bit;
+#else
+    return (uint32_t)__builtin_ctzll(bits);
+#endif
+}
+
+void BuddyBitmap::Reset(size_t numBits)
+{
+    m_levels.clear();
+    do
+    {
+        size_t numWords = (numBits + 63) / 64;
+        m_levels.emplace_back(numWords, 0);
+        numBits = numWords;
+    }
+    while (numBits > 1);
+}
+
+void BuddyBitmap::Set(size_t index)
+{
+    for (auto& level : m_levels)
+    {
+        uint64_t& word = level[index >> 6];
+        const bool wasEmpty = word == 0;
+        word |= 1ull << (index & 63);
+
+        // The levels above already know about this word
+        if (!wasEmpty)
+            return;
+
+        index >>= 6;
+    }
+}
+
+void BuddyBitmap::Clear(size_t index)
+{
+    for (auto& level : m_levels)
+    {
+        uint64_t& word = level[index >> 6];
+        word &= ~(1ull << (index & 63));
+
+        // The levels above only need to know once the word is empty
+        if (word != 0)
+            return;
+
+        index >>= 6;
+    }
+}
+
+size_t BuddyBitmap::FindFirstSet() const
+{
+    ASSERT(!IsEmpty());
+
+    // The top level is a single word
+    size_t index = 0;
+    for (size_t level = m_levels.size(); level-- > 0; )
+        index = (index << 6) | FindLowestSetBit(m_levels[level][index]);
+    return index;
+}
+
+void BuddyBlockAllocator::Reset(uint32_t maxOrder)
+{
+    m_maxOrder = maxOrder;
+
+    // Order N has one bit for each block of 2^N units
+    m_freeBlocks.resize(m_maxOrder + 1);
+    for (uint32_t order = 0; order <= m_maxOrder; ++order)
+        m_freeBlocks[order].Reset(((size_t)1) << (m_maxOrder - order));
+    m_numFreeBlocks.assign(m_maxOrder + 1, 0);
+
+    // Initialize the pool with a free inner block of max inner block size
+    m_freeBlocks[m_maxOrder].Set(0);
+    m_numFreeBlocks[m_maxOrder] = 1;
+}
+
+size_t BuddyBlockAllocator::AllocateBlock(uint32_t order)
+{
+    if (order > m_maxOrder)
+    {
+        throw(std::bad_alloc()); // Can't allocate a block that large
+    }
+
+    // Find the smallest free block that is large enough.  Taking the lowest offset of that order matches
+    // what splitting higher-order blocks on demand would do.
+    uint32_t freeOrder = order;
+    while (m_freeBlocks[freeOrder].IsEmpty())
+    {
+        if (++freeOrder > m_maxOrder)
+        {
+            throw(std::bad_alloc()); // No free block is large enough
+        }
+    }
+
+    size_t index = m_freeBlocks[freeOrder].FindFirstSet();
+    m_freeBlocks[freeOrder].Clear(index);
+    --m_numFreeBlocks[freeOrder];
+
+    // Split it down to the requested order, adding the right halves to the free pool
+    while (freeOrder > order)
+    {
+        --freeOrder;
+        index <<= 1;
+        m_freeBlocks[freeOrder].Set(index + 1);
+        ++m_numFreeBlocks[freeOrder];
+    }
+
+    return index << order;
+}
+
+void BuddyBlockAllocator::DeallocateBlock(size_t offset, uint32_t order)
+{
+    size_t index = offset >> order;
+
+    // Merge with the buddy block for as long as it is free
+    while (order < m_maxOrder && m_freeBlocks[order].Test(index ^ 1))
+    {
+        m_freeBlocks[order].Clear(index ^ 1);
+        --m_numFreeBlocks[order];
+        index >>= 1;
+        ++order;
+    }
+
+    m_freeBlocks[order].Set(index);
+    ++m_numFreeBlocks[order];
+}
@@ -0,0 +1,71 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+// Tracks the free blocks of a buddy allocator, in units of its smallest block.  Free blocks are kept in one
+// bitmap per order, so finding, splitting and merging blocks only takes a few bit scans.  Nothing here
+// touches the device or takes a lock, so BuddyAllocator guards it and tools can use it on its own.
+//
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+// A set of bits with summary levels above it, where each bit tells whether a word of the level below has any
+// bits set.  Finding the first set bit takes one bit scan per level.
+class BuddyBitmap
+{
+public:
+
+    void Reset(size_t numBits);
+
+    void Set(size_t index);
+    void Clear(size_t index);
+
+    bool Test(size_t index) const
+    {
+        return (m_levels[0][index >> 6] & (1ull << (index & 63))) != 0;
+    }
+
+    bool IsEmpty() const
+    {
+        return m_levels.back()[0] == 0;
+    }
+
+    // The bitmap must not be empty
+    size_t FindFirstSet() const;
+
+private:
+    std::vector<std::vector<uint64_t>> m_levels;
+};
+
+class BuddyBlockAllocator
+{
+public:
+
+    BuddyBlockAllocator() : m_maxOrder(0) {}
+
+    // Frees everything, leaving one block of 2^maxOrder units
+    void Reset(uint32_t maxOrder);
+
+    // Returns the offset of a free block of 2^order units, or throws std::bad_alloc.  The lowest offset of the
+    // smallest free order that fits is taken.
+    size_t AllocateBlock(uint32_t order);
+
+    // Frees a block and merges it with its buddy for as long as the buddy is free
+    void DeallocateBlock(size_t offset, uint32_t order);
+
+    uint32_t GetMaxOrder() const { return m_maxOrder; }
+    size_t GetNumFreeBlocks(uint32_t order) const { return m_numFreeBlocks[order]; }
+
+private:
+    std::vector<BuddyBitmap> m_freeBlocks;
+    std::vector<size_t> m_numFreeBlocks;
+    uint32_t m_maxOrder;
+};
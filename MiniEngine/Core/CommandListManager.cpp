@@ -138,15 +138,23 @@ uint64_t CommandQueue::IncrementFence(void)
     return m_NextFenceValue++;
 }
 
+void CommandQueue::UpdateLastCompletedFence(uint64_t CompletedValue)
+{
+    // Another thread may have seen a later value in the meantime, so never let it regress
+    uint64_t LastCompleted = m_LastCompletedFenceValue.load(std::memory_order_relaxed);
+    while (LastCompleted < CompletedValue &&
+        !m_LastCompletedFenceValue.compare_exchange_weak(LastCompleted, CompletedValue, std::memory_order_relaxed))
+    {
+    }
+}
+
 bool CommandQueue::IsFenceComplete(uint64_t FenceValue)
 {
     // Avoid querying the fence value by testing against the last one seen.
-    // The max() is to protect against an unlikely race condition that could cause the last
-    // completed fence value to regress.
-    if (FenceValue > m_LastCompletedFenceValue)
-        m_LastCompletedFenceValue = std::max(m_LastCompletedFenceValue, m_pFence->GetCompletedValue());
+    if (FenceValue > m_LastCompletedFenceValue.load(std::memory_order_relaxed))
+        UpdateLastCompletedFence(m_pFence->GetCompletedValue());
 
-    return FenceValue <= m_LastCompletedFenceValue;
+    return FenceValue <= m_LastCompletedFenceValue.load(std::memory_order_relaxed);
 }
 
 namespace Graphics
@@ -180,7 +188,7 @@ void CommandQueue::WaitForFence(uint64_t FenceValue)
 
         m_pFence->SetEventOnCompletion(FenceValue, m_FenceEventHandle);
         WaitForSingleObject(m_FenceEventHandle, INFINITE);
-        m_LastCompletedFenceValue = FenceValue;
+        UpdateLastCompletedFence(FenceValue);
     }
 }
 
@@ -16,6 +16,7 @@
 #include <vector>
 #include <queue>
 #include <mutex>
+#include <atomic>
 #include <stdint.h>
 #include "CommandAllocatorPool.h"
 
@@ -53,6 +54,9 @@ private:
     ID3D12CommandAllocator* RequestAllocator(void);
     void DiscardAllocator(uint64_t FenceValueForReset, ID3D12CommandAllocator* Allocator);
 
+    // Raises m_LastCompletedFenceValue, which any thread may be reading or raising at the same time
+    void UpdateLastCompletedFence(uint64_t CompletedValue);
+
     ID3D12CommandQueue* m_CommandQueue;
 
     const D3D12_COMMAND_LIST_TYPE m_Type;
@@ -64,7 +68,7 @@ private:
     // Lifetime of these objects is managed by the descriptor cache
     ID3D12Fence* m_pFence;
     uint64_t m_NextFenceValue;
-    uint64_t m_LastCompletedFenceValue;
+    std::atomic<uint64_t> m_LastCompletedFenceValue;
     HANDLE m_FenceEventHandle;
 
 };
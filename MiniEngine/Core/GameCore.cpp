@@ -19,6 +19,7 @@
 #include "BufferManager.h"
 #include "CommandContext.h"
 #include "PostEffects.h"
+#include "JobSystem.h"
 
 #if WINAPI_FAMILY_PARTITION(WINAPI_PARTITION_DESKTOP)
     #pragma comment(lib, "runtimeobject.lib")
@@ -47,6 +48,7 @@ namespace GameCore
     {
         Graphics::Initialize();
         SystemTime::Initialize();
+        JobSystem::Initialize();
         GameInput::Initialize();
         EngineTuning::Initialize();
 
@@ -58,6 +60,7 @@ namespace GameCore
         game.Cleanup();
 
         GameInput::Shutdown();
+        JobSystem::Shutdown();
     }
 
     bool UpdateApplication( IGameApp& game )
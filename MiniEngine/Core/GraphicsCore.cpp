@@ -422,6 +422,12 @@ void Graphics::Initialize(void)
 
             // RESOURCE_BARRIER_DUPLICATE_SUBRESOURCE_TRANSITIONS
             (D3D12_MESSAGE_ID)1008,
+
+            // Pipeline cache blobs from another driver or adapter, or made from a different description, are
+            // rejected and then recompiled
+            D3D12_MESSAGE_ID_CREATEPIPELINESTATE_CACHEDBLOBADAPTERMISMATCH,
+            D3D12_MESSAGE_ID_CREATEPIPELINESTATE_CACHEDBLOBDRIVERVERSIONMISMATCH,
+            D3D12_MESSAGE_ID_CREATEPIPELINESTATE_CACHEDBLOBDESCMISMATCH,
         };
 
         D3D12_INFO_QUEUE_FILTER NewFilter = {};
@@ -516,6 +522,8 @@ void Graphics::Initialize(void)
         g_DisplayPlane[i].CreateFromSwapChain(L"Primary SwapChain Buffer", DisplayPlane.Detach());
     }
 
+    PSO::LoadPipelineCache(L"PipelineCache.bin");
+
     // Common state was moved to GraphicsCommon.*
     InitializeCommonState();
 
@@ -615,6 +623,7 @@ void Graphics::Shutdown( void )
     g_CommandManager.Shutdown();
     GpuTimeManager::Shutdown();
     s_SwapChain1->Release();
+    PSO::SavePipelineCache(L"PipelineCache.bin");
     PSO::DestroyAll();
     RootSignature::DestroyAll();
     DescriptorAllocator::DestroyAll();
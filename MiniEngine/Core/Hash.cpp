@@ -0,0 +1,298 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+
+#include "pch.h"
+#include "Hash.h"
+#include <string.h>
+
+// CRC32C here is the raw register that the CRC32 instructions update, without the usual inversions, which
+// is what HashRange has always returned on x64.  Every implementation only reads bytes in order, so each
+// one's output matches the others'.
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+    #define HASH_CRC32C_X86 1
+    #ifdef _MSC_VER
+        #include <intrin.h>
+        #define HASH_TARGET_CRC32C
+    #else
+        #include <cpuid.h>
+        #include <nmmintrin.h>
+        #define HASH_TARGET_CRC32C __attribute__((target("sse4.2")))
+    #endif
+    #if defined(_M_X64) || defined(__x86_64__)
+        // The 64-bit instruction keeps the CRC in a 64-bit register.  Carrying it that way saves a zero extension
+        // between one instruction and the next.
+        typedef uint64_t Crc32CRegister;
+        #define HASH_CRC32C_U64(Crc, Data) _mm_crc32_u64(Crc, Data)
+    #else
+        typedef uint32_t Crc32CRegister;
+        #define HASH_CRC32C_U64(Crc, Data) _mm_crc32_u32(_mm_crc32_u32(Crc, (uint32_t)(Data)), (uint32_t)((Data) >> 32))
+    #endif
+    #define HASH_CRC32C_U8(Crc, Data) _mm_crc32_u8((uint32_t)(Crc), Data)
+#elif defined(_M_ARM64) || defined(__aarch64__)
+    #define HASH_CRC32C_ARM 1
+    #ifdef _MSC_VER
+        #include <arm64intr.h>
+        #define HASH_TARGET_CRC32C
+    #else
+        #include <arm_acle.h>
+        #define HASH_TARGET_CRC32C __attribute__((target("+crc")))
+        #ifdef __linux__
+            #include <sys/auxv.h>
+            #include <asm/hwcap.h>
+        #endif
+    #endif
+    typedef uint32_t Crc32CRegister;
+    #define HASH_CRC32C_U64(Crc, Data) __crc32cd(Crc, Data)
+    #define HASH_CRC32C_U8(Crc, Data) __crc32cb(Crc, Data)
+#endif
+
+namespace
+{
+    typedef uint32_t (*Crc32CFunc)( uint32_t Crc, const uint8_t* Data, size_t Size );
+
+    const uint32_t kCrc32CPolynomial = 0x82F63B78;    // Castagnoli, bit-reflected
+
+    // The hardware path hashes blocks of three lanes at once, because each CRC32 instruction has to wait for
+    // the previous one's result but three independent ones can be in flight.
+    const size_t kLaneSize = Utility::kHashLaneSize;
+
+    // s_Crc32CTable[k][b] is the CRC of byte b followed by k zero bytes, for slicing by 8
+    uint32_t s_Crc32CTable[8][256];
+
+    // s_LaneShiftTable[k][b] is the CRC of byte b placed k bytes into a word, followed by kLaneSize zero bytes
+    uint32_t s_LaneShiftTable[4][256];
+
+    void InitializeCrc32CTables( void )
+    {
+        for (uint32_t b = 0; b < 256; ++b)
+        {
+            uint32_t Crc = b;
+            for (int Bit = 0; Bit < 8; ++Bit)
+                Crc = (Crc & 1) ? (Crc >> 1) ^ kCrc32CPolynomial : Crc >> 1;
+            s_Crc32CTable[0][b] = Crc;
+        }
+
+        for (uint32_t k = 1; k < 8; ++k)
+        {
+            for (uint32_t b = 0; b < 256; ++b)
+            {
+                const uint32_t Prev = s_Crc32CTable[k - 1][b];
+                s_Crc32CTable[k][b] = (Prev >> 8) ^ s_Crc32CTable[0][Prev & 0xFF];
+            }
+        }
+
+        for (uint32_t k = 0; k < 4; ++k)
+        {
+            for (uint32_t b = 0; b < 256; ++b)
+            {
+                uint32_t Crc = b << (k * 8);
+                for (size_t i = 0; i < kLaneSize; ++i)
+                    Crc = (Crc >> 8) ^ s_Crc32CTable[0][Crc & 0xFF];
+                s_LaneShiftTable[k][b] = Crc;
+            }
+        }
+    }
+
+    // Advances a CRC over kLaneSize zero bytes.  The CRC is linear, so the CRC of two lanes is the first lane's
+    // CRC shifted this way, XORed with the second lane's CRC started from zero.
+    inline uint32_t ShiftLane( uint32_t Crc )
+    {
+        return s_LaneShiftTable[0][Crc & 0xFF] ^ s_LaneShiftTable[1][(Crc >> 8) & 0xFF] ^
+            s_LaneShiftTable[2][(Crc >> 16) & 0xFF] ^ s_LaneShiftTable[3][Crc >> 24];
+    }
+
+    // Reads are little-endian, as on every CPU that runs Direct3D
+    uint32_t Crc32CSoftware( uint32_t Crc, const uint8_t* Data, size_t Size )
+    {
+        while (Size >= 8)
+        {
+            uint64_t Word;
+            memcpy(&Word, Data, 8);
+            Word ^= Crc;
+
+            Crc = s_Crc32CTable[7][Word & 0xFF] ^ s_Crc32CTable[6][(Word >> 8) & 0xFF] ^
+                s_Crc32CTable[5][(Word >> 16) & 0xFF] ^ s_Crc32CTable[4][(Word >> 24) & 0xFF] ^
+                s_Crc32CTable[3][(Word >> 32) & 0xFF] ^ s_Crc32CTable[2][(Word >> 40) & 0xFF] ^
+                s_Crc32CTable[1][(Word >> 48) & 0xFF] ^ s_Crc32CTable[0][Word >> 56];
+
+            Data += 8;
+            Size -= 8;
+        }
+
+        while (Size-- > 0)
+            Crc = (Crc >> 8) ^ s_Crc32CTable[0][(Crc ^ *Data++) & 0xFF];
+
+        return Crc;
+    }
+
+#ifdef HASH_CRC32C_U64
+    HASH_TARGET_CRC32C uint32_t Crc32CHardware( uint32_t InitialCrc, const uint8_t* Data, size_t Size )
+    {
+        Crc32CRegister Crc = InitialCrc;
+
+        // Unaligned 8-byte loads cost the same as aligned ones on these CPUs, so the data is read wherever it starts
+        while (Size >= 3 * kLaneSize)
+        {
+            Crc32CRegister Crc0 = Crc;
+            Crc32CRegister Crc1 = 0;
+            Crc32CRegister Crc2 = 0;
+
+            for (size_t i = 0; i < kLaneSize; i += 8)
+            {
+                uint64_t Word0, Word1, Word2;
+                memcpy(&Word0, Data + i, 8);
+                memcpy(&Word1, Data + i + kLaneSize, 8);
+                memcpy(&Word2, Data + i + 2 * kLaneSize, 8);
+                Crc0 = HASH_CRC32C_U64(Crc0, Word0);
+                Crc1 = HASH_CRC32C_U64(Crc1, Word1);
+                Crc2 = HASH_CRC32C_U64(Crc2, Word2);
+            }
+
+            Crc = ShiftLane(ShiftLane((uint32_t)Crc0) ^ (uint32_t)Crc1) ^ (uint32_t)Crc2;
+
+            Data += 3 * kLaneSize;
+            Size -= 3 * kLaneSize;
+        }
+
+        while (Size >= 8)
+        {
+            uint64_t Word;
+            memcpy(&Word, Data, 8);
+            Crc = HASH_CRC32C_U64(Crc, Word);
+            Data += 8;
+            Size -= 8;
+        }
+
+        while (Size-- > 0)
+            Crc = HASH_CRC32C_U8(Crc, *Data++);
+
+        return (uint32_t)Crc;
+    }
+#endif
+
+    bool HasCrc32CInstructions( void )
+    {
+#if HASH_CRC32C_X86
+    #ifdef _MSC_VER
+        int CpuInfo[4];
+        __cpuid(CpuInfo, 1);
+        return (CpuInfo[2] & (1 << 20)) != 0;
+    #else
+        unsigned int Eax, Ebx, Ecx, Edx;
+        return __get_cpuid(1, &Eax, &Ebx, &Ecx, &Edx) && (Ecx & bit_SSE4_2) != 0;
+    #endif
+#elif HASH_CRC32C_ARM
+    #if defined(_WIN32)
+        return IsProcessorFeaturePresent(PF_ARM_V8_CRC32_INSTRUCTIONS_AVAILABLE) != FALSE;
+    #elif defined(__linux__)
+        return (getauxval(AT_HWCAP) & HWCAP_CRC32) != 0;
+    #elif defined(__APPLE__)
+        return true;
+    #else
+        return false;
+    #endif
+#else
+        return false;
+#endif
+    }
+
+    Crc32CFunc SelectCrc32C( void )
+    {
+        InitializeCrc32CTables();
+
+#ifdef HASH_CRC32C_U64
+        if (HasCrc32CInstructions())
+            return Crc32CHardware;
+#endif
+        return Crc32CSoftware;
+    }
+
+    inline uint64_t Rotate64( uint64_t Value, int Shift )
+    {
+        return (Value << Shift) | (Value >> (64 - Shift));
+    }
+
+    inline uint64_t Mix64( uint64_t Value )
+    {
+        Value ^= Value >> 33;
+        Value *= 0xFF51AFD7ED558CCDull;
+        Value ^= Value >> 33;
+        Value *= 0xC4CEB9FE1A85EC53ull;
+        Value ^= Value >> 33;
+        return Value;
+    }
+}
+
+const bool Utility::g_HasCrc32CInstructions = HasCrc32CInstructions();
+
+size_t Utility::DispatchHashRange(const uint32_t* const Begin, const uint32_t* const End, size_t Hash)
+{
+    static const Crc32CFunc s_Crc32C = SelectCrc32C();
+    return s_Crc32C((uint32_t)Hash, (const uint8_t*)Begin, (End - Begin) * sizeof(uint32_t));
+}
+
+Utility::Hash128 Utility::HashBytes128( const void* Data, size_t Size, uint64_t Seed )
+{
+    const uint64_t c1 = 0x87C37B91114253D5ull;
+    const uint64_t c2 = 0x4CF5AD432745937Full;
+
+    const uint8_t* Bytes = (const uint8_t*)Data;
+    const size_t NumBlocks = Size / 16;
+    uint64_t h1 = Seed;
+    uint64_t h2 = Seed;
+
+    for (size_t i = 0; i < NumBlocks; ++i)
+    {
+        uint64_t k1, k2;
+        memcpy(&k1, Bytes + i * 16, 8);
+        memcpy(&k2, Bytes + i * 16 + 8, 8);
+
+        k1 *= c1; k1 = Rotate64(k1, 31); k1 *= c2; h1 ^= k1;
+        h1 = Rotate64(h1, 27); h1 += h2; h1 = h1 * 5 + 0x52DCE729;
+
+        k2 *= c2; k2 = Rotate64(k2, 33); k2 *= c1; h2 ^= k2;
+        h2 = Rotate64(h2, 31); h2 += h1; h2 = h2 * 5 + 0x38495AB5;
+    }
+
+    // The last 0 to 15 bytes
+    const uint8_t* Tail = Bytes + NumBlocks * 16;
+    const size_t TailSize = Size & 15;
+    uint64_t k1 = 0;
+    uint64_t k2 = 0;
+
+    for (size_t i = TailSize; i > 8; --i)
+        k2 |= (uint64_t)Tail[i - 1] << ((i - 9) * 8);
+    for (size_t i = TailSize < 8 ? TailSize : 8; i > 0; --i)
+        k1 |= (uint64_t)Tail[i - 1] << ((i - 1) * 8);
+
+    if (TailSize > 8)
+    {
+        k2 *= c2; k2 = Rotate64(k2, 33); k2 *= c1; h2 ^= k2;
+    }
+    if (TailSize > 0)
+    {
+        k1 *= c1; k1 = Rotate64(k1, 31); k1 *= c2; h1 ^= k1;
+    }
+
+    h1 ^= (uint64_t)Size;
+    h2 ^= (uint64_t)Size;
+
+    h1 += h2;
+    h2 += h1;
+
+    h1 = Mix64(h1);
+    h2 = Mix64(h2);
+
+    h1 += h2;
+    h2 += h1;
+
+    Hash128 Result = { h1, h2 };
+    return Result;
+}
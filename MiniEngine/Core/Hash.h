@@ -8,53 +8,81 @@
 //
 // Developed by Minigraph
 //
-// Author:  James Stanard 
+// Author:  James Stanard
 
 #pragma once
 
-#include "Math/Common.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
 
-// This requires SSE4.2 which is present on Intel Nehalem (Nov. 2008)
-// and AMD Bulldozer (Oct. 2011) processors.  I could put a runtime
-// check for this, but I'm just going to assume people playing with
-// DirectX 12 on Windows 10 have fairly recent machines.
-#ifdef _M_X64
-#define ENABLE_SSE_CRC32 1
+// Short ranges are hashed inline when the compiler can emit the CRC32 instructions without a target switch
+#if defined(_M_X64) || (defined(__x86_64__) && defined(__SSE4_2__))
+    #define HASH_INLINE_CRC32C 1
+    #include <nmmintrin.h>
+    #define HASH_INLINE_CRC32C_U64(Crc, Data) _mm_crc32_u64(Crc, Data)
+    #define HASH_INLINE_CRC32C_U32(Crc, Data) _mm_crc32_u32((uint32_t)(Crc), Data)
+#elif defined(_M_ARM64) || (defined(__aarch64__) && defined(__ARM_FEATURE_CRC32))
+    #define HASH_INLINE_CRC32C 1
+    #ifdef _MSC_VER
+        #include <intrin.h>
+    #else
+        #include <arm_acle.h>
+    #endif
+    #define HASH_INLINE_CRC32C_U64(Crc, Data) __crc32cd((uint32_t)(Crc), Data)
+    #define HASH_INLINE_CRC32C_U32(Crc, Data) __crc32cw((uint32_t)(Crc), Data)
 #else
-#define ENABLE_SSE_CRC32 0
-#endif
-
-#if ENABLE_SSE_CRC32
-#pragma intrinsic(_mm_crc32_u32)
-#pragma intrinsic(_mm_crc32_u64)
+    #define HASH_INLINE_CRC32C 0
 #endif
 
 namespace Utility
 {
+    // Ranges of at least three lanes are hashed a lane at a time in parallel
+    const size_t kHashLaneSize = 256;
+
+    // True once static initialization has found the CRC32 instructions.  Until then every range goes through
+    // DispatchHashRange, which is always correct.
+    extern const bool g_HasCrc32CInstructions;
+
+    // CRC32C of the words, continuing from Hash.  The first call picks the fastest implementation the CPU
+    // has: the SSE4.2 or ARMv8 CRC32 instructions, or a table-driven fallback.  They all return the same
+    // value, so hashes can be saved and compared across machines.
+    size_t DispatchHashRange(const uint32_t* const Begin, const uint32_t* const End, size_t Hash);
+
+    // Same value as DispatchHashRange.  Most state descriptions are shorter than three lanes, so those are
+    // hashed here in a single lane instead of through a call.  Words are loaded 8 bytes at a time wherever
+    // the range starts.
     inline size_t HashRange(const uint32_t* const Begin, const uint32_t* const End, size_t Hash)
     {
-#if ENABLE_SSE_CRC32
-        const uint64_t* Iter64 = (const uint64_t*)Math::AlignUp(Begin, 8);
-        const uint64_t* const End64 = (const uint64_t* const)Math::AlignDown(End, 8);
+#if HASH_INLINE_CRC32C
+        const size_t Size = (End - Begin) * sizeof(uint32_t);
+        if (Size < 3 * kHashLaneSize && g_HasCrc32CInstructions)
+        {
+            const uint8_t* Data = (const uint8_t*)Begin;
+            const uint8_t* const End64 = Data + (Size & ~(size_t)7);
 
-        // If not 64-bit aligned, start with a single u32
-        if ((uint32_t*)Iter64 > Begin)
-            Hash = _mm_crc32_u32((uint32_t)Hash, *Begin);
+            // Kept in 64 bits so that no zero extension sits between one CRC32 instruction and the next
+            uint64_t Crc = (uint32_t)Hash;
 
-        // Iterate over consecutive u64 values
-        while (Iter64 < End64)
-            Hash = _mm_crc32_u64((uint64_t)Hash, *Iter64++);
+            for (; Data < End64; Data += 8)
+            {
+                uint64_t Word;
+                memcpy(&Word, Data, 8);
+                Crc = HASH_INLINE_CRC32C_U64(Crc, Word);
+            }
 
-        // If there is a 32-bit remainder, accumulate that
-        if ((uint32_t*)Iter64 < End)
-            Hash = _mm_crc32_u32((uint32_t)Hash, *(uint32_t*)Iter64);
-#else
-        // An inexpensive hash for CPUs lacking SSE4.2
-        for (const uint32_t* Iter = Begin; Iter < End; ++Iter)
-            Hash = 16777619U * Hash ^ *Iter;
-#endif
+            // The range is whole words, so at most one is left
+            if (Size & 4)
+            {
+                uint32_t Word;
+                memcpy(&Word, Data, 4);
+                Crc = HASH_INLINE_CRC32C_U32(Crc, Word);
+            }
 
-        return Hash;
+            return (uint32_t)Crc;
+        }
+#endif
+        return DispatchHashRange(Begin, End, Hash);
     }
 
     template <typename T> inline size_t HashState( const T* StateDesc, size_t Count = 1, size_t Hash = 2166136261U )
@@ -63,4 +91,17 @@ namespace Utility
         return HashRange((uint32_t*)StateDesc, (uint32_t*)(StateDesc + Count), Hash);
     }
 
+    struct Hash128
+    {
+        uint64_t Low;
+        uint64_t High;
+
+        bool operator==( const Hash128& rhs ) const { return Low == rhs.Low && High == rhs.High; }
+        bool operator!=( const Hash128& rhs ) const { return !(*this == rhs); }
+    };
+
+    // MurmurHash3 (x64, 128-bit) of any bytes, for content addressing where 32 bits of CRC would collide.
+    // It returns the same value on every CPU.
+    Hash128 HashBytes128( const void* Data, size_t Size, uint64_t Seed = 0 );
+
 } // namespace Utility
@@ -0,0 +1,305 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+
+#include "pch.h"
+#include "JobSystem.h"
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <thread>
+
+namespace JobSystem
+{
+    struct Job
+    {
+        JobFunc Func;
+        Counter* pCounter;
+    };
+
+    // The owner pushes and pops at the back so it keeps working on what it just queued, while thieves take
+    // the oldest job from the front.
+    struct JobQueue
+    {
+        std::mutex Mutex;
+        std::deque<Job> Jobs;
+    };
+
+    std::vector<std::thread> s_Workers;
+    std::unique_ptr<JobQueue[]> s_Queues;
+    uint32_t s_NumQueues = 0;
+    WorkerHooks s_Hooks;
+
+    // Jobs sitting in a queue.  Workers only sleep while this is zero.
+    std::atomic<uint32_t> s_NumQueuedJobs(0);
+    std::atomic<uint32_t> s_NumSleepingWorkers(0);
+    std::mutex s_SleepMutex;
+    std::condition_variable s_WakeCondition;
+    bool s_Shutdown = false;
+
+    thread_local uint32_t s_ThreadIndex = 0;
+
+    void Schedule( Job&& NewJob )
+    {
+        ASSERT(s_Queues != nullptr, "JobSystem::Initialize() has not been called");
+
+        JobQueue& Queue = s_Queues[s_ThreadIndex];
+        {
+            std::lock_guard<std::mutex> LockGuard(Queue.Mutex);
+            Queue.Jobs.push_back(std::move(NewJob));
+        }
+
+        s_NumQueuedJobs.fetch_add(1);
+
+        // A worker that is about to sleep registers itself before checking s_NumQueuedJobs, so either it sees
+        // the job or we see it and take the lock, which it holds until it is waiting.
+        if (s_NumSleepingWorkers.load() > 0)
+        {
+            std::lock_guard<std::mutex> LockGuard(s_SleepMutex);
+            s_WakeCondition.notify_one();
+        }
+    }
+
+    bool TryPopJob( JobQueue& Queue, bool Steal, Job& OutJob )
+    {
+        std::unique_lock<std::mutex> Lock(Queue.Mutex, std::defer_lock);
+
+        // Thieves move on to the next queue rather than wait for a busy one
+        if (Steal)
+        {
+            if (!Lock.try_lock())
+                return false;
+        }
+        else
+        {
+            Lock.lock();
+        }
+
+        if (Queue.Jobs.empty())
+            return false;
+
+        if (Steal)
+        {
+            OutJob = std::move(Queue.Jobs.front());
+            Queue.Jobs.pop_front();
+        }
+        else
+        {
+            OutJob = std::move(Queue.Jobs.back());
+            Queue.Jobs.pop_back();
+        }
+
+        s_NumQueuedJobs.fetch_sub(1);
+        return true;
+    }
+
+    bool TryGetJob( Job& OutJob )
+    {
+        const uint32_t ThreadIndex = s_ThreadIndex;
+
+        if (TryPopJob(s_Queues[ThreadIndex], false, OutJob))
+            return true;
+
+        // Start with the next thread's queue so that thieves spread out
+        for (uint32_t i = 1; i < s_NumQueues; ++i)
+        {
+            if (TryPopJob(s_Queues[(ThreadIndex + i) % s_NumQueues], true, OutJob))
+                return true;
+        }
+
+        return false;
+    }
+
+    void Execute( Job& CurrentJob )
+    {
+        CurrentJob.Func();
+
+        if (CurrentJob.pCounter != nullptr)
+            Decrement(*CurrentJob.pCounter);
+    }
+
+    void WorkerMain( uint32_t ThreadIndex )
+    {
+        s_ThreadIndex = ThreadIndex;
+
+        if (s_Hooks.OnWorkerStart)
+            s_Hooks.OnWorkerStart(ThreadIndex);
+
+        Job CurrentJob;
+        for (;;)
+        {
+            if (TryGetJob(CurrentJob))
+            {
+                Execute(CurrentJob);
+                continue;
+            }
+
+            std::unique_lock<std::mutex> Lock(s_SleepMutex);
+            if (s_Shutdown && s_NumQueuedJobs.load() == 0)
+                break;
+
+            s_NumSleepingWorkers.fetch_add(1);
+            s_WakeCondition.wait(Lock, []() { return s_Shutdown || s_NumQueuedJobs.load() > 0; });
+            s_NumSleepingWorkers.fetch_sub(1);
+        }
+
+        if (s_Hooks.OnWorkerStop)
+            s_Hooks.OnWorkerStop(ThreadIndex);
+    }
+}
+
+void JobSystem::Initialize( uint32_t NumWorkers, const WorkerHooks& Hooks )
+{
+    ASSERT(s_Queues == nullptr, "The job system is already initialized");
+
+    if (NumWorkers == 0)
+    {
+        const uint32_t NumHardwareThreads = std::thread::hardware_concurrency();
+        NumWorkers = NumHardwareThreads > 1 ? NumHardwareThreads - 1 : 0;
+    }
+
+    s_NumQueues = NumWorkers + 1;
+    s_Queues.reset(new JobQueue[s_NumQueues]);
+    s_Hooks = Hooks;
+    s_Shutdown = false;
+    s_ThreadIndex = 0;
+
+    s_Workers.reserve(NumWorkers);
+    for (uint32_t i = 1; i <= NumWorkers; ++i)
+        s_Workers.emplace_back(WorkerMain, i);
+}
+
+void JobSystem::Shutdown( void )
+{
+    if (s_Queues == nullptr)
+        return;
+
+    // Workers finish every queued job before they exit
+    {
+        std::lock_guard<std::mutex> LockGuard(s_SleepMutex);
+        s_Shutdown = true;
+        s_WakeCondition.notify_all();
+    }
+
+    for (std::thread& Worker : s_Workers)
+        Worker.join();
+    s_Workers.clear();
+
+    // Without workers, whatever is left is run here
+    Job CurrentJob;
+    while (TryGetJob(CurrentJob))
+        Execute(CurrentJob);
+
+    s_Queues.reset();
+    s_NumQueues = 0;
+    s_Hooks = WorkerHooks();
+}
+
+uint32_t JobSystem::GetThreadCount( void )
+{
+    return s_NumQueues;
+}
+
+uint32_t JobSystem::GetThreadIndex( void )
+{
+    return s_ThreadIndex;
+}
+
+void JobSystem::Run( JobFunc Job, Counter* pCounter )
+{
+    if (pCounter != nullptr)
+        Increment(*pCounter);
+
+    Schedule({ std::move(Job), pCounter });
+}
+
+void JobSystem::RunAfter( Counter& Dependency, JobFunc Job, Counter* pCounter )
+{
+    if (!AddContinuation(Dependency, Job, pCounter))
+        Run(std::move(Job), pCounter);
+}
+
+bool JobSystem::AddContinuation( Counter& counter, JobFunc Job, Counter* pCounter )
+{
+    std::lock_guard<std::mutex> LockGuard(counter.m_ContinuationMutex);
+
+    if (counter.m_Count.load(std::memory_order_acquire) == 0)
+        return false;
+
+    if (pCounter != nullptr)
+        Increment(*pCounter);
+
+    counter.m_Continuations.emplace_back(std::move(Job), pCounter);
+    return true;
+}
+
+void JobSystem::Wait( Counter& counter )
+{
+    while (!counter.IsDone())
+    {
+        Job CurrentJob;
+        if (TryGetJob(CurrentJob))
+            Execute(CurrentJob);
+        else
+            std::this_thread::yield();
+    }
+
+    // The last Decrement() brings the counter to zero under this lock and doesn't touch it after releasing it
+    std::lock_guard<std::mutex> LockGuard(counter.m_ContinuationMutex);
+}
+
+void JobSystem::ParallelFor( uint32_t Begin, uint32_t End, uint32_t GrainSize, const std::function<void (uint32_t, uint32_t)>& Func )
+{
+    if (Begin >= End)
+        return;
+
+    if (GrainSize == 0)
+        GrainSize = 1;
+
+    // The last range runs on this thread instead of being queued
+    Counter RangesLeft;
+    uint32_t RangeBegin = Begin;
+    while (End - RangeBegin > GrainSize)
+    {
+        const uint32_t RangeEnd = RangeBegin + GrainSize;
+        Run([&Func, RangeBegin, RangeEnd]() { Func(RangeBegin, RangeEnd); }, &RangesLeft);
+        RangeBegin = RangeEnd;
+    }
+
+    Func(RangeBegin, End);
+    Wait(RangesLeft);
+}
+
+void JobSystem::Increment( Counter& counter, uint32_t Count )
+{
+    counter.m_Count.fetch_add(Count, std::memory_order_relaxed);
+}
+
+void JobSystem::Decrement( Counter& counter )
+{
+    uint32_t Count = counter.m_Count.load(std::memory_order_relaxed);
+    ASSERT(Count > 0, "Counter decremented below zero");
+
+    // Unless this is the last job, there's nothing to schedule
+    while (Count > 1)
+    {
+        if (counter.m_Count.compare_exchange_weak(Count, Count - 1, std::memory_order_acq_rel))
+            return;
+    }
+
+    // The counter reaches zero under the lock so that AddContinuation() either sees it or its job is in the list
+    std::vector<std::pair<JobFunc, Counter*>> ReadyJobs;
+    {
+        std::lock_guard<std::mutex> LockGuard(counter.m_ContinuationMutex);
+        if (counter.m_Count.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            ReadyJobs.swap(counter.m_Continuations);
+    }
+
+    for (auto& ReadyJob : ReadyJobs)
+        Schedule({ std::move(ReadyJob.first), ReadyJob.second });
+}
@@ -0,0 +1,107 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+// Contains a work-stealing job system for spreading CPU work across threads.  Every thread has its own
+// deque of jobs: it pushes and pops at the back while idle threads steal from the front.  Jobs signal a
+// Counter when they finish, which other jobs can depend on and any thread can wait on.  Only the C++
+// standard library is used, so it runs anywhere.
+//
+
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <stdint.h>
+#include <vector>
+
+#ifdef __cpp_impl_coroutine
+#include <coroutine>
+#define JOB_SYSTEM_COROUTINES 1
+#endif
+
+namespace JobSystem
+{
+    typedef std::function<void (void)> JobFunc;
+
+    // Counts the jobs that haven't finished yet.  A counter must outlive the jobs that signal it.
+    class Counter
+    {
+    public:
+        Counter() : m_Count(0) {}
+        Counter( const Counter& ) = delete;
+        Counter& operator=( const Counter& ) = delete;
+
+        bool IsDone( void ) const { return m_Count.load(std::memory_order_acquire) == 0; }
+
+    private:
+        friend void Increment( Counter& counter, uint32_t Count );
+        friend void Decrement( Counter& counter );
+        friend bool AddContinuation( Counter& counter, JobFunc Job, Counter* pCounter );
+        friend void Wait( Counter& counter );
+
+        std::atomic<uint32_t> m_Count;
+
+        // Jobs that wait for the counter to reach zero
+        std::mutex m_ContinuationMutex;
+        std::vector<std::pair<JobFunc, Counter*>> m_Continuations;
+    };
+
+    // Called on each worker thread when it starts and before it exits, e.g. to give every worker its own
+    // CommandContext.  The thread index is the same as GetThreadIndex() on that thread.
+    struct WorkerHooks
+    {
+        std::function<void (uint32_t ThreadIndex)> OnWorkerStart;
+        std::function<void (uint32_t ThreadIndex)> OnWorkerStop;
+    };
+
+    // NumWorkers == 0 creates a worker for every hardware thread but the calling one
+    void Initialize( uint32_t NumWorkers = 0, const WorkerHooks& Hooks = WorkerHooks() );
+    void Shutdown( void );
+
+    // The calling thread (index 0) plus every worker.  Threads that aren't workers share index 0.
+    uint32_t GetThreadCount( void );
+    uint32_t GetThreadIndex( void );
+
+    // Queue a job on the calling thread's deque.  pCounter, if any, is incremented now and decremented
+    // when the job finishes.  Without workers, jobs run when a thread waits.
+    void Run( JobFunc Job, Counter* pCounter = nullptr );
+
+    // Queue a job once the dependency reaches zero
+    void RunAfter( Counter& Dependency, JobFunc Job, Counter* pCounter = nullptr );
+
+    // Runs other jobs until the counter reaches zero.  The counter can be destroyed once this returns.
+    void Wait( Counter& counter );
+
+    // Splits [Begin, End) into ranges of at most GrainSize elements, runs them in parallel and waits for all
+    // of them.  Func is called with the begin and end of each range.
+    void ParallelFor( uint32_t Begin, uint32_t End, uint32_t GrainSize, const std::function<void (uint32_t, uint32_t)>& Func );
+
+    void Increment( Counter& counter, uint32_t Count = 1 );
+    void Decrement( Counter& counter );
+
+    // Queues the job once the counter reaches zero and returns true, or returns false without queuing it if the
+    // counter already is zero.  pCounter is incremented only if the job is queued.
+    bool AddContinuation( Counter& counter, JobFunc Job, Counter* pCounter = nullptr );
+
+#ifdef JOB_SYSTEM_COROUTINES
+    // co_await on a counter suspends the coroutine until it reaches zero.  It resumes on whichever thread
+    // picks up the continuation, or right away if the counter already is zero.
+    struct CounterAwaiter
+    {
+        Counter& m_Counter;
+
+        // Always goes through AddContinuation, after which it is safe to destroy the counter
+        bool await_ready( void ) const { return false; }
+        bool await_suspend( std::coroutine_handle<> Handle ) { return AddContinuation(m_Counter, [Handle]() { Handle.resume(); }); }
+        void await_resume( void ) const {}
+    };
+
+    inline CounterAwaiter operator co_await( Counter& counter ) { return CounterAwaiter{ counter }; }
+#endif
+}
@@ -16,7 +16,6 @@
 #include "LinearAllocator.h"
 #include "GraphicsCore.h"
 #include "CommandListManager.h"
-#include <thread>
 
 using namespace Graphics;
 using namespace std;
@@ -28,61 +27,24 @@ LinearAllocatorPageManager::LinearAllocatorPageManager()
     m_AllocationType = sm_AutoType;
     sm_AutoType = (LinearAllocatorType)(sm_AutoType + 1);
     ASSERT(sm_AutoType <= kNumAllocatorTypes);
+
+    m_PagePool.Create(this, m_AllocationType == kGpuExclusive ? kGpuAllocatorPageSize : kCpuAllocatorPageSize,
+        LINEAR_ALLOCATOR_RING_BUFFER ? kRecycleInOrder : kRecycleCompletedPages);
 }
 
 LinearAllocatorPageManager LinearAllocator::sm_PageManager[2];
 
-LinearAllocationPage* LinearAllocatorPageManager::RequestPage()
+bool LinearAllocatorPageManager::IsFenceComplete( uint64_t FenceValue )
 {
-    lock_guard<mutex> LockGuard(m_Mutex);
-
-    while (!m_RetiredPages.empty() && g_CommandManager.IsFenceComplete(m_RetiredPages.front().first))
-    {
-        m_AvailablePages.push(m_RetiredPages.front().second);
-        m_RetiredPages.pop();
-    }
-
-    LinearAllocationPage* PagePtr = nullptr;
-
-    if (!m_AvailablePages.empty())
-    {
-        PagePtr = m_AvailablePages.front();
-        m_AvailablePages.pop();
-    }
-    else
-    {
-        PagePtr = CreateNewPage();
-        m_PagePool.emplace_back(PagePtr);
-    }
-
-    return PagePtr;
+    return g_CommandManager.IsFenceComplete(FenceValue);
 }
 
-void LinearAllocatorPageManager::DiscardPages( uint64_t FenceValue, const vector<LinearAllocationPage*>& UsedPages )
+void LinearAllocatorPageManager::DeletePage( LinearPage* Page )
 {
-    lock_guard<mutex> LockGuard(m_Mutex);
-    for (auto iter = UsedPages.begin(); iter != UsedPages.end(); ++iter)
-        m_RetiredPages.push(make_pair(FenceValue, *iter));
-}
-
-void LinearAllocatorPageManager::FreeLargePages( uint64_t FenceValue, const vector<LinearAllocationPage*>& LargePages )
-{
-    lock_guard<mutex> LockGuard(m_Mutex);
-
-    while (!m_DeletionQueue.empty() && g_CommandManager.IsFenceComplete(m_DeletionQueue.front().first))
-    {
-        delete m_DeletionQueue.front().second;
-        m_DeletionQueue.pop();
-    }
-
-    for (auto iter = LargePages.begin(); iter != LargePages.end(); ++iter)
-    {
-        (*iter)->Unmap();
-        m_DeletionQueue.push(make_pair(FenceValue, *iter));
-    }
+    delete static_cast<LinearAllocationPage*>(Page);
 }
 
-LinearAllocationPage* LinearAllocatorPageManager::CreateNewPage( size_t PageSize  )
+LinearPage* LinearAllocatorPageManager::CreatePage( size_t PageSize )
 {
     D3D12_HEAP_PROPERTIES HeapProps;
     HeapProps.CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN;
@@ -106,14 +68,14 @@ LinearAllocationPage* LinearAllocatorPageManager::CreateNewPage( size_t PageSize
     if (m_AllocationType == kGpuExclusive)
     {
         HeapProps.Type = D3D12_HEAP_TYPE_DEFAULT;
-        ResourceDesc.Width = PageSize == 0 ? kGpuAllocatorPageSize : PageSize;
+        ResourceDesc.Width = PageSize;
         ResourceDesc.Flags = D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS;
         DefaultUsage = D3D12_RESOURCE_STATE_UNORDERED_ACCESS;
     }
     else
     {
         HeapProps.Type = D3D12_HEAP_TYPE_UPLOAD;
-        ResourceDesc.Width = PageSize == 0 ? kCpuAllocatorPageSize : PageSize;
+        ResourceDesc.Width = PageSize;
         ResourceDesc.Flags = D3D12_RESOURCE_FLAG_NONE;
         DefaultUsage = D3D12_RESOURCE_STATE_GENERIC_READ;
     }
@@ -139,18 +101,18 @@ void LinearAllocator::CleanupUsedPages( uint64_t FenceID )
     sm_PageManager[m_AllocationType].DiscardPages(FenceID, m_RetiredPages);
     m_RetiredPages.clear();
 
-    sm_PageManager[m_AllocationType].FreeLargePages(FenceID, m_LargePageList);
+    sm_PageManager[m_AllocationType].DiscardLargePages(FenceID, m_LargePageList);
     m_LargePageList.clear();
 }
 
 DynAlloc LinearAllocator::AllocateLargePage(size_t SizeInBytes)
 {
-    LinearAllocationPage* OneOff = sm_PageManager[m_AllocationType].CreateNewPage(SizeInBytes);
-    m_LargePageList.push_back(OneOff);
+    LinearAllocationPage* LargePage = sm_PageManager[m_AllocationType].RequestLargePage(SizeInBytes);
+    m_LargePageList.push_back(LargePage);
 
-    DynAlloc ret(*OneOff, 0, SizeInBytes);
-    ret.DataPtr = OneOff->m_CpuVirtualAddress;
-    ret.GpuAddress = OneOff->m_GpuVirtualAddress;
+    DynAlloc ret(*LargePage, 0, SizeInBytes);
+    ret.DataPtr = LargePage->m_CpuVirtualAddress;
+    ret.GpuAddress = LargePage->m_GpuVirtualAddress;
 
     return ret;
 }
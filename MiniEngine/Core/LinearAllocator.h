@@ -13,8 +13,8 @@
 // Description:  This is a dynamic graphics memory allocator for DX12.  It's designed to work in concert
 // with the CommandContext class and to do so in a thread-safe manner.  There may be many command contexts,
 // each with its own linear allocators.  They act as windows into a global memory pool by reserving a
-// context-local memory page.  Requesting a new page is done in a thread-safe manner by guarding accesses
-// with a mutex lock.
+// context-local memory page.  Requesting a new page is thread-safe, and usually doesn't take a lock:  see
+// LinearPagePool, which recycles the pages.
 //
 // When a command context is finished, it will receive a fence ID that indicates when it's safe to reclaim
 // used resources.  The CleanupUsedPages() method must be invoked at this time so that the used pages can be
@@ -23,9 +23,8 @@
 #pragma once
 
 #include "GpuResource.h"
+#include "LinearPagePool.h"
 #include <vector>
-#include <queue>
-#include <mutex>
 
 // Constant blocks must be multiples of 16 constants @ 16 bytes each
 #define DEFAULT_ALIGN 256
@@ -43,10 +42,11 @@ struct DynAlloc
     D3D12_GPU_VIRTUAL_ADDRESS GpuAddress;    // The GPU-visible address
 };
 
-class LinearAllocationPage : public GpuResource
+class LinearAllocationPage : public GpuResource, public LinearPage
 {
 public:
-    LinearAllocationPage(ID3D12Resource* pResource, D3D12_RESOURCE_STATES Usage) : GpuResource()
+    LinearAllocationPage(ID3D12Resource* pResource, D3D12_RESOURCE_STATES Usage) : GpuResource(),
+        LinearPage((size_t)pResource->GetDesc().Width)
     {
         m_pResource.Attach(pResource);
         m_UsageState = Usage;
@@ -96,33 +96,48 @@ enum
     kCpuAllocatorPageSize = 0x200000    // 2MB
 };
 
-class LinearAllocatorPageManager
+// Set to 1 to recycle pages as a ring buffer, see kRecycleInOrder
+#define LINEAR_ALLOCATOR_RING_BUFFER 0
+
+// Creates the D3D pages of a LinearPagePool
+class LinearAllocatorPageManager : public LinearPageBackingStore
 {
 public:
 
     LinearAllocatorPageManager();
-    LinearAllocationPage* RequestPage( void );
-    LinearAllocationPage* CreateNewPage( size_t PageSize = 0 );
 
-    // Discarded pages will get recycled.  This is for fixed size pages.
-    void DiscardPages( uint64_t FenceID, const std::vector<LinearAllocationPage*>& Pages );
+    LinearAllocationPage* RequestPage( void )
+    {
+        return static_cast<LinearAllocationPage*>(m_PagePool.RequestPage());
+    }
+
+    LinearAllocationPage* RequestLargePage( size_t PageSize )
+    {
+        return static_cast<LinearAllocationPage*>(m_PagePool.RequestLargePage(PageSize));
+    }
+
+    void DiscardPages( uint64_t FenceID, const std::vector<LinearPage*>& Pages )
+    {
+        m_PagePool.DiscardPages(FenceID, Pages);
+    }
+
+    void DiscardLargePages( uint64_t FenceID, const std::vector<LinearPage*>& Pages )
+    {
+        m_PagePool.DiscardLargePages(FenceID, Pages);
+    }
 
-    // Freed pages will be destroyed once their fence has passed.  This is for single-use,
-    // "large" pages.
-    void FreeLargePages( uint64_t FenceID, const std::vector<LinearAllocationPage*>& Pages );
+    void Destroy( void ) { m_PagePool.Destroy(); }
 
-    void Destroy( void ) { m_PagePool.clear(); }
+    virtual bool IsFenceComplete( uint64_t FenceValue ) override;
+    virtual LinearPage* CreatePage( size_t PageSize ) override;
+    virtual void DeletePage( LinearPage* Page ) override;
 
 private:
 
     static LinearAllocatorType sm_AutoType;
 
     LinearAllocatorType m_AllocationType;
-    std::vector<std::unique_ptr<LinearAllocationPage> > m_PagePool;
-    std::queue<std::pair<uint64_t, LinearAllocationPage*> > m_RetiredPages;
-    std::queue<std::pair<uint64_t, LinearAllocationPage*> > m_DeletionQueue;
-    std::queue<LinearAllocationPage*> m_AvailablePages;
-    std::mutex m_Mutex;
+    LinearPagePool m_PagePool;
 };
 
 class LinearAllocator
@@ -155,6 +170,6 @@ private:
     size_t m_PageSize;
     size_t m_CurOffset;
     LinearAllocationPage* m_CurPage;
-    std::vector<LinearAllocationPage*> m_RetiredPages;
-    std::vector<LinearAllocationPage*> m_LargePageList;
+    std::vector<LinearPage*> m_RetiredPages;
+    std::vector<LinearPage*> m_LargePageList;
 };
@@ -0,0 +1,357 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+// Developed by Minigraph
+//
+// Author(s):  James Stanard
+//             Alex Nankervis
+//
+
+#include "pch.h"
+#include "LinearPagePool.h"
+
+using namespace std;
+
+// Gathers pages into a chain that can be pushed onto a LinearPageList at once
+struct LinearPageChain
+{
+    LinearPageChain() : First(nullptr), Last(nullptr) {}
+
+    void Add( LinearPage* Page )
+    {
+        Page->m_NextPage = First;
+        First = Page;
+        if (Last == nullptr)
+            Last = Page;
+    }
+
+    void PushTo( LinearPageList& List )
+    {
+        if (First != nullptr)
+            List.Push(First, Last);
+    }
+
+    LinearPage* First;
+    LinearPage* Last;
+};
+
+// Rounds a large page up to the next multiple of a quarter of the power of two below it, so that no more
+// than a quarter of the page goes unused
+static uint32_t GetLargePageSizeClass( size_t PageSize, size_t& ClassSize )
+{
+    uint32_t Log2 = 0;
+    while (((size_t)2 << Log2) < PageSize)
+        ++Log2;
+
+    const size_t Step = ((size_t)1 << Log2) / 4;
+    const size_t NumSteps = (PageSize - ((size_t)1 << Log2) + Step - 1) / Step;
+    ClassSize = ((size_t)1 << Log2) + NumSteps * Step;
+
+    return Log2 * 4 + (uint32_t)NumSteps - 1;
+}
+
+static inline uint32_t GetHeadIndex( uint64_t Head )
+{
+    return (uint32_t)Head;
+}
+
+static inline uint64_t MakeHead( uint64_t PreviousHead, uint32_t Index )
+{
+    return (((PreviousHead >> 32) + 1) << 32) | Index;
+}
+
+LinearPagePool::LinearPagePool() :
+    m_BackingStore(nullptr),
+    m_PageSize(0),
+    m_Recycling(kRecycleCompletedPages),
+    m_AvailableHead(kNoPage),
+    m_NumPages(0),
+    m_InOrderFirst(nullptr),
+    m_InOrderLast(nullptr),
+    m_DeletedLargePages(nullptr),
+    m_PooledLargePageBytes(0),
+    m_NumLargePagesCreated(0)
+{
+    for (uint32_t i = 0; i < kNumPageBlocks; ++i)
+        m_PageBlocks[i] = nullptr;
+    for (uint32_t i = 0; i < kNumLargePageSizeClasses; ++i)
+        m_RetiredLargePages[i] = nullptr;
+}
+
+LinearPagePool::~LinearPagePool()
+{
+    // The pages are deleted by Destroy() while the backing store still exists
+    for (uint32_t i = 0; i < kNumPageBlocks; ++i)
+        delete[] m_PageBlocks[i].load();
+}
+
+void LinearPagePool::Create( LinearPageBackingStore* BackingStore, size_t PageSize, LinearPageRecycling Recycling )
+{
+    m_BackingStore = BackingStore;
+    m_PageSize = PageSize;
+    m_Recycling = Recycling;
+}
+
+LinearPage* LinearPagePool::GetPage( uint32_t Index ) const
+{
+    uint32_t Block = 0;
+    while (Index >= (kFirstPageBlockSize << Block))
+    {
+        Index -= kFirstPageBlockSize << Block;
+        ++Block;
+    }
+    return m_PageBlocks[Block].load(memory_order_acquire)[Index];
+}
+
+LinearPage* LinearPagePool::AddNewPage( void )
+{
+    uint32_t Block = 0;
+    size_t Index = m_NumPages;
+    while (Block < kNumPageBlocks && Index >= (kFirstPageBlockSize << Block))
+    {
+        Index -= kFirstPageBlockSize << Block;
+        ++Block;
+    }
+    ASSERT(Block < kNumPageBlocks, "Too many linear allocator pages");
+
+    if (m_PageBlocks[Block].load(memory_order_relaxed) == nullptr)
+        m_PageBlocks[Block].store(new LinearPage*[kFirstPageBlockSize << Block], memory_order_release);
+
+    LinearPage* Page = m_BackingStore->CreatePage(m_PageSize);
+    Page->m_Index = (uint32_t)m_NumPages++;
+    m_PageBlocks[Block].load(memory_order_relaxed)[Index] = Page;
+
+    return Page;
+}
+
+LinearPage* LinearPagePool::PopAvailablePage( void )
+{
+    uint64_t Head = m_AvailableHead.load(memory_order_acquire);
+    while (GetHeadIndex(Head) != kNoPage)
+    {
+        // Pages are never deleted while the pool is in use, so the link can be read even if another thread has
+        // taken the page in the meantime.  The tag then makes the exchange fail.
+        LinearPage* Page = GetPage(GetHeadIndex(Head));
+        const uint32_t Next = Page->m_NextAvailable.load(memory_order_relaxed);
+        if (m_AvailableHead.compare_exchange_weak(Head, MakeHead(Head, Next), memory_order_acquire, memory_order_acquire))
+            return Page;
+    }
+    return nullptr;
+}
+
+void LinearPagePool::PushAvailablePages( LinearPage* First, LinearPage* Last )
+{
+    // Link the chain through the available stack's indices
+    for (LinearPage* Page = First; Page != Last; Page = Page->m_NextPage)
+        Page->m_NextAvailable.store(Page->m_NextPage->m_Index, memory_order_relaxed);
+
+    uint64_t Head = m_AvailableHead.load(memory_order_relaxed);
+    do
+    {
+        Last->m_NextAvailable.store(GetHeadIndex(Head), memory_order_relaxed);
+    }
+    while (!m_AvailableHead.compare_exchange_weak(Head, MakeHead(Head, First->m_Index), memory_order_release, memory_order_relaxed));
+}
+
+void LinearPagePool::RecycleRetiredPages( void )
+{
+    LinearPageChain Completed;
+
+    if (m_Recycling == kRecycleInOrder)
+    {
+        // The retired stack holds the latest page first, so reverse it onto the end of the ring
+        LinearPage* Oldest = nullptr;
+        for (LinearPage* Retired = m_RetiredPages.TakeAll(); Retired != nullptr; )
+        {
+            LinearPage* NextPage = Retired->m_NextPage;
+            Retired->m_NextPage = Oldest;
+            Oldest = Retired;
+            Retired = NextPage;
+        }
+        for (LinearPage* Retired = Oldest; Retired != nullptr; Retired = Retired->m_NextPage)
+        {
+            if (m_InOrderLast == nullptr)
+                m_InOrderFirst = Retired;
+            else
+                m_InOrderLast->m_NextPage = Retired;
+            m_InOrderLast = Retired;
+        }
+
+        while (m_InOrderFirst != nullptr && m_BackingStore->IsFenceComplete(m_InOrderFirst->m_FenceValue))
+        {
+            LinearPage* Page = m_InOrderFirst;
+            m_InOrderFirst = Page->m_NextPage;
+            Completed.Add(Page);
+        }
+        if (m_InOrderFirst == nullptr)
+            m_InOrderLast = nullptr;
+    }
+    else
+    {
+        // Only the thread holding m_Mutex looks for completed pages, so the ones still in flight can be pushed back
+        // without another thread finding the list empty in the meantime
+        LinearPageChain InFlight;
+
+        for (LinearPage* Retired = m_RetiredPages.TakeAll(); Retired != nullptr; )
+        {
+            LinearPage* NextPage = Retired->m_NextPage;
+            if (m_BackingStore->IsFenceComplete(Retired->m_FenceValue))
+                Completed.Add(Retired);
+            else
+                InFlight.Add(Retired);
+            Retired = NextPage;
+        }
+
+        InFlight.PushTo(m_RetiredPages);
+    }
+
+    if (Completed.First != nullptr)
+        PushAvailablePages(Completed.First, Completed.Last);
+}
+
+LinearPage* LinearPagePool::RequestPage( void )
+{
+    LinearPage* Page = PopAvailablePage();
+    if (Page != nullptr)
+        return Page;
+
+    // One thread at a time refills the available stack.  The others wait for it rather than create pages.
+    lock_guard<mutex> LockGuard(m_Mutex);
+
+    Page = PopAvailablePage();
+    if (Page != nullptr)
+        return Page;
+
+    RecycleRetiredPages();
+
+    Page = PopAvailablePage();
+    if (Page != nullptr)
+        return Page;
+
+    return AddNewPage();
+}
+
+LinearPage* LinearPagePool::RequestLargePage( size_t PageSize )
+{
+    size_t ClassSize;
+    const uint32_t SizeClass = GetLargePageSizeClass(PageSize, ClassSize);
+    ASSERT(SizeClass < kNumLargePageSizeClasses);
+
+    {
+        lock_guard<mutex> LockGuard(m_LargePageMutex);
+
+        for (LinearPage** Link = &m_RetiredLargePages[SizeClass]; *Link != nullptr; Link = &(*Link)->m_NextPage)
+        {
+            LinearPage* Page = *Link;
+            if (m_BackingStore->IsFenceComplete(Page->m_FenceValue))
+            {
+                *Link = Page->m_NextPage;
+                m_PooledLargePageBytes -= ClassSize;
+                return Page;
+            }
+        }
+
+        ++m_NumLargePagesCreated;
+    }
+
+    // Large pages belong to the size class lists rather than the page blocks so that they can be deleted one at a time
+    return m_BackingStore->CreatePage(ClassSize);
+}
+
+void LinearPagePool::DiscardPages( uint64_t FenceValue, const vector<LinearPage*>& UsedPages )
+{
+    LinearPageChain Retired;
+    for (auto iter = UsedPages.begin(); iter != UsedPages.end(); ++iter)
+    {
+        (*iter)->m_FenceValue = FenceValue;
+        Retired.Add(*iter);
+    }
+
+    Retired.PushTo(m_RetiredPages);
+}
+
+void LinearPagePool::DiscardLargePages( uint64_t FenceValue, const vector<LinearPage*>& LargePages )
+{
+    if (LargePages.empty())
+        return;
+
+    lock_guard<mutex> LockGuard(m_LargePageMutex);
+
+    DeleteCompletedLargePages();
+
+    for (auto iter = LargePages.begin(); iter != LargePages.end(); ++iter)
+    {
+        LinearPage* Page = *iter;
+        Page->m_FenceValue = FenceValue;
+
+        size_t ClassSize;
+        const uint32_t SizeClass = GetLargePageSizeClass(Page->m_PageSize, ClassSize);
+        ASSERT(ClassSize == Page->m_PageSize);
+
+        if (m_PooledLargePageBytes + ClassSize <= kMaxPooledLargePageBytes)
+        {
+            m_PooledLargePageBytes += ClassSize;
+            Page->m_NextPage = m_RetiredLargePages[SizeClass];
+            m_RetiredLargePages[SizeClass] = Page;
+        }
+        else
+        {
+            Page->m_NextPage = m_DeletedLargePages;
+            m_DeletedLargePages = Page;
+        }
+    }
+}
+
+void LinearPagePool::DeleteCompletedLargePages( void )
+{
+    for (LinearPage** Link = &m_DeletedLargePages; *Link != nullptr; )
+    {
+        LinearPage* Page = *Link;
+        if (m_BackingStore->IsFenceComplete(Page->m_FenceValue))
+        {
+            *Link = Page->m_NextPage;
+            m_BackingStore->DeletePage(Page);
+        }
+        else
+            Link = &Page->m_NextPage;
+    }
+}
+
+void LinearPagePool::Destroy( void )
+{
+    lock_guard<mutex> LockGuard(m_Mutex);
+    lock_guard<mutex> LargePageLockGuard(m_LargePageMutex);
+
+    for (uint32_t i = 0; i < m_NumPages; ++i)
+        m_BackingStore->DeletePage(GetPage(i));
+    m_NumPages = 0;
+
+    m_AvailableHead = kNoPage;
+    m_RetiredPages.TakeAll();
+    m_InOrderFirst = nullptr;
+    m_InOrderLast = nullptr;
+
+    for (uint32_t i = 0; i < kNumLargePageSizeClasses; ++i)
+    {
+        for (LinearPage* Page = m_RetiredLargePages[i]; Page != nullptr; )
+        {
+            LinearPage* NextPage = Page->m_NextPage;
+            m_BackingStore->DeletePage(Page);
+            Page = NextPage;
+        }
+        m_RetiredLargePages[i] = nullptr;
+    }
+    for (LinearPage* Page = m_DeletedLargePages; Page != nullptr; )
+    {
+        LinearPage* NextPage = Page->m_NextPage;
+        m_BackingStore->DeletePage(Page);
+        Page = NextPage;
+    }
+    m_DeletedLargePages = nullptr;
+    m_PooledLargePageBytes = 0;
+}
@@ -0,0 +1,169 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+// Recycles the pages of LinearAllocator once the GPU is done with them.  Pages whose fence has passed are kept
+// on a lock-free stack, so most page requests don't take a lock.  Nothing here touches the device:  pages are
+// created, deleted and checked against their fence through a LinearPageBackingStore, so tools can run the pool
+// with a stand-in.
+//
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+class LinearPage
+{
+public:
+
+    LinearPage( size_t PageSize ) : m_PageSize(PageSize), m_NextPage(nullptr), m_FenceValue(0),
+        m_Index(0), m_NextAvailable(0) {}
+
+    size_t m_PageSize;
+
+    // Links retired pages together and holds the fence they are waiting on
+    LinearPage* m_NextPage;
+    uint64_t m_FenceValue;
+
+private:
+
+    friend class LinearPagePool;
+
+    // Where the pool keeps the page, and the next page on its stack of available pages
+    uint32_t m_Index;
+    std::atomic<uint32_t> m_NextAvailable;
+};
+
+// Creates and deletes the pages of a LinearPagePool and tells it when their fence has passed
+class LinearPageBackingStore
+{
+public:
+
+    virtual bool IsFenceComplete( uint64_t FenceValue ) = 0;
+    virtual LinearPage* CreatePage( size_t PageSize ) = 0;
+    virtual void DeletePage( LinearPage* Page ) = 0;
+
+protected:
+
+    ~LinearPageBackingStore() {}
+};
+
+enum LinearPageRecycling
+{
+    // Any retired page whose fence has passed is reused
+    kRecycleCompletedPages,
+
+    // A ring buffer of pages:  retired pages are reused in the order they were retired, and only the pages up to the
+    // first one whose fence hasn't passed are checked.  Pages retired with the fences of a slower queue hold back
+    // the pages retired after them.
+    kRecycleInOrder
+};
+
+// A lock-free stack of pages linked through m_NextPage.  Pages are pushed a chain at a time and only ever
+// taken all at once, so unlike popping single pages, there is no ABA problem.
+class LinearPageList
+{
+public:
+
+    LinearPageList() : m_Head(nullptr) {}
+
+    void Push( LinearPage* First, LinearPage* Last )
+    {
+        LinearPage* Head = m_Head.load(std::memory_order_relaxed);
+        do
+        {
+            Last->m_NextPage = Head;
+        }
+        while (!m_Head.compare_exchange_weak(Head, First, std::memory_order_release, std::memory_order_relaxed));
+    }
+
+    LinearPage* TakeAll( void )
+    {
+        if (m_Head.load(std::memory_order_relaxed) == nullptr)
+            return nullptr;
+        return m_Head.exchange(nullptr, std::memory_order_acquire);
+    }
+
+private:
+
+    std::atomic<LinearPage*> m_Head;
+};
+
+class LinearPagePool
+{
+public:
+
+    LinearPagePool();
+    ~LinearPagePool();
+
+    // Pages of the default size are PageSize bytes
+    void Create( LinearPageBackingStore* BackingStore, size_t PageSize, LinearPageRecycling Recycling );
+
+    // Deletes every page the pool has created, including the ones still handed out
+    void Destroy( void );
+
+    LinearPage* RequestPage( void );
+
+    // Large pages are rounded up to one of four sizes per power of two and pooled by that size
+    LinearPage* RequestLargePage( size_t PageSize );
+
+    // Discarded pages will get recycled.  This is for fixed size pages.
+    void DiscardPages( uint64_t FenceValue, const std::vector<LinearPage*>& Pages );
+
+    // Discarded large pages will get recycled for requests of the same size class.  Once the pool holds
+    // kMaxPooledLargePageBytes, further pages are deleted when their fence has passed.
+    void DiscardLargePages( uint64_t FenceValue, const std::vector<LinearPage*>& Pages );
+
+    size_t GetNumPages( void ) const { return m_NumPages; }
+    size_t GetNumLargePagesCreated( void ) const { return m_NumLargePagesCreated; }
+
+private:
+
+    static const uint32_t kNumLargePageSizeClasses = 4 * 40;
+    static const size_t kMaxPooledLargePageBytes = 64 * 1024 * 1024;
+
+    // Pages are found by index in blocks which double in size, so that the blocks never move once created
+    static const uint32_t kFirstPageBlockSize = 64;
+    static const uint32_t kNumPageBlocks = 26;
+    static const uint32_t kNoPage = ~0u;
+
+    LinearPage* GetPage( uint32_t Index ) const;
+    LinearPage* AddNewPage( void );
+
+    // The available stack packs the index of its first page in the low 32 bits of its head and a tag which
+    // changes on every update in the high 32 bits, so that a stale head can't be swapped back in (ABA).
+    LinearPage* PopAvailablePage( void );
+    void PushAvailablePages( LinearPage* First, LinearPage* Last );
+
+    // Moves the retired pages whose fence has passed to the available stack.  m_Mutex must be held.
+    void RecycleRetiredPages( void );
+
+    void DeleteCompletedLargePages( void );
+
+    LinearPageBackingStore* m_BackingStore;
+    size_t m_PageSize;
+    LinearPageRecycling m_Recycling;
+
+    std::atomic<uint64_t> m_AvailableHead;
+    LinearPageList m_RetiredPages;                  // Waiting for their fence
+
+    std::mutex m_Mutex;                             // Guards the rest of the fixed size pages
+    std::atomic<LinearPage**> m_PageBlocks[kNumPageBlocks];
+    size_t m_NumPages;
+    LinearPage* m_InOrderFirst;                     // Retired pages in the order they were retired, for kRecycleInOrder
+    LinearPage* m_InOrderLast;
+
+    std::mutex m_LargePageMutex;                    // Guards the large pages
+    LinearPage* m_RetiredLargePages[kNumLargePageSizeClasses];
+    LinearPage* m_DeletedLargePages;                // Over the pool limit, deleted when their fence has passed
+    size_t m_PooledLargePageBytes;
+    size_t m_NumLargePagesCreated;
+};
@@ -14,25 +14,214 @@
 #include "GraphicsCore.h"
 #include "PipelineState.h"
 #include "RootSignature.h"
-#include "Hash.h"
-#include <map>
-#include <thread>
-#include <mutex>
+#include "StateObjectCache.h"
+#include "FileUtility.h"
 
 using Math::IsAligned;
 using namespace Graphics;
 using Microsoft::WRL::ComPtr;
 using namespace std;
 
-static map< size_t, ComPtr<ID3D12PipelineState> > s_GraphicsPSOHashMap;
-static map< size_t, ComPtr<ID3D12PipelineState> > s_ComputePSOHashMap;
+static StateObjectCache<ID3D12PipelineState> s_GraphicsPSOCache;
+static StateObjectCache<ID3D12PipelineState> s_ComputePSOCache;
+
+// Compiled blobs for the pipeline cache file.  Their keys hold the contents of shaders and semantic names and
+// the hash of the root signature rather than pointers, so that they match from run to run.  Only blobs that
+// were looked up or created this run are saved, so PSOs that are no longer made drop out of the file.
+struct CachedBlob
+{
+    StateKey Key;
+    vector<uint8_t> Blob;
+    bool UsedThisRun = false;
+};
+
+static mutex s_CachedBlobMutex;
+static unordered_multimap< size_t, CachedBlob > s_CachedBlobs;
+static bool s_CachedBlobsChanged = false;
+
+// Change the version whenever the keys change
+static const uint32_t kPipelineCacheMagic = 0x4350454D; // "MEPC"
+static const uint32_t kPipelineCacheVersion = 1;
+
+struct PipelineCacheHeader
+{
+    uint32_t Magic;
+    uint32_t Version;
+    uint32_t NumBlobs;
+};
+
+// Followed by the key and then the blob
+struct PipelineCacheEntry
+{
+    uint32_t NumKeyWords;
+    uint32_t BlobSize;
+};
 
 void PSO::DestroyAll(void)
 {
-    s_GraphicsPSOHashMap.clear();
-    s_ComputePSOHashMap.clear();
+    s_GraphicsPSOCache.Clear();
+    s_ComputePSOCache.Clear();
 }
 
+void PSO::LoadPipelineCache( const wstring& FileName )
+{
+    Utility::ByteArray File = Utility::ReadFileSync(FileName);
+    const uint8_t* Iter = (const uint8_t*)File->data();
+    const uint8_t* const End = Iter + File->size();
+
+    PipelineCacheHeader Header;
+    if (File->size() < sizeof(Header))
+        return;
+
+    memcpy(&Header, Iter, sizeof(Header));
+    Iter += sizeof(Header);
+
+    if (Header.Magic != kPipelineCacheMagic || Header.Version != kPipelineCacheVersion)
+    {
+        Utility::Printf(L"Ignoring out of date pipeline cache %s\n", FileName.c_str());
+        return;
+    }
+
+    lock_guard<mutex> LockGuard(s_CachedBlobMutex);
+
+    vector<uint32_t> KeyWords;
+    for (uint32_t i = 0; i < Header.NumBlobs; ++i)
+    {
+        PipelineCacheEntry Entry;
+        if ((size_t)(End - Iter) < sizeof(Entry))
+            break;
+
+        memcpy(&Entry, Iter, sizeof(Entry));
+        Iter += sizeof(Entry);
+
+        const size_t KeySize = Entry.NumKeyWords * sizeof(uint32_t);
+        if ((size_t)(End - Iter) < KeySize + Entry.BlobSize)
+            break;
+
+        KeyWords.resize(Entry.NumKeyWords);
+        memcpy(KeyWords.data(), Iter, KeySize);
+        Iter += KeySize;
+
+        CachedBlob NewBlob;
+        NewBlob.Key.Append(KeyWords.data(), KeyWords.size());
+        NewBlob.Blob.assign(Iter, Iter + Entry.BlobSize);
+        Iter += Entry.BlobSize;
+
+        s_CachedBlobs.emplace(NewBlob.Key.GetHash(), move(NewBlob));
+    }
+}
+
+void PSO::SavePipelineCache( const wstring& FileName )
+{
+    lock_guard<mutex> LockGuard(s_CachedBlobMutex);
+
+    uint32_t NumUsedBlobs = 0;
+    for (auto& Iter : s_CachedBlobs)
+        NumUsedBlobs += Iter.second.UsedThisRun ? 1 : 0;
+
+    if (!s_CachedBlobsChanged && NumUsedBlobs == s_CachedBlobs.size())
+        return;
+
+    FILE* CacheFile = nullptr;
+    _wfopen_s(&CacheFile, FileName.c_str(), L"wb");
+    if (CacheFile == nullptr)
+        return;
+
+    PipelineCacheHeader Header = { kPipelineCacheMagic, kPipelineCacheVersion, NumUsedBlobs };
+    fwrite(&Header, sizeof(Header), 1, CacheFile);
+
+    for (auto& Iter : s_CachedBlobs)
+    {
+        const CachedBlob& Cached = Iter.second;
+        if (!Cached.UsedThisRun)
+            continue;
+
+        PipelineCacheEntry Entry = { (uint32_t)Cached.Key.GetNumWords(), (uint32_t)Cached.Blob.size() };
+        fwrite(&Entry, sizeof(Entry), 1, CacheFile);
+        fwrite(Cached.Key.GetWords(), sizeof(uint32_t), Cached.Key.GetNumWords(), CacheFile);
+        fwrite(Cached.Blob.data(), 1, Cached.Blob.size(), CacheFile);
+    }
+
+    fclose(CacheFile);
+    s_CachedBlobsChanged = false;
+}
+
+static CachedBlob* FindCachedBlob( const StateKey& Key, size_t HashCode )
+{
+    auto Range = s_CachedBlobs.equal_range(HashCode);
+    for (auto Iter = Range.first; Iter != Range.second; ++Iter)
+    {
+        if (Iter->second.Key == Key)
+            return &Iter->second;
+    }
+    return nullptr;
+}
+
+static HRESULT CreatePipelineState( const D3D12_GRAPHICS_PIPELINE_STATE_DESC& Desc, ComPtr<ID3D12PipelineState>& NewPSO )
+{
+    return g_Device->CreateGraphicsPipelineState(&Desc, MY_IID_PPV_ARGS(&NewPSO));
+}
+
+static HRESULT CreatePipelineState( const D3D12_COMPUTE_PIPELINE_STATE_DESC& Desc, ComPtr<ID3D12PipelineState>& NewPSO )
+{
+    return g_Device->CreateComputePipelineState(&Desc, MY_IID_PPV_ARGS(&NewPSO));
+}
+
+// Creates the PSO from its cached blob if the driver accepts it, and otherwise compiles it and caches its blob
+template <typename DescType>
+static ComPtr<ID3D12PipelineState> CreateCachedPipelineState( DescType Desc, const StateKey& BlobKey )
+{
+    const size_t HashCode = BlobKey.GetHash();
+    ComPtr<ID3D12PipelineState> NewPSO;
+
+    vector<uint8_t> Blob;
+    {
+        lock_guard<mutex> LockGuard(s_CachedBlobMutex);
+        CachedBlob* Cached = FindCachedBlob(BlobKey, HashCode);
+        if (Cached != nullptr)
+        {
+            Cached->UsedThisRun = true;
+            Blob = Cached->Blob;
+        }
+    }
+
+    if (!Blob.empty())
+    {
+        Desc.CachedPSO.pCachedBlob = Blob.data();
+        Desc.CachedPSO.CachedBlobSizeInBytes = Blob.size();
+        if (SUCCEEDED(CreatePipelineState(Desc, NewPSO)))
+            return NewPSO;
+
+        Desc.CachedPSO.pCachedBlob = nullptr;
+        Desc.CachedPSO.CachedBlobSizeInBytes = 0;
+    }
+
+    ASSERT_SUCCEEDED( CreatePipelineState(Desc, NewPSO) );
+
+    ComPtr<ID3DBlob> NewBlob;
+    if (SUCCEEDED(NewPSO->GetCachedBlob(&NewBlob)))
+    {
+        const uint8_t* BlobData = (const uint8_t*)NewBlob->GetBufferPointer();
+
+        lock_guard<mutex> LockGuard(s_CachedBlobMutex);
+        CachedBlob* Cached = FindCachedBlob(BlobKey, HashCode);
+        if (Cached == nullptr)
+        {
+            Cached = &s_CachedBlobs.emplace(HashCode, CachedBlob())->second;
+            Cached->Key = BlobKey;
+        }
+        Cached->Blob.assign(BlobData, BlobData + NewBlob->GetBufferSize());
+        Cached->UsedThisRun = true;
+        s_CachedBlobsChanged = true;
+    }
+
+    return NewPSO;
+}
+
+static void AppendShader( StateKey& Key, const D3D12_SHADER_BYTECODE& Shader )
+{
+    Key.AppendBytes(Shader.pShaderBytecode, Shader.BytecodeLength);
+}
 
 GraphicsPSO::GraphicsPSO()
 {
@@ -113,38 +302,46 @@ void GraphicsPSO::Finalize()
     ASSERT(m_PSODesc.pRootSignature != nullptr);
 
     m_PSODesc.InputLayout.pInputElementDescs = nullptr;
-    size_t HashCode = Utility::HashState(&m_PSODesc);
-    HashCode = Utility::HashState(m_InputLayouts.get(), m_PSODesc.InputLayout.NumElements, HashCode);
+    StateKey Key;
+    Key.Append(&m_PSODesc);
+    Key.Append(m_InputLayouts.get(), m_PSODesc.InputLayout.NumElements);
     m_PSODesc.InputLayout.pInputElementDescs = m_InputLayouts.get();
 
-    ID3D12PipelineState** PSORef = nullptr;
-    bool firstCompile = false;
+    m_PSO = s_GraphicsPSOCache.GetOrCreate(Key, [this]()
     {
-        static mutex s_HashMapMutex;
-        lock_guard<mutex> CS(s_HashMapMutex);
-        auto iter = s_GraphicsPSOHashMap.find(HashCode);
+        // Stream output isn't used, and the driver rejects a blob that doesn't match it anyway
+        D3D12_GRAPHICS_PIPELINE_STATE_DESC BlobDesc;
+        memcpy(&BlobDesc, &m_PSODesc, sizeof(BlobDesc));
+        BlobDesc.pRootSignature = nullptr;
+        BlobDesc.VS.pShaderBytecode = nullptr;
+        BlobDesc.PS.pShaderBytecode = nullptr;
+        BlobDesc.DS.pShaderBytecode = nullptr;
+        BlobDesc.HS.pShaderBytecode = nullptr;
+        BlobDesc.GS.pShaderBytecode = nullptr;
+        BlobDesc.StreamOutput.pSODeclaration = nullptr;
+        BlobDesc.StreamOutput.pBufferStrides = nullptr;
+        BlobDesc.InputLayout.pInputElementDescs = nullptr;
 
-        // Reserve space so the next inquiry will find that someone got here first.
-        if (iter == s_GraphicsPSOHashMap.end())
+        StateKey BlobKey;
+        BlobKey.Append(&BlobDesc);
+        const size_t RootSignatureHash = m_RootSignature->GetHash();
+        BlobKey.Append(&RootSignatureHash);
+        AppendShader(BlobKey, m_PSODesc.VS);
+        AppendShader(BlobKey, m_PSODesc.PS);
+        AppendShader(BlobKey, m_PSODesc.DS);
+        AppendShader(BlobKey, m_PSODesc.HS);
+        AppendShader(BlobKey, m_PSODesc.GS);
+
+        for (UINT i = 0; i < m_PSODesc.InputLayout.NumElements; ++i)
         {
-            firstCompile = true;
-            PSORef = s_GraphicsPSOHashMap[HashCode].GetAddressOf();
+            D3D12_INPUT_ELEMENT_DESC Element = m_InputLayouts.get()[i];
+            BlobKey.AppendBytes(Element.SemanticName, strlen(Element.SemanticName));
+            Element.SemanticName = nullptr;
+            BlobKey.Append(&Element);
         }
-        else
-            PSORef = iter->second.GetAddressOf();
-    }
 
-    if (firstCompile)
-    {
-        ASSERT_SUCCEEDED( g_Device->CreateGraphicsPipelineState(&m_PSODesc, MY_IID_PPV_ARGS(&m_PSO)) );
-        s_GraphicsPSOHashMap[HashCode].Attach(m_PSO);
-    }
-    else
-    {
-        while (*PSORef == nullptr)
-            this_thread::yield();
-        m_PSO = *PSORef;
-    }
+        return CreateCachedPipelineState(m_PSODesc, BlobKey);
+    });
 }
 
 void ComputePSO::Finalize()
@@ -153,36 +350,24 @@ void ComputePSO::Finalize()
     m_PSODesc.pRootSignature = m_RootSignature->GetSignature();
     ASSERT(m_PSODesc.pRootSignature != nullptr);
 
-    size_t HashCode = Utility::HashState(&m_PSODesc);
+    StateKey Key;
+    Key.Append(&m_PSODesc);
 
-    ID3D12PipelineState** PSORef = nullptr;
-    bool firstCompile = false;
+    m_PSO = s_ComputePSOCache.GetOrCreate(Key, [this]()
     {
-        static mutex s_HashMapMutex;
-        lock_guard<mutex> CS(s_HashMapMutex);
-        auto iter = s_ComputePSOHashMap.find(HashCode);
+        D3D12_COMPUTE_PIPELINE_STATE_DESC BlobDesc;
+        memcpy(&BlobDesc, &m_PSODesc, sizeof(BlobDesc));
+        BlobDesc.pRootSignature = nullptr;
+        BlobDesc.CS.pShaderBytecode = nullptr;
 
-        // Reserve space so the next inquiry will find that someone got here first.
-        if (iter == s_ComputePSOHashMap.end())
-        {
-            firstCompile = true;
-            PSORef = s_ComputePSOHashMap[HashCode].GetAddressOf();
-        }
-        else
-            PSORef = iter->second.GetAddressOf();
-    }
+        StateKey BlobKey;
+        BlobKey.Append(&BlobDesc);
+        const size_t RootSignatureHash = m_RootSignature->GetHash();
+        BlobKey.Append(&RootSignatureHash);
+        AppendShader(BlobKey, m_PSODesc.CS);
 
-    if (firstCompile)
-    {
-        ASSERT_SUCCEEDED( g_Device->CreateComputePipelineState(&m_PSODesc, MY_IID_PPV_ARGS(&m_PSO)) );
-        s_ComputePSOHashMap[HashCode].Attach(m_PSO);
-    }
-    else
-    {
-        while (*PSORef == nullptr)
-            this_thread::yield();
-        m_PSO = *PSORef;
-    }
+        return CreateCachedPipelineState(m_PSODesc, BlobKey);
+    });
 }
 
 ComputePSO::ComputePSO()
@@ -32,6 +32,12 @@ public:
 
     static void DestroyAll( void );
 
+    // Compiled pipeline state blobs are kept across runs in a cache file.  Load it before finalizing any PSOs
+    // and save it before DestroyAll().  Blobs that don't match the driver or hardware are recompiled, and only
+    // blobs for PSOs finalized this run are saved.
+    static void LoadPipelineCache( const std::wstring& FileName );
+    static void SavePipelineCache( const std::wstring& FileName );
+
     void SetRootSignature( const RootSignature& BindMappings )
     {
         m_RootSignature = &BindMappings;
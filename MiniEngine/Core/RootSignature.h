@@ -162,6 +162,9 @@ public:
 
     ID3D12RootSignature* GetSignature() const { return m_Signature; }
 
+    // Hash of the description, which unlike the signature pointer is the same from run to run
+    size_t GetHash() const { return m_Hash; }
+
 protected:
 
     BOOL m_Finalized;
@@ -174,4 +177,5 @@ protected:
     std::unique_ptr<RootParameter[]> m_ParamArray;
     std::unique_ptr<D3D12_STATIC_SAMPLER_DESC[]> m_SamplerArray;
     ID3D12RootSignature* m_Signature;
+    size_t m_Hash;
 };
@@ -0,0 +1,150 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+// Caches the root signatures and pipeline state objects created from identical descriptions.  Entries
+// are found by hash but matched by the whole description, so a hash collision can't return the wrong
+// object.  The cache is split into shards with their own locks so that threads finalizing different
+// state rarely contend.
+//
+
+#pragma once
+
+#include "Hash.h"
+#include <algorithm>
+#include <future>
+#include <mutex>
+#include <string.h>
+#include <unordered_map>
+#include <vector>
+
+// A state description flattened into 32-bit words
+class StateKey
+{
+public:
+    template <typename T> void Append( const T* State, size_t Count = 1 )
+    {
+        static_assert((sizeof(T) & 3) == 0 && alignof(T) >= 4, "State object is not word-aligned");
+        m_Words.insert(m_Words.end(), (const uint32_t*)State, (const uint32_t*)(State + Count));
+    }
+
+    void AppendWord( uint32_t Word ) { m_Words.push_back(Word); }
+
+    // Appends the size followed by the bytes, padded with zeros to a whole word
+    void AppendBytes( const void* Data, size_t Size )
+    {
+        AppendWord((uint32_t)Size);
+        const size_t Offset = m_Words.size();
+        m_Words.resize(Offset + (Size + 3) / 4, 0);
+        if (Size > 0)
+            memcpy(m_Words.data() + Offset, Data, Size);
+    }
+
+    size_t GetHash( void ) const
+    {
+        const uint32_t* Begin = m_Words.data();
+        return Utility::HashRange(Begin, Begin + m_Words.size(), 2166136261U);
+    }
+
+    bool operator==( const StateKey& rhs ) const { return m_Words == rhs.m_Words; }
+
+    const uint32_t* GetWords( void ) const { return m_Words.data(); }
+    size_t GetNumWords( void ) const { return m_Words.size(); }
+
+private:
+    std::vector<uint32_t> m_Words;
+};
+
+template <typename ObjectType>
+class StateObjectCache
+{
+public:
+    typedef Microsoft::WRL::ComPtr<ObjectType> ObjectPtr;
+
+    // Returns the object made from Key, calling Create() if there isn't one yet.  Only the first thread to ask
+    // for a key creates the object; the others wait on its future.  The cache holds a reference to the object.
+    // If Create() throws, the exception reaches every waiting thread and the key is dropped from the cache.
+    template <typename CreateFunc>
+    ObjectType* GetOrCreate( const StateKey& Key, CreateFunc Create )
+    {
+        const size_t HashCode = Key.GetHash();
+        Shard& CacheShard = m_Shards[HashCode % kNumShards];
+
+        std::promise<ObjectPtr> Promise;
+        std::shared_future<ObjectPtr> Future;
+        bool FirstCompile = false;
+        {
+            std::lock_guard<std::mutex> LockGuard(CacheShard.Mutex);
+            auto Range = CacheShard.Entries.equal_range(HashCode);
+            auto Iter = std::find_if(Range.first, Range.second, [&Key]( const std::pair<const size_t, Entry>& Candidate )
+                { return Candidate.second.Key == Key; });
+
+            // Insert the future so that the next inquiry will find that someone got here first
+            if (Iter == Range.second)
+            {
+                FirstCompile = true;
+                Future = Promise.get_future().share();
+                CacheShard.Entries.emplace(HashCode, Entry{ Key, Future });
+            }
+            else
+                Future = Iter->second.Future;
+        }
+
+        if (FirstCompile)
+        {
+            try
+            {
+                Promise.set_value(Create());
+            }
+            catch (...)
+            {
+                // Threads already waiting see the same failure, later ones get to try again
+                Promise.set_exception(std::current_exception());
+                Erase(Key, HashCode);
+                throw;
+            }
+        }
+
+        return Future.get().Get();
+    }
+
+    void Clear( void )
+    {
+        for (Shard& CacheShard : m_Shards)
+        {
+            std::lock_guard<std::mutex> LockGuard(CacheShard.Mutex);
+            CacheShard.Entries.clear();
+        }
+    }
+
+private:
+    void Erase( const StateKey& Key, size_t HashCode )
+    {
+        Shard& CacheShard = m_Shards[HashCode % kNumShards];
+        std::lock_guard<std::mutex> LockGuard(CacheShard.Mutex);
+        auto Range = CacheShard.Entries.equal_range(HashCode);
+        auto Iter = std::find_if(Range.first, Range.second, [&Key]( const std::pair<const size_t, Entry>& Candidate )
+            { return Candidate.second.Key == Key; });
+        if (Iter != Range.second)
+            CacheShard.Entries.erase(Iter);
+    }
+
+    struct Entry
+    {
+        StateKey Key;
+        std::shared_future<ObjectPtr> Future;
+    };
+
+    struct Shard
+    {
+        std::mutex Mutex;
+        std::unordered_multimap<size_t, Entry> Entries;
+    };
+
+    static const size_t kNumShards = 16;
+    Shard m_Shards[kNumShards];
+};
@@ -20,6 +20,7 @@
 #include <assert.h>
 #include <math.h>
 #include <algorithm>
+#include <vector>
 
 #include "IndexOptimizePostTransform.h"
 
@@ -222,21 +223,20 @@ struct FaceValenceSort
 template <typename IndexType>
 void OptimizeFaces(const IndexType* indexList, uint32_t indexCount, IndexType* newIndexList, uint16_t lruCacheSize)
 {
-    OptimizeVertexData<IndexType> *vertexDataList = new OptimizeVertexData<IndexType> [indexCount]; // upper bounds on size is indexCount
-    IndexType *vertexRemap = new IndexType [indexCount];
-    uint32_t *activeFaceList = new uint32_t [indexCount];
+    std::vector<OptimizeVertexData<IndexType>> vertexDataList(indexCount); // upper bounds on size is indexCount
+    std::vector<IndexType> vertexRemap(indexCount);
+    std::vector<uint32_t> activeFaceList(indexCount);
 
     uint32_t faceCount = indexCount / 3;
-    uint8_t *processedFaceList = new uint8_t [faceCount];
-    memset(processedFaceList, 0, sizeof(uint8_t) * faceCount);
-    unsigned int *faceSorted = new unsigned int [faceCount];
-    unsigned int *faceReverseLookup = new unsigned int [faceCount];
+    std::vector<uint8_t> processedFaceList(faceCount, 0);
+    std::vector<unsigned int> faceSorted(faceCount);
+    std::vector<unsigned int> faceReverseLookup(faceCount);
 
     // build the vertex remap table
     unsigned int uniqueVertexCount = 0;
     {
         typedef IndexSortCompareIndexed<unsigned int, IndexType> indexSorter;
-        unsigned int *indexSorted = new unsigned int [indexCount];
+        std::vector<unsigned int> indexSorted(indexCount);
 
         for (unsigned int i = 0; i < indexCount; i++)
         {
@@ -244,7 +244,7 @@ void OptimizeFaces(const IndexType* indexList, uint32_t indexCount, IndexType* n
         }
 
         indexSorter sortFunc(indexList);
-        std::sort(indexSorted, indexSorted + indexCount, sortFunc);
+        std::sort(indexSorted.begin(), indexSorted.end(), sortFunc);
 
         for (unsigned int i = 0; i < indexCount; i++)
         {
@@ -260,8 +260,6 @@ void OptimizeFaces(const IndexType* indexList, uint32_t indexCount, IndexType* n
                 vertexRemap[indexSorted[i]] = vertexRemap[indexSorted[i - 1]];
             }
         }
-
-        delete [] indexSorted;
     }
 
     // compute face count per vertex
@@ -293,8 +291,8 @@ void OptimizeFaces(const IndexType* indexList, uint32_t indexCount, IndexType* n
     {
         faceSorted[f] = f;
     }
-    FaceValenceSort<unsigned int, IndexType> faceValenceSort(vertexDataList);
-    std::sort(faceSorted, faceSorted + faceCount, faceValenceSort);
+    FaceValenceSort<unsigned int, IndexType> faceValenceSort(vertexDataList.data());
+    std::sort(faceSorted.begin(), faceSorted.end(), faceValenceSort);
     for (uint32_t f = 0; f < faceCount; f++)
     {
         faceReverseLookup[faceSorted[f]] = f;
@@ -378,8 +376,8 @@ void OptimizeFaces(const IndexType* indexList, uint32_t indexCount, IndexType* n
             }
 
             assert(vertexData.activeFaceListSize > 0);
-            uint32_t* begin = activeFaceList + vertexData.activeFaceListStart;
-            uint32_t* end = activeFaceList + (vertexData.activeFaceListStart + vertexData.activeFaceListSize);
+            uint32_t* begin = activeFaceList.data() + vertexData.activeFaceListStart;
+            uint32_t* end = activeFaceList.data() + (vertexData.activeFaceListStart + vertexData.activeFaceListSize);
             uint32_t* it = std::find(begin, end, bestFace);
             assert(it != end);
             std::swap(*it, *(end-1));
@@ -453,11 +451,331 @@ void OptimizeFaces(const IndexType* indexList, uint32_t indexCount, IndexType* n
         std::swap(cache0, cache1);
         entriesInCache0 = std::min(entriesInCache1, lruCacheSize);
     }
+}
+
+namespace
+{
+    // FIFO post-transform cache simulation. A vertex is resident while fewer than cacheSize misses have happened
+    // since it was loaded; flushing the cache is done by advancing time by cacheSize + 1.
+    template <typename IndexType>
+    uint32_t SimulateFifoCache(const IndexType* face, uint32_t cacheSize, uint32_t* timestamps, uint32_t& time)
+    {
+        uint32_t misses = 0;
+        for (uint32_t k = 0; k < 3; ++k)
+        {
+            IndexType index = face[k];
+            if (time - timestamps[index] > cacheSize)
+            {
+                timestamps[index] = time++;
+                misses++;
+            }
+        }
+        return misses;
+    }
+
+    const uint32_t kInvalidVertex = ~0u;
+}
+
+template <typename IndexType>
+void OptimizeFacesTipsify(const IndexType* indexList, uint32_t indexCount, uint32_t vertexCount, IndexType* newIndexList, uint16_t cacheSize)
+{
+    uint32_t faceCount = indexCount / 3;
+
+    // number of faces that still need each vertex
+    std::vector<uint32_t> liveFaceCount(vertexCount, 0);
+    for (uint32_t i = 0; i < faceCount * 3; ++i)
+    {
+        liveFaceCount[indexList[i]]++;
+    }
+
+    // vertex to face adjacency, stored as one list with a start offset per vertex
+    std::vector<uint32_t> adjacencyStart(vertexCount + 1);
+    adjacencyStart[0] = 0;
+    for (uint32_t v = 0; v < vertexCount; ++v)
+    {
+        adjacencyStart[v + 1] = adjacencyStart[v] + liveFaceCount[v];
+    }
+
+    std::vector<uint32_t> adjacency(faceCount * 3);
+    {
+        std::vector<uint32_t> adjacencyFill(adjacencyStart.begin(), adjacencyStart.end() - 1);
+        for (uint32_t i = 0; i < faceCount * 3; ++i)
+        {
+            adjacency[adjacencyFill[indexList[i]]++] = i / 3;
+        }
+    }
+
+    std::vector<uint32_t> timestamps(vertexCount, 0);
+    std::vector<uint8_t> emittedFaceList(faceCount, 0);
+    std::vector<uint32_t> deadEndStack;
+    std::vector<uint32_t> candidates;
+    deadEndStack.reserve(faceCount * 3);
+
+    uint32_t time = cacheSize + 1;
+    uint32_t nextUnprocessedVertex = 0;
+    uint32_t outputCount = 0;
+
+    uint32_t fanVertex = faceCount > 0 ? indexList[0] : kInvalidVertex;
+    while (fanVertex != kInvalidVertex)
+    {
+        // emit all remaining faces around the fan vertex
+        candidates.clear();
+        for (uint32_t a = adjacencyStart[fanVertex]; a < adjacencyStart[fanVertex + 1]; ++a)
+        {
+            uint32_t face = adjacency[a];
+            if (emittedFaceList[face])
+                continue;
+
+            emittedFaceList[face] = 1;
+            for (uint32_t k = 0; k < 3; ++k)
+            {
+                IndexType index = indexList[face * 3 + k];
+                newIndexList[outputCount++] = index;
+
+                deadEndStack.push_back(index);
+                candidates.push_back(index);
+                liveFaceCount[index]--;
+
+                if (time - timestamps[index] > cacheSize)
+                {
+                    timestamps[index] = time++;
+                }
+            }
+        }
+
+        // continue with the oldest candidate that will still be in the cache after its remaining faces are emitted
+        fanVertex = kInvalidVertex;
+        int bestPriority = -1;
+        for (uint32_t candidate : candidates)
+        {
+            if (liveFaceCount[candidate] == 0)
+                continue;
+
+            int priority = 0;
+            uint32_t age = time - timestamps[candidate];
+            if (age + 2 * liveFaceCount[candidate] <= cacheSize)
+            {
+                priority = (int)age;
+            }
+
+            if (priority > bestPriority)
+            {
+                bestPriority = priority;
+                fanVertex = candidate;
+            }
+        }
+
+        // dead end - back track through recently used vertices, then fall back to a linear scan
+        while (fanVertex == kInvalidVertex && !deadEndStack.empty())
+        {
+            uint32_t vertex = deadEndStack.back();
+            deadEndStack.pop_back();
+            if (liveFaceCount[vertex] > 0)
+            {
+                fanVertex = vertex;
+            }
+        }
+
+        for (; fanVertex == kInvalidVertex && nextUnprocessedVertex < vertexCount; ++nextUnprocessedVertex)
+        {
+            if (liveFaceCount[nextUnprocessedVertex] > 0)
+            {
+                fanVertex = nextUnprocessedVertex;
+            }
+        }
+    }
+
+    assert(outputCount == faceCount * 3);
+}
+
+template <typename IndexType>
+void OptimizeOverdraw(const IndexType* indexList, uint32_t indexCount, uint32_t vertexCount, const float* positions, uint32_t positionStride,
+    IndexType* newIndexList, uint16_t cacheSize, float threshold)
+{
+    uint32_t faceCount = indexCount / 3;
+    if (faceCount == 0)
+        return;
+
+    std::vector<uint32_t> timestamps(vertexCount, 0);
+    uint32_t time = cacheSize + 1;
+
+    // hard boundaries - a face that misses on all three vertices starts a new patch of the mesh
+    std::vector<uint32_t> runStart;
+    for (uint32_t f = 0; f < faceCount; ++f)
+    {
+        uint32_t misses = SimulateFifoCache(indexList + f * 3, cacheSize, timestamps.data(), time);
+        if (f == 0 || misses == 3)
+        {
+            runStart.push_back(f);
+        }
+    }
+    runStart.push_back(faceCount);
+
+    // soft boundaries - split each run as soon as the faces since the last split reach threshold times its ACMR
+    std::vector<uint32_t> clusterStart;
+    for (size_t r = 0; r + 1 < runStart.size(); ++r)
+    {
+        uint32_t start = runStart[r];
+        uint32_t end = runStart[r + 1];
+
+        time += cacheSize + 1;
+        uint32_t runMisses = 0;
+        for (uint32_t f = start; f < end; ++f)
+        {
+            runMisses += SimulateFifoCache(indexList + f * 3, cacheSize, timestamps.data(), time);
+        }
+        float clusterThreshold = threshold * (float)runMisses / (float)(end - start);
+
+        clusterStart.push_back(start);
+        time += cacheSize + 1;
+        uint32_t clusterMisses = 0;
+        uint32_t clusterFaces = 0;
+        for (uint32_t f = start; f + 1 < end; ++f)
+        {
+            clusterMisses += SimulateFifoCache(indexList + f * 3, cacheSize, timestamps.data(), time);
+            clusterFaces++;
+
+            if ((float)clusterMisses <= clusterThreshold * (float)clusterFaces)
+            {
+                clusterStart.push_back(f + 1);
+                time += cacheSize + 1;
+                clusterMisses = 0;
+                clusterFaces = 0;
+            }
+        }
+    }
+    clusterStart.push_back(faceCount);
+
+    auto getPosition = [&](IndexType index) -> const float*
+    {
+        return (const float*)((const unsigned char*)positions + (size_t)index * positionStride);
+    };
+
+    float meshCentroid[3] = { 0.0f, 0.0f, 0.0f };
+    for (uint32_t i = 0; i < faceCount * 3; ++i)
+    {
+        const float* p = getPosition(indexList[i]);
+        meshCentroid[0] += p[0];
+        meshCentroid[1] += p[1];
+        meshCentroid[2] += p[2];
+    }
+    for (uint32_t k = 0; k < 3; ++k)
+    {
+        meshCentroid[k] /= (float)(faceCount * 3);
+    }
+
+    // sort key per cluster - how far its area weighted centroid lies in front of the mesh centroid along the
+    // cluster's average normal; clusters on the outside of the mesh are drawn first
+    uint32_t clusterCount = (uint32_t)clusterStart.size() - 1;
+    std::vector<float> clusterSortKey(clusterCount);
+    for (uint32_t c = 0; c < clusterCount; ++c)
+    {
+        float centroid[3] = { 0.0f, 0.0f, 0.0f };
+        float normal[3] = { 0.0f, 0.0f, 0.0f };
+        float area = 0.0f;
+
+        for (uint32_t f = clusterStart[c]; f < clusterStart[c + 1]; ++f)
+        {
+            const float* p0 = getPosition(indexList[f * 3 + 0]);
+            const float* p1 = getPosition(indexList[f * 3 + 1]);
+            const float* p2 = getPosition(indexList[f * 3 + 2]);
+
+            float e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+            float e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+            float n[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+            float faceArea = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+
+            for (uint32_t k = 0; k < 3; ++k)
+            {
+                centroid[k] += (p0[k] + p1[k] + p2[k]) * (faceArea / 3.0f);
+                normal[k] += n[k];
+            }
+            area += faceArea;
+        }
+
+        float normalLength = sqrtf(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+        if (area == 0.0f || normalLength == 0.0f)
+        {
+            clusterSortKey[c] = 0.0f;
+            continue;
+        }
+
+        float sortKey = 0.0f;
+        for (uint32_t k = 0; k < 3; ++k)
+        {
+            sortKey += (centroid[k] / area - meshCentroid[k]) * normal[k];
+        }
+        clusterSortKey[c] = sortKey / normalLength;
+    }
+
+    std::vector<uint32_t> clusterOrder(clusterCount);
+    for (uint32_t c = 0; c < clusterCount; ++c)
+    {
+        clusterOrder[c] = c;
+    }
+    std::stable_sort(clusterOrder.begin(), clusterOrder.end(),
+        [&](uint32_t a, uint32_t b) { return clusterSortKey[a] > clusterSortKey[b]; });
+
+    uint32_t outputCount = 0;
+    for (uint32_t c : clusterOrder)
+    {
+        for (uint32_t i = clusterStart[c] * 3; i < clusterStart[c + 1] * 3; ++i)
+        {
+            newIndexList[outputCount++] = indexList[i];
+        }
+    }
+    assert(outputCount == faceCount * 3);
+}
+
+template <typename IndexType>
+void OptimizePostTransformOrder(const PostTransformOptions& options, const IndexType* indexList, uint32_t indexCount, uint32_t vertexCount,
+    const float* positions, uint32_t positionStride, IndexType* newIndexList)
+{
+    switch (options.optimizer)
+    {
+    case post_transform_tipsify:
+        OptimizeFacesTipsify(indexList, indexCount, vertexCount, newIndexList, options.cacheSize);
+        break;
+
+    default:
+        // the LRU scores are precomputed for caches up to kMaxVertexCacheSize entries
+        OptimizeFaces(indexList, indexCount, newIndexList, std::min(options.cacheSize, (uint16_t)kMaxVertexCacheSize));
+        break;
+    }
+
+    if (options.overdrawThreshold > 0.0f && positions != nullptr)
+    {
+        std::vector<IndexType> cacheOptimizedIndexList(newIndexList, newIndexList + indexCount);
+        OptimizeOverdraw(cacheOptimizedIndexList.data(), indexCount, vertexCount, positions, positionStride,
+            newIndexList, options.cacheSize, std::max(options.overdrawThreshold, 1.0f));
+    }
+}
+
+template <typename IndexType>
+PostTransformCacheStats ComputePostTransformCacheStats(const IndexType* indexList, uint32_t indexCount, uint32_t vertexCount, uint16_t cacheSize)
+{
+    PostTransformCacheStats stats;
+
+    uint32_t faceCount = indexCount / 3;
+    if (faceCount == 0)
+        return stats;
+
+    std::vector<uint32_t> timestamps(vertexCount, 0);
+    uint32_t time = cacheSize + 1;
+    uint32_t misses = 0;
+    for (uint32_t f = 0; f < faceCount; ++f)
+    {
+        misses += SimulateFifoCache(indexList + f * 3, cacheSize, timestamps.data(), time);
+    }
+
+    uint32_t referencedVertexCount = 0;
+    for (uint32_t v = 0; v < vertexCount; ++v)
+    {
+        if (timestamps[v] != 0)
+            referencedVertexCount++;
+    }
 
-    delete [] vertexDataList;
-    delete [] vertexRemap;
-    delete [] activeFaceList;
-    delete [] processedFaceList;
-    delete [] faceSorted;
-    delete [] faceReverseLookup;
+    stats.acmr = (float)misses / (float)faceCount;
+    stats.atvr = (float)misses / (float)referencedVertexCount;
+    return stats;
 }
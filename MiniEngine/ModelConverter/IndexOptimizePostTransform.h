@@ -13,6 +13,8 @@
 
 #pragma once
 
+#include <stdint.h>
+
 //-----------------------------------------------------------------------------
 //  OptimizeFaces
 //-----------------------------------------------------------------------------
@@ -32,3 +34,117 @@ void OptimizeFaces(const IndexType* indexList, uint32_t indexCount, IndexType* n
 
 template void OptimizeFaces<uint16_t>(const uint16_t* indexList, uint32_t indexCount, uint16_t* newIndexList, uint16_t lruCacheSize);
 template void OptimizeFaces<uint32_t>(const uint32_t* indexList, uint32_t indexCount, uint32_t* newIndexList, uint16_t lruCacheSize);
+
+//-----------------------------------------------------------------------------
+//  OptimizeFacesTipsify
+//-----------------------------------------------------------------------------
+//  Linear-time vertex cache optimization from Sander, Nehab & Barczak,
+//  "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw".
+//  Targets a FIFO post-transform cache of any size.
+//
+//  Parameters:
+//      indexList
+//          input index list
+//      indexCount
+//          the number of indices in the list
+//      vertexCount
+//          one more than the largest index value in indexList
+//      newIndexList
+//          a pointer to a preallocated buffer the same size as indexList to
+//          hold the optimized index list
+//      cacheSize
+//          the size of the simulated post-transform cache
+//-----------------------------------------------------------------------------
+template <typename IndexType>
+void OptimizeFacesTipsify(const IndexType* indexList, uint32_t indexCount, uint32_t vertexCount, IndexType* newIndexList, uint16_t cacheSize);
+
+template void OptimizeFacesTipsify<uint16_t>(const uint16_t* indexList, uint32_t indexCount, uint32_t vertexCount, uint16_t* newIndexList, uint16_t cacheSize);
+template void OptimizeFacesTipsify<uint32_t>(const uint32_t* indexList, uint32_t indexCount, uint32_t vertexCount, uint32_t* newIndexList, uint16_t cacheSize);
+
+//-----------------------------------------------------------------------------
+//  OptimizeOverdraw
+//-----------------------------------------------------------------------------
+//  Splits a cache-optimized index list into clusters and sorts the clusters
+//  so that outward facing ones are drawn first, reducing overdraw. Clusters
+//  are cut wherever their ACMR stays within threshold times the ACMR of the
+//  surrounding cache-optimized run; 1.0 only reorders existing runs, larger
+//  values trade vertex cache efficiency for finer grained sorting.
+//
+//  Parameters:
+//      indexList
+//          input index list, already optimized for the post-transform cache
+//      indexCount
+//          the number of indices in the list
+//      vertexCount
+//          one more than the largest index value in indexList
+//      positions
+//          a pointer to the position (3 floats) of the first vertex
+//      positionStride
+//          the distance in bytes between consecutive positions
+//      newIndexList
+//          a pointer to a preallocated buffer the same size as indexList to
+//          hold the reordered index list
+//      cacheSize
+//          the size of the simulated post-transform cache
+//      threshold
+//          the ACMR ratio allowed when splitting clusters (>= 1.0)
+//-----------------------------------------------------------------------------
+template <typename IndexType>
+void OptimizeOverdraw(const IndexType* indexList, uint32_t indexCount, uint32_t vertexCount, const float* positions, uint32_t positionStride,
+    IndexType* newIndexList, uint16_t cacheSize, float threshold);
+
+template void OptimizeOverdraw<uint16_t>(const uint16_t* indexList, uint32_t indexCount, uint32_t vertexCount, const float* positions, uint32_t positionStride,
+    uint16_t* newIndexList, uint16_t cacheSize, float threshold);
+template void OptimizeOverdraw<uint32_t>(const uint32_t* indexList, uint32_t indexCount, uint32_t vertexCount, const float* positions, uint32_t positionStride,
+    uint32_t* newIndexList, uint16_t cacheSize, float threshold);
+
+//-----------------------------------------------------------------------------
+//  OptimizePostTransformOrder
+//-----------------------------------------------------------------------------
+//  Reorders faces with the optimizer selected in options, followed by the
+//  overdraw pass when options.overdrawThreshold is non-zero and positions
+//  are available.
+//-----------------------------------------------------------------------------
+enum PostTransformOptimizer
+{
+    post_transform_lru,         // Forsyth, scored against an LRU cache (max size 64)
+    post_transform_tipsify,     // Sander et al., linear time, FIFO cache
+
+    post_transform_optimizers,
+};
+
+struct PostTransformOptions
+{
+    PostTransformOptimizer optimizer = post_transform_lru;
+    uint16_t cacheSize = 64;
+    float overdrawThreshold = 0.0f; // 0 disables the overdraw pass
+};
+
+template <typename IndexType>
+void OptimizePostTransformOrder(const PostTransformOptions& options, const IndexType* indexList, uint32_t indexCount, uint32_t vertexCount,
+    const float* positions, uint32_t positionStride, IndexType* newIndexList);
+
+template void OptimizePostTransformOrder<uint16_t>(const PostTransformOptions& options, const uint16_t* indexList, uint32_t indexCount, uint32_t vertexCount,
+    const float* positions, uint32_t positionStride, uint16_t* newIndexList);
+template void OptimizePostTransformOrder<uint32_t>(const PostTransformOptions& options, const uint32_t* indexList, uint32_t indexCount, uint32_t vertexCount,
+    const float* positions, uint32_t positionStride, uint32_t* newIndexList);
+
+//-----------------------------------------------------------------------------
+//  ComputePostTransformCacheStats
+//-----------------------------------------------------------------------------
+//  Simulates a FIFO post-transform cache of cacheSize entries over the index
+//  list and returns the average cache miss ratio (transformed vertices per
+//  triangle) and the average transform to vertex ratio (transformed vertices
+//  per referenced vertex, 1.0 is ideal).
+//-----------------------------------------------------------------------------
+struct PostTransformCacheStats
+{
+    float acmr = 0.0f;
+    float atvr = 0.0f;
+};
+
+template <typename IndexType>
+PostTransformCacheStats ComputePostTransformCacheStats(const IndexType* indexList, uint32_t indexCount, uint32_t vertexCount, uint16_t cacheSize);
+
+template PostTransformCacheStats ComputePostTransformCacheStats<uint16_t>(const uint16_t* indexList, uint32_t indexCount, uint32_t vertexCount, uint16_t cacheSize);
+template PostTransformCacheStats ComputePostTransformCacheStats<uint32_t>(const uint32_t* indexList, uint32_t indexCount, uint32_t vertexCount, uint16_t cacheSize);
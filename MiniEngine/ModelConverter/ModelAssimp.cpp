@@ -17,6 +17,121 @@
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
 
+#include <stdio.h>
+#include <algorithm>
+#include <vector>
+
+namespace
+{
+    // max vertices per mesh, keeps indices below the primitive restart index
+    const uint32_t kMaxMeshVertices = 0xfffe;
+
+    // A piece of an imported mesh small enough for 16-bit indices. vertices maps each vertex of the piece to the
+    // source mesh, indices reference the piece's own vertices.
+    struct MeshPart
+    {
+        const aiMesh *srcMesh;
+        std::vector<uint32_t> vertices;
+        std::vector<uint16_t> indices;
+    };
+
+    uint32_t SpreadBits10(uint32_t x)
+    {
+        x &= 0x3ff;
+        x = (x | (x << 16)) & 0x030000ff;
+        x = (x | (x << 8)) & 0x0300f00f;
+        x = (x | (x << 4)) & 0x030c30c3;
+        x = (x | (x << 2)) & 0x09249249;
+        return x;
+    }
+
+    // Splits srcMesh into parts of at most kMaxMeshVertices vertices. Faces are visited along a Morton curve through
+    // the mesh bounds so every part covers a compact region, and each part is cache optimized on its own afterwards;
+    // only vertices on the seams between parts are duplicated.
+    void SplitMesh(const aiMesh *srcMesh, std::vector<MeshPart> &parts)
+    {
+        const unsigned int faceCount = srcMesh->mNumFaces;
+        std::vector<uint32_t> faceOrder(faceCount);
+        for (unsigned int f = 0; f < faceCount; f++)
+            faceOrder[f] = f;
+
+        if (srcMesh->mNumVertices > kMaxMeshVertices)
+        {
+            aiVector3D bboxMin = srcMesh->mVertices[0];
+            aiVector3D bboxMax = srcMesh->mVertices[0];
+            for (unsigned int v = 1; v < srcMesh->mNumVertices; v++)
+            {
+                const aiVector3D &p = srcMesh->mVertices[v];
+                bboxMin = aiVector3D(std::min(bboxMin.x, p.x), std::min(bboxMin.y, p.y), std::min(bboxMin.z, p.z));
+                bboxMax = aiVector3D(std::max(bboxMax.x, p.x), std::max(bboxMax.y, p.y), std::max(bboxMax.z, p.z));
+            }
+
+            aiVector3D extent = bboxMax - bboxMin;
+            float scale = 1023.0f / std::max(std::max(extent.x, extent.y), std::max(extent.z, 1e-20f));
+
+            std::vector<uint32_t> faceCode(faceCount);
+            for (unsigned int f = 0; f < faceCount; f++)
+            {
+                const unsigned int *indices = srcMesh->mFaces[f].mIndices;
+                aiVector3D centroid = (srcMesh->mVertices[indices[0]] + srcMesh->mVertices[indices[1]] + srcMesh->mVertices[indices[2]]) / 3.0f;
+                aiVector3D cell = (centroid - bboxMin) * scale;
+
+                faceCode[f] = SpreadBits10((uint32_t)cell.x) | (SpreadBits10((uint32_t)cell.y) << 1) | (SpreadBits10((uint32_t)cell.z) << 2);
+            }
+
+            std::stable_sort(faceOrder.begin(), faceOrder.end(),
+                [&faceCode](uint32_t a, uint32_t b) { return faceCode[a] < faceCode[b]; });
+        }
+
+        // vertexPart records which part a source vertex was last added to, vertexLocal its index in that part
+        std::vector<uint32_t> vertexPart(srcMesh->mNumVertices, ~0u);
+        std::vector<uint16_t> vertexLocal(srcMesh->mNumVertices);
+
+        size_t firstPart = parts.size();
+        for (unsigned int n = 0; n < faceCount; n++)
+        {
+            const unsigned int *indices = srcMesh->mFaces[faceOrder[n]].mIndices;
+            assert(srcMesh->mFaces[faceOrder[n]].mNumIndices == 3);
+
+            uint32_t partIndex = (uint32_t)parts.size() - 1;
+            uint32_t newVertices = 0;
+            if (parts.size() > firstPart)
+            {
+                for (unsigned int k = 0; k < 3; k++)
+                {
+                    if (vertexPart[indices[k]] != partIndex && (k < 1 || indices[k] != indices[0]) && (k < 2 || indices[k] != indices[1]))
+                        newVertices++;
+                }
+            }
+
+            if (parts.size() == firstPart || parts[partIndex].vertices.size() + newVertices > kMaxMeshVertices)
+            {
+                parts.push_back(MeshPart());
+                parts.back().srcMesh = srcMesh;
+                partIndex++;
+            }
+
+            MeshPart &part = parts[partIndex];
+            for (unsigned int k = 0; k < 3; k++)
+            {
+                uint32_t index = indices[k];
+                if (vertexPart[index] != partIndex)
+                {
+                    vertexPart[index] = partIndex;
+                    vertexLocal[index] = (uint16_t)part.vertices.size();
+                    part.vertices.push_back(index);
+                }
+                part.indices.push_back(vertexLocal[index]);
+            }
+        }
+
+        if (parts.size() - firstPart > 1)
+        {
+            printf("split mesh with %u vertices into %u meshes\n", srcMesh->mNumVertices, (uint32_t)(parts.size() - firstPart));
+        }
+    }
+}
+
 const char* AssimpModel::s_FormatString[] =
 {
     "none",
@@ -42,6 +157,8 @@ int AssimpModel::FormatFromFilename(const char *filename)
 bool AssimpModel::Load(const char *filename)
 {
     Clear();
+    m_CacheStats.clear();
+    m_CacheStatsDepth.clear();
 
     int format = FormatFromFilename(filename);
 
@@ -95,9 +212,8 @@ bool AssimpModel::LoadAssimp(const char *filename)
     importer.SetPropertyInteger(AI_CONFIG_PP_RVC_FLAGS, 
         aiComponent_COLORS | aiComponent_LIGHTS | aiComponent_CAMERAS);
 
-    // max triangles and vertices per mesh, splits above this threshold
-    importer.SetPropertyInteger(AI_CONFIG_PP_SLM_TRIANGLE_LIMIT, INT_MAX);
-    importer.SetPropertyInteger(AI_CONFIG_PP_SLM_VERTEX_LIMIT, 0xfffe); // avoid the primitive restart index
+    // meshes above the 16-bit index limit are split spatially by SplitMesh() instead of aiProcess_SplitLargeMeshes,
+    // which cuts them in face order
 
     // remove points and lines
     importer.SetPropertyInteger(AI_CONFIG_PP_SBP_REMOVE, aiPrimitiveType_POINT | aiPrimitiveType_LINE);
@@ -108,7 +224,6 @@ bool AssimpModel::LoadAssimp(const char *filename)
         aiProcess_Triangulate |
         aiProcess_RemoveComponent |
         aiProcess_GenSmoothNormals |
-        aiProcess_SplitLargeMeshes |
         aiProcess_ValidateDataStructure |
         //aiProcess_ImproveCacheLocality | // handled by optimizePostTransform()
         aiProcess_RemoveRedundantMaterials |
@@ -215,17 +330,23 @@ bool AssimpModel::LoadAssimp(const char *filename)
         strncpy_s(dstMat->name, matName.C_Str(), Material::maxMaterialName - 1);
     }
 
-    m_Header.meshCount = scene->mNumMeshes;
+    std::vector<MeshPart> parts;
+    for (unsigned int meshIndex = 0; meshIndex < scene->mNumMeshes; meshIndex++)
+    {
+        assert(scene->mMeshes[meshIndex]->mPrimitiveTypes == aiPrimitiveType_TRIANGLE);
+        SplitMesh(scene->mMeshes[meshIndex], parts);
+    }
+
+    m_Header.meshCount = (uint32_t)parts.size();
     m_pMesh = new Mesh [m_Header.meshCount];
     memset(m_pMesh, 0, sizeof(Mesh) * m_Header.meshCount);
     // first pass, count everything
-    for (unsigned int meshIndex = 0; meshIndex < scene->mNumMeshes; meshIndex++)
+    for (unsigned int meshIndex = 0; meshIndex < m_Header.meshCount; meshIndex++)
     {
-        const aiMesh *srcMesh = scene->mMeshes[meshIndex];
+        const MeshPart &part = parts[meshIndex];
+        const aiMesh *srcMesh = part.srcMesh;
         Mesh *dstMesh = m_pMesh + meshIndex;
 
-        assert(srcMesh->mPrimitiveTypes == aiPrimitiveType_TRIANGLE);
-
         dstMesh->materialIndex = srcMesh->mMaterialIndex;
 
         // just store everything as float. Can quantize in Model::optimize()
@@ -274,17 +395,17 @@ bool AssimpModel::LoadAssimp(const char *filename)
 
         // color rendering
         dstMesh->vertexDataByteOffset = m_Header.vertexDataByteSize;
-        dstMesh->vertexCount = srcMesh->mNumVertices;
+        dstMesh->vertexCount = (unsigned int)part.vertices.size();
 
         dstMesh->indexDataByteOffset = m_Header.indexDataByteSize;
-        dstMesh->indexCount = srcMesh->mNumFaces * 3;
+        dstMesh->indexCount = (unsigned int)part.indices.size();
 
         m_Header.vertexDataByteSize += dstMesh->vertexStride * dstMesh->vertexCount;
         m_Header.indexDataByteSize += sizeof(uint16_t) * dstMesh->indexCount;
 
         // depth-only rendering
         dstMesh->vertexDataByteOffsetDepth = m_Header.vertexDataByteSizeDepth;
-        dstMesh->vertexCountDepth = srcMesh->mNumVertices;
+        dstMesh->vertexCountDepth = (unsigned int)part.vertices.size();
 
         m_Header.vertexDataByteSizeDepth += dstMesh->vertexStrideDepth * dstMesh->vertexCountDepth;
     }
@@ -294,9 +415,10 @@ bool AssimpModel::LoadAssimp(const char *filename)
     m_pVertexDataDepth = new unsigned char [m_Header.vertexDataByteSizeDepth];
     m_pIndexDataDepth = new unsigned char [m_Header.indexDataByteSize];
     // second pass, fill in vertex and index data
-    for (unsigned int meshIndex = 0; meshIndex < scene->mNumMeshes; meshIndex++)
+    for (unsigned int meshIndex = 0; meshIndex < m_Header.meshCount; meshIndex++)
     {
-        const aiMesh *srcMesh = scene->mMeshes[meshIndex];
+        const MeshPart &part = parts[meshIndex];
+        const aiMesh *srcMesh = part.srcMesh;
         Mesh *dstMesh = m_pMesh + meshIndex;
 
         float *dstPos = (float*)(m_pVertexData + dstMesh->vertexDataByteOffset + dstMesh->attrib[attrib_position].offset);
@@ -309,15 +431,17 @@ bool AssimpModel::LoadAssimp(const char *filename)
 
         for (unsigned int v = 0; v < dstMesh->vertexCount; v++)
         {
+            unsigned int srcVertex = part.vertices[v];
+
             if (srcMesh->mVertices)
             {
-                dstPos[0] = srcMesh->mVertices[v].x;
-                dstPos[1] = srcMesh->mVertices[v].y;
-                dstPos[2] = srcMesh->mVertices[v].z;
+                dstPos[0] = srcMesh->mVertices[srcVertex].x;
+                dstPos[1] = srcMesh->mVertices[srcVertex].y;
+                dstPos[2] = srcMesh->mVertices[srcVertex].z;
 
-                dstPosDepth[0] = srcMesh->mVertices[v].x;
-                dstPosDepth[1] = srcMesh->mVertices[v].y;
-                dstPosDepth[2] = srcMesh->mVertices[v].z;
+                dstPosDepth[0] = srcMesh->mVertices[srcVertex].x;
+                dstPosDepth[1] = srcMesh->mVertices[srcVertex].y;
+                dstPosDepth[2] = srcMesh->mVertices[srcVertex].z;
             }
             else
             {
@@ -329,8 +453,8 @@ bool AssimpModel::LoadAssimp(const char *filename)
 
             if (srcMesh->mTextureCoords[0])
             {
-                dstTexcoord0[0] = srcMesh->mTextureCoords[0][v].x;
-                dstTexcoord0[1] = srcMesh->mTextureCoords[0][v].y;
+                dstTexcoord0[0] = srcMesh->mTextureCoords[0][srcVertex].x;
+                dstTexcoord0[1] = srcMesh->mTextureCoords[0][srcVertex].y;
             }
             else
             {
@@ -341,9 +465,9 @@ bool AssimpModel::LoadAssimp(const char *filename)
 
             if (srcMesh->mNormals)
             {
-                dstNormal[0] = srcMesh->mNormals[v].x;
-                dstNormal[1] = srcMesh->mNormals[v].y;
-                dstNormal[2] = srcMesh->mNormals[v].z;
+                dstNormal[0] = srcMesh->mNormals[srcVertex].x;
+                dstNormal[1] = srcMesh->mNormals[srcVertex].y;
+                dstNormal[2] = srcMesh->mNormals[srcVertex].z;
             }
             else
             {
@@ -355,9 +479,9 @@ bool AssimpModel::LoadAssimp(const char *filename)
 
             if (srcMesh->mTangents)
             {
-                dstTangent[0] = srcMesh->mTangents[v].x;
-                dstTangent[1] = srcMesh->mTangents[v].y;
-                dstTangent[2] = srcMesh->mTangents[v].z;
+                dstTangent[0] = srcMesh->mTangents[srcVertex].x;
+                dstTangent[1] = srcMesh->mTangents[srcVertex].y;
+                dstTangent[2] = srcMesh->mTangents[srcVertex].z;
             }
             else
             {
@@ -370,9 +494,9 @@ bool AssimpModel::LoadAssimp(const char *filename)
 
             if (srcMesh->mBitangents)
             {
-                dstBitangent[0] = srcMesh->mBitangents[v].x;
-                dstBitangent[1] = srcMesh->mBitangents[v].y;
-                dstBitangent[2] = srcMesh->mBitangents[v].z;
+                dstBitangent[0] = srcMesh->mBitangents[srcVertex].x;
+                dstBitangent[1] = srcMesh->mBitangents[srcVertex].y;
+                dstBitangent[2] = srcMesh->mBitangents[srcVertex].z;
             }
             else
             {
@@ -386,18 +510,8 @@ bool AssimpModel::LoadAssimp(const char *filename)
 
         uint16_t *dstIndex = (uint16_t*)(m_pIndexData + dstMesh->indexDataByteOffset);
         uint16_t *dstIndexDepth = (uint16_t*)(m_pIndexDataDepth + dstMesh->indexDataByteOffset);
-        for (unsigned int f = 0; f < srcMesh->mNumFaces; f++)
-        {
-            assert(srcMesh->mFaces[f].mNumIndices == 3);
-
-            *dstIndex++ = srcMesh->mFaces[f].mIndices[0];
-            *dstIndex++ = srcMesh->mFaces[f].mIndices[1];
-            *dstIndex++ = srcMesh->mFaces[f].mIndices[2];
-
-            *dstIndexDepth++ = srcMesh->mFaces[f].mIndices[0];
-            *dstIndexDepth++ = srcMesh->mFaces[f].mIndices[1];
-            *dstIndexDepth++ = srcMesh->mFaces[f].mIndices[2];
-        }
+        memcpy(dstIndex, part.indices.data(), sizeof(uint16_t) * dstMesh->indexCount);
+        memcpy(dstIndexDepth, part.indices.data(), sizeof(uint16_t) * dstMesh->indexCount);
     }
 
     ComputeAllBoundingBoxes();
@@ -12,6 +12,9 @@
 #pragma once
 
 #include "Model.h"
+#include "IndexOptimizePostTransform.h"
+
+#include <vector>
 
 class AssimpModel : public Model
 {
@@ -30,6 +33,18 @@ public:
     virtual bool Load(const char* filename) override;
     bool Save(const char* filename) const;
 
+    // post-transform cache optimizer used by Optimize(), set before Load()
+    PostTransformOptions m_PostTransformOptions;
+
+    // vertex cache efficiency of each mesh before and after OptimizePostTransform
+    struct MeshCacheStats
+    {
+        PostTransformCacheStats before;
+        PostTransformCacheStats after;
+    };
+    std::vector<MeshCacheStats> m_CacheStats;
+    std::vector<MeshCacheStats> m_CacheStatsDepth;
+
 private:
 
     bool LoadAssimp(const char *filename);
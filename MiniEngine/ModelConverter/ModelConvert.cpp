@@ -14,17 +14,37 @@
 #include "ModelAssimp.h"
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 void PrintHelp()
 {
     printf("model_convert\n");
 
     printf("usage:\n");
-    printf("model_convert input_file output_file\n");
+    printf("model_convert [options] input_file output_file\n");
+    printf("options:\n");
+    printf("  -vcache lru|tipsify   post-transform cache optimizer (default lru)\n");
+    printf("  -vcachesize n         simulated post-transform cache size, 3-64 for lru (default 64)\n");
+    printf("  -overdraw threshold   reorder clusters of faces to reduce overdraw, allowing the ACMR of\n");
+    printf("                        each cluster to grow by this factor, e.g. 1.05 (default off)\n");
 }
 
-void PrintModelStats(const Model *model)
+void PrintCacheStats(const char *name, const AssimpModel::MeshCacheStats &stats)
 {
+    printf("%s: acmr %.3f -> %.3f, atvr %.3f -> %.3f\n", name
+        , stats.before.acmr, stats.after.acmr, stats.before.atvr, stats.after.atvr);
+}
+
+void PrintModelStats(const AssimpModel *model)
+{
+    static const char *s_PostTransformOptimizerString[] =
+    {
+        "lru",
+        "tipsify",
+    };
+    static_assert(_countof(s_PostTransformOptimizerString) == post_transform_optimizers, "s_PostTransformOptimizerString doesn't match optimizer enum");
+
     printf("model stats:\n");
     
     Model::BoundingBox bbox = model->GetBoundingBox();
@@ -35,6 +55,9 @@ void PrintModelStats(const Model *model)
     printf("vertex data size: %u\n", model->m_Header.vertexDataByteSize);
     printf("index data size: %u\n", model->m_Header.indexDataByteSize);
     printf("vertex data size depth-only: %u\n", model->m_Header.vertexDataByteSizeDepth);
+    printf("post-transform optimizer: %s, cache size %u, overdraw threshold %.2f\n"
+        , s_PostTransformOptimizerString[model->m_PostTransformOptions.optimizer]
+        , model->m_PostTransformOptions.cacheSize, model->m_PostTransformOptions.overdrawThreshold);
     printf("\n");
 
     printf("mesh count: %u\n", model->m_Header.meshCount);
@@ -71,6 +94,8 @@ void PrintModelStats(const Model *model)
         printf("mesh %u\n", meshIndex);
         printf("vertices: %u\n", mesh->vertexCount);
         printf("indices: %u\n", mesh->indexCount);
+        if (meshIndex < model->m_CacheStats.size())
+            PrintCacheStats("vertex cache", model->m_CacheStats[meshIndex]);
         printf("vertex stride: %u\n", mesh->vertexStride);
         for (int n = 0; n < Model::maxAttribs; n++)
         {
@@ -85,6 +110,8 @@ void PrintModelStats(const Model *model)
         }
 
         printf("vertices depth-only: %u\n", mesh->vertexCountDepth);
+        if (meshIndex < model->m_CacheStatsDepth.size())
+            PrintCacheStats("vertex cache depth-only", model->m_CacheStatsDepth[meshIndex]);
         printf("vertex stride depth-only: %u\n", mesh->vertexStrideDepth);
         for (int n = 0; n < Model::maxAttribs; n++)
         {
@@ -112,20 +139,65 @@ void PrintModelStats(const Model *model)
 
 int main(int argc, char **argv)
 {
-    if (argc != 3)
+    AssimpModel model;
+
+    int argIndex = 1;
+    for (; argIndex < argc && argv[argIndex][0] == '-'; argIndex++)
+    {
+        const char *option = argv[argIndex];
+        const char *value = argIndex + 1 < argc ? argv[argIndex + 1] : nullptr;
+        if (value == nullptr)
+        {
+            PrintHelp();
+            return -1;
+        }
+
+        if (_stricmp(option, "-vcache") == 0)
+        {
+            if (_stricmp(value, "lru") == 0)
+                model.m_PostTransformOptions.optimizer = post_transform_lru;
+            else if (_stricmp(value, "tipsify") == 0)
+                model.m_PostTransformOptions.optimizer = post_transform_tipsify;
+            else
+            {
+                printf("unknown post-transform optimizer: %s\n", value);
+                return -1;
+            }
+        }
+        else if (_stricmp(option, "-vcachesize") == 0)
+        {
+            int cacheSize = atoi(value);
+            if (cacheSize < 3 || cacheSize > 0xffff)
+            {
+                printf("invalid vertex cache size: %s\n", value);
+                return -1;
+            }
+            model.m_PostTransformOptions.cacheSize = (uint16_t)cacheSize;
+        }
+        else if (_stricmp(option, "-overdraw") == 0)
+        {
+            model.m_PostTransformOptions.overdrawThreshold = (float)atof(value);
+        }
+        else
+        {
+            PrintHelp();
+            return -1;
+        }
+        argIndex++;
+    }
+
+    if (argc - argIndex != 2)
     {
         PrintHelp();
         return -1;
     }
 
-    const char *input_file = argv[1];
-    const char *output_file = argv[2];
+    const char *input_file = argv[argIndex];
+    const char *output_file = argv[argIndex + 1];
 
     printf("input file %s\n", input_file);
     printf("output file %s\n", output_file);
 
-    AssimpModel model;
-
     printf("loading...\n");
     if (!model.Load(input_file))
     {
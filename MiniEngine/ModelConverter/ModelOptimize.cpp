@@ -12,75 +12,146 @@
 //
 
 #include "ModelAssimp.h"
-#include "IndexOptimizePostTransform.h"
 
+#include <stdio.h>
 #include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
 
-void AssimpModel::OptimizeRemoveDuplicateVertices(bool depth)
+namespace
 {
-    unsigned char *deduplicatedVertexData = new unsigned char [depth ? m_Header.vertexDataByteSizeDepth : m_Header.vertexDataByteSize];
-    uint32_t deduplicatedVertexDataSize = 0;
-
-    for (unsigned int meshIndex = 0; meshIndex < m_Header.meshCount; meshIndex++)
+    // Runs func(meshIndex) for every mesh, spreading the meshes over the available hardware threads.
+    template <typename Func>
+    void ForEachMeshParallel(unsigned int meshCount, const Func& func)
     {
-        Mesh *mesh = m_pMesh + meshIndex;
-        unsigned int vertexStride = depth ? mesh->vertexStrideDepth : mesh->vertexStride;
-        unsigned char *meshVertexData = depth ? (m_pVertexDataDepth + mesh->vertexDataByteOffsetDepth) : (m_pVertexData + mesh->vertexDataByteOffset);
+        unsigned int threadCount = std::min(std::thread::hardware_concurrency(), meshCount);
+        if (threadCount <= 1)
+        {
+            for (unsigned int meshIndex = 0; meshIndex < meshCount; meshIndex++)
+                func(meshIndex);
+            return;
+        }
 
-        unsigned char *meshDeduplicatedVertexData = deduplicatedVertexData + deduplicatedVertexDataSize;
-        unsigned int deduplicatedCount = 0;
+        std::atomic<unsigned int> nextMesh(0);
+        auto worker = [&]()
+        {
+            for (unsigned int meshIndex = nextMesh++; meshIndex < meshCount; meshIndex = nextMesh++)
+                func(meshIndex);
+        };
 
-        unsigned int vertexCount = depth ? mesh->vertexCountDepth : mesh->vertexCount;
-        uint32_t *vertexRemap = new uint32_t [vertexCount];
-        memset(vertexRemap, (uint32_t)-1, sizeof(uint32_t) * vertexCount);
-        assert(vertexCount <= (uint32_t)-1);
+        std::vector<std::thread> threads;
+        for (unsigned int n = 1; n < threadCount; n++)
+            threads.emplace_back(worker);
 
-        for (unsigned int v1 = 0; v1 < vertexCount; v1++)
+        worker();
+
+        for (auto& thread : threads)
+            thread.join();
+    }
+
+    uint64_t HashVertex(const unsigned char *data, unsigned int size)
+    {
+        // FNV-1a
+        uint64_t hash = 14695981039346656037ull;
+        for (unsigned int n = 0; n < size; n++)
         {
-            if (vertexRemap[v1] != (uint32_t)-1)
-                continue; // this was already found to be a duplicate
+            hash ^= data[n];
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
 
-            const unsigned char *v1Data = meshVertexData + v1 * vertexStride;
+    // Welds bit-identical vertices. Unique vertices keep their first-occurrence order and are written to dst. Returns
+    // the unique vertex count; vertexRemap receives the new slot of every source vertex.
+    uint32_t WeldVertices(const unsigned char *src, unsigned int vertexCount, unsigned int vertexStride, unsigned char *dst, uint32_t *vertexRemap)
+    {
+        // Open addressing table of first occurrences, at most half full
+        uint32_t tableSize = 1;
+        while (tableSize < vertexCount * 2)
+            tableSize <<= 1;
 
-            // this is a new unique vertex
-            uint32_t remappedSlot = deduplicatedCount++;
-            vertexRemap[v1] = remappedSlot;
-            memcpy(meshDeduplicatedVertexData + remappedSlot * vertexStride, v1Data, vertexStride);
+        std::vector<uint32_t> table(tableSize, (uint32_t)-1);
+        uint32_t deduplicatedCount = 0;
 
-            // scan for duplicates
-            for (unsigned int v2 = v1 + 1; v2 < vertexCount; v2++)
-            {
-                if (vertexRemap[v2] != (uint32_t)-1)
-                    continue; // this was already found to be a duplicate of another vertex
+        for (unsigned int v = 0; v < vertexCount; v++)
+        {
+            const unsigned char *vData = src + v * vertexStride;
 
-                const unsigned char *v2Data = meshVertexData + v2 * vertexStride;
+            uint32_t slot = (uint32_t)HashVertex(vData, vertexStride) & (tableSize - 1);
+            for (;;)
+            {
+                uint32_t first = table[slot];
+                if (first == (uint32_t)-1)
+                {
+                    // this is a new unique vertex
+                    table[slot] = v;
+                    vertexRemap[v] = deduplicatedCount;
+                    memcpy(dst + deduplicatedCount * vertexStride, vData, vertexStride);
+                    deduplicatedCount++;
+                    break;
+                }
 
-                if (0 == memcmp(v1Data, v2Data, vertexStride))
+                if (0 == memcmp(src + first * vertexStride, vData, vertexStride))
                 {
-                    vertexRemap[v2] = remappedSlot;
+                    vertexRemap[v] = vertexRemap[first];
+                    break;
                 }
+
+                slot = (slot + 1) & (tableSize - 1);
             }
         }
 
+        return deduplicatedCount;
+    }
+}
+
+void AssimpModel::OptimizeRemoveDuplicateVertices(bool depth)
+{
+    unsigned char *vertexData = depth ? m_pVertexDataDepth : m_pVertexData;
+    unsigned char *deduplicatedVertexData = new unsigned char [depth ? m_Header.vertexDataByteSizeDepth : m_Header.vertexDataByteSize];
+    std::vector<uint32_t> deduplicatedCounts(m_Header.meshCount);
+
+    // Weld each mesh into its original location in the new buffer - a mesh never grows, so meshes can't overlap
+    ForEachMeshParallel(m_Header.meshCount, [&](unsigned int meshIndex)
+    {
+        Mesh *mesh = m_pMesh + meshIndex;
+        unsigned int vertexStride = depth ? mesh->vertexStrideDepth : mesh->vertexStride;
+        unsigned int vertexDataByteOffset = depth ? mesh->vertexDataByteOffsetDepth : mesh->vertexDataByteOffset;
+        unsigned int vertexCount = depth ? mesh->vertexCountDepth : mesh->vertexCount;
+
+        std::vector<uint32_t> vertexRemap(vertexCount);
+        deduplicatedCounts[meshIndex] = WeldVertices(vertexData + vertexDataByteOffset, vertexCount, vertexStride,
+            deduplicatedVertexData + vertexDataByteOffset, vertexRemap.data());
+
         unsigned int indexCount = mesh->indexCount;
         uint16_t *indexArray = (uint16_t*)((depth ? m_pIndexDataDepth : m_pIndexData) + mesh->indexDataByteOffset);
         for (unsigned int n = 0; n < indexCount; n++)
         {
             indexArray[n] = vertexRemap[indexArray[n]];
         }
+    });
 
-        delete [] vertexRemap;
+    // Pack the welded meshes together, in order
+    uint32_t deduplicatedVertexDataSize = 0;
+
+    for (unsigned int meshIndex = 0; meshIndex < m_Header.meshCount; meshIndex++)
+    {
+        Mesh *mesh = m_pMesh + meshIndex;
+        unsigned int vertexStride = depth ? mesh->vertexStrideDepth : mesh->vertexStride;
+        unsigned int deduplicatedCount = deduplicatedCounts[meshIndex];
+        unsigned int& vertexDataByteOffset = depth ? mesh->vertexDataByteOffsetDepth : mesh->vertexDataByteOffset;
+
+        memmove(deduplicatedVertexData + deduplicatedVertexDataSize, deduplicatedVertexData + vertexDataByteOffset, deduplicatedCount * vertexStride);
 
         if (depth)
-        {
             mesh->vertexCountDepth = deduplicatedCount;
-            mesh->vertexDataByteOffsetDepth = deduplicatedVertexDataSize;
-        }
         else
-        {
             mesh->vertexCount = deduplicatedCount;
-            mesh->vertexDataByteOffset = deduplicatedVertexDataSize;
-        }
+
+        vertexDataByteOffset = deduplicatedVertexDataSize;
         deduplicatedVertexDataSize += deduplicatedCount * vertexStride;
     }
 
@@ -100,20 +171,36 @@ void AssimpModel::OptimizeRemoveDuplicateVertices(bool depth)
 
 void AssimpModel::OptimizePostTransform(bool depth)
 {
-    enum {lruCacheSize = 64};
+    const PostTransformOptions& options = m_PostTransformOptions;
 
-    for (unsigned int meshIndex = 0; meshIndex < m_Header.meshCount; meshIndex++)
+    std::vector<MeshCacheStats>& cacheStats = depth ? m_CacheStatsDepth : m_CacheStats;
+    cacheStats.resize(m_Header.meshCount);
+
+    ForEachMeshParallel(m_Header.meshCount, [&](unsigned int meshIndex)
     {
         Mesh *mesh = m_pMesh + meshIndex;
+        unsigned int vertexCount = depth ? mesh->vertexCountDepth : mesh->vertexCount;
+
+        // positions are only needed by the overdraw pass
+        const Attrib& position = depth ? mesh->attribDepth[attrib_position] : mesh->attrib[attrib_position];
+        const float *positions = nullptr;
+        if (position.format == attrib_format_float && position.components >= 3)
+        {
+            positions = (const float*)(depth
+                ? (m_pVertexDataDepth + mesh->vertexDataByteOffsetDepth + position.offset)
+                : (m_pVertexData + mesh->vertexDataByteOffset + position.offset));
+        }
 
-        uint16_t *srcIndices = new uint16_t [mesh->indexCount];
         uint16_t *dstIndices = (uint16_t*)((depth ? m_pIndexDataDepth : m_pIndexData) + mesh->indexDataByteOffset);
-        memcpy(srcIndices, dstIndices, sizeof(uint16_t) * mesh->indexCount);
+        std::vector<uint16_t> srcIndices(dstIndices, dstIndices + mesh->indexCount);
 
-        OptimizeFaces<uint16_t>(srcIndices, mesh->indexCount, dstIndices, lruCacheSize);
+        cacheStats[meshIndex].before = ComputePostTransformCacheStats<uint16_t>(srcIndices.data(), mesh->indexCount, vertexCount, options.cacheSize);
 
-        delete [] srcIndices;
-    }
+        OptimizePostTransformOrder<uint16_t>(options, srcIndices.data(), mesh->indexCount, vertexCount,
+            positions, depth ? mesh->vertexStrideDepth : mesh->vertexStride, dstIndices);
+
+        cacheStats[meshIndex].after = ComputePostTransformCacheStats<uint16_t>(dstIndices, mesh->indexCount, vertexCount, options.cacheSize);
+    });
 }
 
 void AssimpModel::OptimizePreTransform(bool depth)
@@ -171,9 +258,25 @@ void AssimpModel::Optimize()
 {
     // TODO: quantize/compress vertex data
 
+    auto countVertices = [this](bool depth) -> uint64_t
+    {
+        uint64_t count = 0;
+        for (unsigned int meshIndex = 0; meshIndex < m_Header.meshCount; meshIndex++)
+            count += depth ? m_pMesh[meshIndex].vertexCountDepth : m_pMesh[meshIndex].vertexCount;
+        return count;
+    };
+
+    uint64_t vertexCount = countVertices(false);
+    uint64_t vertexCountDepth = countVertices(true);
+    auto start = std::chrono::high_resolution_clock::now();
+
     OptimizeRemoveDuplicateVertices(false);
     OptimizeRemoveDuplicateVertices(true);
 
+    double elapsedMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    printf("remove duplicate vertices: %llu -> %llu vertices, %llu -> %llu depth-only vertices, %.2f ms\n"
+        , vertexCount, countVertices(false), vertexCountDepth, countVertices(true), elapsedMs);
+
     // re-order indices for post transform cache
     OptimizePostTransform(false);
     OptimizePostTransform(true);
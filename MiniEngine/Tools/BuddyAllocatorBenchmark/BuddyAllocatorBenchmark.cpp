@@ -0,0 +1,310 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+// Checks that Core/BuddyBlockAllocator hands out the same blocks as the std::set free lists that BuddyAllocator
+// used before, then measures how long each takes to allocate and free a block with the pool at different
+// levels of use.  Only the block logic is run, so no GPU is needed.
+//
+
+#include "BuddyBlockAllocator.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <set>
+#include <utility>
+#include <vector>
+
+namespace
+{
+    // The free lists of BuddyAllocator before the bitmaps: a std::set of offsets per order, with blocks split
+    // and merged recursively
+    class SetBuddyBlocks
+    {
+    public:
+
+        void Reset( uint32_t MaxOrder )
+        {
+            m_MaxOrder = MaxOrder;
+            m_FreeBlocks.assign(MaxOrder + 1, std::set<size_t>());
+            m_FreeBlocks[MaxOrder].insert(0);
+        }
+
+        size_t AllocateBlock( uint32_t Order )
+        {
+            if (Order > m_MaxOrder)
+                throw(std::bad_alloc());
+
+            auto Iter = m_FreeBlocks[Order].begin();
+            if (Iter == m_FreeBlocks[Order].end())
+            {
+                // Split a higher-order block and keep the right half free
+                const size_t Left = AllocateBlock(Order + 1);
+                m_FreeBlocks[Order].insert(Left + ((size_t)1 << Order));
+                return Left;
+            }
+
+            const size_t Offset = *Iter;
+            m_FreeBlocks[Order].erase(Iter);
+            return Offset;
+        }
+
+        void DeallocateBlock( size_t Offset, uint32_t Order )
+        {
+            const size_t Buddy = Offset ^ ((size_t)1 << Order);
+
+            auto Iter = m_FreeBlocks[Order].find(Buddy);
+            if (Iter != m_FreeBlocks[Order].end())
+            {
+                DeallocateBlock(std::min(Offset, Buddy), Order + 1);
+                m_FreeBlocks[Order].erase(Iter);
+            }
+            else
+                m_FreeBlocks[Order].insert(Offset);
+        }
+
+        size_t GetNumFreeBlocks( uint32_t Order ) const { return m_FreeBlocks[Order].size(); }
+
+    private:
+        std::vector<std::set<size_t>> m_FreeBlocks;
+        uint32_t m_MaxOrder;
+    };
+
+    struct Block
+    {
+        size_t Offset;
+        uint32_t Order;
+    };
+
+    const size_t kFailed = ~(size_t)0;
+
+    uint32_t g_NumRuns = 5;
+    uint32_t g_NumCompareOps = 200000;
+    bool g_Failed = false;
+
+    inline uint32_t NextRandom( uint32_t& State )
+    {
+        State ^= State << 13;
+        State ^= State >> 17;
+        State ^= State << 5;
+        return State;
+    }
+
+    // Most buffers fit in the smallest block or two, so small orders are the most likely
+    inline uint32_t RandomOrder( uint32_t& State, uint32_t MaxOrder )
+    {
+        uint32_t Order = 0;
+        while (Order < MaxOrder && (NextRandom(State) & 1) != 0)
+            ++Order;
+        return Order;
+    }
+
+    inline uint32_t Log2Floor( size_t Value )
+    {
+        uint32_t Log2 = 0;
+        while ((Value >>= 1) != 0)
+            ++Log2;
+        return Log2;
+    }
+
+    template <typename Allocator>
+    size_t TryAllocate( Allocator& Blocks, uint32_t Order )
+    {
+        try
+        {
+            return Blocks.AllocateBlock(Order);
+        }
+        catch (std::bad_alloc&)
+        {
+            return kFailed;
+        }
+    }
+
+    void Check( bool Condition, const char* What, uint32_t MaxOrder, uint32_t Step )
+    {
+        if (!Condition)
+        {
+            if (!g_Failed)
+                fprintf(stderr, "FAILED: %s with max order %u at step %u\n", What, MaxOrder, Step);
+            g_Failed = true;
+        }
+    }
+
+    // Runs both allocators through the same random allocations and frees.  The pool alternates between
+    // filling up and draining so that both full and nearly empty pools are covered.
+    void Compare( uint32_t MaxOrder, uint32_t NumOps )
+    {
+        BuddyBlockAllocator Bitmaps;
+        SetBuddyBlocks Sets;
+        Bitmaps.Reset(MaxOrder);
+        Sets.Reset(MaxOrder);
+
+        // One larger than the pool, so that some requests can never fit
+        const uint32_t MaxRequestOrder = std::min(MaxOrder + 1, 8u);
+
+        std::vector<Block> Live;
+        uint32_t State = 0x9E3779B9u ^ MaxOrder;
+        uint32_t NumFailed = 0;
+
+        for (uint32_t Step = 0; Step < NumOps && !g_Failed; ++Step)
+        {
+            const bool Filling = (Step / 10000) % 2 == 0;
+            if (Live.empty() || NextRandom(State) % 10 < (Filling ? 7u : 3u))
+            {
+                const uint32_t Order = RandomOrder(State, MaxRequestOrder);
+                const size_t Offset = TryAllocate(Bitmaps, Order);
+                Check(Offset == TryAllocate(Sets, Order), "allocations differ", MaxOrder, Step);
+                if (Offset != kFailed)
+                    Live.push_back({ Offset, Order });
+                else
+                    ++NumFailed;
+            }
+            else
+            {
+                const size_t Index = NextRandom(State) % Live.size();
+                Bitmaps.DeallocateBlock(Live[Index].Offset, Live[Index].Order);
+                Sets.DeallocateBlock(Live[Index].Offset, Live[Index].Order);
+                Live[Index] = Live.back();
+                Live.pop_back();
+            }
+
+            if (Step % 1000 == 0)
+            {
+                for (uint32_t Order = 0; Order <= MaxOrder; ++Order)
+                    Check(Bitmaps.GetNumFreeBlocks(Order) == Sets.GetNumFreeBlocks(Order), "free block counts differ", MaxOrder, Step);
+            }
+        }
+
+        for (const Block& Used : Live)
+        {
+            Bitmaps.DeallocateBlock(Used.Offset, Used.Order);
+            Sets.DeallocateBlock(Used.Offset, Used.Order);
+        }
+        for (uint32_t Order = 0; Order <= MaxOrder; ++Order)
+            Check(Bitmaps.GetNumFreeBlocks(Order) == (Order == MaxOrder ? 1u : 0u), "freeing everything merges every block", MaxOrder, NumOps);
+
+        printf("%10u %12u %12u %12s\n", MaxOrder, NumOps, NumFailed, g_Failed ? "MISMATCH" : "identical");
+    }
+
+    // Fills the pool with random blocks until UsedPercent of it is taken, the same way for both allocators
+    void Fill( BuddyBlockAllocator& Bitmaps, SetBuddyBlocks& Sets, uint32_t MaxOrder, uint32_t UsedPercent )
+    {
+        const size_t Target = (((size_t)1 << MaxOrder) * UsedPercent) / 100;
+        const uint32_t MaxRequestOrder = std::min(MaxOrder, 4u);
+
+        uint32_t State = 12345;
+        size_t Used = 0;
+        while (Used < Target)
+        {
+            const uint32_t Order = std::min(RandomOrder(State, MaxRequestOrder), Log2Floor(Target - Used));
+            const size_t Offset = TryAllocate(Bitmaps, Order);
+            Check(Offset == TryAllocate(Sets, Order), "allocations differ", MaxOrder, 0);
+            if (Offset == kFailed)
+                break;
+            Used += (size_t)1 << Order;
+        }
+    }
+
+    template <typename Allocator>
+    void MeasureLatency( Allocator& Blocks, const std::vector<uint32_t>& Orders, const std::vector<uint32_t>& FreeOrder,
+        std::vector<size_t>& Offsets, double& AllocateSeconds, double& FreeSeconds )
+    {
+        AllocateSeconds = 1e30;
+        FreeSeconds = 1e30;
+
+        for (uint32_t Run = 0; Run < g_NumRuns; ++Run)
+        {
+            const auto Start = std::chrono::steady_clock::now();
+            for (size_t i = 0; i < Orders.size(); ++i)
+                Offsets[i] = TryAllocate(Blocks, Orders[i]);
+            const auto Allocated = std::chrono::steady_clock::now();
+
+            // Blocks are freed in a different order than they were allocated, as buffers are
+            for (uint32_t i : FreeOrder)
+            {
+                if (Offsets[i] != kFailed)
+                    Blocks.DeallocateBlock(Offsets[i], Orders[i]);
+            }
+            const auto Freed = std::chrono::steady_clock::now();
+
+            AllocateSeconds = std::min(AllocateSeconds, std::chrono::duration<double>(Allocated - Start).count());
+            FreeSeconds = std::min(FreeSeconds, std::chrono::duration<double>(Freed - Allocated).count());
+        }
+    }
+
+    // Measures allocating a batch of blocks into a pool that is already partly used, then freeing them again
+    void Latency( uint32_t MaxOrder, uint32_t UsedPercent )
+    {
+        BuddyBlockAllocator Bitmaps;
+        SetBuddyBlocks Sets;
+        Bitmaps.Reset(MaxOrder);
+        Sets.Reset(MaxOrder);
+        Fill(Bitmaps, Sets, MaxOrder, UsedPercent);
+
+        // Enough requests to take about half of the space that is left
+        const size_t FreeUnits = ((size_t)1 << MaxOrder) - (((size_t)1 << MaxOrder) * UsedPercent) / 100;
+        const size_t NumBlocks = std::max<size_t>(1, std::min<size_t>(FreeUnits / 8, 100000));
+
+        uint32_t State = 777;
+        std::vector<uint32_t> Orders(NumBlocks);
+        std::vector<uint32_t> FreeOrder(NumBlocks);
+        for (size_t i = 0; i < NumBlocks; ++i)
+        {
+            Orders[i] = RandomOrder(State, std::min(MaxOrder, 4u));
+            FreeOrder[i] = (uint32_t)i;
+        }
+        for (size_t i = NumBlocks; i > 1; --i)
+            std::swap(FreeOrder[i - 1], FreeOrder[NextRandom(State) % i]);
+
+        std::vector<size_t> BitmapOffsets(NumBlocks), SetOffsets(NumBlocks);
+        double BitmapAllocate, BitmapFree, SetAllocate, SetFree;
+        MeasureLatency(Bitmaps, Orders, FreeOrder, BitmapOffsets, BitmapAllocate, BitmapFree);
+        MeasureLatency(Sets, Orders, FreeOrder, SetOffsets, SetAllocate, SetFree);
+        Check(BitmapOffsets == SetOffsets, "allocations differ", MaxOrder, 0);
+
+        printf("%10u %5u%% %8zu %10.1f %10.1f %10.1f %10.1f\n", MaxOrder, UsedPercent, NumBlocks,
+            BitmapAllocate * 1e9 / NumBlocks, SetAllocate * 1e9 / NumBlocks,
+            BitmapFree * 1e9 / NumBlocks, SetFree * 1e9 / NumBlocks);
+    }
+}
+
+int main( int argc, char** argv )
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+            g_NumRuns = std::max(1, atoi(argv[++i]));
+        else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc)
+            g_NumCompareOps = std::max(1, atoi(argv[++i]));
+        else
+        {
+            fprintf(stderr, "Usage: %s [-n <runs>] [-c <operations to compare>]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    // A 64 KB placed buffer heap of 1 MB, 64 MB and 1 GB, and a 256 byte sub-allocated buffer of 256 MB
+    const uint32_t kMaxOrders[] = { 4, 10, 14, 20 };
+
+    printf("Compared allocations and frees\n%10s %12s %12s %12s\n", "max order", "operations", "failed", "result");
+    for (uint32_t MaxOrder : kMaxOrders)
+        Compare(MaxOrder, g_NumCompareOps);
+
+    printf("\nns per block, fastest of %u runs\n%10s %6s %8s %21s %21s\n", g_NumRuns, "", "", "", "allocate", "free");
+    printf("%10s %6s %8s %10s %10s %10s %10s\n", "max order", "used", "blocks", "bitmaps", "sets", "bitmaps", "sets");
+    for (uint32_t MaxOrder : kMaxOrders)
+    {
+        for (uint32_t UsedPercent : { 0u, 50u, 90u })
+            Latency(MaxOrder, UsedPercent);
+    }
+
+    return g_Failed ? 1 : 0;
+}
@@ -0,0 +1,17 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+// Stands in for Core/pch.h when BuddyBlockAllocator.cpp is built without the rest of the engine.  The block
+// logic only needs the standard library and ASSERT.
+//
+
+#pragma once
+
+#include <cassert>
+
+#define ASSERT( isTrue, ... ) assert(isTrue)
@@ -0,0 +1,233 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+// Checks that every implementation behind Utility::HashRange returns the same values as the SSE4.2 version
+// that Hash.h inlined on x64 before the runtime dispatch, then measures the throughput of each.  Hash.cpp is
+// compiled into this file so that the implementations it keeps private can be called directly.
+//
+
+#include "Hash.cpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+namespace
+{
+#if defined(_M_X64) || defined(__x86_64__)
+    #define HAS_OLD_X64_HASH 1
+
+    // Utility::HashRange as Hash.h had it for x64 builds, with Math::AlignUp and AlignDown written out
+    HASH_TARGET_CRC32C size_t OldX64HashRange( const uint32_t* const Begin, const uint32_t* const End, size_t Hash )
+    {
+        const uint64_t* Iter64 = (const uint64_t*)(((uintptr_t)Begin + 7) & ~(uintptr_t)7);
+        const uint64_t* const End64 = (const uint64_t*)((uintptr_t)End & ~(uintptr_t)7);
+
+        if ((uint32_t*)Iter64 > Begin)
+            Hash = _mm_crc32_u32((uint32_t)Hash, *Begin);
+
+        while (Iter64 < End64)
+            Hash = _mm_crc32_u64((uint64_t)Hash, *Iter64++);
+
+        if ((uint32_t*)Iter64 < End)
+            Hash = _mm_crc32_u32((uint32_t)Hash, *(uint32_t*)Iter64);
+
+        return Hash;
+    }
+#endif
+
+    // The hash that Hash.h used on every other CPU.  It isn't CRC32C, so it is only timed for comparison.
+    size_t OldFallbackHashRange( const uint32_t* const Begin, const uint32_t* const End, size_t Hash )
+    {
+        for (const uint32_t* Iter = Begin; Iter < End; ++Iter)
+            Hash = 16777619U * Hash ^ *Iter;
+        return Hash;
+    }
+
+    typedef size_t (*HashRangeFunc)( const uint32_t* const Begin, const uint32_t* const End, size_t Hash );
+
+    size_t TableHashRange( const uint32_t* const Begin, const uint32_t* const End, size_t Hash )
+    {
+        return Crc32CSoftware((uint32_t)Hash, (const uint8_t*)Begin, (End - Begin) * sizeof(uint32_t));
+    }
+
+#ifdef HASH_CRC32C_U64
+    size_t HardwareHashRange( const uint32_t* const Begin, const uint32_t* const End, size_t Hash )
+    {
+        return Crc32CHardware((uint32_t)Hash, (const uint8_t*)Begin, (End - Begin) * sizeof(uint32_t));
+    }
+#endif
+
+    struct Implementation
+    {
+        const char* Name;
+        HashRangeFunc Func;
+        bool IsCrc32C;
+
+        // The old x64 version read one word past an empty range that started off 8-byte alignment
+        bool ReadsPastEmptyRange;
+    };
+
+    // Compares every CRC32C implementation over random ranges, including ones that start off 8-byte alignment.
+    // Returns the number of mismatches.
+    uint32_t CheckImplementations( const std::vector<Implementation>& Implementations, uint32_t NumCases )
+    {
+        std::mt19937 Random(1);
+        std::vector<uint32_t> Buffer(8192 + 16);
+        for (uint32_t& Word : Buffer)
+            Word = Random();
+
+        uint32_t NumMismatches = 0;
+        for (uint32_t i = 0; i < NumCases; ++i)
+        {
+            // Mostly state-sized ranges, with some long enough for the hardware path's three-lane blocks
+            const size_t Offset = Random() % 16;
+            const size_t NumWords = (i % 4 == 0) ? Random() % 8192 : Random() % 256;
+            const size_t Seed = (i & 1) ? 2166136261U : Random();
+
+            const uint32_t* Begin = Buffer.data() + Offset;
+            const uint32_t* End = Begin + NumWords;
+
+            const size_t Expected = Implementations[0].Func(Begin, End, Seed);
+            for (const Implementation& Impl : Implementations)
+            {
+                if (!Impl.IsCrc32C || (Impl.ReadsPastEmptyRange && NumWords == 0 && (Offset & 1) != 0))
+                    continue;
+
+                const size_t Result = Impl.Func(Begin, End, Seed);
+                if (Result != Expected)
+                {
+                    if (NumMismatches++ < 10)
+                    {
+                        fprintf(stderr, "Mismatch: %s returned %08zx instead of %08zx for %zu words at word %zu, seed %08zx\n",
+                            Impl.Name, Result, Expected, NumWords, Offset, Seed);
+                    }
+                }
+            }
+        }
+
+#ifdef HASH_CRC32C_U64
+        // The CRC32C implementations also take byte-aligned input, which HashRange never passes
+        std::vector<uint8_t> Bytes(4096 + 8);
+        for (uint8_t& Byte : Bytes)
+            Byte = (uint8_t)Random();
+
+        for (uint32_t i = 0; HasCrc32CInstructions() && i < NumCases; ++i)
+        {
+            const size_t Offset = Random() % 8;
+            const size_t Size = Random() % 4096;
+            const uint32_t Seed = Random();
+            if (Crc32CHardware(Seed, Bytes.data() + Offset, Size) != Crc32CSoftware(Seed, Bytes.data() + Offset, Size))
+            {
+                if (NumMismatches++ < 10)
+                    fprintf(stderr, "Mismatch: hardware CRC32C of %zu bytes at byte %zu\n", Size, Offset);
+            }
+        }
+#endif
+
+        return NumMismatches;
+    }
+
+    // Returns bytes per second, the fastest of several runs
+    double MeasureThroughput( HashRangeFunc Func, const uint32_t* Data, size_t NumWords, size_t TotalBytes )
+    {
+        const size_t NumCalls = std::max<size_t>(1, TotalBytes / (NumWords * sizeof(uint32_t)));
+
+        double Fastest = 1e30;
+        volatile size_t Sink = 0;
+        for (int Run = 0; Run < 5; ++Run)
+        {
+            size_t Hash = 2166136261U;
+            const auto Start = std::chrono::steady_clock::now();
+            for (size_t i = 0; i < NumCalls; ++i)
+                Hash = Func(Data, Data + NumWords, Hash);
+            const auto End = std::chrono::steady_clock::now();
+            Sink = Sink + Hash;
+            Fastest = std::min(Fastest, std::chrono::duration<double>(End - Start).count());
+        }
+        return double(NumCalls * NumWords * sizeof(uint32_t)) / Fastest;
+    }
+}
+
+int main( int argc, char** argv )
+{
+    size_t TotalBytes = 256 << 20;
+    uint32_t NumCases = 100000;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "-m") == 0 && i + 1 < argc)
+            TotalBytes = size_t(std::max(1, atoi(argv[++i]))) << 20;
+        else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc)
+            NumCases = std::max(1, atoi(argv[++i]));
+        else
+        {
+            fprintf(stderr, "Usage: %s [-m <MB hashed per measurement>] [-c <cases to compare>]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    // Builds the tables and picks the implementation
+    Utility::DispatchHashRange(nullptr, nullptr, 0);
+
+    const bool HasHardware = HasCrc32CInstructions();
+    std::vector<Implementation> Implementations;
+    Implementations.push_back({ "table", TableHashRange, true, false });
+#ifdef HASH_CRC32C_U64
+    if (HasHardware)
+        Implementations.push_back({ "hardware", HardwareHashRange, true, false });
+#endif
+#if HAS_OLD_X64_HASH
+    if (HasHardware)
+        Implementations.push_back({ "old x64", OldX64HashRange, true, true });
+#endif
+    Implementations.push_back({ "dispatch", Utility::DispatchHashRange, true, false });
+    Implementations.push_back({ "HashRange", Utility::HashRange, true, false });
+    Implementations.push_back({ "old fallback", OldFallbackHashRange, false, false });
+
+    printf("CRC32C instructions: %s, short ranges inlined: %s\n", HasHardware ? "yes" : "no",
+        HASH_INLINE_CRC32C && Utility::g_HasCrc32CInstructions ? "yes" : "no");
+
+    const uint32_t NumMismatches = CheckImplementations(Implementations, NumCases);
+    printf("Compared");
+    for (const Implementation& Impl : Implementations)
+    {
+        if (Impl.IsCrc32C)
+            printf(" %s", Impl.Name);
+    }
+    printf(" over %u ranges: %s\n\n", NumCases, NumMismatches == 0 ? "identical" : "MISMATCH");
+
+    // A root signature, a graphics PSO description, a large state blob and bulk data
+    const size_t kSizes[] = { 64, 656, 4096, 1 << 20 };
+    std::vector<uint32_t> Data((1 << 20) / sizeof(uint32_t) + 2);
+    std::mt19937 Random(2);
+    for (uint32_t& Word : Data)
+        Word = Random();
+
+    printf("GB/s %10s", "bytes");
+    for (const Implementation& Impl : Implementations)
+        printf(" %12s", Impl.Name);
+    printf("\n");
+
+    for (size_t Size : kSizes)
+    {
+        // Word-aligned but not 8-byte aligned, as many state descriptions are
+        for (size_t Offset = 0; Offset < 2; ++Offset)
+        {
+            printf("%4s %10zu", Offset ? "+4" : "", Size);
+            for (const Implementation& Impl : Implementations)
+                printf(" %12.2f", MeasureThroughput(Impl.Func, Data.data() + Offset, Size / sizeof(uint32_t), TotalBytes) / 1e9);
+            printf("\n");
+        }
+    }
+
+    return NumMismatches == 0 ? 0 : 1;
+}
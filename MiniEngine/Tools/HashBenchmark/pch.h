@@ -0,0 +1,22 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+// Stands in for Core/pch.h when Hash.cpp is built without the rest of the engine.  It only needs the C++
+// standard library, and Windows for IsProcessorFeaturePresent on ARM64.
+//
+
+#pragma once
+
+#include <cassert>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#endif
+
+#define ASSERT( isTrue, ... ) assert(isTrue)
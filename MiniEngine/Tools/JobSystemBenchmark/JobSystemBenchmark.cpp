@@ -0,0 +1,245 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+// Measures the overhead of Core/JobSystem: the cost of spawning and waiting on jobs, how ParallelFor scales
+// with the number of workers, and how quickly RunAfter chains hand off from one job to the next.  Every
+// result is the fastest of several runs.
+//
+
+#include "JobSystem.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <vector>
+
+using namespace JobSystem;
+
+namespace
+{
+    uint32_t g_NumRuns = 5;
+    uint32_t g_MaxThreads = 0;
+    bool g_Failed = false;
+
+    // Runs Func g_NumRuns times and returns the fastest run in seconds
+    template <typename F>
+    double FastestRun( F&& Func )
+    {
+        double Fastest = 1e30;
+        for (uint32_t i = 0; i < g_NumRuns; ++i)
+        {
+            const auto Start = std::chrono::steady_clock::now();
+            Func();
+            const auto End = std::chrono::steady_clock::now();
+            Fastest = std::min(Fastest, std::chrono::duration<double>(End - Start).count());
+        }
+        return Fastest;
+    }
+
+    void Check( bool Condition, const char* What )
+    {
+        if (!Condition)
+        {
+            fprintf(stderr, "FAILED: %s\n", What);
+            g_Failed = true;
+        }
+    }
+
+    // Enough arithmetic per element that ParallelFor isn't bound by memory bandwidth
+    inline float Work( uint32_t i )
+    {
+        float x = float(i & 1023) * 0.001f;
+        for (uint32_t j = 0; j < 16; ++j)
+            x = std::sqrt(x * x + 1.0f) - 0.5f;
+        return x;
+    }
+
+    void SpawnCost( uint32_t NumWorkers )
+    {
+        const uint32_t kNumJobs = 100000;
+        const uint32_t kNumRoundTrips = 10000;
+
+        std::atomic<uint32_t> NumRun(0);
+        const double Batch = FastestRun([&]()
+        {
+            Counter Jobs;
+            for (uint32_t i = 0; i < kNumJobs; ++i)
+                Run([&NumRun]() { NumRun.fetch_add(1, std::memory_order_relaxed); }, &Jobs);
+            Wait(Jobs);
+        });
+        Check(NumRun == kNumJobs * g_NumRuns, "every spawned job ran once");
+
+        // One job at a time, so each Wait() sees the latency of a worker picking the job up
+        const double RoundTrip = FastestRun([&]()
+        {
+            for (uint32_t i = 0; i < kNumRoundTrips; ++i)
+            {
+                Counter Job;
+                Run([]() {}, &Job);
+                Wait(Job);
+            }
+        });
+
+        printf("%8u %18.1f %18.1f\n", NumWorkers, Batch * 1e9 / kNumJobs, RoundTrip * 1e9 / kNumRoundTrips);
+    }
+
+    void ParallelForScaling( uint32_t NumThreads, double SerialTime, double SerialSum )
+    {
+        const uint32_t kNumElements = 1 << 22;
+        const uint32_t kGrainSizes[] = { 256, 4096, 65536 };
+
+        printf("%8u", NumThreads);
+        for (uint32_t GrainSize : kGrainSizes)
+        {
+            std::unique_ptr<float[]> Results(new float[kNumElements]);
+            const double Time = FastestRun([&]()
+            {
+                ParallelFor(0, kNumElements, GrainSize, [&Results](uint32_t Begin, uint32_t End)
+                {
+                    for (uint32_t i = Begin; i < End; ++i)
+                        Results[i] = Work(i);
+                });
+            });
+
+            double Sum = 0.0;
+            for (uint32_t i = 0; i < kNumElements; ++i)
+                Sum += Results[i];
+            Check(Sum == SerialSum, "ParallelFor covers every element once");
+
+            printf(" %10.2f ms %5.2fx", Time * 1e3, SerialTime / Time);
+        }
+        printf("\n");
+    }
+
+    // Links NumChains chains of ChainLength jobs with RunAfter, all waiting on one gate counter, then opens the
+    // gate and waits for the ends of the chains.  Returns the time from opening the gate to the last job.
+    double RunChains( uint32_t NumChains, uint32_t ChainLength, double& BuildTime )
+    {
+        std::unique_ptr<Counter[]> Links(new Counter[NumChains * ChainLength]);
+        std::unique_ptr<std::atomic<uint32_t>[]> Progress(new std::atomic<uint32_t>[NumChains]);
+        std::atomic<uint32_t> NumOutOfOrder(0);
+
+        Counter Gate;
+        Increment(Gate);
+
+        const auto BuildStart = std::chrono::steady_clock::now();
+        for (uint32_t c = 0; c < NumChains; ++c)
+        {
+            Progress[c] = 0;
+            for (uint32_t i = 0; i < ChainLength; ++i)
+            {
+                Counter& Dependency = i == 0 ? Gate : Links[c * ChainLength + i - 1];
+                std::atomic<uint32_t>& ChainProgress = Progress[c];
+                RunAfter(Dependency, [&ChainProgress, &NumOutOfOrder, i]()
+                {
+                    if (ChainProgress.exchange(i + 1, std::memory_order_relaxed) != i)
+                        NumOutOfOrder.fetch_add(1, std::memory_order_relaxed);
+                }, &Links[c * ChainLength + i]);
+            }
+        }
+        const auto BuildEnd = std::chrono::steady_clock::now();
+        BuildTime = std::chrono::duration<double>(BuildEnd - BuildStart).count();
+
+        Decrement(Gate);
+        for (uint32_t c = 0; c < NumChains; ++c)
+            Wait(Links[c * ChainLength + ChainLength - 1]);
+        const auto End = std::chrono::steady_clock::now();
+
+        Check(NumOutOfOrder == 0, "RunAfter chains run in order");
+        return std::chrono::duration<double>(End - BuildEnd).count();
+    }
+
+    void ChainLatency( uint32_t NumChains )
+    {
+        const uint32_t kChainLength = 10000;
+
+        double BuildTime = 1e30;
+        const double RunTime = FastestRun([&]()
+        {
+            double Build;
+            RunChains(NumChains, kChainLength, Build);
+            BuildTime = std::min(BuildTime, Build);
+        });
+
+        const double NumLinks = double(NumChains) * kChainLength;
+        printf("%8u %18.1f %18.1f\n", NumChains, BuildTime * 1e9 / NumLinks, RunTime * 1e9 / kChainLength);
+    }
+}
+
+int main( int argc, char** argv )
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+            g_NumRuns = std::max(1, atoi(argv[++i]));
+        else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc)
+            g_MaxThreads = std::max(2, atoi(argv[++i]));
+        else
+        {
+            fprintf(stderr, "Usage: %s [-n <runs>] [-t <max threads>]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    // Initialize(0) means a worker per hardware thread, so there is always at least one worker.  A single thread is
+    // measured with a plain loop instead.
+    if (g_MaxThreads == 0)
+        g_MaxThreads = std::thread::hardware_concurrency();
+    g_MaxThreads = std::max(2u, g_MaxThreads);
+
+    std::vector<uint32_t> ThreadCounts;
+    for (uint32_t NumThreads = 2; NumThreads < g_MaxThreads; NumThreads *= 2)
+        ThreadCounts.push_back(NumThreads);
+    ThreadCounts.push_back(g_MaxThreads);
+
+    printf("Run/Wait, ns per job\n%8s %18s %18s\n", "workers", "batch of 100000", "one at a time");
+    for (uint32_t NumThreads : ThreadCounts)
+    {
+        Initialize(NumThreads - 1);
+        SpawnCost(NumThreads - 1);
+        Shutdown();
+    }
+
+    printf("\nParallelFor over 4M elements, time and speedup over a plain loop\n%8s %21s %21s %21s\n",
+        "threads", "grain 256", "grain 4096", "grain 65536");
+    {
+        const uint32_t kNumElements = 1 << 22;
+        std::unique_ptr<float[]> Results(new float[kNumElements]);
+        const double SerialTime = FastestRun([&]()
+        {
+            for (uint32_t i = 0; i < kNumElements; ++i)
+                Results[i] = Work(i);
+        });
+        double SerialSum = 0.0;
+        for (uint32_t i = 0; i < kNumElements; ++i)
+            SerialSum += Results[i];
+
+        printf("%8u %10.2f ms %5.2fx\n", 1u, SerialTime * 1e3, 1.0);
+        for (uint32_t NumThreads : ThreadCounts)
+        {
+            Initialize(NumThreads - 1);
+            ParallelForScaling(NumThreads, SerialTime, SerialSum);
+            Shutdown();
+        }
+    }
+
+    printf("\nRunAfter chains of 10000 jobs on %u threads, ns per link\n%8s %18s %18s\n",
+        g_MaxThreads, "chains", "RunAfter", "hand-off");
+    Initialize(g_MaxThreads - 1);
+    for (uint32_t NumChains = 1; NumChains <= g_MaxThreads; NumChains *= 2)
+        ChainLatency(NumChains);
+    Shutdown();
+
+    return g_Failed ? 1 : 0;
+}
@@ -0,0 +1,393 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+// Measures how fast several threads can sub-allocate upload memory the way LinearAllocator does, with the pages
+// recycled by Core/LinearPagePool in both of its modes and by the mutex and queues that LinearAllocatorPageManager
+// used before.  Pages are plain host memory and fences are a counter that lags a few frames behind, so no GPU is
+// needed.  The tool exits with an error if a page is handed out while it is still in use, or if a page isn't
+// deleted by Destroy.
+//
+
+#include "LinearPagePool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace
+{
+    // The same as LinearAllocator's upload pages and alignment
+    const size_t kPageSize = 0x200000;
+    const size_t kAlignment = 256;
+
+    uint32_t g_NumRuns = 3;
+    uint32_t g_NumFramesInFlight = 2;
+    uint32_t g_NumFrames = 400;
+    uint32_t g_AllocationsPerFrame = 2000;
+    std::atomic<bool> g_Failed(false);
+
+    class HostPage : public LinearPage
+    {
+    public:
+
+        HostPage( size_t PageSize ) : LinearPage(PageSize), m_Memory(new uint8_t[PageSize]), m_InUse(false) {}
+        ~HostPage() { delete[] m_Memory; }
+
+        uint8_t* m_Memory;
+        std::atomic<bool> m_InUse;
+    };
+
+    // Stands in for the D3D pages and the command queue fences
+    class HostBackingStore : public LinearPageBackingStore
+    {
+    public:
+
+        HostBackingStore() : m_NextFenceValue(1), m_CompletedFenceValue(0), m_NumPagesCreated(0), m_NumPagesDeleted(0) {}
+
+        virtual bool IsFenceComplete( uint64_t FenceValue ) override
+        {
+            return FenceValue <= m_CompletedFenceValue.load(std::memory_order_acquire);
+        }
+
+        virtual LinearPage* CreatePage( size_t PageSize ) override
+        {
+            ++m_NumPagesCreated;
+            return new HostPage(PageSize);
+        }
+
+        virtual void DeletePage( LinearPage* Page ) override
+        {
+            ++m_NumPagesDeleted;
+            delete static_cast<HostPage*>(Page);
+        }
+
+        // Every thread submits once per frame, and the stand-in GPU finishes the submissions from
+        // g_NumFramesInFlight frames ago
+        uint64_t Submit( uint32_t NumThreads )
+        {
+            const uint64_t FenceValue = m_NextFenceValue++;
+            const uint64_t Lag = (uint64_t)g_NumFramesInFlight * NumThreads;
+            if (FenceValue > Lag)
+                Complete(FenceValue - Lag);
+            return FenceValue;
+        }
+
+        void Complete( uint64_t FenceValue )
+        {
+            uint64_t Completed = m_CompletedFenceValue.load(std::memory_order_relaxed);
+            while (Completed < FenceValue &&
+                !m_CompletedFenceValue.compare_exchange_weak(Completed, FenceValue, std::memory_order_release, std::memory_order_relaxed))
+            {
+            }
+        }
+
+        void CompleteAll( void ) { Complete(m_NextFenceValue.load()); }
+
+        std::atomic<uint64_t> m_NextFenceValue;
+        std::atomic<uint64_t> m_CompletedFenceValue;
+        std::atomic<size_t> m_NumPagesCreated;
+        std::atomic<size_t> m_NumPagesDeleted;
+    };
+
+    // LinearAllocatorPageManager before LinearPagePool:  every request takes a mutex, retired pages wait in a queue
+    // in the order they were retired, and large pages are created for each request and deleted after their fence
+    class MutexPageManager
+    {
+    public:
+
+        void Create( LinearPageBackingStore* BackingStore, size_t PageSize, LinearPageRecycling )
+        {
+            m_BackingStore = BackingStore;
+            m_PageSize = PageSize;
+        }
+
+        LinearPage* RequestPage( void )
+        {
+            std::lock_guard<std::mutex> LockGuard(m_Mutex);
+
+            while (!m_RetiredPages.empty() && m_BackingStore->IsFenceComplete(m_RetiredPages.front().first))
+            {
+                m_AvailablePages.push(m_RetiredPages.front().second);
+                m_RetiredPages.pop();
+            }
+
+            LinearPage* PagePtr = nullptr;
+            if (!m_AvailablePages.empty())
+            {
+                PagePtr = m_AvailablePages.front();
+                m_AvailablePages.pop();
+            }
+            else
+            {
+                PagePtr = m_BackingStore->CreatePage(m_PageSize);
+                m_PagePool.push_back(PagePtr);
+            }
+            return PagePtr;
+        }
+
+        LinearPage* RequestLargePage( size_t PageSize )
+        {
+            return m_BackingStore->CreatePage(PageSize);
+        }
+
+        void DiscardPages( uint64_t FenceValue, const std::vector<LinearPage*>& UsedPages )
+        {
+            std::lock_guard<std::mutex> LockGuard(m_Mutex);
+            for (LinearPage* Page : UsedPages)
+                m_RetiredPages.push(std::make_pair(FenceValue, Page));
+        }
+
+        void DiscardLargePages( uint64_t FenceValue, const std::vector<LinearPage*>& LargePages )
+        {
+            std::lock_guard<std::mutex> LockGuard(m_Mutex);
+            while (!m_DeletionQueue.empty() && m_BackingStore->IsFenceComplete(m_DeletionQueue.front().first))
+            {
+                m_BackingStore->DeletePage(m_DeletionQueue.front().second);
+                m_DeletionQueue.pop();
+            }
+            for (LinearPage* Page : LargePages)
+                m_DeletionQueue.push(std::make_pair(FenceValue, Page));
+        }
+
+        void Destroy( void )
+        {
+            for (LinearPage* Page : m_PagePool)
+                m_BackingStore->DeletePage(Page);
+            m_PagePool.clear();
+            m_RetiredPages = std::queue<std::pair<uint64_t, LinearPage*>>();
+            m_AvailablePages = std::queue<LinearPage*>();
+            for (; !m_DeletionQueue.empty(); m_DeletionQueue.pop())
+                m_BackingStore->DeletePage(m_DeletionQueue.front().second);
+        }
+
+    private:
+
+        LinearPageBackingStore* m_BackingStore;
+        size_t m_PageSize;
+        std::vector<LinearPage*> m_PagePool;
+        std::queue<std::pair<uint64_t, LinearPage*>> m_RetiredPages;
+        std::queue<std::pair<uint64_t, LinearPage*>> m_DeletionQueue;
+        std::queue<LinearPage*> m_AvailablePages;
+        std::mutex m_Mutex;
+    };
+
+    inline uint32_t NextRandom( uint32_t& State )
+    {
+        State ^= State << 13;
+        State ^= State >> 17;
+        State ^= State << 5;
+        return State;
+    }
+
+    void CheckOut( LinearPage* Page )
+    {
+        if (static_cast<HostPage*>(Page)->m_InUse.exchange(true))
+        {
+            if (!g_Failed.exchange(true))
+                fprintf(stderr, "FAILED: a page was handed out while it was still in use\n");
+        }
+    }
+
+    void CheckIn( const std::vector<LinearPage*>& Pages )
+    {
+        for (LinearPage* Page : Pages)
+            static_cast<HostPage*>(Page)->m_InUse = false;
+    }
+
+    // The sub-allocation of LinearAllocator::Allocate and CleanupUsedPages, on one thread
+    template <typename PageManager>
+    class HostLinearAllocator
+    {
+    public:
+
+        HostLinearAllocator( PageManager& Manager ) : m_Manager(Manager), m_CurOffset(~(size_t)0), m_CurPage(nullptr) {}
+
+        uint8_t* Allocate( size_t SizeInBytes )
+        {
+            const size_t AlignedSize = (SizeInBytes + kAlignment - 1) & ~(kAlignment - 1);
+
+            if (AlignedSize > kPageSize)
+            {
+                LinearPage* LargePage = m_Manager.RequestLargePage(AlignedSize);
+                CheckOut(LargePage);
+                m_LargePageList.push_back(LargePage);
+                return static_cast<HostPage*>(LargePage)->m_Memory;
+            }
+
+            m_CurOffset = (m_CurOffset + kAlignment - 1) & ~(kAlignment - 1);
+
+            if (m_CurOffset + AlignedSize > kPageSize)
+            {
+                m_RetiredPages.push_back(m_CurPage);
+                m_CurPage = nullptr;
+            }
+
+            if (m_CurPage == nullptr)
+            {
+                m_CurPage = m_Manager.RequestPage();
+                CheckOut(m_CurPage);
+                m_CurOffset = 0;
+            }
+
+            uint8_t* DataPtr = static_cast<HostPage*>(m_CurPage)->m_Memory + m_CurOffset;
+            m_CurOffset += AlignedSize;
+            return DataPtr;
+        }
+
+        void CleanupUsedPages( uint64_t FenceID )
+        {
+            if (m_CurPage == nullptr)
+                return;
+
+            m_RetiredPages.push_back(m_CurPage);
+            m_CurPage = nullptr;
+            m_CurOffset = 0;
+
+            CheckIn(m_RetiredPages);
+            m_Manager.DiscardPages(FenceID, m_RetiredPages);
+            m_RetiredPages.clear();
+
+            CheckIn(m_LargePageList);
+            m_Manager.DiscardLargePages(FenceID, m_LargePageList);
+            m_LargePageList.clear();
+        }
+
+    private:
+
+        PageManager& m_Manager;
+        size_t m_CurOffset;
+        LinearPage* m_CurPage;
+        std::vector<LinearPage*> m_RetiredPages;
+        std::vector<LinearPage*> m_LargePageList;
+    };
+
+    // Mostly constant buffers, some larger uploads, and one allocation in 1000 bigger than a page
+    inline size_t RandomAllocationSize( uint32_t& State )
+    {
+        const uint32_t Kind = NextRandom(State) % 1000;
+        if (Kind == 0)
+            return kPageSize + (NextRandom(State) % 4) * (kPageSize / 2) + 1;
+        if (Kind < 200)
+            return 1024 + NextRandom(State) % (32 * 1024);
+        return 256;
+    }
+
+    struct RunResults
+    {
+        double Seconds;
+        size_t NumPages;
+        size_t NumPagesCreated;
+    };
+
+    template <typename PageManager>
+    RunResults Run( uint32_t NumThreads, LinearPageRecycling Recycling )
+    {
+        HostBackingStore BackingStore;
+        PageManager Manager;
+        Manager.Create(&BackingStore, kPageSize, Recycling);
+
+        std::atomic<uint32_t> NumReady(0);
+        std::vector<std::thread> Threads;
+
+        const auto Start = std::chrono::steady_clock::now();
+        for (uint32_t t = 0; t < NumThreads; ++t)
+        {
+            Threads.emplace_back([&, t]()
+            {
+                HostLinearAllocator<PageManager> Allocator(Manager);
+                uint32_t State = 2463534242u + t * 7919u;
+
+                // Start every thread at the same time so that they contend
+                ++NumReady;
+                while (NumReady < NumThreads)
+                    std::this_thread::yield();
+
+                for (uint32_t Frame = 0; Frame < g_NumFrames; ++Frame)
+                {
+                    for (uint32_t i = 0; i < g_AllocationsPerFrame; ++i)
+                        *Allocator.Allocate(RandomAllocationSize(State)) = (uint8_t)i;
+                    Allocator.CleanupUsedPages(BackingStore.Submit(NumThreads));
+                }
+            });
+        }
+        for (std::thread& Thread : Threads)
+            Thread.join();
+        const auto End = std::chrono::steady_clock::now();
+
+        RunResults Results;
+        Results.Seconds = std::chrono::duration<double>(End - Start).count();
+        Results.NumPagesCreated = BackingStore.m_NumPagesCreated;
+
+        BackingStore.CompleteAll();
+        Manager.Destroy();
+        Results.NumPages = Results.NumPagesCreated - BackingStore.m_NumPagesDeleted;
+        if (Results.NumPages != 0 && !g_Failed.exchange(true))
+            fprintf(stderr, "FAILED: %zu pages were not deleted by Destroy\n", Results.NumPages);
+
+        return Results;
+    }
+
+    template <typename PageManager>
+    void Measure( const char* Name, uint32_t NumThreads, LinearPageRecycling Recycling )
+    {
+        RunResults Fastest = {};
+        for (uint32_t i = 0; i < g_NumRuns; ++i)
+        {
+            const RunResults Results = Run<PageManager>(NumThreads, Recycling);
+            if (i == 0 || Results.Seconds < Fastest.Seconds)
+                Fastest = Results;
+        }
+
+        const double NumAllocations = (double)NumThreads * g_NumFrames * g_AllocationsPerFrame;
+        printf("%8u %-10s %14.1f %14.1f %14zu\n", NumThreads, Name, NumAllocations / Fastest.Seconds * 1e-6,
+            Fastest.Seconds * 1e9 / NumAllocations, Fastest.NumPagesCreated);
+    }
+}
+
+int main( int argc, char** argv )
+{
+    uint32_t MaxThreads = std::max(1u, std::thread::hardware_concurrency());
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+            g_NumRuns = std::max(1, atoi(argv[++i]));
+        else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc)
+            MaxThreads = std::max(1, atoi(argv[++i]));
+        else if (strcmp(argv[i], "-f") == 0 && i + 1 < argc)
+            g_NumFramesInFlight = std::max(0, atoi(argv[++i]));
+        else if (strcmp(argv[i], "-a") == 0 && i + 1 < argc)
+            g_AllocationsPerFrame = std::max(1, atoi(argv[++i]));
+        else
+        {
+            fprintf(stderr, "Usage: %s [-n <runs>] [-t <threads>] [-f <frames in flight>] [-a <allocations per frame>]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    printf("%u frames of %u allocations per thread, %u frames in flight, fastest of %u runs\n",
+        g_NumFrames, g_AllocationsPerFrame, g_NumFramesInFlight, g_NumRuns);
+    printf("%8s %-10s %14s %14s %14s\n", "threads", "manager", "M allocs/s", "ns per alloc", "pages created");
+    for (uint32_t NumThreads = 1; ; NumThreads = std::min(NumThreads * 2, MaxThreads))
+    {
+        Measure<LinearPagePool>("pool", NumThreads, kRecycleCompletedPages);
+        Measure<LinearPagePool>("ring", NumThreads, kRecycleInOrder);
+        Measure<MutexPageManager>("mutex", NumThreads, kRecycleInOrder);
+        if (NumThreads == MaxThreads)
+            break;
+    }
+
+    return g_Failed ? 1 : 0;
+}
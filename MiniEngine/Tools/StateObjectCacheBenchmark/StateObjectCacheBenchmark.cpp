@@ -0,0 +1,290 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+// Measures how quickly threads finalizing PSOs find them in Core/StateObjectCache.h, against the single
+// locked map that PSO::Finalize used before the cache was sharded.  A stand-in device "compiles" each PSO by
+// spinning for a fixed time, so no GPU is needed and every run sees the same compile cost.
+//
+
+#include "pch.h"
+#include "StateObjectCache.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <thread>
+#include <vector>
+
+using Microsoft::WRL::ComPtr;
+
+namespace
+{
+    // About the size of D3D12_GRAPHICS_PIPELINE_STATE_DESC with a few input elements
+    const uint32_t kNumDescWords = 180;
+
+    struct PipelineDesc
+    {
+        uint32_t Words[kNumDescWords];
+    };
+
+    class FakePipelineState
+    {
+    public:
+        explicit FakePipelineState( uint32_t Id ) : m_Id(Id), m_RefCount(1) {}
+
+        unsigned long AddRef( void ) { return ++m_RefCount; }
+        unsigned long Release( void )
+        {
+            const unsigned long Count = --m_RefCount;
+            if (Count == 0)
+                delete this;
+            return Count;
+        }
+
+        uint32_t GetId( void ) const { return m_Id; }
+
+    private:
+        uint32_t m_Id;
+        std::atomic<unsigned long> m_RefCount;
+    };
+
+    // Stands in for ID3D12Device::CreateGraphicsPipelineState
+    class StandInDevice
+    {
+    public:
+        explicit StandInDevice( uint32_t CompileMicroseconds ) : m_CompileTime(CompileMicroseconds), m_NumCreated(0) {}
+
+        ComPtr<FakePipelineState> CreatePipelineState( const PipelineDesc& Desc )
+        {
+            const auto End = std::chrono::steady_clock::now() + m_CompileTime;
+            while (std::chrono::steady_clock::now() < End)
+                ;
+
+            m_NumCreated.fetch_add(1);
+            ComPtr<FakePipelineState> NewPSO;
+            NewPSO.Attach(new FakePipelineState(Desc.Words[0]));
+            return NewPSO;
+        }
+
+        uint32_t GetNumCreated( void ) const { return m_NumCreated; }
+
+    private:
+        std::chrono::microseconds m_CompileTime;
+        std::atomic<uint32_t> m_NumCreated;
+    };
+
+    // What PSO::Finalize did before StateObjectCache: one lock and one map per PSO type, keyed by the hash alone.
+    // The first thread reserves the entry and the others spin until it is filled in.
+    class SingleLockCache
+    {
+    public:
+        ~SingleLockCache()
+        {
+            for (auto& Iter : m_Map)
+            {
+                if (FakePipelineState* PSO = Iter.second.load())
+                    PSO->Release();
+            }
+        }
+
+        template <typename CreateFunc>
+        FakePipelineState* GetOrCreate( const PipelineDesc& Desc, CreateFunc Create )
+        {
+            const size_t HashCode = Utility::HashState(&Desc);
+
+            std::atomic<FakePipelineState*>* PSORef = nullptr;
+            bool FirstCompile = false;
+            {
+                std::lock_guard<std::mutex> LockGuard(m_Mutex);
+                auto Iter = m_Map.find(HashCode);
+                if (Iter == m_Map.end())
+                {
+                    FirstCompile = true;
+                    PSORef = &m_Map[HashCode];
+                }
+                else
+                    PSORef = &Iter->second;
+            }
+
+            if (FirstCompile)
+            {
+                ComPtr<FakePipelineState> NewPSO = Create();
+                NewPSO->AddRef();
+                PSORef->store(NewPSO.Get());
+            }
+            else
+            {
+                while (PSORef->load() == nullptr)
+                    std::this_thread::yield();
+            }
+            return PSORef->load();
+        }
+
+    private:
+        std::mutex m_Mutex;
+        std::map<size_t, std::atomic<FakePipelineState*>> m_Map;
+    };
+
+    // Looks a PSO up the way GraphicsPSO::Finalize does, by flattening its description into a key
+    struct ShardedCache
+    {
+        StateObjectCache<FakePipelineState> Cache;
+
+        template <typename CreateFunc>
+        FakePipelineState* GetOrCreate( const PipelineDesc& Desc, CreateFunc Create )
+        {
+            StateKey Key;
+            Key.Append(&Desc);
+            return Cache.GetOrCreate(Key, Create);
+        }
+    };
+
+    uint32_t g_NumDescs = 2000;
+    uint32_t g_CompileMicroseconds = 20;
+    uint32_t g_LookupsPerThread = 200000;
+    uint32_t g_MaxThreads = 0;
+    bool g_Failed = false;
+
+    // Descriptions mostly share their state, like the PSOs of one renderer, and differ in a few words
+    std::vector<PipelineDesc> MakeDescs( void )
+    {
+        std::vector<PipelineDesc> Descs(g_NumDescs);
+        for (uint32_t i = 0; i < g_NumDescs; ++i)
+        {
+            for (uint32_t w = 0; w < kNumDescWords; ++w)
+                Descs[i].Words[w] = w * 2654435761u;
+            Descs[i].Words[0] = i;
+            Descs[i].Words[kNumDescWords / 2] ^= i * 40503u;
+            Descs[i].Words[kNumDescWords - 1] ^= i % 7;
+        }
+        return Descs;
+    }
+
+    inline uint32_t NextRandom( uint32_t& State )
+    {
+        State ^= State << 13;
+        State ^= State >> 17;
+        State ^= State << 5;
+        return State;
+    }
+
+    template <typename CacheType>
+    void Measure( uint32_t NumThreads, const std::vector<PipelineDesc>& Descs, double& ColdSeconds, double& WarmSeconds )
+    {
+        StandInDevice Device(g_CompileMicroseconds);
+        CacheType Cache;
+        std::atomic<uint32_t> NumWrong(0);
+
+        auto RunThreads = [&]( auto ThreadFunc ) -> double
+        {
+            std::vector<std::thread> Threads;
+            std::atomic<uint32_t> NumReady(0);
+            std::atomic<bool> Go(false);
+            for (uint32_t t = 0; t < NumThreads; ++t)
+            {
+                Threads.emplace_back([&, t]()
+                {
+                    NumReady.fetch_add(1);
+                    while (!Go.load())
+                        std::this_thread::yield();
+                    ThreadFunc(t);
+                });
+            }
+            while (NumReady.load() < NumThreads)
+                std::this_thread::yield();
+
+            const auto Start = std::chrono::steady_clock::now();
+            Go.store(true);
+            for (std::thread& Thread : Threads)
+                Thread.join();
+            return std::chrono::duration<double>(std::chrono::steady_clock::now() - Start).count();
+        };
+
+        auto Lookup = [&]( uint32_t Index )
+        {
+            const PipelineDesc& Desc = Descs[Index];
+            FakePipelineState* PSO = Cache.GetOrCreate(Desc, [&Device, &Desc]() { return Device.CreatePipelineState(Desc); });
+            if (PSO == nullptr || PSO->GetId() != Index)
+                NumWrong.fetch_add(1);
+        };
+
+        // Every thread finalizes every PSO, starting at a different one, as when loading screens spread PSO
+        // creation over workers
+        ColdSeconds = RunThreads([&]( uint32_t t )
+        {
+            const uint32_t First = t * g_NumDescs / NumThreads;
+            for (uint32_t i = 0; i < g_NumDescs; ++i)
+                Lookup((First + i) % g_NumDescs);
+        });
+
+        // Every PSO exists now, so this is the cost of finding one while recording command lists
+        WarmSeconds = RunThreads([&]( uint32_t t )
+        {
+            uint32_t State = 0x9E3779B9u * (t + 1);
+            for (uint32_t i = 0; i < g_LookupsPerThread; ++i)
+                Lookup(NextRandom(State) % g_NumDescs);
+        });
+
+        if (Device.GetNumCreated() != g_NumDescs || NumWrong != 0)
+        {
+            fprintf(stderr, "FAILED: %u PSOs created for %u descriptions, %u lookups returned the wrong PSO\n",
+                Device.GetNumCreated(), g_NumDescs, NumWrong.load());
+            g_Failed = true;
+        }
+    }
+}
+
+int main( int argc, char** argv )
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "-k") == 0 && i + 1 < argc)
+            g_NumDescs = std::max(1, atoi(argv[++i]));
+        else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc)
+            g_CompileMicroseconds = std::max(0, atoi(argv[++i]));
+        else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+            g_LookupsPerThread = std::max(1, atoi(argv[++i]));
+        else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc)
+            g_MaxThreads = std::max(1, atoi(argv[++i]));
+        else
+        {
+            fprintf(stderr, "Usage: %s [-k <PSOs>] [-c <compile microseconds>] [-n <lookups per thread>] [-t <max threads>]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if (g_MaxThreads == 0)
+        g_MaxThreads = std::max(1u, std::thread::hardware_concurrency());
+
+    const std::vector<PipelineDesc> Descs = MakeDescs();
+
+    printf("%u PSOs, %u us to compile each, %u lookups per thread\n", g_NumDescs, g_CompileMicroseconds, g_LookupsPerThread);
+    printf("%8s %24s %24s\n", "", "first finalize, ms", "lookup, ns");
+    printf("%8s %11s %12s %11s %12s\n", "threads", "sharded", "single lock", "sharded", "single lock");
+
+    for (uint32_t NumThreads = 1; ; NumThreads = std::min(NumThreads * 2, g_MaxThreads))
+    {
+        double ShardedCold, ShardedWarm, SingleLockCold, SingleLockWarm;
+        Measure<ShardedCache>(NumThreads, Descs, ShardedCold, ShardedWarm);
+        Measure<SingleLockCache>(NumThreads, Descs, SingleLockCold, SingleLockWarm);
+
+        // Lookup time is per lookup on each thread, so it stays flat when threads don't contend
+        printf("%8u %11.2f %12.2f %11.1f %12.1f\n", NumThreads,
+            ShardedCold * 1e3, SingleLockCold * 1e3,
+            ShardedWarm * 1e9 / g_LookupsPerThread, SingleLockWarm * 1e9 / g_LookupsPerThread);
+
+        if (NumThreads == g_MaxThreads)
+            break;
+    }
+
+    return g_Failed ? 1 : 0;
+}
@@ -0,0 +1,51 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+// Stands in for Core/pch.h when Hash.cpp and StateObjectCache.h are built without the rest of the engine.
+// Outside of Windows, ComPtr is reduced to the reference counting that the cache relies on.
+//
+
+#pragma once
+
+#include <cassert>
+#include <stdint.h>
+#include <utility>
+
+#define ASSERT( isTrue, ... ) assert(isTrue)
+
+#ifdef _WIN32
+#include <wrl/client.h>
+#else
+namespace Microsoft
+{
+    namespace WRL
+    {
+        template <typename T>
+        class ComPtr
+        {
+        public:
+            ComPtr() : m_Ptr(nullptr) {}
+            ComPtr( T* Ptr ) : m_Ptr(Ptr) { if (m_Ptr) m_Ptr->AddRef(); }
+            ComPtr( const ComPtr& rhs ) : m_Ptr(rhs.m_Ptr) { if (m_Ptr) m_Ptr->AddRef(); }
+            ComPtr( ComPtr&& rhs ) : m_Ptr(rhs.m_Ptr) { rhs.m_Ptr = nullptr; }
+            ~ComPtr() { if (m_Ptr) m_Ptr->Release(); }
+
+            ComPtr& operator=( ComPtr rhs ) { std::swap(m_Ptr, rhs.m_Ptr); return *this; }
+
+            T* Get( void ) const { return m_Ptr; }
+            T* operator->( void ) const { return m_Ptr; }
+
+            // Takes ownership without adding a reference, as when an object is returned by a device
+            void Attach( T* Ptr ) { ComPtr Old; Old.m_Ptr = m_Ptr; m_Ptr = Ptr; }
+
+        private:
+            T* m_Ptr;
+        };
+    }
+}
+#endif
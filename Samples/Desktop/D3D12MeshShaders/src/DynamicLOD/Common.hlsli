@@ -47,6 +47,10 @@ struct MeshInfo
     uint MeshletCount;
     uint LastMeshletVertCount;
     uint LastMeshletPrimCount;
+
+    float3 PositionScale;  // Packed positions decode to offset + scale * value
+    uint   PackedVertices; // Positions as R16G16B16A16_UNORM & octahedral normals as R16G16_SNORM
+    float3 PositionOffset;
 };
 
 struct Vertex
@@ -67,7 +71,7 @@ ConstantBuffer<Constants>  Constants : register(b0);
 ConstantBuffer<DrawParams> DrawParams : register(b1);
 
 ConstantBuffer<MeshInfo>   MeshInfo[MAX_LOD_LEVELS] : register(b2);
-StructuredBuffer<Vertex>   Vertices[MAX_LOD_LEVELS] : register(t0);
+ByteAddressBuffer          Vertices[MAX_LOD_LEVELS] : register(t0);
 StructuredBuffer<Meshlet>  Meshlets[MAX_LOD_LEVELS] : register(t8);
 ByteAddressBuffer          UniqueVertexIndices[MAX_LOD_LEVELS] : register(t16);
 StructuredBuffer<uint>     PrimitiveIndices[MAX_LOD_LEVELS] : register(t24);
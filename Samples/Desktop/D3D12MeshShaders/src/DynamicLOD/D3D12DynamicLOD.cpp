@@ -48,6 +48,10 @@ namespace
 
 const float D3D12DynamicLOD::c_fovy = XM_PI / 3.0f;
 
+// Written by 'WavefrontConverter -lod 5 Dragon.obj' - one mesh per level of detail, most detailed first.
+const wchar_t* D3D12DynamicLOD::c_lodChainFilename = L"..\\Assets\\Dragon.bin";
+
+// One file per level of detail, used if the single LOD chain file hasn't been generated.
 const wchar_t* D3D12DynamicLOD::c_lodFilenames[] =
 {
     L"..\\Assets\\Dragon_LOD0.bin",
@@ -335,31 +339,56 @@ void D3D12DynamicLOD::LoadAssets()
         ThrowIfFailed(m_device->CreatePipelineState(&streamDesc, IID_PPV_ARGS(&m_pipelineState)));
     }
 
-    m_lods.resize(_countof(c_lodFilenames));
-    for (uint32_t i = 0; i < static_cast<uint32_t>(m_lods.size()); ++i)
+    // Load the whole LOD chain from a single file if one is available, otherwise one file per level.
+    m_models.resize(1);
+    if (FAILED(m_models[0].LoadFromFile(c_lodChainFilename, true)))
     {
-        auto& lod = m_lods[i];
+        m_models.clear();
+        m_models.resize(_countof(c_lodFilenames));
 
-        // Load and upload model resources to the GPU
+        for (uint32_t i = 0; i < static_cast<uint32_t>(m_models.size()); ++i)
+        {
+            ThrowIfFailed(m_models[i].LoadFromFile(c_lodFilenames[i], true));
+        }
+    }
+
+    for (auto& model : m_models)
+    {
+        // Upload model resources to the GPU
         // Just use the D3D12_COMMAND_LIST_TYPE_DIRECT queue since it's a one-and-done operation. 
         // For per-frame uploads consider using the D3D12_COMMAND_LIST_TYPE_COPY command queue.
-        lod.LoadFromFile(c_lodFilenames[i]);
-        lod.UploadGpuResources(m_device.Get(), m_commandQueue.Get(), m_commandAllocators[m_frameIndex].Get(), m_commandList.Get());
+        model.UploadGpuResources(m_device.Get(), m_commandQueue.Get(), m_commandAllocators[m_frameIndex].Get(), m_commandList.Get());
 
-#ifdef _DEBUG
-        // Mesh shader file expects a certain vertex layout; assert our mesh conforms to that layout.
-        const D3D12_INPUT_ELEMENT_DESC c_elementDescs[2] =
+        for (uint32_t i = 0; i < model.GetMeshCount() && m_lods.size() < MAX_LOD_LEVELS; ++i)
         {
-            { "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, D3D12_APPEND_ALIGNED_ELEMENT, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 1 },
-            { "NORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, D3D12_APPEND_ALIGNED_ELEMENT, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 1 },
-        };
+            m_lods.push_back(&model.GetMesh(i));
+        }
+    }
 
-        assert(lod.GetMesh(0).LayoutDesc.NumElements == 2);
+#ifdef _DEBUG
+    // Mesh shader file expects a certain vertex layout; assert our meshes conform to that layout.
+    const D3D12_INPUT_ELEMENT_DESC c_elementDescs[2] =
+    {
+        { "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, D3D12_APPEND_ALIGNED_ELEMENT, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 1 },
+        { "NORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, D3D12_APPEND_ALIGNED_ELEMENT, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 1 },
+    };
 
-        for (uint32_t i = 0; i < _countof(c_elementDescs); ++i)
-            assert(std::memcmp(&lod.GetMesh(0).LayoutElems[i], &c_elementDescs[i], sizeof(D3D12_INPUT_ELEMENT_DESC)) == 0);
-#endif
+    // Or its packed form, as exported by the converter's -q switch.
+    const D3D12_INPUT_ELEMENT_DESC c_packedElementDescs[2] =
+    {
+        { "POSITION", 0, DXGI_FORMAT_R16G16B16A16_UNORM, 0, D3D12_APPEND_ALIGNED_ELEMENT, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 1 },
+        { "NORMAL", 0, DXGI_FORMAT_R16G16_SNORM, 0, D3D12_APPEND_ALIGNED_ELEMENT, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 1 },
+    };
+
+    for (auto lod : m_lods)
+    {
+        assert(lod->LayoutDesc.NumElements == 2);
+
+        auto& expectedDescs = lod->PackedVertices ? c_packedElementDescs : c_elementDescs;
+        for (uint32_t i = 0; i < _countof(expectedDescs); ++i)
+            assert(std::memcmp(&lod->LayoutElems[i], &expectedDescs[i], sizeof(D3D12_INPUT_ELEMENT_DESC)) == 0);
     }
+#endif
 
     D3D12_CPU_DESCRIPTOR_HANDLE srvHandle = m_srvHeap->GetCPUDescriptorHandleForHeapStart();
     auto OffsetHandle = [=](uint32_t index) { return D3D12_CPU_DESCRIPTOR_HANDLE{ srvHandle.ptr + SIZE_T(index) * m_srvDescriptorSize }; };
@@ -367,7 +396,7 @@ void D3D12DynamicLOD::LoadAssets()
     // Populate descriptor table with arrays of SRVs for each LOD
     for (uint32_t i = 0; i < static_cast<uint32_t>(m_lods.size()); ++i)
     {
-        auto& m = m_lods[i].GetMesh(0);
+        auto& m = *m_lods[i];
 
         // Mesh Info Buffers
         D3D12_CONSTANT_BUFFER_VIEW_DESC cbvDesc = {};
@@ -382,11 +411,6 @@ void D3D12DynamicLOD::LoadAssets()
         srvDesc.Buffer.FirstElement     = 0;
         srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
 
-        // Vertices
-        srvDesc.Buffer.StructureByteStride = m.VertexStrides[0]; // We assume we'll only use the first vertex buffer
-        srvDesc.Buffer.NumElements         = m.VertexCount;
-        m_device->CreateShaderResourceView(m.VertexResources[0].Get(), &srvDesc, OffsetHandle(SRV_VertexLODs + i));
-
         // Meshlets
         srvDesc.Buffer.StructureByteStride = sizeof(Meshlet);
         srvDesc.Buffer.NumElements         = static_cast<uint32_t>(m.Meshlets.size());
@@ -403,6 +427,10 @@ void D3D12DynamicLOD::LoadAssets()
         srvDesc.Buffer.NumElements         = DivRoundUp(static_cast<uint32_t>(m.UniqueVertexIndices.size()), 4);
         srvDesc.Buffer.Flags               = D3D12_BUFFER_SRV_FLAG_RAW;
         m_device->CreateShaderResourceView(m.UniqueVertexIndexResource.Get(), &srvDesc, OffsetHandle(SRV_UniqueVertexIndexLODs + i));
+
+        // Vertices - read as raw bytes since packed and full precision layouts differ
+        srvDesc.Buffer.NumElements         = m.VertexCount * m.VertexStrides[0] / 4; // We assume we'll only use the first vertex buffer
+        m_device->CreateShaderResourceView(m.VertexResources[0].Get(), &srvDesc, OffsetHandle(SRV_VertexLODs + i));
     }
 
     // Null-out remaining LOD slots in the descriptor table.
@@ -415,9 +443,6 @@ void D3D12DynamicLOD::LoadAssets()
         srvDesc.ViewDimension = D3D12_SRV_DIMENSION_BUFFER;
         srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
 
-        srvDesc.Buffer.StructureByteStride = 24;
-        m_device->CreateShaderResourceView(nullptr, &srvDesc, OffsetHandle(SRV_VertexLODs + i));
-
         srvDesc.Buffer.StructureByteStride = sizeof(Meshlet);
         m_device->CreateShaderResourceView(nullptr, &srvDesc, OffsetHandle(SRV_MeshletLODs + i));
 
@@ -428,6 +453,7 @@ void D3D12DynamicLOD::LoadAssets()
         srvDesc.Buffer.StructureByteStride = 0;
         srvDesc.Buffer.Flags = D3D12_BUFFER_SRV_FLAG_RAW;
         m_device->CreateShaderResourceView(nullptr, &srvDesc, OffsetHandle(SRV_UniqueVertexIndexLODs + i));
+        m_device->CreateShaderResourceView(nullptr, &srvDesc, OffsetHandle(SRV_VertexLODs + i));
     }
     
     // Create synchronization objects and wait until assets have been uploaded to the GPU.
@@ -662,7 +688,7 @@ void D3D12DynamicLOD::RegenerateInstances()
 {
     m_updateInstances = true;
 
-    const float radius = m_lods[0].GetBoundingSphere().Radius;
+    const float radius = m_lods[0]->BoundingSphere.Radius;
     const float padding = 0.5f;
     const float spacing = (1.0f + padding) * radius;
 
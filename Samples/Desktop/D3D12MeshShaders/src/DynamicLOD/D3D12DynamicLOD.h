@@ -95,7 +95,8 @@ private:
 
     StepTimer                           m_timer;
     SimpleCamera                        m_camera;
-    std::vector<Model>                  m_lods;
+    std::vector<Model>                  m_models;
+    std::vector<const Mesh*>            m_lods;
     RenderMode                          m_renderMode;
     uint32_t                            m_instanceLevel;
 
@@ -105,6 +106,7 @@ private:
 private:
     static const float    c_fovy;
 
+    static const wchar_t* c_lodChainFilename;
     static const wchar_t* c_lodFilenames[];
 
     static const wchar_t* c_ampShaderFilename;
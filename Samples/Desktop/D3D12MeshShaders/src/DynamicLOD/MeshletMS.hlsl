@@ -52,10 +52,48 @@ uint GetVertexIndex(uint lodIndex, Meshlet m, uint localIndex)
     }
 }
 
+float3 DecodeOctahedral(uint packed)
+{
+    // Sign extend the pair of 16-bit snorm values
+    float2 p = max(float2(asint(packed << 16) >> 16, asint(packed) >> 16) / 32767.0, -1.0);
+
+    // Unfold the lower hemisphere of the octahedron & project back onto the unit sphere.
+    float3 n = float3(p, 1.0 - abs(p.x) - abs(p.y));
+    if (n.z < 0)
+    {
+        n.xy = (1.0 - abs(n.yx)) * (step(0.0, n.xy) * 2.0 - 1.0);
+    }
+
+    return normalize(n);
+}
+
+Vertex GetVertex(uint lodIndex, uint vertexIndex)
+{
+    Vertex v;
+
+    if (MeshInfo[lodIndex].PackedVertices)
+    {
+        // 12-byte vertex: 4 x 16-bit position followed by the octahedral normal
+        uint3 packed = Vertices[lodIndex].Load3(vertexIndex * 12);
+        float3 position = float3(packed.x & 0xffff, packed.x >> 16, packed.y & 0xffff) / 65535.0;
+
+        v.Position = MeshInfo[lodIndex].PositionOffset + MeshInfo[lodIndex].PositionScale * position;
+        v.Normal = DecodeOctahedral(packed.z);
+    }
+    else
+    {
+        // 24-byte vertex: float3 position followed by float3 normal
+        v.Position = asfloat(Vertices[lodIndex].Load3(vertexIndex * 24));
+        v.Normal = asfloat(Vertices[lodIndex].Load3(vertexIndex * 24 + 12));
+    }
+
+    return v;
+}
+
 VertexOut GetVertexAttributes(uint lodIndex, uint meshletIndex, uint vertexIndex, uint instanceIndex)
 {
     Instance n = Instances[DrawParams.InstanceOffset + instanceIndex];
-    Vertex v = Vertices[lodIndex][vertexIndex];
+    Vertex v = GetVertex(lodIndex, vertexIndex);
 
     float4 positionWS = mul(float4(v.Position, 1), n.World);
 
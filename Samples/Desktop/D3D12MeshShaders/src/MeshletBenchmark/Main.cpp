@@ -0,0 +1,696 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+
+// Headless benchmark for the MeshletGenerator library. Requires no GPU or D3D12 runtime - only the DirectXMath
+// headers and the D3D12 headers for the base types used by the generator interface (see readme.md).
+
+#ifndef _WIN32
+#include <wsl/winadapter.h>
+#endif
+
+#include <D3D12MeshletGenerator.h>
+#include <Utilities.h>
+
+#include "MappedFile.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace DirectX;
+
+namespace
+{
+    const uint32_t c_prolog = ('M' << 24) | ('S' << 16) | ('H' << 8) | 'L'; // 'MSHL'
+
+    enum FileVersion
+    {
+        FILE_VERSION_INITIAL = 0,
+        FILE_VERSION_ATTRIBUTE_FORMATS = 1,
+        CURRENT_FILE_VERSION = FILE_VERSION_ATTRIBUTE_FORMATS
+    };
+
+    enum AttributeType : uint32_t
+    {
+        Position,
+        Normal,
+        TexCoord,
+        Tangent,
+        Bitangent,
+        AttributeCount
+    };
+
+    enum AttributeFormat : uint32_t
+    {
+        Float,
+        UNorm16,
+        Octahedral,
+        Half,
+    };
+
+    struct FileHeader
+    {
+        uint32_t Prolog;
+        uint32_t Version;
+
+        uint32_t MeshCount;
+        uint32_t AccessorCount;
+        uint32_t BufferViewCount;
+        uint32_t BufferSize;
+    };
+
+    struct MeshHeader
+    {
+        uint32_t Indices;
+        uint32_t IndexSubsets;
+        uint32_t Attributes[AttributeCount];
+
+        uint32_t Meshlets;
+        uint32_t MeshletSubsets;
+        uint32_t UniqueVertexIndices;
+        uint32_t PrimitiveIndices;
+        uint32_t CullData;
+    };
+
+    struct BufferView
+    {
+        uint32_t Offset;
+        uint32_t Size;
+    };
+
+    struct AccessorInitial
+    {
+        uint32_t BufferView;
+        uint32_t Offset;
+        uint32_t Size;
+        uint32_t Stride;
+        uint32_t Count;
+    };
+
+    struct Accessor : AccessorInitial
+    {
+        uint32_t Format;
+        XMFLOAT3 DecodeScale;
+        XMFLOAT3 DecodeOffset;
+    };
+
+    // Geometry required to drive the generator - positions and 32-bit indices split into subsets.
+    struct InputMesh
+    {
+        std::string           Name;
+        std::vector<XMFLOAT3> Positions;
+        std::vector<uint32_t> Indices;
+        std::vector<Subset>   IndexSubsets;
+    };
+
+    struct BenchmarkOptions
+    {
+        uint32_t    MeshletMaxVerts;
+        uint32_t    MeshletMaxPrims;
+        uint32_t    Iterations;
+        std::string OutputPath;
+
+        BenchmarkOptions(void)
+            : MeshletMaxVerts(64)
+            , MeshletMaxPrims(126)
+            , Iterations(3)
+        { }
+    };
+
+    struct MeshResult
+    {
+        std::string Name;
+        uint32_t    VertexCount;
+        uint32_t    TriangleCount;
+        uint32_t    SubsetCount;
+
+        // Best-of-N wall times in milliseconds
+        double      AdjacencyMs;
+        double      MeshletizeMs;
+        double      CullDataMs;
+
+        uint32_t    MeshletCount;
+        double      VertexFill;      // Average meshlet vertex count / max vertex count
+        double      PrimitiveFill;   // Average meshlet primitive count / max primitive count
+        double      VertsPerTri;     // Meshlet vertices emitted per triangle (lower is better; 0.5 is ideal for a closed mesh)
+        double      VertexReuse;     // Average number of triangles referencing each emitted meshlet vertex
+        double      SphereTightness; // Sphere radius / half meshlet AABB diagonal (1.0 is the AABB-enclosing sphere)
+        double      ConeAngleDeg;    // Average normal cone half-angle of non-degenerate meshlets
+        double      DegenerateCones; // Fraction of meshlets whose normals are too spread out for a usable cone
+        double      TrianglesPerSec; // Triangles meshletized per second
+    };
+
+    using Clock = std::chrono::high_resolution_clock;
+
+    double ElapsedMs(Clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    }
+
+    void PrintHelp()
+    {
+        std::cout << std::endl;
+        std::cout << "---------------------------- Meshlet Benchmark ----------------------------" << std::endl;
+        std::cout << "This tool measures build time and output quality of the meshlet generator." << std::endl;
+        std::cout << std::endl;
+
+        std::cout << "Usage:" << std::endl;
+        std::cout << "\t<string list> -- Specifies paths to the .obj or .bin files to process." << std::endl;
+        std::cout << std::endl;
+
+        std::cout << "Switches:" << std::endl;
+        std::cout << "\t-h            -- Display this help message." << std::endl;
+        std::cout << "\t-v <int>      -- Specifies the maximum vertex count of a meshlet. Must be less than 256. Default is 64" << std::endl;
+        std::cout << "\t-p <int>      -- Specifies the maximum primitive count of a meshlet. Must be less than 256. Default is 126" << std::endl;
+        std::cout << "\t-n <int>      -- Number of timed iterations per stage; the fastest is reported. Default is 3" << std::endl;
+        std::cout << "\t-o <path>     -- Writes the JSON report to a file instead of stdout." << std::endl;
+        std::cout << std::endl;
+
+        std::cout << "Example:" << std::endl;
+        std::cout << "\tMeshletBenchmark -v 64 -p 126 -o results.json Path/To/Dragon.obj Path/To/ToyRobot.bin" << std::endl;
+        std::cout << std::endl;
+    }
+
+    bool ParseCommandLine(int argc, const char* args[], std::vector<std::string>& files, BenchmarkOptions& options)
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            if (std::strcmp(args[i], "-h") == 0)
+            {
+                PrintHelp();
+                return false;
+            }
+            else if (std::strcmp(args[i], "-v") == 0 || std::strcmp(args[i], "-p") == 0 || std::strcmp(args[i], "-n") == 0)
+            {
+                if (i + 1 == argc)
+                {
+                    std::cerr << "Must provide an integral value if supplying the " << args[i] << " switch." << std::endl;
+                    return false;
+                }
+
+                uint32_t value = std::strtoul(args[i + 1], nullptr, 10);
+
+                switch (args[i][1])
+                {
+                case 'v': options.MeshletMaxVerts = std::min(std::max(value, 3u), 255u); break;
+                case 'p': options.MeshletMaxPrims = std::min(std::max(value, 1u), 255u); break;
+                case 'n': options.Iterations = std::max(value, 1u); break;
+                }
+                ++i;
+            }
+            else if (std::strcmp(args[i], "-o") == 0)
+            {
+                if (i + 1 == argc)
+                {
+                    std::cerr << "Must provide a file path if supplying the -o switch." << std::endl;
+                    return false;
+                }
+
+                options.OutputPath = args[++i];
+            }
+            else
+            {
+                files.push_back(args[i]);
+            }
+        }
+
+        if (files.empty())
+        {
+            PrintHelp();
+            return false;
+        }
+
+        return true;
+    }
+
+    // Loads positions & faces from a Wavefront OBJ file. Only geometry is needed by the generator, so vertices are
+    // indexed by position alone and polygons are fan-triangulated. Each 'usemtl' statement starts a new subset.
+    bool LoadObj(const std::string& filename, InputMesh& mesh)
+    {
+        std::ifstream stream(filename);
+        if (!stream.is_open())
+        {
+            std::cerr << "Failed to open file '" << filename << "'." << std::endl;
+            return false;
+        }
+
+        std::string line;
+        std::vector<uint32_t> face;
+
+        auto closeSubset = [&]()
+        {
+            uint32_t offset = mesh.IndexSubsets.empty() ? 0 : mesh.IndexSubsets.back().Offset + mesh.IndexSubsets.back().Count;
+            uint32_t count = static_cast<uint32_t>(mesh.Indices.size()) - offset;
+
+            if (count > 0)
+            {
+                mesh.IndexSubsets.push_back({ offset, count });
+            }
+        };
+
+        while (std::getline(stream, line))
+        {
+            const char* curr = line.c_str();
+            while (*curr == ' ' || *curr == '\t')
+                ++curr;
+
+            if (curr[0] == 'v' && (curr[1] == ' ' || curr[1] == '\t'))
+            {
+                char* end = nullptr;
+
+                XMFLOAT3 p;
+                p.x = std::strtof(curr + 2, &end);
+                p.y = std::strtof(end, &end);
+                p.z = std::strtof(end, &end);
+
+                mesh.Positions.push_back(p);
+            }
+            else if (curr[0] == 'f' && (curr[1] == ' ' || curr[1] == '\t'))
+            {
+                face.clear();
+
+                std::istringstream tokens(curr + 2);
+                std::string token;
+
+                while (tokens >> token)
+                {
+                    // Only the position index (before the first '/') is relevant; negative indices are relative.
+                    long index = std::strtol(token.c_str(), nullptr, 10);
+                    index = index < 0 ? static_cast<long>(mesh.Positions.size()) + index : index - 1;
+
+                    if (index < 0 || index >= static_cast<long>(mesh.Positions.size()))
+                    {
+                        std::cerr << "Invalid face index in file '" << filename << "'." << std::endl;
+                        return false;
+                    }
+
+                    face.push_back(static_cast<uint32_t>(index));
+                }
+
+                for (uint32_t i = 2; i < face.size(); ++i)
+                {
+                    mesh.Indices.push_back(face[0]);
+                    mesh.Indices.push_back(face[i - 1]);
+                    mesh.Indices.push_back(face[i]);
+                }
+            }
+            else if (std::strncmp(curr, "usemtl", 6) == 0)
+            {
+                closeSubset();
+            }
+        }
+
+        closeSubset();
+
+        return true;
+    }
+
+    // Loads positions, indices & index subsets from every mesh in a file exported by the Wavefront Converter. The file is
+    // memory-mapped, the same as the samples load it, so the data section is read in place rather than copied.
+    bool LoadBin(const std::string& filename, std::vector<InputMesh>& output)
+    {
+        MappedFile file;
+        if (!file.Open(filename.c_str()))
+        {
+            std::cerr << "Failed to open file '" << filename << "'." << std::endl;
+            return false;
+        }
+
+        const uint8_t* data = file.GetData();
+        size_t offset = 0;
+
+        // Copies the next size bytes of the metadata block, failing if the file is too short.
+        auto read = [&](void* dest, size_t size)
+        {
+            if (file.GetSize() - offset < size)
+                return false;
+
+            std::memcpy(dest, data + offset, size);
+            offset += size;
+            return true;
+        };
+
+        FileHeader header;
+        if (!read(&header, sizeof(header)) || header.Prolog != c_prolog || header.Version > CURRENT_FILE_VERSION)
+        {
+            std::cerr << "File '" << filename << "' is not a supported meshlet file." << std::endl;
+            return false;
+        }
+
+        std::vector<MeshHeader> meshes(header.MeshCount);
+        std::vector<Accessor> accessors(header.AccessorCount);
+        std::vector<BufferView> bufferViews(header.BufferViewCount);
+
+        bool complete = read(meshes.data(), meshes.size() * sizeof(meshes[0]));
+        if (header.Version == FILE_VERSION_INITIAL)
+        {
+            std::vector<AccessorInitial> initialAccessors(header.AccessorCount);
+            complete = complete && read(initialAccessors.data(), initialAccessors.size() * sizeof(initialAccessors[0]));
+
+            for (uint32_t i = 0; i < header.AccessorCount; ++i)
+            {
+                static_cast<AccessorInitial&>(accessors[i]) = initialAccessors[i];
+                accessors[i].Format = Float;
+            }
+        }
+        else
+        {
+            complete = complete && read(accessors.data(), accessors.size() * sizeof(accessors[0]));
+        }
+        complete = complete && read(bufferViews.data(), bufferViews.size() * sizeof(bufferViews[0]));
+
+        if (!complete || file.GetSize() - offset < header.BufferSize)
+        {
+            std::cerr << "File '" << filename << "' is truncated." << std::endl;
+            return false;
+        }
+
+        const uint8_t* buffer = data + offset;
+
+        for (uint32_t i = 0; i < header.MeshCount; ++i)
+        {
+            auto& meshView = meshes[i];
+
+            if (meshView.Attributes[Position] == uint32_t(-1))
+                continue;
+
+            InputMesh mesh;
+            mesh.Name = filename + "#" + std::to_string(i);
+
+            // Index data
+            {
+                const Accessor& accessor = accessors[meshView.Indices];
+                const uint8_t* src = buffer + bufferViews[accessor.BufferView].Offset + accessor.Offset;
+
+                mesh.Indices.resize(accessor.Count);
+                for (uint32_t j = 0; j < accessor.Count; ++j, src += accessor.Stride)
+                {
+                    if (accessor.Size == 4)
+                    {
+                        std::memcpy(&mesh.Indices[j], src, sizeof(uint32_t));
+                    }
+                    else
+                    {
+                        uint16_t index;
+                        std::memcpy(&index, src, sizeof(uint16_t));
+                        mesh.Indices[j] = index;
+                    }
+                }
+            }
+
+            // Index subset data
+            {
+                const Accessor& accessor = accessors[meshView.IndexSubsets];
+                const uint8_t* src = buffer + bufferViews[accessor.BufferView].Offset + accessor.Offset;
+
+                mesh.IndexSubsets.resize(accessor.Count);
+                std::memcpy(mesh.IndexSubsets.data(), src, accessor.Count * sizeof(Subset));
+            }
+
+            // Position data
+            {
+                const Accessor& accessor = accessors[meshView.Attributes[Position]];
+                const uint8_t* src = buffer + bufferViews[accessor.BufferView].Offset + accessor.Offset;
+
+                mesh.Positions.resize(accessor.Count);
+                for (uint32_t j = 0; j < accessor.Count; ++j, src += accessor.Stride)
+                {
+                    if (accessor.Format == UNorm16)
+                    {
+                        uint16_t q[3];
+                        std::memcpy(q, src, sizeof(q));
+
+                        mesh.Positions[j].x = accessor.DecodeOffset.x + accessor.DecodeScale.x * (q[0] / 65535.0f);
+                        mesh.Positions[j].y = accessor.DecodeOffset.y + accessor.DecodeScale.y * (q[1] / 65535.0f);
+                        mesh.Positions[j].z = accessor.DecodeOffset.z + accessor.DecodeScale.z * (q[2] / 65535.0f);
+                    }
+                    else
+                    {
+                        std::memcpy(&mesh.Positions[j], src, sizeof(XMFLOAT3));
+                    }
+                }
+            }
+
+            output.emplace_back(std::move(mesh));
+        }
+
+        return true;
+    }
+
+    template <typename T>
+    void RunMesh(const BenchmarkOptions& options, const InputMesh& input, const std::vector<T>& indices, MeshResult& result)
+    {
+        const uint32_t vertexCount = static_cast<uint32_t>(input.Positions.size());
+        const uint32_t indexCount = static_cast<uint32_t>(indices.size());
+
+        result.Name = input.Name;
+        result.VertexCount = vertexCount;
+        result.TriangleCount = indexCount / 3;
+        result.SubsetCount = static_cast<uint32_t>(input.IndexSubsets.size());
+        result.AdjacencyMs = result.MeshletizeMs = result.CullDataMs = 1e30;
+
+        std::vector<Subset> meshletSubsets;
+        std::vector<Meshlet> meshlets;
+        std::vector<uint8_t> uniqueVertexIndices;
+        std::vector<PackedTriangle> primitiveIndices;
+        std::vector<CullData> cullData;
+        std::vector<uint32_t> adjacency;
+
+        for (uint32_t iter = 0; iter < options.Iterations; ++iter)
+        {
+            // Adjacency on its own - ComputeMeshlets builds it again internally for each subset.
+            auto start = Clock::now();
+            for (auto& s : input.IndexSubsets)
+            {
+                adjacency.resize(s.Count);
+                BuildAdjacencyList(indices.data() + s.Offset, s.Count, input.Positions.data(), vertexCount, adjacency.data());
+            }
+            result.AdjacencyMs = std::min(result.AdjacencyMs, ElapsedMs(start));
+
+            meshletSubsets.clear();
+            meshlets.clear();
+            uniqueVertexIndices.clear();
+            primitiveIndices.clear();
+
+            start = Clock::now();
+            ComputeMeshlets(
+                options.MeshletMaxVerts, options.MeshletMaxPrims,
+                indices.data(), indexCount,
+                input.IndexSubsets.data(), static_cast<uint32_t>(input.IndexSubsets.size()),
+                input.Positions.data(), vertexCount,
+                meshletSubsets, meshlets, uniqueVertexIndices, primitiveIndices);
+            result.MeshletizeMs = std::min(result.MeshletizeMs, ElapsedMs(start));
+
+            cullData.resize(meshlets.size());
+
+            start = Clock::now();
+            ComputeCullData(
+                input.Positions.data(), vertexCount,
+                meshlets.data(), static_cast<uint32_t>(meshlets.size()),
+                reinterpret_cast<const T*>(uniqueVertexIndices.data()),
+                primitiveIndices.data(),
+                0,
+                cullData.data());
+            result.CullDataMs = std::min(result.CullDataMs, ElapsedMs(start));
+        }
+
+        // Quality metrics over the final iteration's output
+        const T* vertexIndices = reinterpret_cast<const T*>(uniqueVertexIndices.data());
+
+        uint64_t totalVerts = 0;
+        uint64_t totalPrims = 0;
+        double tightness = 0.0;
+        double coneAngle = 0.0;
+        uint32_t degenerate = 0;
+
+        for (uint32_t i = 0; i < static_cast<uint32_t>(meshlets.size()); ++i)
+        {
+            const Meshlet& m = meshlets[i];
+            const CullData& c = cullData[i];
+
+            totalVerts += m.VertCount;
+            totalPrims += m.PrimCount;
+
+            XMVECTOR vmin = g_XMFltMax;
+            XMVECTOR vmax = -g_XMFltMax;
+
+            for (uint32_t j = 0; j < m.VertCount; ++j)
+            {
+                XMVECTOR p = XMLoadFloat3(&input.Positions[vertexIndices[m.VertOffset + j]]);
+                vmin = XMVectorMin(vmin, p);
+                vmax = XMVectorMax(vmax, p);
+            }
+
+            float halfDiagonal = XMVectorGetX(XMVector3Length(vmax - vmin)) * 0.5f;
+            tightness += halfDiagonal > 0.0f ? c.BoundingSphere.w / halfDiagonal : 1.0;
+
+            // ComputeCullData writes a zero axis with the widest cutoff for degenerate cones. A wide valid cone can
+            // also round its cutoff up to 255, so the axis bytes are what tell them apart.
+            if (c.NormalCone[0] == 127 && c.NormalCone[1] == 127 && c.NormalCone[2] == 127 && c.NormalCone[3] == 255)
+            {
+                ++degenerate;
+            }
+            else
+            {
+                // NormalCone.w stores sin(a) of the cone half-angle a, quantized to 8 bits.
+                coneAngle += std::asin(c.NormalCone[3] / 255.0) * 180.0 / 3.14159265358979323846;
+            }
+        }
+
+        const uint32_t meshletCount = static_cast<uint32_t>(meshlets.size());
+        const uint32_t validCones = meshletCount - degenerate;
+
+        result.MeshletCount = meshletCount;
+        result.VertexFill = meshletCount ? double(totalVerts) / meshletCount / options.MeshletMaxVerts : 0.0;
+        result.PrimitiveFill = meshletCount ? double(totalPrims) / meshletCount / options.MeshletMaxPrims : 0.0;
+        result.VertsPerTri = totalPrims ? double(totalVerts) / totalPrims : 0.0;
+        result.VertexReuse = totalVerts ? double(totalPrims * 3) / totalVerts : 0.0;
+        result.SphereTightness = meshletCount ? tightness / meshletCount : 0.0;
+        result.ConeAngleDeg = validCones ? coneAngle / validCones : 0.0;
+        result.DegenerateCones = meshletCount ? double(degenerate) / meshletCount : 0.0;
+        result.TrianglesPerSec = result.MeshletizeMs > 0.0 ? result.TriangleCount / (result.MeshletizeMs * 1e-3) : 0.0;
+    }
+
+    void RunMesh(const BenchmarkOptions& options, const InputMesh& input, MeshResult& result)
+    {
+        // Match the converter's index size selection so results are representative of the exported data.
+        if (input.Positions.size() > 65536)
+        {
+            RunMesh(options, input, input.Indices, result);
+        }
+        else
+        {
+            std::vector<uint16_t> indices(input.Indices.begin(), input.Indices.end());
+            RunMesh(options, input, indices, result);
+        }
+    }
+
+    std::string EscapeJson(const std::string& str)
+    {
+        std::string out;
+        for (char c : str)
+        {
+            if (c == '"' || c == '\\')
+            {
+                out.push_back('\\');
+            }
+            out.push_back(c);
+        }
+        return out;
+    }
+
+    void WriteJson(std::ostream& stream, const BenchmarkOptions& options, const std::vector<MeshResult>& results)
+    {
+        stream << "{" << std::endl;
+        stream << "  \"maxVerts\": " << options.MeshletMaxVerts << "," << std::endl;
+        stream << "  \"maxPrims\": " << options.MeshletMaxPrims << "," << std::endl;
+        stream << "  \"iterations\": " << options.Iterations << "," << std::endl;
+        stream << "  \"meshes\": [" << std::endl;
+
+        for (size_t i = 0; i < results.size(); ++i)
+        {
+            const MeshResult& r = results[i];
+
+            stream << "    {" << std::endl;
+            stream << "      \"name\": \"" << EscapeJson(r.Name) << "\"," << std::endl;
+            stream << "      \"vertices\": " << r.VertexCount << "," << std::endl;
+            stream << "      \"triangles\": " << r.TriangleCount << "," << std::endl;
+            stream << "      \"subsets\": " << r.SubsetCount << "," << std::endl;
+            stream << "      \"timeMs\": { \"adjacency\": " << r.AdjacencyMs << ", \"meshletize\": " << r.MeshletizeMs << ", \"cullData\": " << r.CullDataMs << " }," << std::endl;
+            stream << "      \"trianglesPerSec\": " << r.TrianglesPerSec << "," << std::endl;
+            stream << "      \"meshlets\": " << r.MeshletCount << "," << std::endl;
+            stream << "      \"vertexFill\": " << r.VertexFill << "," << std::endl;
+            stream << "      \"primitiveFill\": " << r.PrimitiveFill << "," << std::endl;
+            stream << "      \"vertsPerTriangle\": " << r.VertsPerTri << "," << std::endl;
+            stream << "      \"vertexReuse\": " << r.VertexReuse << "," << std::endl;
+            stream << "      \"sphereTightness\": " << r.SphereTightness << "," << std::endl;
+            stream << "      \"coneAngleDeg\": " << r.ConeAngleDeg << "," << std::endl;
+            stream << "      \"degenerateCones\": " << r.DegenerateCones << std::endl;
+            stream << "    }" << (i + 1 < results.size() ? "," : "") << std::endl;
+        }
+
+        stream << "  ]" << std::endl;
+        stream << "}" << std::endl;
+    }
+}
+
+int main(int argc, const char* args[])
+{
+    std::vector<std::string> files;
+
+    BenchmarkOptions options;
+    if (!ParseCommandLine(argc, args, files, options))
+    {
+        return 1;
+    }
+
+    std::vector<InputMesh> inputs;
+    for (auto& filename : files)
+    {
+        auto extLoc = filename.find_last_of(".");
+        std::string ext = extLoc == std::string::npos ? "" : filename.substr(extLoc);
+
+        bool success;
+        if (ext == ".bin")
+        {
+            success = LoadBin(filename, inputs);
+        }
+        else
+        {
+            InputMesh mesh;
+            mesh.Name = filename;
+
+            success = LoadObj(filename, mesh);
+            if (success)
+            {
+                inputs.emplace_back(std::move(mesh));
+            }
+        }
+
+        if (!success)
+        {
+            return 1;
+        }
+    }
+
+    std::vector<MeshResult> results(inputs.size());
+    for (size_t i = 0; i < inputs.size(); ++i)
+    {
+        std::cerr << "Processing " << inputs[i].Name << " (" << inputs[i].Indices.size() / 3 << " triangles)" << std::endl;
+        RunMesh(options, inputs[i], results[i]);
+    }
+
+    if (options.OutputPath.empty())
+    {
+        WriteJson(std::cout, options, results);
+    }
+    else
+    {
+        std::ofstream stream(options.OutputPath);
+        if (!stream.is_open())
+        {
+            std::cerr << "Failed to open file '" << options.OutputPath << "' for writing." << std::endl;
+            return 1;
+        }
+
+        WriteJson(stream, options, results);
+    }
+
+    return 0;
+}
@@ -58,6 +58,9 @@ namespace
         case DXGI_FORMAT_R32G32B32_FLOAT: return 12;
         case DXGI_FORMAT_R32G32_FLOAT: return 8;
         case DXGI_FORMAT_R32_FLOAT: return 4;
+        case DXGI_FORMAT_R16G16B16A16_UNORM: return 8;
+        case DXGI_FORMAT_R16G16_SNORM: return 4;
+        case DXGI_FORMAT_R16G16_FLOAT: return 4;
         default: assert(false);
         }
         return 0;
@@ -430,7 +433,7 @@ void D3D12MeshletCull::LoadAssets()
         // Load and upload model resources to the GPU
         // Just use the D3D12_COMMAND_LIST_TYPE_DIRECT queue since it's a one-and-done operation. 
         // For per-frame uploads consider using the D3D12_COMMAND_LIST_TYPE_COPY command queue.
-        obj.Model.LoadFromFile(c_modelFilenames[def.ModelIndex]);
+        obj.Model.LoadFromFile(c_modelFilenames[def.ModelIndex], true);
         obj.Model.UploadGpuResources(m_device.Get(), m_commandQueue.Get(), m_commandAllocators[m_frameIndex].Get(), m_commandList.Get());
 
         const CD3DX12_HEAP_PROPERTIES instanceBufferHeapProps(D3D12_HEAP_TYPE_UPLOAD);
@@ -457,14 +460,22 @@ void D3D12MeshletCull::LoadAssets()
         { "NORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, D3D12_APPEND_ALIGNED_ELEMENT, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 1 },
     };
 
+    // Or its packed form, as exported by the converter's -q switch.
+    const D3D12_INPUT_ELEMENT_DESC c_packedElementDescs[2] =
+    {
+        { "POSITION", 0, DXGI_FORMAT_R16G16B16A16_UNORM, 0, D3D12_APPEND_ALIGNED_ELEMENT, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 1 },
+        { "NORMAL", 0, DXGI_FORMAT_R16G16_SNORM, 0, D3D12_APPEND_ALIGNED_ELEMENT, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 1 },
+    };
+
     for (auto& obj : m_objects)
     {
         for (auto& mesh : obj.Model)
         {
             assert(mesh.LayoutDesc.NumElements == 2);
 
-            for (uint32_t i = 0; i < _countof(c_elementDescs); ++i)
-                assert(std::memcmp(&mesh.LayoutElems[i], &c_elementDescs[i], sizeof(D3D12_INPUT_ELEMENT_DESC)) == 0);
+            auto& expectedDescs = mesh.PackedVertices ? c_packedElementDescs : c_elementDescs;
+            for (uint32_t i = 0; i < _countof(expectedDescs); ++i)
+                assert(std::memcmp(&mesh.LayoutElems[i], &expectedDescs[i], sizeof(D3D12_INPUT_ELEMENT_DESC)) == 0);
         }
     }
 #endif
@@ -830,9 +841,9 @@ void D3D12MeshletCull::Pick()
             uint32_t v1 = mesh.GetVertexIndex(meshlet.VertOffset + i1);
             uint32_t v2 = mesh.GetVertexIndex(meshlet.VertOffset + i2);
 
-            XMVECTOR p0 = XMLoadFloat3((XMFLOAT3*)(vbMem + v0 * stride + offset));
-            XMVECTOR p1 = XMLoadFloat3((XMFLOAT3*)(vbMem + v1 * stride + offset));
-            XMVECTOR p2 = XMLoadFloat3((XMFLOAT3*)(vbMem + v2 * stride + offset));
+            XMVECTOR p0 = mesh.DecodePosition(vbMem + v0 * stride + offset);
+            XMVECTOR p1 = mesh.DecodePosition(vbMem + v1 * stride + offset);
+            XMVECTOR p2 = mesh.DecodePosition(vbMem + v2 * stride + offset);
 
             XMVECTOR t = RayIntersectTriangle(org, dir, p0, p1, p2);
             if (XMVector4Less(t, minT))
@@ -0,0 +1,181 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+#pragma once
+
+#include <cstdint>
+#include <utility>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Read-only view of an entire file mapped into the address space. Pages are faulted in from the OS file cache on
+// first access, so the file contents are never copied into process-owned memory.
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    ~MappedFile() { Close(); }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    MappedFile(MappedFile&& other) noexcept { *this = std::move(other); }
+    MappedFile& operator=(MappedFile&& other) noexcept
+    {
+        if (this != &other)
+        {
+            Close();
+
+            std::swap(m_data, other.m_data);
+            std::swap(m_size, other.m_size);
+#ifdef _WIN32
+            std::swap(m_file, other.m_file);
+            std::swap(m_mapping, other.m_mapping);
+#endif
+        }
+        return *this;
+    }
+
+#ifdef _WIN32
+    bool Open(const wchar_t* filename)
+    {
+        Close();
+
+        m_file = CreateFileW(filename, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        return Map();
+    }
+
+    bool Open(const char* filename)
+    {
+        Close();
+
+        m_file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        return Map();
+    }
+
+    void Close()
+    {
+        if (m_data != nullptr)
+        {
+            UnmapViewOfFile(m_data);
+        }
+
+        if (m_mapping != nullptr)
+        {
+            CloseHandle(m_mapping);
+        }
+
+        if (m_file != INVALID_HANDLE_VALUE)
+        {
+            CloseHandle(m_file);
+        }
+
+        m_data = nullptr;
+        m_size = 0;
+        m_mapping = nullptr;
+        m_file = INVALID_HANDLE_VALUE;
+    }
+#else
+    bool Open(const char* filename)
+    {
+        Close();
+
+        int fd = open(filename, O_RDONLY);
+        if (fd == -1)
+        {
+            return false;
+        }
+
+        struct stat info;
+        if (fstat(fd, &info) != 0 || info.st_size == 0)
+        {
+            close(fd);
+            return false;
+        }
+
+        // The mapping holds its own reference to the file - the descriptor is no longer needed.
+        void* data = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+
+        if (data == MAP_FAILED)
+        {
+            return false;
+        }
+
+        m_data = static_cast<uint8_t*>(data);
+        m_size = static_cast<size_t>(info.st_size);
+
+        return true;
+    }
+
+    void Close()
+    {
+        if (m_data != nullptr)
+        {
+            munmap(m_data, m_size);
+        }
+
+        m_data = nullptr;
+        m_size = 0;
+    }
+#endif
+
+    bool IsOpen() const { return m_data != nullptr; }
+
+    const uint8_t* GetData() const { return m_data; }
+    size_t GetSize() const { return m_size; }
+
+private:
+#ifdef _WIN32
+    bool Map()
+    {
+        LARGE_INTEGER size;
+        if (m_file == INVALID_HANDLE_VALUE || !GetFileSizeEx(m_file, &size) || size.QuadPart == 0)
+        {
+            Close();
+            return false;
+        }
+
+        m_mapping = CreateFileMappingW(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (m_mapping == nullptr)
+        {
+            Close();
+            return false;
+        }
+
+        m_data = static_cast<uint8_t*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+        if (m_data == nullptr)
+        {
+            Close();
+            return false;
+        }
+
+        m_size = static_cast<size_t>(size.QuadPart);
+
+        return true;
+    }
+#endif
+
+private:
+    uint8_t* m_data = nullptr;
+    size_t   m_size = 0;
+
+#ifdef _WIN32
+    HANDLE   m_file = INVALID_HANDLE_VALUE;
+    HANDLE   m_mapping = nullptr;
+#endif
+};
@@ -39,7 +39,7 @@ struct Payload
 ConstantBuffer<Constants>   Constants           : register(b0);
 ConstantBuffer<MeshInfo>    MeshInfo            : register(b1);
 ConstantBuffer<Instance>    Instance            : register(b2);
-StructuredBuffer<Vertex>    Vertices            : register(t0);
+ByteAddressBuffer           Vertices            : register(t0);
 StructuredBuffer<Meshlet>   Meshlets            : register(t1);
 ByteAddressBuffer           UniqueVertexIndices : register(t2);
 StructuredBuffer<uint>      PrimitiveIndices    : register(t3);
@@ -43,9 +43,47 @@ uint3 GetPrimitive(Meshlet m, uint index)
     return UnpackPrimitive(PrimitiveIndices[m.PrimOffset + index]);
 }
 
+float3 DecodeOctahedral(uint packed)
+{
+    // Sign extend the pair of 16-bit snorm values
+    float2 p = max(float2(asint(packed << 16) >> 16, asint(packed) >> 16) / 32767.0, -1.0);
+
+    // Unfold the lower hemisphere of the octahedron & project back onto the unit sphere.
+    float3 n = float3(p, 1.0 - abs(p.x) - abs(p.y));
+    if (n.z < 0)
+    {
+        n.xy = (1.0 - abs(n.yx)) * (step(0.0, n.xy) * 2.0 - 1.0);
+    }
+
+    return normalize(n);
+}
+
+Vertex GetVertex(uint vertexIndex)
+{
+    Vertex v;
+
+    if (MeshInfo.PackedVertices)
+    {
+        // 12-byte vertex: 4 x 16-bit position followed by the octahedral normal
+        uint3 packed = Vertices.Load3(vertexIndex * 12);
+        float3 position = float3(packed.x & 0xffff, packed.x >> 16, packed.y & 0xffff) / 65535.0;
+
+        v.Position = MeshInfo.PositionOffset + MeshInfo.PositionScale * position;
+        v.Normal = DecodeOctahedral(packed.z);
+    }
+    else
+    {
+        // 24-byte vertex: float3 position followed by float3 normal
+        v.Position = asfloat(Vertices.Load3(vertexIndex * 24));
+        v.Normal = asfloat(Vertices.Load3(vertexIndex * 24 + 12));
+    }
+
+    return v;
+}
+
 VertexOut GetVertexAttributes(uint meshletIndex, uint vertexIndex)
 {
-    Vertex v = Vertices[vertexIndex];
+    Vertex v = GetVertex(vertexIndex);
 
     float4 positionWS = mul(float4(v.Position, 1), Instance.World);
 
@@ -16,6 +16,10 @@ struct MeshInfo
 
     uint LastMeshletVertCount;
     uint LastMeshletPrimCount;
+
+    float3 PositionScale;  // Packed positions decode to offset + scale * value
+    uint   PackedVertices; // Positions as R16G16B16A16_UNORM & octahedral normals as R16G16_SNORM
+    float3 PositionOffset;
 };
 
 struct Meshlet
@@ -10,9 +10,12 @@
 //*********************************************************
 #pragma once
 
+#include "MappedFile.h"
 #include "Span.h"
 
 #include <DirectXCollision.h>
+#include <iosfwd>
+#include <DirectXPackedVector.h>
 
 struct Attribute
 {
@@ -26,6 +29,15 @@ struct Attribute
         Count
     };
 
+    // Encoding of attribute data within a file - it is uploaded as stored & decoded by the shaders
+    enum EFormat : uint32_t
+    {
+        Float,      // Full precision floats
+        UNorm16,    // 16-bit unsigned normalized xyzw, decoded as offset + scale * value
+        Octahedral, // Unit vector octahedrally mapped to a 16-bit signed normalized pair
+        Half,       // 16-bit floats
+    };
+
     EType    Type;
     uint32_t Offset;
 };
@@ -43,6 +55,10 @@ struct MeshInfo
 
     uint32_t LastMeshletVertCount;
     uint32_t LastMeshletPrimCount;
+
+    DirectX::XMFLOAT3 PositionScale;
+    uint32_t          PackedVertices;
+    DirectX::XMFLOAT3 PositionOffset;
 };
 
 struct Meshlet
@@ -72,21 +88,26 @@ struct Mesh
     D3D12_INPUT_ELEMENT_DESC   LayoutElems[Attribute::Count];
     D3D12_INPUT_LAYOUT_DESC    LayoutDesc;
 
-    std::vector<Span<uint8_t>> Vertices;
+    std::vector<Span<const uint8_t>> Vertices;
     std::vector<uint32_t>      VertexStrides;
     uint32_t                   VertexCount;
     DirectX::BoundingSphere    BoundingSphere;
 
-    Span<Subset>               IndexSubsets;
-    Span<uint8_t>              Indices;
+    // Packed vertices hold UNorm16 positions & octahedral normals. Positions decode to offset + scale * value.
+    bool                       PackedVertices;
+    DirectX::XMFLOAT3          PositionScale;
+    DirectX::XMFLOAT3          PositionOffset;
+
+    Span<const Subset>         IndexSubsets;
+    Span<const uint8_t>        Indices;
     uint32_t                   IndexSize;
     uint32_t                   IndexCount;
 
-    Span<Subset>               MeshletSubsets;
-    Span<Meshlet>              Meshlets;
-    Span<uint8_t>              UniqueVertexIndices;
-    Span<PackedTriangle>       PrimitiveIndices;
-    Span<CullData>             CullingData;
+    Span<const Subset>         MeshletSubsets;
+    Span<const Meshlet>        Meshlets;
+    Span<const uint8_t>        UniqueVertexIndices;
+    Span<const PackedTriangle> PrimitiveIndices;
+    Span<const CullData>       CullingData;
 
     // D3D resource references
     std::vector<D3D12_VERTEX_BUFFER_VIEW>  VBViews;
@@ -120,6 +141,17 @@ struct Mesh
         i2 = prim.i2;
     }
 
+    DirectX::XMVECTOR DecodePosition(const uint8_t* data) const
+    {
+        if (!PackedVertices)
+        {
+            return DirectX::XMLoadFloat3(reinterpret_cast<const DirectX::XMFLOAT3*>(data));
+        }
+
+        DirectX::XMVECTOR v = DirectX::PackedVector::XMLoadUShortN4(reinterpret_cast<const DirectX::PackedVector::XMUSHORTN4*>(data));
+        return DirectX::XMVectorMultiplyAdd(v, DirectX::XMLoadFloat3(&PositionScale), DirectX::XMLoadFloat3(&PositionOffset));
+    }
+
     uint32_t GetVertexIndex(uint32_t index) const
     {
         const uint8_t* addr = UniqueVertexIndices.data() + index * IndexSize;
@@ -137,7 +169,12 @@ struct Mesh
 class Model
 {
 public:
-    HRESULT LoadFromFile(const wchar_t* filename);
+    // With memoryMap set the file is mapped read-only & mesh data spans point directly into the mapping for the
+    // lifetime of the model, rather than into a copy of the file contents.
+    HRESULT LoadFromFile(const char* filename, bool memoryMap = false);
+#ifdef _WIN32
+    HRESULT LoadFromFile(const wchar_t* filename, bool memoryMap = false);
+#endif
     HRESULT UploadGpuResources(ID3D12Device* device, ID3D12CommandQueue* cmdQueue, ID3D12CommandAllocator* cmdAlloc, ID3D12GraphicsCommandList* cmdList);
 
     uint32_t GetMeshCount() const { return static_cast<uint32_t>(m_meshes.size()); }
@@ -149,9 +186,13 @@ public:
     auto begin() { return m_meshes.begin(); }
     auto end() { return m_meshes.end(); }
 
+private:
+    HRESULT Load(std::istream& stream, bool memoryMap);
+
 private:
     std::vector<Mesh>                      m_meshes;
     DirectX::BoundingSphere                m_boundingSphere;
 
     std::vector<uint8_t>                   m_buffer;
+    MappedFile                             m_mappedFile;
 };
@@ -13,6 +13,9 @@
 #include "Generation.h"
 #include "Utilities.h"
 
+#include <algorithm>
+#include <cstring>
+
 using namespace DirectX;
 
 namespace
@@ -142,59 +145,92 @@ HRESULT internal::ComputeMeshlets(
 {
     UNREFERENCED_PARAMETER(indexCount);
 
+    // Subsets are independent - meshletize them concurrently. Hand out the largest subsets first to balance the workers.
+    std::vector<uint32_t> order(subsetCount);
     for (uint32_t i = 0; i < subsetCount; ++i)
     {
-        Subset s = indexSubsets[i];
+        assert(indexSubsets[i].Offset + indexSubsets[i].Count <= indexCount);
+        order[i] = i;
+    }
 
-        assert(s.Offset + s.Count <= indexCount);
+    std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return indexSubsets[a].Count > indexSubsets[b].Count; });
 
-        std::vector<InlineMeshlet<T>> builtMeshlets;
-        Meshletize(maxVerts, maxPrims, indices + s.Offset, s.Count, positions, vertexCount, builtMeshlets);
+    std::vector<std::vector<InlineMeshlet<T>>> builtMeshlets(subsetCount);
 
-        Subset meshletSubset;
-        meshletSubset.Offset = static_cast<uint32_t>(meshlets.size());
-        meshletSubset.Count = static_cast<uint32_t>(builtMeshlets.size());
-        meshletSubsets.push_back(meshletSubset);
+    ParallelFor(subsetCount, [&](uint32_t i)
+    {
+        Subset s = indexSubsets[order[i]];
+        Meshletize(maxVerts, maxPrims, indices + s.Offset, s.Count, positions, vertexCount, builtMeshlets[order[i]]);
+    });
 
-        // Determine final unique vertex index and primitive index counts & offsets.
-        uint32_t startVertCount = static_cast<uint32_t>(uniqueVertexIndices.size()) / sizeof(T);
-        uint32_t startPrimCount = static_cast<uint32_t>(primitiveIndices.size());
+    // Prefix-sum the meshlet, unique vertex index and primitive index counts in subset order. This keeps the output 
+    // layout identical to processing the subsets one after another.
+    struct SubsetOffsets
+    {
+        uint32_t Meshlet;
+        uint32_t Vert;
+        uint32_t Prim;
+    };
 
-        uint32_t uniqueVertexIndexCount = startVertCount;
-        uint32_t primitiveIndexCount = startPrimCount;
+    std::vector<SubsetOffsets> offsets(subsetCount);
 
-        // Resize the meshlet output array to hold the newly formed meshlets.
-        uint32_t meshletCount = static_cast<uint32_t>(meshlets.size());
-        meshlets.resize(meshletCount + builtMeshlets.size());
+    uint32_t meshletCount = static_cast<uint32_t>(meshlets.size());
+    uint32_t uniqueVertexIndexCount = static_cast<uint32_t>(uniqueVertexIndices.size()) / sizeof(T);
+    uint32_t primitiveIndexCount = static_cast<uint32_t>(primitiveIndices.size());
 
-        for (uint32_t j = 0, dest = meshletCount; j < static_cast<uint32_t>(builtMeshlets.size()); ++j, ++dest)
-        {
-            meshlets[dest].VertOffset = uniqueVertexIndexCount;
-            meshlets[dest].VertCount = static_cast<uint32_t>(builtMeshlets[j].UniqueVertexIndices.size());
-            uniqueVertexIndexCount += static_cast<uint32_t>(builtMeshlets[j].UniqueVertexIndices.size());
+    for (uint32_t i = 0; i < subsetCount; ++i)
+    {
+        offsets[i] = { meshletCount, uniqueVertexIndexCount, primitiveIndexCount };
+
+        Subset meshletSubset;
+        meshletSubset.Offset = meshletCount;
+        meshletSubset.Count = static_cast<uint32_t>(builtMeshlets[i].size());
+        meshletSubsets.push_back(meshletSubset);
+
+        meshletCount += meshletSubset.Count;
 
-            meshlets[dest].PrimOffset = primitiveIndexCount;
-            meshlets[dest].PrimCount = static_cast<uint32_t>(builtMeshlets[j].PrimitiveIndices.size());
-            primitiveIndexCount += static_cast<uint32_t>(builtMeshlets[j].PrimitiveIndices.size());
+        for (auto& m : builtMeshlets[i])
+        {
+            uniqueVertexIndexCount += static_cast<uint32_t>(m.UniqueVertexIndices.size());
+            primitiveIndexCount += static_cast<uint32_t>(m.PrimitiveIndices.size());
         }
+    }
+
+    // Allocate space for the new data.
+    meshlets.resize(meshletCount);
+    uniqueVertexIndices.resize(uniqueVertexIndexCount * sizeof(T));
+    primitiveIndices.resize(primitiveIndexCount);
 
-        // Allocate space for the new data.
-        uniqueVertexIndices.resize(uniqueVertexIndexCount * sizeof(T));
-        primitiveIndices.resize(primitiveIndexCount);
+    // Copy data from the freshly built meshlets into the output buffers - each subset writes a disjoint range.
+    ParallelFor(subsetCount, [&](uint32_t i)
+    {
+        const SubsetOffsets& o = offsets[i];
 
-        // Copy data from the freshly built meshlets into the output buffers.
-        auto vertDest = reinterpret_cast<T*>(uniqueVertexIndices.data()) + startVertCount;
-        auto primDest = reinterpret_cast<uint32_t*>(primitiveIndices.data()) + startPrimCount;
+        uint32_t vertOffset = o.Vert;
+        uint32_t primOffset = o.Prim;
 
-        for (uint32_t j = 0; j < static_cast<uint32_t>(builtMeshlets.size()); ++j)
+        auto vertDest = reinterpret_cast<T*>(uniqueVertexIndices.data()) + o.Vert;
+        auto primDest = reinterpret_cast<uint32_t*>(primitiveIndices.data()) + o.Prim;
+
+        for (uint32_t j = 0, dest = o.Meshlet; j < static_cast<uint32_t>(builtMeshlets[i].size()); ++j, ++dest)
         {
-            std::memcpy(vertDest, builtMeshlets[j].UniqueVertexIndices.data(), builtMeshlets[j].UniqueVertexIndices.size() * sizeof(T));
-            std::memcpy(primDest, builtMeshlets[j].PrimitiveIndices.data(), builtMeshlets[j].PrimitiveIndices.size() * sizeof(uint32_t));
+            const InlineMeshlet<T>& m = builtMeshlets[i][j];
+
+            meshlets[dest].VertOffset = vertOffset;
+            meshlets[dest].VertCount = static_cast<uint32_t>(m.UniqueVertexIndices.size());
+            vertOffset += static_cast<uint32_t>(m.UniqueVertexIndices.size());
+
+            meshlets[dest].PrimOffset = primOffset;
+            meshlets[dest].PrimCount = static_cast<uint32_t>(m.PrimitiveIndices.size());
+            primOffset += static_cast<uint32_t>(m.PrimitiveIndices.size());
 
-            vertDest += builtMeshlets[j].UniqueVertexIndices.size();
-            primDest += builtMeshlets[j].PrimitiveIndices.size();
+            std::memcpy(vertDest, m.UniqueVertexIndices.data(), m.UniqueVertexIndices.size() * sizeof(T));
+            std::memcpy(primDest, m.PrimitiveIndices.data(), m.PrimitiveIndices.size() * sizeof(uint32_t));
+
+            vertDest += m.UniqueVertexIndices.size();
+            primDest += m.PrimitiveIndices.size();
         }
-    }
+    });
 
     return S_OK;
 }
@@ -14,6 +14,7 @@
 #include <DirectXMath.h>
 
 #include <algorithm>
+#include <cfloat>
 #include <unordered_set>
 
 using namespace DirectX;
@@ -218,8 +219,9 @@ void internal::Meshletize(
     std::vector<bool> checklist;
     checklist.resize(triCount);
 
-    std::vector<XMFLOAT3> m_positions;
-    std::vector<XMFLOAT3> normals;
+    // Bounds of the meshlet under construction - updated incrementally as triangles are accepted.
+    BoundingSphereAccumulator positionBounds;
+    BoundingSphereAccumulator normalBounds;
     std::vector<std::pair<uint32_t, float>> candidates;
     std::unordered_set<uint32_t> candidateCheck;
 
@@ -253,7 +255,7 @@ void internal::Meshletize(
             // Success! Mark as added.
             checklist[index] = true;
 
-            // Add m_positions & normal to list
+            // Fold positions & normal into the meshlet bounds
             XMFLOAT3 points[3] =
             {
                 positions[tri[0]],
@@ -261,19 +263,17 @@ void internal::Meshletize(
                 positions[tri[2]],
             };
 
-            m_positions.push_back(points[0]);
-            m_positions.push_back(points[1]);
-            m_positions.push_back(points[2]);
+            positionBounds.Add(points[0]);
+            positionBounds.Add(points[1]);
+            positionBounds.Add(points[2]);
 
             XMFLOAT3 Normal;
             XMStoreFloat3(&Normal, ComputeNormal(points));
-            normals.push_back(Normal);
+            normalBounds.Add(Normal);
 
-            // Compute new bounding sphere & normal axis
-            psphere = MinimumBoundingSphere(m_positions.data(), static_cast<uint32_t>(m_positions.size()));
-            
-            XMVECTOR nsphere = MinimumBoundingSphere(normals.data(), static_cast<uint32_t>(normals.size()));
-            normal = XMVector3Normalize(nsphere);
+            // Fetch new bounding sphere & normal axis
+            psphere = positionBounds.GetSphere();
+            normal = XMVector3Normalize(normalBounds.GetSphere());
 
             // Find and add all applicable adjacent triangles to candidate list
             const uint32_t adjIndex = index * 3;
@@ -332,8 +332,8 @@ void internal::Meshletize(
             // Determine whether we need to move to the next meshlet.
             if (IsMeshletFull(maxVerts, maxPrims, *curr))
             {
-                m_positions.clear();
-                normals.clear();
+                positionBounds.Reset();
+                normalBounds.Reset();
                 candidateCheck.clear();
 
                 // Use one of our existing candidates as the next meshlet seed.
@@ -356,8 +356,8 @@ void internal::Meshletize(
         {
             if (candidates.empty())
             {
-                m_positions.clear();
-                normals.clear();
+                positionBounds.Reset();
+                normalBounds.Reset();
                 candidateCheck.clear();
 
                 output.emplace_back();
@@ -10,50 +10,76 @@
 //*********************************************************
 #include "Utilities.h"
 
-#include <unordered_map>
-#include <memory>
+#include <algorithm>
+#include <cstring>
 
 using namespace DirectX;
 
 namespace
 {
-    struct EdgeEntry
+    // Number of elements processed per ParallelFor work item when operating over vertex or face streams.
+    const uint32_t ParallelBlockSize = 16384;
+
+    template <typename Func>
+    void ParallelForBlocks(uint32_t count, const Func& func)
     {
-        uint32_t   i0;
-        uint32_t   i1;
-        uint32_t   i2;
-                   
-        uint32_t   Face;
-        EdgeEntry* Next;
-    };
+        ParallelFor((count + ParallelBlockSize - 1) / ParallelBlockSize, [&](uint32_t block)
+        {
+            uint32_t end = std::min(count, (block + 1) * ParallelBlockSize);
 
-    size_t CRCHash(const uint32_t* dwords, uint32_t dwordCount)
+            for (uint32_t i = block * ParallelBlockSize; i < end; ++i)
+            {
+                func(i);
+            }
+        });
+    }
+
+    // Stable LSD radix sort of 'order' by keys[order[i]], 8 bits per pass over the low 'keyBits' bits of each key.
+    // Passes where every key shares the same digit are skipped.
+    void RadixSort(std::vector<uint32_t>& order, const uint64_t* keys, uint32_t keyBits)
     {
-        size_t h = 0;
+        if (order.empty())
+            return;
+
+        std::vector<uint32_t> temp(order.size());
 
-        for (uint32_t i = 0; i < dwordCount; ++i)
+        for (uint32_t shift = 0; shift < keyBits; shift += 8)
         {
-            uint32_t highOrd = h & 0xf8000000;
-            h = h << 5;
-            h = h ^ (highOrd >> 27);
-            h = h ^ size_t(dwords[i]);
-        }
+            uint32_t histogram[256] = {};
+
+            for (uint32_t i : order)
+            {
+                ++histogram[(keys[i] >> shift) & 0xff];
+            }
 
-        return h;
+            if (histogram[(keys[order[0]] >> shift) & 0xff] == order.size())
+                continue;
+
+            uint32_t offset = 0;
+            for (uint32_t& bucket : histogram)
+            {
+                uint32_t count = bucket;
+                bucket = offset;
+                offset += count;
+            }
+
+            for (uint32_t i : order)
+            {
+                temp[histogram[(keys[i] >> shift) & 0xff]++] = i;
+            }
+
+            order.swap(temp);
+        }
     }
 
-    template <typename T>
-    inline size_t Hash(const T& val)
+    inline uint32_t FloatBits(float f)
     {
-        return std::hash<T>()(val);
+        uint32_t bits;
+        std::memcpy(&bits, &f, sizeof(bits));
+        return bits;
     }
 }
 
-namespace std
-{
-    template <> struct hash<XMFLOAT3> { size_t operator()(const XMFLOAT3& v) const { return CRCHash(reinterpret_cast<const uint32_t*>(&v), sizeof(v) / 4); } };
-}
-
 
 ///
 // External Interface
@@ -97,67 +123,102 @@ void internal::BuildAdjacencyList(
 )
 {
     const uint32_t triCount = indexCount / 3;
+
     // Find point reps (unique positions) in the position stream
-    // Create a mapping of non-unique vertex indices to point reps
+    // Sort vertex indices by their exact position bits; each run of identical positions maps to its lowest vertex index.
     std::vector<T> pointRep;
     pointRep.resize(vertexCount);
-
-    std::unordered_map<size_t, T> uniquePositionMap;
-    uniquePositionMap.reserve(vertexCount);
-
-    for (uint32_t i = 0; i < vertexCount; ++i)
     {
-        XMFLOAT3 position = *(positions + i);
-        size_t hash = Hash(position);
+        std::vector<uint64_t> keys(vertexCount);
+        std::vector<uint32_t> order(vertexCount);
 
-        auto it = uniquePositionMap.find(hash);
-        if (it != uniquePositionMap.end())
+        ParallelForBlocks(vertexCount, [&](uint32_t i)
         {
-            // Position already encountered - reference previous index
-            pointRep[i] = it->second;
-        }
-        else
+            keys[i] = (uint64_t(FloatBits(positions[i].y)) << 32) | FloatBits(positions[i].z);
+            order[i] = i;
+        });
+        RadixSort(order, keys.data(), 64);
+
+        ParallelForBlocks(vertexCount, [&](uint32_t i)
         {
-            // New position found - add to hash table and LUT
-            uniquePositionMap.insert(std::make_pair(hash, static_cast<T>(i)));
-            pointRep[i] = static_cast<T>(i);
+            keys[i] = FloatBits(positions[i].x);
+        });
+        RadixSort(order, keys.data(), 32);
+
+        for (uint32_t i = 0; i < vertexCount; )
+        {
+            const uint32_t first = order[i];
+
+            for (; i < vertexCount && std::memcmp(&positions[order[i]], &positions[first], sizeof(XMFLOAT3)) == 0; ++i)
+            {
+                pointRep[order[i]] = static_cast<T>(first);
+            }
         }
     }
 
-    // Create a linked list of edges for each vertex to determine adjacency
-    const uint32_t hashSize = vertexCount / 3;
-
-    std::unique_ptr<EdgeEntry*[]> hashTable(new EdgeEntry*[hashSize]);
-    std::unique_ptr<EdgeEntry[]> entries(new EdgeEntry[triCount * 3]);
+    // Create a flat table of directed edges - one per face corner, identified by (face * 3 + corner). The table is
+    // counting-sorted by the start point rep so every edge leaving a point is stored contiguously, in face order.
+    struct EdgeEntry
+    {
+        uint32_t End;  // Point rep the edge is directed to
+        uint32_t Edge; // face * 3 + corner
+    };
 
-    std::memset(hashTable.get(), 0, sizeof(EdgeEntry*) * hashSize);
-    uint32_t entryIndex = 0;
+    std::vector<uint32_t> edgeStart(triCount * 3);
+    std::vector<uint32_t> bucketOffsets(vertexCount + 1);
+    std::vector<XMFLOAT3> faceNormals(triCount);
 
-    for (uint32_t iFace = 0; iFace < triCount; ++iFace)
+    ParallelForBlocks(triCount, [&](uint32_t iFace)
     {
         uint32_t index = iFace * 3;
 
-        // Create a hash entry in the hash table for each each.
-        for (uint32_t iEdge = 0; iEdge < 3; ++iEdge)
+        T i[3] =
         {
-            T i0 = pointRep[indices[index + (iEdge % 3)]];
-            T i1 = pointRep[indices[index + ((iEdge + 1) % 3)]];
-            T i2 = pointRep[indices[index + ((iEdge + 2) % 3)]];
+            pointRep[indices[index]],
+            pointRep[indices[index + 1]],
+            pointRep[indices[index + 2]],
+        };
+
+        edgeStart[index] = i[0];
+        edgeStart[index + 1] = i[1];
+        edgeStart[index + 2] = i[2];
 
-            auto& entry = entries[entryIndex++];
-            entry.i0 = i0;
-            entry.i1 = i1;
-            entry.i2 = i2;
+        // Cache this face's normal
+        XMVECTOR p0 = XMLoadFloat3(&positions[i[0]]);
+        XMVECTOR p1 = XMLoadFloat3(&positions[i[1]]);
+        XMVECTOR p2 = XMLoadFloat3(&positions[i[2]]);
 
-            uint32_t key = entry.i0 % hashSize;
+        XMVECTOR e0 = p0 - p1;
+        XMVECTOR e1 = p1 - p2;
 
-            entry.Next = hashTable[key];
-            entry.Face = iFace;
+        XMStoreFloat3(&faceNormals[iFace], XMVector3Normalize(XMVector3Cross(e0, e1)));
+    });
+
+    for (uint32_t start : edgeStart)
+    {
+        ++bucketOffsets[start + 1];
+    }
+
+    for (uint32_t i = 0; i < vertexCount; ++i)
+    {
+        bucketOffsets[i + 1] += bucketOffsets[i];
+    }
+
+    std::vector<EdgeEntry> edges(triCount * 3);
+    {
+        std::vector<uint32_t> cursor(bucketOffsets.begin(), bucketOffsets.end() - 1);
 
-            hashTable[key] = &entry;
+        for (uint32_t edge = 0; edge < triCount * 3; ++edge)
+        {
+            uint32_t face = edge / 3;
+            uint32_t next = face * 3 + (edge + 1) % 3;
+
+            edges[cursor[edgeStart[edge]]++] = { edgeStart[next], edge };
         }
     }
 
+    // Edges are consumed as they are paired.
+    std::vector<bool> consumed(triCount * 3);
 
     // Initialize the adjacency list
     std::memset(adjacency, uint32_t(-1), indexCount * sizeof(uint32_t));
@@ -168,134 +229,59 @@ void internal::BuildAdjacencyList(
 
         for (uint32_t point = 0; point < 3; ++point)
         {
-            if (adjacency[iFace * 3 + point] != uint32_t(-1))
+            if (adjacency[index + point] != uint32_t(-1))
                 continue;
 
             // Look for edges directed in the opposite direction.
             T i0 = pointRep[indices[index + ((point + 1) % 3)]];
             T i1 = pointRep[indices[index + (point % 3)]];
-            T i2 = pointRep[indices[index + ((point + 2) % 3)]];
 
-            // Find a face sharing this edge
-            uint32_t key = i0 % hashSize;
+            // Use face normal dot product to determine best edge-sharing candidate. Later faces are visited first and win ties.
+            XMVECTOR n0 = XMLoadFloat3(&faceNormals[iFace]);
 
-            EdgeEntry* found = nullptr;
-            EdgeEntry* foundPrev = nullptr;
-
-            for (EdgeEntry* current = hashTable[key], *prev = nullptr; current != nullptr; prev = current, current = current->Next)
-            {
-                if (current->i1 == i1 && current->i0 == i0)
-                {
-                    found = current;
-                    foundPrev = prev;
-                    break;
-                }
-            }
+            uint32_t found = uint32_t(-1);
+            float bestDot = -2.0f;
 
-            // Cache this face's normal
-            XMVECTOR n0;
+            for (uint32_t i = bucketOffsets[i0 + 1]; i > bucketOffsets[i0]; --i)
             {
-                XMVECTOR p0 = XMLoadFloat3(&positions[i1]);
-                XMVECTOR p1 = XMLoadFloat3(&positions[i0]);
-                XMVECTOR p2 = XMLoadFloat3(&positions[i2]);
-
-                XMVECTOR e0 = p0 - p1;
-                XMVECTOR e1 = p1 - p2;
+                const EdgeEntry& entry = edges[i - 1];
+                if (entry.End != i1 || consumed[entry.Edge])
+                    continue;
 
-                n0 = XMVector3Normalize(XMVector3Cross(e0, e1));
-            }
+                float dot = XMVectorGetX(XMVector3Dot(n0, XMLoadFloat3(&faceNormals[entry.Edge / 3])));
 
-            // Use face normal dot product to determine best edge-sharing candidate.
-            float bestDot = -2.0f;
-            for (EdgeEntry* current = found, *prev = foundPrev; current != nullptr; prev = current, current = current->Next)
-            {
-                if (bestDot == -2.0f || (current->i1 == i1 && current->i0 == i0))
+                if (found == uint32_t(-1) || dot > bestDot)
                 {
-                    XMVECTOR p0 = XMLoadFloat3(&positions[current->i0]);
-                    XMVECTOR p1 = XMLoadFloat3(&positions[current->i1]);
-                    XMVECTOR p2 = XMLoadFloat3(&positions[current->i2]);
-
-                    XMVECTOR e0 = p0 - p1;
-                    XMVECTOR e1 = p1 - p2;
-
-                    XMVECTOR n1 = XMVector3Normalize(XMVector3Cross(e0, e1));
-
-                    float dot = XMVectorGetX(XMVector3Dot(n0, n1));
-
-                    if (dot > bestDot)
-                    {
-                        found = current;
-                        foundPrev = prev;
-                        bestDot = dot;
-                    }
+                    found = entry.Edge;
+                    bestDot = dot;
                 }
             }
 
-            // Update hash table and adjacency list
-            if (found && found->Face != uint32_t(-1))
-            {
-                // Erase the found from the hash table linked list.
-                if (foundPrev != nullptr)
-                {
-                    foundPrev->Next = found->Next;
-                }
-                else
-                {
-                    hashTable[key] = found->Next;
-                }
+            if (found == uint32_t(-1))
+                continue;
 
-                // Update adjacency information
-                adjacency[iFace * 3 + point] = found->Face;
+            // Remove both edges from the table & update adjacency information
+            uint32_t foundFace = found / 3;
 
-                // Search & remove this face from the table linked list
-                uint32_t key2 = i1 % hashSize;
+            consumed[found] = true;
+            consumed[index + point] = true;
 
-                for (EdgeEntry* current = hashTable[key2], *prev = nullptr; current != nullptr; prev = current, current = current->Next)
-                {
-                    if (current->Face == iFace && current->i1 == i0 && current->i0 == i1)
-                    {
-                        if (prev != nullptr)
-                        {
-                            prev->Next = current->Next;
-                        }
-                        else
-                        {
-                            hashTable[key2] = current->Next;
-                        }
-
-                        break;
-                    }
-                }
+            adjacency[index + point] = foundFace;
 
-                bool linked = false;
-                for (uint32_t point2 = 0; point2 < point; ++point2)
+            bool linked = false;
+            for (uint32_t point2 = 0; point2 < point; ++point2)
+            {
+                if (foundFace == adjacency[index + point2])
                 {
-                    if (found->Face == adjacency[iFace * 3 + point2])
-                    {
-                        linked = true;
-                        adjacency[iFace * 3 + point] = uint32_t(-1);
-                        break;
-                    }
+                    linked = true;
+                    adjacency[index + point] = uint32_t(-1);
+                    break;
                 }
+            }
 
-                if (!linked)
-                {
-                    uint32_t edge2 = 0;
-                    for (; edge2 < 3; ++edge2)
-                    {
-                        T k = indices[found->Face * 3 + edge2];
-                        if (k == uint32_t(-1))
-                            continue;
-
-                        if (pointRep[k] == i0)
-                            break;
-                    }
-
-                    if (edge2 < 3)
-                    {
-                        adjacency[found->Face * 3 + edge2] = iFace;
-                    }
-                }
+            if (!linked)
+            {
+                adjacency[found] = iFace;
             }
         }
     }
@@ -369,3 +355,50 @@ XMVECTOR MinimumBoundingSphere(XMFLOAT3* points, uint32_t count)
     return XMVectorSelect(center, radius, select0001);
 }
 
+
+///
+// BoundingSphereAccumulator
+
+BoundingSphereAccumulator::BoundingSphereAccumulator()
+    : m_sphere(0.0f, 0.0f, 0.0f, 0.0f)
+{ }
+
+void BoundingSphereAccumulator::Reset()
+{
+    m_points.clear();
+    m_sphere = XMFLOAT4(0.0f, 0.0f, 0.0f, 0.0f);
+}
+
+void BoundingSphereAccumulator::Add(const XMFLOAT3& point)
+{
+    m_points.push_back(point);
+
+    const uint32_t count = static_cast<uint32_t>(m_points.size());
+
+    // Exact recompute at power-of-two counts bounds the looseness introduced by the incremental expansion below.
+    if ((count & (count - 1)) == 0)
+    {
+        XMStoreFloat4(&m_sphere, MinimumBoundingSphere(m_points.data(), count));
+        return;
+    }
+
+    XMVECTOR sphere = XMLoadFloat4(&m_sphere);
+    XMVECTOR center = XMVectorSetW(sphere, 0);
+    XMVECTOR radius = XMVectorSplatW(sphere);
+
+    XMVECTOR p = XMLoadFloat3(&point);
+    XMVECTOR distSq = XMVector3LengthSq(p - center);
+
+    if (XMVector3Greater(distSq, radius * radius))
+    {
+        // Same expansion step used by MinimumBoundingSphere - pull the center toward the point until it lies on the surface.
+        XMVECTOR dist = XMVectorSqrt(distSq);
+        XMVECTOR k = (radius / dist) * 0.5f + XMVectorReplicate(0.5f);
+
+        center = center * k + p * (g_XMOne - k);
+        radius = (radius + dist) * 0.5f;
+
+        XMVECTOR select0001 = XMVectorSelectControl(0, 0, 0, 1);
+        XMStoreFloat4(&m_sphere, XMVectorSelect(center, radius, select0001));
+    }
+}
@@ -12,6 +12,9 @@
 
 #include <DirectXMath.h>
 
+#include <algorithm>
+#include <atomic>
+#include <thread>
 #include <vector>
 
 void BuildAdjacencyList(
@@ -26,4 +29,79 @@ void BuildAdjacencyList(
     uint32_t* adjacency
 );
 
+// Runs func(i) for every i in [0, count) across the available hardware threads. Indices are handed out
+// dynamically so that workers finishing early pick up the remaining items. Calls made from inside another
+// ParallelFor run serially on the calling worker to avoid oversubscribing the machine.
+namespace internal
+{
+    inline bool& InsideParallelFor()
+    {
+        thread_local bool inside = false;
+        return inside;
+    }
+}
+
+template <typename Func>
+void ParallelFor(uint32_t count, const Func& func)
+{
+    uint32_t threadCount = std::min(std::max(std::thread::hardware_concurrency(), 1u), count);
+
+    if (threadCount <= 1 || internal::InsideParallelFor())
+    {
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            func(i);
+        }
+        return;
+    }
+
+    std::atomic<uint32_t> next(0);
+    auto worker = [&]()
+    {
+        bool& inside = internal::InsideParallelFor();
+        inside = true;
+
+        for (uint32_t i = next++; i < count; i = next++)
+        {
+            func(i);
+        }
+
+        inside = false;
+    };
+
+    std::vector<std::thread> threads;
+    threads.reserve(threadCount - 1);
+
+    for (uint32_t i = 1; i < threadCount; ++i)
+    {
+        threads.emplace_back(worker);
+    }
+
+    worker();
+
+    for (auto& t : threads)
+    {
+        t.join();
+    }
+}
+
 DirectX::XMVECTOR MinimumBoundingSphere(DirectX::XMFLOAT3* points, uint32_t count);
+
+// Tracks a bounding sphere over a growing set of points. Each new point expands the current sphere in constant
+// time; the sphere is re-tightened with MinimumBoundingSphere whenever the point count reaches a power of two,
+// which keeps the amortized cost per point constant.
+class BoundingSphereAccumulator
+{
+public:
+    BoundingSphereAccumulator();
+
+    void Reset();
+    void Add(const DirectX::XMFLOAT3& point);
+
+    DirectX::XMVECTOR GetSphere() const { return DirectX::XMLoadFloat4(&m_sphere); }
+    uint32_t GetCount() const { return static_cast<uint32_t>(m_points.size()); }
+
+private:
+    std::vector<DirectX::XMFLOAT3> m_points;
+    DirectX::XMFLOAT4              m_sphere; // xyz = center, w = radius
+};
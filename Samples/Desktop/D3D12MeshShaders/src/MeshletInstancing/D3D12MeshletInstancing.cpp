@@ -305,7 +305,7 @@ void D3D12MeshletInstancing::LoadAssets()
     // Load and upload model resources to the GPU
     // Just use the D3D12_COMMAND_LIST_TYPE_DIRECT queue since it's a one-and-done operation. 
     // For per-frame uploads consider using the D3D12_COMMAND_LIST_TYPE_COPY command queue.
-    m_model.LoadFromFile(c_meshFilename);
+    m_model.LoadFromFile(c_meshFilename, true);
     m_model.UploadGpuResources(m_device.Get(), m_commandQueue.Get(), m_commandAllocators[m_frameIndex].Get(), m_commandList.Get());
 
 #ifdef _DEBUG
@@ -316,12 +316,20 @@ void D3D12MeshletInstancing::LoadAssets()
         { "NORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, D3D12_APPEND_ALIGNED_ELEMENT, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 1 },
     };
 
+    // Or its packed form, as exported by the converter's -q switch.
+    const D3D12_INPUT_ELEMENT_DESC c_packedElementDescs[2] =
+    {
+        { "POSITION", 0, DXGI_FORMAT_R16G16B16A16_UNORM, 0, D3D12_APPEND_ALIGNED_ELEMENT, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 1 },
+        { "NORMAL", 0, DXGI_FORMAT_R16G16_SNORM, 0, D3D12_APPEND_ALIGNED_ELEMENT, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 1 },
+    };
+
     for (auto& mesh : m_model)
     {
         assert(mesh.LayoutDesc.NumElements == 2);
 
-        for (uint32_t i = 0; i < _countof(c_elementDescs); ++i)
-            assert(std::memcmp(&mesh.LayoutElems[i], &c_elementDescs[i], sizeof(D3D12_INPUT_ELEMENT_DESC)) == 0);
+        auto& expectedDescs = mesh.PackedVertices ? c_packedElementDescs : c_elementDescs;
+        for (uint32_t i = 0; i < _countof(expectedDescs); ++i)
+            assert(std::memcmp(&mesh.LayoutElems[i], &expectedDescs[i], sizeof(D3D12_INPUT_ELEMENT_DESC)) == 0);
     }
 #endif
     
@@ -470,7 +478,12 @@ void D3D12MeshletInstancing::PopulateCommandList()
 
     for (auto& mesh : m_model)
     {
+        const uint32_t packedVertices = mesh.PackedVertices ? 1 : 0;
+
         m_commandList->SetGraphicsRoot32BitConstant(2, mesh.IndexSize, 0);
+        m_commandList->SetGraphicsRoot32BitConstant(2, packedVertices, 3);
+        m_commandList->SetGraphicsRoot32BitConstants(2, 3, &mesh.PositionScale, 4);
+        m_commandList->SetGraphicsRoot32BitConstants(2, 3, &mesh.PositionOffset, 8);
         m_commandList->SetGraphicsRootShaderResourceView(3, mesh.VertexResources[0]->GetGPUVirtualAddress());
         m_commandList->SetGraphicsRootShaderResourceView(4, mesh.MeshletResource->GetGPUVirtualAddress());
         m_commandList->SetGraphicsRootShaderResourceView(5, mesh.UniqueVertexIndexResource->GetGPUVirtualAddress());
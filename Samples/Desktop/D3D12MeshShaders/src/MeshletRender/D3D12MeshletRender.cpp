@@ -273,7 +273,7 @@ void D3D12MeshletRender::LoadAssets()
     // to record yet. The main loop expects it to be closed, so close it now.
     ThrowIfFailed(m_commandList->Close());
 
-    m_model.LoadFromFile(c_meshFilename);
+    m_model.LoadFromFile(c_meshFilename, true);
     m_model.UploadGpuResources(m_device.Get(), m_commandQueue.Get(), m_commandAllocators[m_frameIndex].Get(), m_commandList.Get());
 
 #ifdef _DEBUG
@@ -284,12 +284,20 @@ void D3D12MeshletRender::LoadAssets()
         { "NORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, D3D12_APPEND_ALIGNED_ELEMENT, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 1 },
     };
 
+    // Or its packed form, as exported by the converter's -q switch.
+    const D3D12_INPUT_ELEMENT_DESC c_packedElementDescs[2] =
+    {
+        { "POSITION", 0, DXGI_FORMAT_R16G16B16A16_UNORM, 0, D3D12_APPEND_ALIGNED_ELEMENT, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 1 },
+        { "NORMAL", 0, DXGI_FORMAT_R16G16_SNORM, 0, D3D12_APPEND_ALIGNED_ELEMENT, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 1 },
+    };
+
     for (auto& mesh : m_model)
     {
         assert(mesh.LayoutDesc.NumElements == 2);
 
-        for (uint32_t i = 0; i < _countof(c_elementDescs); ++i)
-            assert(std::memcmp(&mesh.LayoutElems[i], &c_elementDescs[i], sizeof(D3D12_INPUT_ELEMENT_DESC)) == 0);
+        auto& expectedDescs = mesh.PackedVertices ? c_packedElementDescs : c_elementDescs;
+        for (uint32_t i = 0; i < _countof(expectedDescs); ++i)
+            assert(std::memcmp(&mesh.LayoutElems[i], &expectedDescs[i], sizeof(D3D12_INPUT_ELEMENT_DESC)) == 0);
     }
 #endif
     
@@ -408,7 +416,12 @@ void D3D12MeshletRender::PopulateCommandList()
 
     for (auto& mesh : m_model)
     {
+        const uint32_t packedVertices = mesh.PackedVertices ? 1 : 0;
+
         m_commandList->SetGraphicsRoot32BitConstant(1, mesh.IndexSize, 0);
+        m_commandList->SetGraphicsRoot32BitConstant(1, packedVertices, 2);
+        m_commandList->SetGraphicsRoot32BitConstants(1, 3, &mesh.PositionScale, 4);
+        m_commandList->SetGraphicsRoot32BitConstants(1, 3, &mesh.PositionOffset, 8);
         m_commandList->SetGraphicsRootShaderResourceView(2, mesh.VertexResources[0]->GetGPUVirtualAddress());
         m_commandList->SetGraphicsRootShaderResourceView(3, mesh.MeshletResource->GetGPUVirtualAddress());
         m_commandList->SetGraphicsRootShaderResourceView(4, mesh.UniqueVertexIndexResource->GetGPUVirtualAddress());
@@ -10,7 +10,7 @@
 //*********************************************************
 
 #define ROOT_SIG "CBV(b0), \
-                  RootConstants(b1, num32bitconstants=2), \
+                  RootConstants(b1, num32bitconstants=12), \
                   SRV(t0), \
                   SRV(t1), \
                   SRV(t2), \
@@ -26,8 +26,12 @@ struct Constants
 
 struct MeshInfo
 {
-    uint IndexBytes;
-    uint MeshletOffset;
+    uint   IndexBytes;
+    uint   MeshletOffset;
+    uint   PackedVertices; // Positions as R16G16B16A16_UNORM & octahedral normals as R16G16_SNORM
+    uint   Padding;
+    float4 PositionScale;  // Packed positions decode to offset + scale * value
+    float4 PositionOffset;
 };
 
 struct Vertex
@@ -55,7 +59,7 @@ struct Meshlet
 ConstantBuffer<Constants> Globals             : register(b0);
 ConstantBuffer<MeshInfo>  MeshInfo            : register(b1);
 
-StructuredBuffer<Vertex>  Vertices            : register(t0);
+ByteAddressBuffer         Vertices            : register(t0);
 StructuredBuffer<Meshlet> Meshlets            : register(t1);
 ByteAddressBuffer         UniqueVertexIndices : register(t2);
 StructuredBuffer<uint>    PrimitiveIndices    : register(t3);
@@ -97,9 +101,47 @@ uint GetVertexIndex(Meshlet m, uint localIndex)
     }
 }
 
+float3 DecodeOctahedral(uint packed)
+{
+    // Sign extend the pair of 16-bit snorm values
+    float2 p = max(float2(asint(packed << 16) >> 16, asint(packed) >> 16) / 32767.0, -1.0);
+
+    // Unfold the lower hemisphere of the octahedron & project back onto the unit sphere.
+    float3 n = float3(p, 1.0 - abs(p.x) - abs(p.y));
+    if (n.z < 0)
+    {
+        n.xy = (1.0 - abs(n.yx)) * (step(0.0, n.xy) * 2.0 - 1.0);
+    }
+
+    return normalize(n);
+}
+
+Vertex GetVertex(uint vertexIndex)
+{
+    Vertex v;
+
+    if (MeshInfo.PackedVertices)
+    {
+        // 12-byte vertex: 4 x 16-bit position followed by the octahedral normal
+        uint3 packed = Vertices.Load3(vertexIndex * 12);
+        float3 position = float3(packed.x & 0xffff, packed.x >> 16, packed.y & 0xffff) / 65535.0;
+
+        v.Position = MeshInfo.PositionOffset.xyz + MeshInfo.PositionScale.xyz * position;
+        v.Normal = DecodeOctahedral(packed.z);
+    }
+    else
+    {
+        // 24-byte vertex: float3 position followed by float3 normal
+        v.Position = asfloat(Vertices.Load3(vertexIndex * 24));
+        v.Normal = asfloat(Vertices.Load3(vertexIndex * 24 + 12));
+    }
+
+    return v;
+}
+
 VertexOut GetVertexAttributes(uint meshletIndex, uint vertexIndex)
 {
-    Vertex v = Vertices[vertexIndex];
+    Vertex v = GetVertex(vertexIndex);
 
     VertexOut vout;
     vout.PositionVS = mul(float4(v.Position, 1), Globals.WorldView).xyz;
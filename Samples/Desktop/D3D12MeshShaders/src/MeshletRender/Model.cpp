@@ -30,21 +30,13 @@ namespace
         { "BITANGENT", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, D3D12_APPEND_ALIGNED_ELEMENT, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 1 },
     };
 
-    const uint32_t c_sizeMap[] =
-    {
-        12, // Position
-        12, // Normal
-        8,  // TexCoord
-        12, // Tangent
-        12, // Bitangent
-    };
-
     const uint32_t c_prolog = 'MSHL';
 
     enum FileVersion
     {
         FILE_VERSION_INITIAL = 0,
-        CURRENT_FILE_VERSION = FILE_VERSION_INITIAL
+        FILE_VERSION_ATTRIBUTE_FORMATS = 1,
+        CURRENT_FILE_VERSION = FILE_VERSION_ATTRIBUTE_FORMATS
     };
 
     struct FileHeader
@@ -77,7 +69,7 @@ namespace
         uint32_t Size;
     };
 
-    struct Accessor
+    struct AccessorInitial
     {
         uint32_t BufferView;
         uint32_t Offset;
@@ -86,6 +78,26 @@ namespace
         uint32_t Count;
     };
 
+    struct Accessor : AccessorInitial
+    {
+        // Vertex attribute encoding - decoded value = offset + scale * stored value
+        uint32_t Format;
+        XMFLOAT3 DecodeScale;
+        XMFLOAT3 DecodeOffset;
+    };
+
+    // Selects the input layout format of a stored vertex attribute.
+    DXGI_FORMAT GetElementFormat(Attribute::EType type, uint32_t format)
+    {
+        switch (format)
+        {
+            case Attribute::UNorm16: return DXGI_FORMAT_R16G16B16A16_UNORM;
+            case Attribute::Octahedral: return DXGI_FORMAT_R16G16_SNORM;
+            case Attribute::Half: return DXGI_FORMAT_R16G16_FLOAT;
+            default: return c_elementDescs[type].Format;
+        }
+    }
+
     uint32_t GetFormatSize(DXGI_FORMAT format)
     { 
         switch(format)
@@ -94,6 +106,9 @@ namespace
             case DXGI_FORMAT_R32G32B32_FLOAT: return 12;
             case DXGI_FORMAT_R32G32_FLOAT: return 8;
             case DXGI_FORMAT_R32_FLOAT: return 4;
+            case DXGI_FORMAT_R16G16B16A16_UNORM: return 8;
+            case DXGI_FORMAT_R16G16_SNORM: return 4;
+            case DXGI_FORMAT_R16G16_FLOAT: return 4;
             default: throw std::exception("Unimplemented type");
         }
     }
@@ -113,14 +128,32 @@ namespace
     }
 }
 
-HRESULT Model::LoadFromFile(const wchar_t* filename)
+HRESULT Model::LoadFromFile(const char* filename, bool memoryMap)
+{
+    std::ifstream stream(filename, std::ios::binary);
+    if (!stream.is_open() || (memoryMap && !m_mappedFile.Open(filename)))
+    {
+        return E_INVALIDARG;
+    }
+
+    return Load(stream, memoryMap);
+}
+
+#ifdef _WIN32
+HRESULT Model::LoadFromFile(const wchar_t* filename, bool memoryMap)
 {
     std::ifstream stream(filename, std::ios::binary);
-    if (!stream.is_open())
+    if (!stream.is_open() || (memoryMap && !m_mappedFile.Open(filename)))
     {
         return E_INVALIDARG;
     }
 
+    return Load(stream, memoryMap);
+}
+#endif
+
+HRESULT Model::Load(std::istream& stream, bool memoryMap)
+{
     std::vector<MeshHeader> meshes;
     std::vector<BufferView> bufferViews;
     std::vector<Accessor> accessors;
@@ -133,7 +166,7 @@ HRESULT Model::LoadFromFile(const wchar_t* filename)
         return E_FAIL; // Incorrect file format.
     }
 
-    if (header.Version != CURRENT_FILE_VERSION)
+    if (header.Version > CURRENT_FILE_VERSION)
     {
         return E_FAIL; // Version mismatch between export and import serialization code.
     }
@@ -143,20 +176,57 @@ HRESULT Model::LoadFromFile(const wchar_t* filename)
     stream.read(reinterpret_cast<char*>(meshes.data()), meshes.size() * sizeof(meshes[0]));
     
     accessors.resize(header.AccessorCount);
-    stream.read(reinterpret_cast<char*>(accessors.data()), accessors.size() * sizeof(accessors[0]));
+    if (header.Version == FILE_VERSION_INITIAL)
+    {
+        // Initial version accessors carry no format - all vertex data is stored as floats.
+        std::vector<AccessorInitial> initialAccessors(header.AccessorCount);
+        stream.read(reinterpret_cast<char*>(initialAccessors.data()), initialAccessors.size() * sizeof(initialAccessors[0]));
+
+        for (uint32_t i = 0; i < header.AccessorCount; ++i)
+        {
+            static_cast<AccessorInitial&>(accessors[i]) = initialAccessors[i];
+            accessors[i].Format = Attribute::Float;
+            accessors[i].DecodeScale = XMFLOAT3(1.0f, 1.0f, 1.0f);
+            accessors[i].DecodeOffset = XMFLOAT3(0.0f, 0.0f, 0.0f);
+        }
+    }
+    else
+    {
+        stream.read(reinterpret_cast<char*>(accessors.data()), accessors.size() * sizeof(accessors[0]));
+    }
 
     bufferViews.resize(header.BufferViewCount);
     stream.read(reinterpret_cast<char*>(bufferViews.data()), bufferViews.size() * sizeof(bufferViews[0]));
 
-    m_buffer.resize(header.BufferSize);
-    stream.read(reinterpret_cast<char*>(m_buffer.data()), header.BufferSize);
+    const uint8_t* buffer = nullptr;
 
-    char eofbyte;
-    stream.read(&eofbyte, 1); // Read last byte to hit the eof bit
+    if (memoryMap)
+    {
+        const size_t bufferOffset = static_cast<size_t>(stream.tellg());
 
-    assert(stream.eof()); // There's a problem if we didn't completely consume the file contents.
+        assert(m_mappedFile.GetSize() == bufferOffset + header.BufferSize); // File size must match the serialized buffer size.
+
+        if (m_mappedFile.GetSize() < bufferOffset + header.BufferSize)
+        {
+            m_mappedFile.Close();
+            return E_FAIL; // Truncated file.
+        }
 
-    stream.close();
+        // Point directly into the read-only mapping.
+        buffer = m_mappedFile.GetData() + bufferOffset;
+    }
+    else
+    {
+        m_buffer.resize(header.BufferSize);
+        stream.read(reinterpret_cast<char*>(m_buffer.data()), header.BufferSize);
+
+        char eofbyte;
+        stream.read(&eofbyte, 1); // Read last byte to hit the eof bit
+
+        assert(stream.eof()); // There's a problem if we didn't completely consume the file contents.
+
+        buffer = m_buffer.data();
+    }
 
     // Populate mesh data from binary data and metadata.
     m_meshes.resize(meshes.size());
@@ -173,7 +243,7 @@ HRESULT Model::LoadFromFile(const wchar_t* filename)
             mesh.IndexSize = accessor.Size;
             mesh.IndexCount = accessor.Count;
 
-            mesh.Indices = MakeSpan(m_buffer.data() + bufferView.Offset, bufferView.Size);
+            mesh.Indices = MakeSpan(buffer + bufferView.Offset, bufferView.Size);
         }
 
         // Index Subset data
@@ -181,7 +251,7 @@ HRESULT Model::LoadFromFile(const wchar_t* filename)
             Accessor& accessor = accessors[meshView.IndexSubsets];
             BufferView& bufferView = bufferViews[accessor.BufferView];
 
-            mesh.IndexSubsets = MakeSpan(reinterpret_cast<Subset*>(m_buffer.data() + bufferView.Offset), accessor.Count);
+            mesh.IndexSubsets = MakeSpan(reinterpret_cast<const Subset*>(buffer + bufferView.Offset), accessor.Count);
         }
 
         // Vertex data & layout metadata
@@ -209,7 +279,7 @@ HRESULT Model::LoadFromFile(const wchar_t* filename)
             vbMap.push_back(accessor.BufferView);
             BufferView& bufferView = bufferViews[accessor.BufferView];
 
-            Span<uint8_t> verts = MakeSpan(m_buffer.data() + bufferView.Offset, bufferView.Size);
+            Span<const uint8_t> verts = MakeSpan(buffer + bufferView.Offset, bufferView.Size);
 
             mesh.VertexStrides.push_back(accessor.Stride);
             mesh.Vertices.push_back(verts);
@@ -228,17 +298,27 @@ HRESULT Model::LoadFromFile(const wchar_t* filename)
             auto it = std::find(vbMap.begin(), vbMap.end(), accessor.BufferView);
 
             D3D12_INPUT_ELEMENT_DESC desc = c_elementDescs[j];
+            desc.Format = GetElementFormat(static_cast<Attribute::EType>(j), accessor.Format);
             desc.InputSlot = static_cast<uint32_t>(std::distance(vbMap.begin(), it));
 
             mesh.LayoutElems[mesh.LayoutDesc.NumElements++] = desc;
         }
 
+        // Quantized positions are decoded by the shaders relative to the mesh bounding box.
+        {
+            Accessor& accessor = accessors[meshView.Attributes[Attribute::Position]];
+
+            mesh.PackedVertices = accessor.Format == Attribute::UNorm16;
+            mesh.PositionScale = accessor.DecodeScale;
+            mesh.PositionOffset = accessor.DecodeOffset;
+        }
+
         // Meshlet data
         {
             Accessor& accessor = accessors[meshView.Meshlets];
             BufferView& bufferView = bufferViews[accessor.BufferView];
 
-            mesh.Meshlets = MakeSpan(reinterpret_cast<Meshlet*>(m_buffer.data() + bufferView.Offset), accessor.Count);
+            mesh.Meshlets = MakeSpan(reinterpret_cast<const Meshlet*>(buffer + bufferView.Offset), accessor.Count);
         }
 
         // Meshlet Subset data
@@ -246,7 +326,7 @@ HRESULT Model::LoadFromFile(const wchar_t* filename)
             Accessor& accessor = accessors[meshView.MeshletSubsets];
             BufferView& bufferView = bufferViews[accessor.BufferView];
 
-            mesh.MeshletSubsets = MakeSpan(reinterpret_cast<Subset*>(m_buffer.data() + bufferView.Offset), accessor.Count);
+            mesh.MeshletSubsets = MakeSpan(reinterpret_cast<const Subset*>(buffer + bufferView.Offset), accessor.Count);
         }
 
         // Unique Vertex Index data
@@ -254,7 +334,7 @@ HRESULT Model::LoadFromFile(const wchar_t* filename)
             Accessor& accessor = accessors[meshView.UniqueVertexIndices];
             BufferView& bufferView = bufferViews[accessor.BufferView];
 
-            mesh.UniqueVertexIndices = MakeSpan(m_buffer.data() + bufferView.Offset, bufferView.Size);
+            mesh.UniqueVertexIndices = MakeSpan(buffer + bufferView.Offset, bufferView.Size);
         }
 
         // Primitive Index data
@@ -262,7 +342,7 @@ HRESULT Model::LoadFromFile(const wchar_t* filename)
             Accessor& accessor = accessors[meshView.PrimitiveIndices];
             BufferView& bufferView = bufferViews[accessor.BufferView];
 
-            mesh.PrimitiveIndices = MakeSpan(reinterpret_cast<PackedTriangle*>(m_buffer.data() + bufferView.Offset), accessor.Count);
+            mesh.PrimitiveIndices = MakeSpan(reinterpret_cast<const PackedTriangle*>(buffer + bufferView.Offset), accessor.Count);
         }
 
         // Cull data
@@ -270,7 +350,7 @@ HRESULT Model::LoadFromFile(const wchar_t* filename)
             Accessor& accessor = accessors[meshView.CullData];
             BufferView& bufferView = bufferViews[accessor.BufferView];
 
-            mesh.CullingData = MakeSpan(reinterpret_cast<CullData*>(m_buffer.data() + bufferView.Offset), accessor.Count);
+            mesh.CullingData = MakeSpan(reinterpret_cast<const CullData*>(buffer + bufferView.Offset), accessor.Count);
         }
      }
 
@@ -309,10 +389,24 @@ HRESULT Model::LoadFromFile(const wchar_t* filename)
             }
         }
 
-        XMFLOAT3* v0 = reinterpret_cast<XMFLOAT3*>(m.Vertices[vbIndexPos].data() + positionOffset);
+        const uint8_t* v0 = m.Vertices[vbIndexPos].data() + positionOffset;
         uint32_t stride = m.VertexStrides[vbIndexPos];
 
-        BoundingSphere::CreateFromPoints(m.BoundingSphere, m.VertexCount, v0, stride);
+        if (m.PackedVertices)
+        {
+            // Decode a temporary copy of the positions.
+            std::vector<XMFLOAT3> positions(m.VertexCount);
+            for (uint32_t j = 0; j < m.VertexCount; ++j)
+            {
+                XMStoreFloat3(&positions[j], m.DecodePosition(v0 + j * stride));
+            }
+
+            BoundingSphere::CreateFromPoints(m.BoundingSphere, m.VertexCount, positions.data(), sizeof(XMFLOAT3));
+        }
+        else
+        {
+            BoundingSphere::CreateFromPoints(m.BoundingSphere, m.VertexCount, reinterpret_cast<const XMFLOAT3*>(v0), stride);
+        }
 
         if (i == 0)
         {
@@ -438,6 +532,9 @@ HRESULT Model::UploadGpuResources(ID3D12Device* device, ID3D12CommandQueue* cmdQ
             info.MeshletCount         = static_cast<uint32_t>(m.Meshlets.size());
             info.LastMeshletVertCount = m.Meshlets.back().VertCount;
             info.LastMeshletPrimCount = m.Meshlets.back().PrimCount;
+            info.PositionScale        = m.PositionScale;
+            info.PackedVertices       = m.PackedVertices;
+            info.PositionOffset       = m.PositionOffset;
 
 
             uint8_t* memory = nullptr;
@@ -17,22 +17,14 @@
 namespace
 {
     const char s_padding[4096] = {};
-    
-    const uint32_t s_sizeMap[] =
-    {
-        12, // Position
-        12, // Normal
-        8,  // TexCoord
-        12, // Tangent
-        12, // Bitangent
-    };
 
     const uint32_t s_prolog = 'MSHL';
 
     enum FileVersion
     {
         FILE_VERSION_INITIAL = 0,
-        CURRENT_FILE_VERSION = FILE_VERSION_INITIAL
+        FILE_VERSION_ATTRIBUTE_FORMATS = 1,
+        CURRENT_FILE_VERSION = FILE_VERSION_ATTRIBUTE_FORMATS
     };
 
     struct FileHeader
@@ -72,6 +64,11 @@ namespace
         uint32_t Size;
         uint32_t Stride;
         uint32_t Count;
+
+        // Vertex attribute encoding - decoded value = offset + scale * stored value
+        uint32_t Format = Attribute::Float;
+        DirectX::XMFLOAT3 DecodeScale = { 1.0f, 1.0f, 1.0f };
+        DirectX::XMFLOAT3 DecodeOffset = { 0.0f, 0.0f, 0.0f };
     };
 
     void AddAlignUp(uint32_t& offset, uint32_t size, uint32_t align = 4096u)
@@ -163,8 +160,15 @@ bool ExportMeshes(const char* filename, std::vector<ExportMesh>& exportMeshes)
                 accessor.BufferView = static_cast<uint32_t>(bufferViews.size());
                 accessor.Count = m.VertexCount;
                 accessor.Offset = a.Offset;
-                accessor.Size = s_sizeMap[a.Type];
+                accessor.Size = GetAttributeSize(a.Type, a.Format);
                 accessor.Stride = l.Stride;
+                accessor.Format = a.Format;
+
+                if (a.Format == Attribute::UNorm16)
+                {
+                    accessor.DecodeScale = m.PositionScale;
+                    accessor.DecodeOffset = m.PositionOffset;
+                }
 
                 meshView.Attributes[a.Type] = static_cast<uint32_t>(accessors.size());
                 accessors.push_back(accessor);
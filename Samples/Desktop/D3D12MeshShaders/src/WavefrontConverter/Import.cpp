@@ -84,8 +84,7 @@ bool ImportFile(const char* filename, const ProcessOptions& options, std::vector
         std::cout << "Mesh " << reader.name.c_str() << std::endl;
     }
 
-    meshes.resize(1);
-    processor.Process(options, reader, meshes[0]);
+    processor.Process(options, reader, meshes);
     
     return !meshes.empty();
 }
@@ -35,6 +35,8 @@ namespace
         std::cout << "\t-s <float>    -- Specifies a global scaling factor for scene geometry. Default is 1.0" << std::endl;
         std::cout << "\t-i            -- Forces vertex indices to be 32 bits, even if only 16 bits are required. Default is false" << std::endl;
         std::cout << "\t-f            -- Flip primitive winding order. Default is false" << std::endl;
+        std::cout << "\t-q            -- Quantizes vertex attributes: 16-bit positions, octahedral normals & tangents, half float UVs. Default is false" << std::endl;
+        std::cout << "\t-lod <int>    -- Generates additional simplified levels of detail, each with half the triangles of the last. Default is 0" << std::endl;
         std::cout << "\t-l <int>      -- Sets the log verbosity: 0 - Error, 1 - Basic, 2 - Verbose. Default is Basic" << std::endl;
         std::cout << std::endl;
 
@@ -49,7 +51,7 @@ namespace
         std::cout << std::endl;
 
         std::cout << "Example:" << std::endl;
-        std::cout << "\tConverterApp.exe -a p:nutb -v 128 -p 128 -i Path/To/MyFile1.obj Path/To/MyFile2.obj " << std::endl;
+        std::cout << "\tConverterApp.exe -a p:nutb -v 128 -p 128 -i -lod 4 Path/To/MyFile1.obj Path/To/MyFile2.obj " << std::endl;
         std::cout << std::endl;
     }
 
@@ -181,6 +183,21 @@ namespace
                 std::cout << "Flipping winding order." << std::endl;
                 options.Flip = true;
             }
+            else if (std::strcmp(args[i], "-q") == 0)
+            {
+                std::cout << "Quantizing vertex attributes." << std::endl;
+                options.QuantizeAttributes = true;
+            }
+            else if (std::strcmp(args[i], "-lod") == 0)
+            {
+                if (i + 1 == argc)
+                {
+                    std::cout << "Must provide an integral value for level of detail count if supplying -lod switch." << std::endl;
+                    return 1;
+                }
+
+                options.LODCount = std::strtoul(args[++i], nullptr, 10);
+            }
             else if (std::strcmp(args[i], "-l") == 0)
             {
                 if (i + 1 == argc)
@@ -237,6 +254,11 @@ namespace
         {
             std::cout << "Forcing indices to 32 bits" << std::endl;
         }
+
+        if (options.LODCount > 0)
+        {
+            std::cout << "Generating " << options.LODCount << " additional levels of detail" << std::endl;
+        }
         
         std::cout << "Exporting vertex buffers as: " << std::endl;
         for (uint32_t i = 0; i < options.ExportAttributes.size(); ++i)
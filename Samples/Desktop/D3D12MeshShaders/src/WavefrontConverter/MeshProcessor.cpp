@@ -10,12 +10,15 @@
 //*********************************************************
 #include "stdafx.h"
 #include "MeshProcessor.h"
+#include "Simplify.h"
 
 #include <Utilities.h>
 
 #include <DirectXMesh.h>
+#include <DirectXPackedVector.h>
 
 using namespace DirectX;
+using namespace DirectX::PackedVector;
 
 namespace
 {
@@ -54,6 +57,22 @@ namespace
     {
         return std::hash<T>()(val);
     }
+
+    // Maps a unit vector onto the [-1, 1] square by projecting onto an octahedron and folding its lower half outward.
+    XMVECTOR OctahedralEncode(FXMVECTOR n)
+    {
+        XMVECTOR p = XMVectorDivide(n, XMVectorReplicate(XMVectorGetX(XMVector3Dot(XMVectorAbs(n), g_XMOne))));
+
+        if (XMVectorGetZ(p) < 0.0f)
+        {
+            XMVECTOR sign = XMVectorSelect(g_XMNegativeOne, g_XMOne, XMVectorGreaterOrEqual(p, g_XMZero));
+            XMVECTOR folded = XMVectorSubtract(g_XMOne, XMVectorAbs(XMVectorSwizzle<1, 0, 2, 3>(p)));
+
+            p = XMVectorMultiply(folded, sign);
+        }
+
+        return p;
+    }
 }
 
 namespace std
@@ -101,35 +120,56 @@ void MeshProcessor::Reset()
     m_indexCount = 0;
 }
 
-bool MeshProcessor::Process(const ProcessOptions& options, const WaveFrontReader<uint32_t>& reader, ExportMesh& output)
+bool MeshProcessor::Process(const ProcessOptions& options, const WaveFrontReader<uint32_t>& reader, std::vector<ExportMesh>& output)
 {
     if (!Extract(options, reader))
     {
         return false;
     }
 
-    if (m_indexSize == 4)
+    // Keep the uncompacted source around - each level of detail is simplified from the one before it.
+    SourceMesh source;
+    if (options.LODCount > 0)
     {
-        Finalize<uint32_t>(options);
+        source.Type = m_type;
+        source.Positions = m_positions;
+        source.Normals = m_normals;
+        source.UVs = m_uvs;
+        source.Indices = reader.indices;
+        source.Attributes = m_attributes;
     }
-    else
+
+    for (uint32_t lod = 0; lod <= options.LODCount; ++lod)
     {
-        Finalize<uint16_t>(options);
-    }
+        if (lod > 0 && !Simplify(options, source))
+        {
+            break;
+        }
 
-    Export(options, output);
+        if (m_indexSize == 4)
+        {
+            Finalize<uint32_t>(options);
+        }
+        else
+        {
+            Finalize<uint16_t>(options);
+        }
 
-    if (options.LogLevel >= ProcessOptions::Verbose)
-    {
-        std::cout << "Stats: " << std::endl;
-        std::cout << "\t" << output.VertexCount << " vertices" << std::endl;
-        std::cout << "\t" << output.IndexCount << " indices" << std::endl;
-        std::cout << "\t" << output.IndexSize << " byte indices" << std::endl;
-        std::cout << "\t" << output.IndexSubsets.size() << " material subsets" << std::endl;
-        std::cout << "\t" << output.Meshlets.size() << " meshlets" << std::endl;
-    }
+        output.emplace_back();
+        Export(options, output.back());
+
+        if (options.LogLevel >= ProcessOptions::Verbose)
+        {
+            std::cout << "Stats (LOD " << lod << "): " << std::endl;
+            std::cout << "\t" << output.back().VertexCount << " vertices" << std::endl;
+            std::cout << "\t" << output.back().IndexCount << " indices" << std::endl;
+            std::cout << "\t" << output.back().IndexSize << " byte indices" << std::endl;
+            std::cout << "\t" << output.back().IndexSubsets.size() << " material subsets" << std::endl;
+            std::cout << "\t" << output.back().Meshlets.size() << " meshlets" << std::endl;
+        }
 
-    Reset();
+        Reset();
+    }
 
     return true;
 }
@@ -195,25 +235,124 @@ bool MeshProcessor::Extract(const ProcessOptions& options, const WaveFrontReader
     return true;
 }
 
+bool MeshProcessor::Simplify(const ProcessOptions& options, SourceMesh& source)
+{
+    const uint32_t sourceIndexCount = static_cast<uint32_t>(source.Indices.size());
+    const uint32_t targetIndexCount = (sourceIndexCount / 6) * 3;
+
+    uint32_t indexCount = SimplifyMesh(
+        source.Positions.data(), static_cast<uint32_t>(source.Positions.size()),
+        source.Indices,
+        source.Attributes,
+        targetIndexCount
+    );
+
+    if (indexCount == 0 || indexCount == sourceIndexCount)
+    {
+        if (options.LogLevel >= ProcessOptions::Basic)
+        {
+            std::cout << "Mesh cannot be simplified further - stopping level of detail generation." << std::endl;
+        }
+
+        return false;
+    }
+
+    // Compact the vertices still referenced by the simplified index buffer.
+    std::vector<uint32_t> vertexRemap(source.Positions.size(), uint32_t(-1));
+    std::vector<uint32_t> indices(indexCount);
+
+    uint32_t vertexCount = 0;
+    for (uint32_t i = 0; i < indexCount; ++i)
+    {
+        uint32_t& index = vertexRemap[source.Indices[i]];
+        if (index == uint32_t(-1))
+        {
+            index = vertexCount++;
+        }
+
+        indices[i] = index;
+    }
+
+    m_type = source.Type;
+    m_positions.resize(vertexCount);
+
+    if (HasAttribute(m_type, Attribute::Normal))
+    {
+        m_normals.resize(vertexCount);
+    }
+
+    if (HasAttribute(m_type, Attribute::TexCoord))
+    {
+        m_uvs.resize(vertexCount);
+    }
+
+    for (uint32_t i = 0; i < vertexRemap.size(); ++i)
+    {
+        uint32_t index = vertexRemap[i];
+        if (index == uint32_t(-1))
+        {
+            continue;
+        }
+
+        m_positions[index] = source.Positions[i];
+
+        if (HasAttribute(m_type, Attribute::Normal))
+        {
+            m_normals[index] = source.Normals[i];
+        }
+
+        if (HasAttribute(m_type, Attribute::TexCoord))
+        {
+            m_uvs[index] = source.UVs[i];
+        }
+    }
+
+    // Same index size rules as Extract()
+    m_indexCount = indexCount;
+    m_indexSize = (m_indexCount > 65536 || options.Force32BitIndices) ? 4 : 2;
+    m_indices.resize(m_indexSize * m_indexCount);
+
+    if (m_indexSize == 4)
+    {
+        std::memcpy(m_indices.data(), indices.data(), m_indexCount * m_indexSize);
+    }
+    else
+    {
+        uint16_t* dest = reinterpret_cast<uint16_t*>(m_indices.data());
+
+        for (uint32_t i = 0; i < m_indexCount; ++i)
+        {
+            dest[i] = static_cast<uint16_t>(indices[i]);
+        }
+    }
+
+    m_attributes = source.Attributes;
+
+    return true;
+}
+
 template <typename T>
 void MeshProcessor::Finalize(const ProcessOptions& options)
 {
     // Pull out some final counts for readability
-    const uint32_t vertexCount = static_cast<uint32_t>(m_positions.size());
+    const uint32_t sourceVertexCount = static_cast<uint32_t>(m_positions.size());
     const uint32_t triCount = m_indexCount / 3;
 
+    ///
+    // Use DirectXMesh to optimize our vertex buffer data
+
+    // Clean the mesh, sort faces by material, and reorder
+    ThrowIfFailed(DirectX::Clean(reinterpret_cast<T*>(m_indices.data()), triCount, sourceVertexCount, nullptr, m_attributes.data(), m_dupVerts, true));
+
+    // Cleaning may split bowtie vertices (common in simplified meshes) - these are appended by FinalizeVB
+    const uint32_t vertexCount = sourceVertexCount + static_cast<uint32_t>(m_dupVerts.size());
+
     // Resize all our interim data buffers to appropriate sizes for the mesh
     m_positionReorder.resize(vertexCount);
     m_indexReorder.resize(m_indexCount * m_indexSize);
 
     m_faceRemap.resize(triCount);
     m_vertexRemap.resize(vertexCount);
-
-    ///
-    // Use DirectXMesh to optimize our vertex buffer data
-
-    // Clean the mesh, sort faces by material, and reorder
-    ThrowIfFailed(DirectX::Clean(reinterpret_cast<T*>(m_indices.data()), triCount, vertexCount, nullptr, m_attributes.data(), m_dupVerts, true));
     ThrowIfFailed(DirectX::AttributeSort(triCount, m_attributes.data(), m_faceRemap.data()));
     ThrowIfFailed(DirectX::ReorderIB(reinterpret_cast<T*>(m_indices.data()), triCount, m_faceRemap.data(), reinterpret_cast<T*>(m_indexReorder.data())));
 
@@ -230,7 +369,7 @@ void MeshProcessor::Finalize(const ProcessOptions& options)
 
     // Finalize the index & vertex buffers (potential reordering)
     ThrowIfFailed(DirectX::FinalizeIB(reinterpret_cast<T*>(m_indices.data()), triCount, m_vertexRemap.data(), vertexCount, reinterpret_cast<T*>(m_indexReorder.data())));
-    ThrowIfFailed(DirectX::FinalizeVB(m_positions.data(), sizeof(XMFLOAT3), vertexCount, m_dupVerts.data(), m_dupVerts.size(), m_vertexRemap.data(), m_positionReorder.data()));
+    ThrowIfFailed(DirectX::FinalizeVB(m_positions.data(), sizeof(XMFLOAT3), sourceVertexCount, m_dupVerts.data(), m_dupVerts.size(), m_vertexRemap.data(), m_positionReorder.data()));
 
     std::swap(m_indices, m_indexReorder);
     std::swap(m_positions, m_positionReorder);
@@ -238,7 +377,7 @@ void MeshProcessor::Finalize(const ProcessOptions& options)
     if (HasAttribute(m_type, Attribute::Normal))
     {
         m_normalReorder.resize(vertexCount);
-        ThrowIfFailed(DirectX::FinalizeVB(m_normals.data(), sizeof(XMFLOAT3), vertexCount, m_dupVerts.data(), m_dupVerts.size(), m_vertexRemap.data(), m_normalReorder.data()));
+        ThrowIfFailed(DirectX::FinalizeVB(m_normals.data(), sizeof(XMFLOAT3), sourceVertexCount, m_dupVerts.data(), m_dupVerts.size(), m_vertexRemap.data(), m_normalReorder.data()));
 
         std::swap(m_normals, m_normalReorder);
     }
@@ -246,7 +385,7 @@ void MeshProcessor::Finalize(const ProcessOptions& options)
     if (HasAttribute(m_type, Attribute::TexCoord))
     {
         m_uvReorder.resize(vertexCount);
-        ThrowIfFailed(DirectX::FinalizeVB(m_uvs.data(), sizeof(XMFLOAT2), vertexCount, m_dupVerts.data(), m_dupVerts.size(), m_vertexRemap.data(), m_uvReorder.data()));
+        ThrowIfFailed(DirectX::FinalizeVB(m_uvs.data(), sizeof(XMFLOAT2), sourceVertexCount, m_dupVerts.data(), m_dupVerts.size(), m_vertexRemap.data(), m_uvReorder.data()));
 
         std::swap(m_uvs, m_uvReorder);
     }
@@ -281,6 +420,39 @@ void MeshProcessor::Finalize(const ProcessOptions& options)
         ThrowIfFailed(DirectX::ComputeTangentFrame(reinterpret_cast<T*>(m_indices.data()), triCount, m_positions.data(), m_normals.data(), m_uvs.data(), vertexCount, m_tangents.data(), m_bitangents.data()));
     }
 
+    // Quantized positions are stored relative to the mesh bounding box
+    XMVECTOR minPos = g_XMFltMax;
+    XMVECTOR maxPos = -g_XMFltMax;
+
+    for (auto& p : m_positions)
+    {
+        minPos = XMVectorMin(minPos, XMLoadFloat3(&p));
+        maxPos = XMVectorMax(maxPos, XMLoadFloat3(&p));
+    }
+
+    if (m_positions.empty())
+    {
+        minPos = maxPos = g_XMZero;
+    }
+
+    XMVECTOR extent = XMVectorSubtract(maxPos, minPos);
+
+    XMStoreFloat3(&m_positionScale, extent);
+    XMStoreFloat3(&m_positionOffset, minPos);
+
+    // Snap positions to the values the shaders decode, so the culling data bounds the geometry that is drawn
+    if (options.QuantizeAttributes)
+    {
+        XMVECTOR invExtent = XMVectorSelect(XMVectorReciprocal(extent), g_XMZero, XMVectorEqual(extent, g_XMZero));
+
+        for (auto& p : m_positions)
+        {
+            XMUSHORTN4 packed;
+            XMStoreUShortN4(&packed, XMVectorSetW(XMVectorMultiply(XMVectorSubtract(XMLoadFloat3(&p), minPos), invExtent), 0.0f));
+            XMStoreFloat3(&p, XMVectorMultiplyAdd(XMLoadUShortN4(&packed), extent, minPos));
+        }
+    }
+
     // Meshletize our mesh and generate per-meshlet culling data
     ThrowIfFailed(ComputeMeshlets(
         options.MeshletMaxVerts, options.MeshletMaxPrims,
@@ -308,13 +480,13 @@ void MeshProcessor::Finalize(const ProcessOptions& options)
 void MeshProcessor::Export(const ProcessOptions& options, ExportMesh& output)
 {
     // Determine vertex layout - mapping the extracted mesh type to the output type
-    const uint32_t s_sizeMap[] = 
+    const Attribute::EFormat s_quantizedFormats[] =
     {
-        12, // Position
-        12, // Normal
-        8,  // TexCoord
-        12, // Tangent
-        12, // Bitangent
+        Attribute::UNorm16,    // Position
+        Attribute::Octahedral, // Normal
+        Attribute::Half,       // TexCoord
+        Attribute::Octahedral, // Tangent
+        Attribute::Octahedral, // Bitangent
     };
 
     // Determine our final layout attributes
@@ -333,9 +505,10 @@ void MeshProcessor::Export(const ProcessOptions& options, ExportMesh& output)
             Attribute attribute;
             attribute.Type = attr;
             attribute.Offset = desc.Stride;
+            attribute.Format = options.QuantizeAttributes ? s_quantizedFormats[attr] : Attribute::Float;
 
             desc.Attributes.push_back(attribute);
-            desc.Stride += s_sizeMap[attr];
+            desc.Stride += GetAttributeSize(attribute.Type, attribute.Format);
         }
 
         if (desc.Stride > 0)
@@ -350,6 +523,14 @@ void MeshProcessor::Export(const ProcessOptions& options, ExportMesh& output)
     output.VertexCount = vertexCount;
     output.Vertices.resize(output.Layout.size());
 
+    // Positions were snapped to this grid by Finalize, so they encode exactly
+    XMVECTOR minPos = XMLoadFloat3(&m_positionOffset);
+    XMVECTOR extent = XMLoadFloat3(&m_positionScale);
+    XMVECTOR invExtent = XMVectorSelect(XMVectorReciprocal(extent), g_XMZero, XMVectorEqual(extent, g_XMZero));
+
+    output.PositionScale = m_positionScale;
+    output.PositionOffset = m_positionOffset;
+
     for (uint32_t i = 0; i < output.Layout.size(); ++i)
     {
         output.Vertices[i].resize(output.Layout[i].Stride * vertexCount);
@@ -401,11 +582,33 @@ void MeshProcessor::Export(const ProcessOptions& options, ExportMesh& output)
 
             for (uint32_t k = 0; k < vertexCount; ++k, src += size, dest += stream.Stride)
             {
-                std::memcpy(dest, src, size);
+                switch (attr.Format)
+                {
+                case Attribute::Float:
+                    std::memcpy(dest, src, size);
+                    break;
+
+                case Attribute::UNorm16:
+                {
+                    XMVECTOR v = XMVectorMultiply(XMVectorSubtract(XMLoadFloat3(reinterpret_cast<const XMFLOAT3*>(src)), minPos), invExtent);
+                    XMStoreUShortN4(reinterpret_cast<XMUSHORTN4*>(dest), XMVectorSetW(v, 0.0f));
+                    break;
+                }
+
+                case Attribute::Octahedral:
+                {
+                    XMVECTOR v = XMVector3Normalize(XMLoadFloat3(reinterpret_cast<const XMFLOAT3*>(src)));
+                    XMStoreShortN2(reinterpret_cast<XMSHORTN2*>(dest), OctahedralEncode(v));
+                    break;
+                }
+
+                case Attribute::Half:
+                    XMStoreHalf2(reinterpret_cast<XMHALF2*>(dest), XMLoadFloat2(reinterpret_cast<const XMFLOAT2*>(src)));
+                    break;
+                }
             }
         }
     }
-
     // Copy index data to export stream
     output.IndexCount = m_indexCount;
     output.IndexSize = m_indexSize;
@@ -26,13 +26,34 @@ struct Attribute
         Count
     };
 
+    // Encoding of the exported attribute data
+    enum EFormat : uint32_t
+    {
+        Float,      // Full precision floats
+        UNorm16,    // 16-bit unsigned normalized xyzw, decoded as offset + scale * value
+        Octahedral, // Unit vector octahedrally mapped to a 16-bit signed normalized pair
+        Half,       // 16-bit floats
+    };
+
     EType       Type;
     uint32_t    Offset;
+    EFormat     Format;
 };
 
 inline bool HasAttribute(uint32_t base, Attribute::EType check) { return (base & (1 << check)) != 0; }
 inline uint32_t AddAttribute(uint32_t base, Attribute::EType add) { return base | (1 << add); }
 
+inline uint32_t GetAttributeSize(Attribute::EType type, Attribute::EFormat format)
+{
+    switch (format)
+    {
+    case Attribute::UNorm16:    return 8;
+    case Attribute::Octahedral: return 4;
+    case Attribute::Half:       return 4;
+    default:                    return type == Attribute::TexCoord ? 8 : 12;
+    }
+}
+
 using AttrStream = std::vector<Attribute::EType>;
 using AttrLayout = std::vector<AttrStream>;
 
@@ -50,6 +71,10 @@ struct ExportMesh
     std::vector<DataStream>         Vertices;
     uint32_t                        VertexCount;
 
+    // Decode parameters of UNorm16 quantized positions
+    DirectX::XMFLOAT3               PositionScale;
+    DirectX::XMFLOAT3               PositionOffset;
+
     std::vector<Subset>             IndexSubsets;
     DataStream                      Indices;
     uint32_t                        IndexSize;
@@ -78,6 +103,8 @@ struct ProcessOptions
     float           UnitScale;
     bool            Force32BitIndices;
     bool            Flip;
+    bool            QuantizeAttributes;
+    uint32_t        LODCount;
     ELogVerbosity   LogLevel;
 
     ProcessOptions(void)
@@ -87,6 +114,8 @@ struct ProcessOptions
         , ExportAttributes{}
         , Force32BitIndices(false)
         , Flip(false)
+        , QuantizeAttributes(false)
+        , LODCount(0)
         , LogLevel(Basic)
     { }
 };
@@ -96,11 +125,24 @@ class MeshProcessor
 public:
     MeshProcessor();
 
-    bool Process(const ProcessOptions& options, const WaveFrontReader<uint32_t>& reader, ExportMesh& output);
+    // Appends the processed mesh to the output, followed by options.LODCount simplified levels of detail.
+    bool Process(const ProcessOptions& options, const WaveFrontReader<uint32_t>& reader, std::vector<ExportMesh>& output);
 
 private:
+    // Uncompacted copy of the extracted mesh from which the level of detail chain is simplified.
+    struct SourceMesh
+    {
+        uint32_t                        Type;
+        std::vector<DirectX::XMFLOAT3>  Positions;
+        std::vector<DirectX::XMFLOAT3>  Normals;
+        std::vector<DirectX::XMFLOAT2>  UVs;
+        std::vector<uint32_t>           Indices;
+        std::vector<uint32_t>           Attributes;
+    };
+
     void Reset();
     bool Extract(const ProcessOptions& options, const WaveFrontReader<uint32_t>& reader);
+    bool Simplify(const ProcessOptions& options, SourceMesh& source);
     void Export(const ProcessOptions& options, ExportMesh& output);
 
     template <typename T> 
@@ -116,6 +158,8 @@ private:
     uint32_t                                m_indexCount;
 
     std::vector<DirectX::XMFLOAT3>          m_positions;
+    DirectX::XMFLOAT3                       m_positionScale;  // Decode parameters of UNorm16 quantized positions
+    DirectX::XMFLOAT3                       m_positionOffset;
     std::vector<DirectX::XMFLOAT3>          m_normals;
     std::vector<DirectX::XMFLOAT2>          m_uvs;
     std::vector<DirectX::XMFLOAT3>          m_tangents;
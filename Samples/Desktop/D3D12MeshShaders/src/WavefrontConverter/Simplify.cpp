@@ -0,0 +1,566 @@
+//*********************************************************************************
+//
+// This file is based on or incorporates material from the projects listed below 
+// (Third Party OSS). The original copyright notice and the license under which 
+// Microsoft received such Third Party OSS, are set forth below. Such licenses 
+// and notices are provided for informational purposes only. Microsoft licenses 
+// the Third Party OSS to you under the licensing terms for the Microsoft product 
+// or service. Microsoft reserves all other rights not expressly granted under 
+// this agreement, whether by implication, estoppel or otherwise.
+//
+// meshoptimizer - https://github.com/zeux/meshoptimizer
+//
+// MIT License
+// Copyright (c) 2016-2020 Arseny Kapoulkine
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy 
+// of this software and associated documentation files (the "Software"), to deal 
+// in the Software without restriction, including without limitation the rights 
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+// copies of the Software, and to permit persons to whom the Software is furnished 
+// to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all 
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS 
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS 
+// OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, 
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR 
+// IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//*********************************************************************************
+
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+#include "stdafx.h"
+#include "Simplify.h"
+
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+
+//
+// Garland & Heckbert quadric error simplification. The seam & border classification of vertices (VertexKind, the
+// collapse tables & open edge loops) follows meshoptimizer's simplifier - see the notice above.
+//
+
+using namespace DirectX;
+
+namespace
+{
+    const uint32_t Undef = uint32_t(-1);
+
+    // Weight of the quadrics which keep open borders, seams & material boundaries in place, relative to face quadrics.
+    const double c_boundaryWeight = 2.0;
+
+    enum VertexKind : uint8_t
+    {
+        Manifold, // Interior vertex with a single set of attributes
+        Border,   // Vertex on exactly one open border or material boundary loop
+        Seam,     // Vertex shared by exactly two attribute sets along a consistent seam
+        Locked,   // Anything more complex - never moves
+        KindCount
+    };
+
+    // Whether a vertex of the row kind may collapse onto a vertex of the column kind.
+    const bool c_canCollapse[KindCount][KindCount] =
+    {
+        { true,  true,  true,  true  },
+        { false, true,  false, false },
+        { false, false, true,  false },
+        { false, false, false, false },
+    };
+
+    // Whether an edge between vertices of these kinds also appears in the opposite direction - used to visit each such
+    // edge only once.
+    const bool c_hasOpposite[KindCount][KindCount] =
+    {
+        { true,  true,  true,  true  },
+        { true,  false, true,  false },
+        { true,  true,  true,  true  },
+        { true,  false, true,  false },
+    };
+
+    // Symmetric 4x4 quadric stored as its 10 unique coefficients.
+    struct Quadric
+    {
+        double a00, a11, a22;
+        double a10, a20, a21;
+        double b0, b1, b2;
+        double c;
+
+        void AddPlane(double nx, double ny, double nz, double d, double w)
+        {
+            a00 += w * nx * nx;
+            a11 += w * ny * ny;
+            a22 += w * nz * nz;
+            a10 += w * ny * nx;
+            a20 += w * nz * nx;
+            a21 += w * nz * ny;
+            b0 += w * nx * d;
+            b1 += w * ny * d;
+            b2 += w * nz * d;
+            c += w * d * d;
+        }
+
+        void Add(const Quadric& q)
+        {
+            a00 += q.a00; a11 += q.a11; a22 += q.a22;
+            a10 += q.a10; a20 += q.a20; a21 += q.a21;
+            b0 += q.b0; b1 += q.b1; b2 += q.b2;
+            c += q.c;
+        }
+
+        double Error(const XMFLOAT3& p) const
+        {
+            double x = p.x, y = p.y, z = p.z;
+
+            double r = a00 * x * x + a11 * y * y + a22 * z * z
+                + 2.0 * (a10 * x * y + a20 * x * z + a21 * y * z)
+                + 2.0 * (b0 * x + b1 * y + b2 * z)
+                + c;
+
+            return std::fabs(r);
+        }
+    };
+
+    struct Collapse
+    {
+        uint32_t From;
+        uint32_t To;
+        double   Error;
+    };
+
+    inline uint64_t EdgeKey(uint32_t a, uint32_t b)
+    {
+        return (uint64_t(a) << 32) | b;
+    }
+
+    inline XMVECTOR TriangleNormal(const XMFLOAT3& p0, const XMFLOAT3& p1, const XMFLOAT3& p2)
+    {
+        XMVECTOR v0 = XMLoadFloat3(&p0);
+        return XMVector3Cross(XMLoadFloat3(&p1) - v0, XMLoadFloat3(&p2) - v0);
+    }
+
+    // Builds remap (lowest vertex index at each unique position) & wedge (circular list of vertices sharing a position).
+    void BuildPositionRemap(const XMFLOAT3* positions, uint32_t vertexCount, std::vector<uint32_t>& remap, std::vector<uint32_t>& wedge)
+    {
+        std::vector<uint32_t> order(vertexCount);
+        for (uint32_t i = 0; i < vertexCount; ++i)
+        {
+            order[i] = i;
+        }
+
+        std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b)
+        {
+            int cmp = std::memcmp(&positions[a], &positions[b], sizeof(XMFLOAT3));
+            return cmp != 0 ? cmp < 0 : a < b;
+        });
+
+        remap.resize(vertexCount);
+        wedge.resize(vertexCount);
+
+        for (uint32_t i = 0; i < vertexCount; )
+        {
+            uint32_t first = i;
+            for (; i < vertexCount && std::memcmp(&positions[order[i]], &positions[order[first]], sizeof(XMFLOAT3)) == 0; ++i)
+            {
+                remap[order[i]] = order[first];
+                wedge[order[i]] = order[i + 1 < vertexCount && std::memcmp(&positions[order[i + 1]], &positions[order[first]], sizeof(XMFLOAT3)) == 0 ? i + 1 : first];
+            }
+        }
+    }
+
+    // Finds the open edges of each vertex. An edge is open when the adjacent face across it doesn't reference the same
+    // vertices, or belongs to another material. openOut[v]/openIn[v] hold the single open edge leaving/entering v,
+    // Undef if there is none, or v itself if there are several.
+    void BuildOpenEdges(const std::vector<uint32_t>& indices, const std::vector<uint32_t>& attributes, uint32_t vertexCount, std::vector<uint32_t>& openOut, std::vector<uint32_t>& openIn)
+    {
+        const uint32_t NonManifold = Undef;
+
+        std::unordered_map<uint64_t, uint32_t> edges;
+        edges.reserve(indices.size());
+
+        for (uint32_t i = 0; i < indices.size(); ++i)
+        {
+            uint32_t face = i / 3;
+            uint32_t next = face * 3 + (i + 1) % 3;
+
+            auto result = edges.insert(std::make_pair(EdgeKey(indices[i], indices[next]), attributes[face]));
+            if (!result.second)
+            {
+                result.first->second = NonManifold;
+            }
+        }
+
+        openOut.assign(vertexCount, Undef);
+        openIn.assign(vertexCount, Undef);
+
+        for (uint32_t i = 0; i < indices.size(); ++i)
+        {
+            uint32_t face = i / 3;
+            uint32_t a = indices[i];
+            uint32_t b = indices[face * 3 + (i + 1) % 3];
+
+            auto self = edges.find(EdgeKey(a, b));
+            auto opposite = edges.find(EdgeKey(b, a));
+
+            bool open = self->second == NonManifold
+                || opposite == edges.end()
+                || opposite->second != attributes[face];
+
+            if (open)
+            {
+                openOut[a] = (openOut[a] == Undef) ? b : a;
+                openIn[b] = (openIn[b] == Undef) ? a : b;
+            }
+        }
+    }
+
+    void ClassifyVertices(uint32_t vertexCount, const std::vector<uint32_t>& remap, const std::vector<uint32_t>& wedge,
+        const std::vector<uint32_t>& openOut, const std::vector<uint32_t>& openIn, std::vector<VertexKind>& kinds)
+    {
+        kinds.resize(vertexCount);
+
+        auto isSingle = [](uint32_t edge, uint32_t v) { return edge != Undef && edge != v; };
+
+        for (uint32_t i = 0; i < vertexCount; ++i)
+        {
+            if (remap[i] != i)
+                continue;
+
+            if (wedge[i] == i)
+            {
+                // Unique position - interior if it has no open edges, border if it is on exactly one open loop.
+                if (openOut[i] == Undef && openIn[i] == Undef)
+                {
+                    kinds[i] = Manifold;
+                }
+                else if (isSingle(openOut[i], i) && isSingle(openIn[i], i))
+                {
+                    kinds[i] = Border;
+                }
+                else
+                {
+                    kinds[i] = Locked;
+                }
+            }
+            else if (wedge[wedge[i]] == i)
+            {
+                // Two vertices at this position - a seam if both follow the same pair of open edges in opposite directions.
+                uint32_t w = wedge[i];
+
+                if (isSingle(openOut[i], i) && isSingle(openIn[i], i) && isSingle(openOut[w], w) && isSingle(openIn[w], w)
+                    && remap[openIn[i]] == remap[openOut[w]]
+                    && remap[openOut[i]] == remap[openIn[w]]
+                    && remap[openIn[i]] != remap[openOut[i]])
+                {
+                    kinds[i] = Seam;
+                }
+                else
+                {
+                    kinds[i] = Locked;
+                }
+            }
+            else
+            {
+                kinds[i] = Locked;
+            }
+        }
+
+        for (uint32_t i = 0; i < vertexCount; ++i)
+        {
+            kinds[i] = kinds[remap[i]];
+        }
+    }
+
+    // Collapsed vertices leave their open edge references dangling - walk them onto the surviving vertex.
+    void RemapOpenEdges(std::vector<uint32_t>& loop, const std::vector<uint32_t>& collapseRemap)
+    {
+        for (uint32_t i = 0; i < loop.size(); ++i)
+        {
+            if (loop[i] != Undef)
+            {
+                uint32_t l = loop[i];
+                uint32_t r = collapseRemap[l];
+
+                // A seam edge collapsed against the direction of the loop folds onto the vertex itself.
+                loop[i] = (i == r) ? loop[l] : r;
+            }
+        }
+    }
+}
+
+uint32_t SimplifyMesh(
+    const XMFLOAT3* positions, uint32_t vertexCount,
+    std::vector<uint32_t>& indices,
+    std::vector<uint32_t>& attributes,
+    uint32_t targetIndexCount)
+{
+    assert(indices.size() % 3 == 0);
+    assert(attributes.size() == indices.size() / 3);
+
+    std::vector<uint32_t> remap, wedge;
+    BuildPositionRemap(positions, vertexCount, remap, wedge);
+
+    std::vector<uint32_t> openOut, openIn;
+    BuildOpenEdges(indices, attributes, vertexCount, openOut, openIn);
+
+    std::vector<VertexKind> kinds;
+    ClassifyVertices(vertexCount, remap, wedge, openOut, openIn, kinds);
+
+    // Accumulate face & boundary quadrics onto the position representatives.
+    std::vector<Quadric> quadrics(vertexCount, Quadric{});
+
+    for (uint32_t i = 0; i < indices.size(); i += 3)
+    {
+        const XMFLOAT3& p0 = positions[indices[i]];
+        const XMFLOAT3& p1 = positions[indices[i + 1]];
+        const XMFLOAT3& p2 = positions[indices[i + 2]];
+
+        XMVECTOR n = TriangleNormal(p0, p1, p2);
+        float area = XMVectorGetX(XMVector3Length(n));
+
+        if (area > 0.0f)
+        {
+            n /= area;
+            double d = -XMVectorGetX(XMVector3Dot(n, XMLoadFloat3(&p0)));
+
+            for (uint32_t j = 0; j < 3; ++j)
+            {
+                quadrics[remap[indices[i + j]]].AddPlane(XMVectorGetX(n), XMVectorGetY(n), XMVectorGetZ(n), d, area);
+            }
+        }
+
+        for (uint32_t j = 0; j < 3; ++j)
+        {
+            uint32_t i0 = indices[i + j];
+            uint32_t i1 = indices[i + (j + 1) % 3];
+            uint32_t i2 = indices[i + (j + 2) % 3];
+
+            if (openOut[i0] != i1 && openOut[i0] != i0)
+                continue;
+
+            // Plane through the open edge, perpendicular to the face.
+            XMVECTOR v0 = XMLoadFloat3(&positions[i0]);
+            XMVECTOR e = XMLoadFloat3(&positions[i1]) - v0;
+            XMVECTOR f = XMLoadFloat3(&positions[i2]) - v0;
+
+            float lengthSq = XMVectorGetX(XMVector3LengthSq(e));
+            if (lengthSq <= 0.0f)
+                continue;
+
+            XMVECTOR perp = f - e * (XMVectorGetX(XMVector3Dot(f, e)) / lengthSq);
+            float perpLength = XMVectorGetX(XMVector3Length(perp));
+            if (perpLength <= 0.0f)
+                continue;
+
+            perp /= perpLength;
+            double d = -XMVectorGetX(XMVector3Dot(perp, v0));
+            double w = std::sqrt(lengthSq) * c_boundaryWeight;
+
+            quadrics[remap[i0]].AddPlane(XMVectorGetX(perp), XMVectorGetY(perp), XMVectorGetZ(perp), d, w);
+            quadrics[remap[i1]].AddPlane(XMVectorGetX(perp), XMVectorGetY(perp), XMVectorGetZ(perp), d, w);
+        }
+    }
+
+    std::vector<Collapse> collapses;
+    std::vector<uint32_t> collapseRemap(vertexCount);
+    std::vector<uint8_t> collapseLocked(vertexCount);
+
+    std::vector<uint32_t> faceOffsets(vertexCount + 1);
+    std::vector<uint32_t> vertexFaces;
+
+    while (indices.size() > targetIndexCount)
+    {
+        const uint32_t faceCount = static_cast<uint32_t>(indices.size() / 3);
+
+        // Gather candidate collapses, evaluating both directions of every eligible edge.
+        collapses.clear();
+
+        for (uint32_t i = 0; i < indices.size(); ++i)
+        {
+            uint32_t i0 = indices[i];
+            uint32_t i1 = indices[(i / 3) * 3 + (i + 1) % 3];
+
+            VertexKind k0 = kinds[i0];
+            VertexKind k1 = kinds[i1];
+
+            if (!c_canCollapse[k0][k1] && !c_canCollapse[k1][k0])
+                continue;
+
+            // Edges between two border or seam vertices must be the open edge itself.
+            if ((k0 == Border || k0 == Seam) && (k1 == Border || k1 == Seam) && openOut[i0] != i1)
+                continue;
+
+            if (c_hasOpposite[k0][k1] && remap[i1] > remap[i0])
+                continue;
+
+            double e01 = c_canCollapse[k0][k1] ? quadrics[remap[i0]].Error(positions[i1]) : DBL_MAX;
+            double e10 = c_canCollapse[k1][k0] ? quadrics[remap[i1]].Error(positions[i0]) : DBL_MAX;
+
+            if (e01 <= e10)
+            {
+                collapses.push_back({ i0, i1, e01 });
+            }
+            else
+            {
+                collapses.push_back({ i1, i0, e10 });
+            }
+        }
+
+        if (collapses.empty())
+            break;
+
+        std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) { return a.Error < b.Error; });
+
+        // Vertex to face adjacency for the triangle flip test.
+        std::fill(faceOffsets.begin(), faceOffsets.end(), 0);
+        for (uint32_t index : indices)
+        {
+            ++faceOffsets[index + 1];
+        }
+        for (uint32_t i = 0; i < vertexCount; ++i)
+        {
+            faceOffsets[i + 1] += faceOffsets[i];
+        }
+
+        vertexFaces.resize(indices.size());
+        {
+            std::vector<uint32_t> cursor(faceOffsets.begin(), faceOffsets.end() - 1);
+            for (uint32_t i = 0; i < indices.size(); ++i)
+            {
+                vertexFaces[cursor[indices[i]]++] = i / 3;
+            }
+        }
+
+        for (uint32_t i = 0; i < vertexCount; ++i)
+        {
+            collapseRemap[i] = i;
+        }
+        std::fill(collapseLocked.begin(), collapseLocked.end(), uint8_t(0));
+
+        // Moving 'from' onto 'to' must not turn any surviving face around.
+        auto hasFlips = [&](uint32_t from, uint32_t to)
+        {
+            for (uint32_t j = faceOffsets[from]; j < faceOffsets[from + 1]; ++j)
+            {
+                uint32_t face = vertexFaces[j];
+
+                uint32_t v[3] =
+                {
+                    collapseRemap[indices[face * 3]],
+                    collapseRemap[indices[face * 3 + 1]],
+                    collapseRemap[indices[face * 3 + 2]],
+                };
+
+                // Faces spanning the collapsed edge disappear.
+                if (remap[v[0]] == remap[to] || remap[v[1]] == remap[to] || remap[v[2]] == remap[to])
+                    continue;
+
+                XMVECTOR before = TriangleNormal(positions[v[0]], positions[v[1]], positions[v[2]]);
+
+                for (uint32_t k = 0; k < 3; ++k)
+                {
+                    v[k] = (v[k] == from) ? to : v[k];
+                }
+
+                XMVECTOR after = TriangleNormal(positions[v[0]], positions[v[1]], positions[v[2]]);
+
+                // Reject faces which flip or rotate by more than ~75 degrees.
+                float dot = XMVectorGetX(XMVector3Dot(before, after));
+                if (dot <= 0.25f * XMVectorGetX(XMVector3Length(before)) * XMVectorGetX(XMVector3Length(after)))
+                    return true;
+            }
+
+            return false;
+        };
+
+        // Greedily apply the cheapest collapses, touching each position at most once per pass.
+        const uint32_t faceGoal = (static_cast<uint32_t>(indices.size()) - targetIndexCount + 2) / 3;
+        uint32_t facesRemoved = 0;
+        uint32_t collapseCount = 0;
+
+        for (const Collapse& c : collapses)
+        {
+            uint32_t r0 = remap[c.From];
+            uint32_t r1 = remap[c.To];
+
+            if (collapseLocked[r0] || collapseLocked[r1])
+                continue;
+
+            if (kinds[c.From] == Seam)
+            {
+                // Both sides of the seam move together - the partner collapses along its own open edge.
+                uint32_t s0 = wedge[c.From];
+                uint32_t s1 = openOut[c.From] == c.To ? openIn[s0] : openOut[s0];
+
+                assert(s0 != c.From && wedge[s0] == c.From);
+                assert(remap[s1] == r1);
+
+                if (hasFlips(c.From, c.To) || hasFlips(s0, s1))
+                    continue;
+
+                collapseRemap[c.From] = c.To;
+                collapseRemap[s0] = s1;
+                facesRemoved += 2;
+            }
+            else
+            {
+                if (hasFlips(c.From, c.To))
+                    continue;
+
+                collapseRemap[c.From] = c.To;
+                facesRemoved += (kinds[c.From] == Border) ? 1 : 2;
+            }
+
+            quadrics[r1].Add(quadrics[r0]);
+
+            collapseLocked[r0] = 1;
+            collapseLocked[r1] = 1;
+            ++collapseCount;
+
+            if (facesRemoved >= faceGoal)
+                break;
+        }
+
+        if (collapseCount == 0)
+            break;
+
+        RemapOpenEdges(openOut, collapseRemap);
+        RemapOpenEdges(openIn, collapseRemap);
+
+        // Rewrite the index buffer, dropping faces which became degenerate.
+        uint32_t writeFace = 0;
+        for (uint32_t face = 0; face < faceCount; ++face)
+        {
+            uint32_t v0 = collapseRemap[indices[face * 3]];
+            uint32_t v1 = collapseRemap[indices[face * 3 + 1]];
+            uint32_t v2 = collapseRemap[indices[face * 3 + 2]];
+
+            if (remap[v0] == remap[v1] || remap[v1] == remap[v2] || remap[v0] == remap[v2])
+                continue;
+
+            indices[writeFace * 3] = v0;
+            indices[writeFace * 3 + 1] = v1;
+            indices[writeFace * 3 + 2] = v2;
+            attributes[writeFace] = attributes[face];
+            ++writeFace;
+        }
+
+        indices.resize(writeFace * 3);
+        attributes.resize(writeFace);
+    }
+
+    return static_cast<uint32_t>(indices.size());
+}
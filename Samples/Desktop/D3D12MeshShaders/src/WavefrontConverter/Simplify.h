@@ -0,0 +1,29 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+#pragma once
+
+#include <DirectXMath.h>
+
+#include <vector>
+
+// Reduces a triangle list with quadric error metric edge collapses until no more than targetIndexCount indices
+// remain, or until no further collapse is possible.
+//
+// Vertices which share a position but differ in other attributes (attribute seams), vertices on open borders and
+// vertices on material boundaries only collapse along those edges, keeping seams & boundaries intact.
+//
+// indices & attributes (one material id per face) are updated in place; the vertex buffer is left untouched and
+// may contain unreferenced vertices afterwards. Returns the final index count.
+uint32_t SimplifyMesh(
+    const DirectX::XMFLOAT3* positions, uint32_t vertexCount,
+    std::vector<uint32_t>& indices,
+    std::vector<uint32_t>& attributes,
+    uint32_t targetIndexCount);